@@ -0,0 +1,169 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#include "common/system/numa/numa_topology.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+namespace common {
+
+namespace {
+
+std::string FormatCpuList(const std::vector<int>& cpus)
+{
+    std::string result;
+    char buffer[32];
+    for (size_t i = 0; i < cpus.size(); )
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        if (j == i)
+            snprintf(buffer, sizeof(buffer), "%d", cpus[i]);
+        else
+            snprintf(buffer, sizeof(buffer), "%d-%d", cpus[i], cpus[j]);
+        if (!result.empty())
+            result += ',';
+        result += buffer;
+        i = j + 1;
+    }
+    return result;
+}
+
+} // namespace
+
+NumaTopology::NumaTopology()
+    : m_node_cpus(1)
+{
+}
+
+NumaTopology::NumaTopology(const std::vector<std::vector<int> >& node_cpus)
+    : m_node_cpus(node_cpus)
+{
+    if (m_node_cpus.empty())
+        m_node_cpus.resize(1);
+}
+
+NumaTopology NumaTopology::Detect(const std::string& node_dir)
+{
+    // the cpus of every node by its number
+    std::map<int, std::vector<int> > nodes;
+    DIR* dir = opendir(node_dir.c_str());
+    if (dir != NULL)
+    {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            int node = 0;
+            char tail = 0;
+            if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1)
+                continue;
+            std::ifstream in((node_dir + "/" + entry->d_name +
+                              "/cpulist").c_str());
+            std::string text;
+            std::vector<int> cpus;
+            if (std::getline(in, text) && ParseCpuList(text, &cpus) &&
+                !cpus.empty())
+                nodes[node].swap(cpus);
+        }
+        closedir(dir);
+    }
+
+    std::vector<std::vector<int> > node_cpus;
+    for (std::map<int, std::vector<int> >::iterator iter = nodes.begin();
+         iter != nodes.end(); ++iter)
+    {
+        node_cpus.push_back(iter->second);
+    }
+    if (node_cpus.empty())
+    {
+        const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        node_cpus.resize(1);
+        for (long cpu = 0; cpu < num_cpus; ++cpu)
+            node_cpus[0].push_back(static_cast<int>(cpu));
+    }
+    return NumaTopology(node_cpus);
+}
+
+bool NumaTopology::ParseCpuList(const std::string& text,
+                                std::vector<int>* cpus)
+{
+    cpus->clear();
+    const char* p = text.c_str();
+    while (*p != '\0' && *p != '\n')
+    {
+        char* end = NULL;
+        const long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            ++p;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+            cpus->push_back(static_cast<int>(cpu));
+        if (*p == ',')
+            ++p;
+        else if (*p != '\0' && *p != '\n')
+            return false;
+    }
+    std::sort(cpus->begin(), cpus->end());
+    cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+    return true;
+}
+
+std::string NumaTopology::ToString() const
+{
+    std::string result;
+    char buffer[32];
+    for (int node = 0; node < NumNodes(); ++node)
+    {
+        snprintf(buffer, sizeof(buffer), "node%d=", node);
+        if (!result.empty())
+            result += ' ';
+        result += buffer;
+        result += FormatCpuList(m_node_cpus[node]);
+    }
+    return result;
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    }
+    // 0 for the calling thread
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace common
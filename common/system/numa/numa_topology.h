@@ -0,0 +1,64 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#ifndef COMMON_SYSTEM_NUMA_NUMA_TOPOLOGY_H
+#define COMMON_SYSTEM_NUMA_NUMA_TOPOLOGY_H
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace common {
+
+/// @brief the NUMA nodes of a machine and their cpus
+/// @details the memory a thread touches first is allocated on the node of
+/// its cpu by default, so a thread pinned to the cpus of a node keeps the
+/// memory it first touches local to it.
+class NumaTopology
+{
+public:
+    /// one node of no cpu in particular, i.e. a uniform layout
+    NumaTopology();
+
+    /// the nodes of the cpus of node_cpus, e.g. for tests
+    explicit NumaTopology(const std::vector<std::vector<int> >& node_cpus);
+
+    /// @brief detects the nodes of node_dir, with the cpus of their cpulist
+    /// @details the nodes of no cpu, e.g. of memory only, are skipped. Falls
+    /// back to one node of all the online cpus if node_dir cannot be read,
+    /// e.g. off Linux.
+    static NumaTopology Detect(
+        const std::string& node_dir = "/sys/devices/system/node");
+
+    /// @brief parses a cpulist of sysfs, e.g. "0-3,8,10-11"
+    /// @return false if text is malformed
+    static bool ParseCpuList(const std::string& text, std::vector<int>* cpus);
+
+    int NumNodes() const { return static_cast<int>(m_node_cpus.size()); }
+
+    /// @return whether there is a single node, whose layout is uniform
+    bool IsUniform() const { return NumNodes() <= 1; }
+
+    /// @return the cpus of node, empty if it is of no cpu in particular
+    const std::vector<int>& NodeCpus(int node) const
+    {
+        return m_node_cpus[node];
+    }
+
+    /// @return the nodes and their cpus, e.g. "node0=0-3,8 node1=4-7"
+    std::string ToString() const;
+
+private:
+    std::vector<std::vector<int> > m_node_cpus;
+};
+
+/// @brief pins the calling thread to cpus
+/// @return false if it cannot, e.g. if cpus is empty, none of them is
+/// allowed, or off Linux, and the thread may run anywhere as before then
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+} // namespace common
+
+#endif // COMMON_SYSTEM_NUMA_NUMA_TOPOLOGY_H
@@ -0,0 +1,110 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#include "common/system/numa/numa_topology.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace common {
+
+namespace {
+
+void WriteFile(const std::string& filename, const std::string& text)
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    ASSERT_TRUE(fp != NULL);
+    fputs(text.c_str(), fp);
+    fclose(fp);
+}
+
+} // namespace
+
+TEST(NumaTopology, ParseCpuList)
+{
+    std::vector<int> cpus;
+    ASSERT_TRUE(NumaTopology::ParseCpuList("0-3,8,10-11\n", &cpus));
+    const int expected[] = {0, 1, 2, 3, 8, 10, 11};
+    EXPECT_EQ(std::vector<int>(expected, expected + 7), cpus);
+
+    ASSERT_TRUE(NumaTopology::ParseCpuList("", &cpus));
+    EXPECT_TRUE(cpus.empty());
+    ASSERT_TRUE(NumaTopology::ParseCpuList("5,4,4", &cpus));
+    EXPECT_EQ(2U, cpus.size());
+
+    EXPECT_FALSE(NumaTopology::ParseCpuList("3-1", &cpus));
+    EXPECT_FALSE(NumaTopology::ParseCpuList("a", &cpus));
+    EXPECT_FALSE(NumaTopology::ParseCpuList("1;2", &cpus));
+}
+
+TEST(NumaTopology, Detect)
+{
+    char dir[] = "/tmp/numa_topology_test.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string node_dir = dir;
+    const char* nodes[] = {"node0", "node1", "node2"};
+    for (size_t i = 0; i < 3; ++i)
+        ASSERT_EQ(0, mkdir((node_dir + "/" + nodes[i]).c_str(), 0755));
+    WriteFile(node_dir + "/node0/cpulist", "0-1,4\n");
+    WriteFile(node_dir + "/node1/cpulist", "2-3,5\n");
+    WriteFile(node_dir + "/node2/cpulist", "\n");  // of memory only
+    WriteFile(node_dir + "/online", "0-2\n");
+
+    const NumaTopology topology = NumaTopology::Detect(node_dir);
+    ASSERT_EQ(2, topology.NumNodes());
+    EXPECT_FALSE(topology.IsUniform());
+    EXPECT_EQ(3U, topology.NodeCpus(1).size());
+    EXPECT_EQ("node0=0-1,4 node1=2-3,5", topology.ToString());
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const std::string node = node_dir + "/" + nodes[i];
+        unlink((node + "/cpulist").c_str());
+        rmdir(node.c_str());
+    }
+    unlink((node_dir + "/online").c_str());
+    rmdir(dir);
+
+    // one node of all the cpus, if there is no node.
+    const NumaTopology uniform = NumaTopology::Detect(node_dir);
+    ASSERT_EQ(1, uniform.NumNodes());
+    EXPECT_TRUE(uniform.IsUniform());
+    EXPECT_FALSE(uniform.NodeCpus(0).empty());
+
+    EXPECT_TRUE(NumaTopology().IsUniform());
+    EXPECT_TRUE(NumaTopology(std::vector<std::vector<int> >()).IsUniform());
+}
+
+TEST(NumaTopology, PinCurrentThread)
+{
+    EXPECT_FALSE(PinCurrentThread(std::vector<int>()));
+
+    // pinned to all the cpus of the machine, on a thread of its own.
+    const NumaTopology topology = NumaTopology::Detect();
+    std::vector<int> cpus;
+    for (int node = 0; node < topology.NumNodes(); ++node)
+    {
+        cpus.insert(cpus.end(), topology.NodeCpus(node).begin(),
+                    topology.NodeCpus(node).end());
+    }
+    bool pinned = false;
+    std::thread thread([&cpus, &pinned] { pinned = PinCurrentThread(cpus); });
+    thread.join();
+#if defined(__linux__)
+    EXPECT_TRUE(pinned);
+#else
+    EXPECT_FALSE(pinned);
+#endif
+}
+
+} // namespace common
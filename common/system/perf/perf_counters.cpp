@@ -0,0 +1,199 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#include "common/system/perf/perf_counters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace common {
+
+namespace {
+
+const char* const kEventNames[PERF_NUM_EVENTS] =
+{
+    "cycles", "instructions", "llc_misses", "branch_misses", "task_clock_ms"
+};
+
+#if defined(__linux__)
+
+int OpenCounter(PerfEvent event)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event)
+    {
+    case PERF_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_LLC_MISSES:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PERF_BRANCH_MISSES:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case PERF_TASK_CLOCK:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_TASK_CLOCK;
+        break;
+    default:
+        return -1;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // the calling thread, and the threads it starts later, on any cpu
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif // __linux__
+
+} // namespace
+
+PerfCounts::PerfCounts()
+{
+    memset(values, 0, sizeof(values));
+    memset(available, 0, sizeof(available));
+}
+
+double PerfCounts::Ipc() const
+{
+    if (!available[PERF_CYCLES] || !available[PERF_INSTRUCTIONS] ||
+        values[PERF_CYCLES] == 0)
+        return 0.0;
+    return static_cast<double>(values[PERF_INSTRUCTIONS]) /
+        values[PERF_CYCLES];
+}
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& other)
+{
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        values[i] += other.values[i];
+        available[i] = available[i] || other.available[i];
+    }
+    return *this;
+}
+
+std::string PerfCounts::ToString() const
+{
+    std::string result;
+    char buffer[64];
+    if (Ipc() > 0)
+    {
+        snprintf(buffer, sizeof(buffer), "ipc=%.3f", Ipc());
+        result += buffer;
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        if (!available[i])
+            continue;
+        if (i == PERF_TASK_CLOCK)
+        {
+            snprintf(buffer, sizeof(buffer), "%s=%.3f", kEventNames[i],
+                     values[i] / 1e6);
+        }
+        else
+        {
+            snprintf(buffer, sizeof(buffer), "%s=%llu", kEventNames[i],
+                     static_cast<unsigned long long>(values[i]));
+        }
+        if (!result.empty())
+            result += ' ';
+        result += buffer;
+    }
+    return result.empty() ? "unavailable" : result;
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+#if defined(__linux__)
+        m_fds[i] = OpenCounter(static_cast<PerfEvent>(i));
+#else
+        m_fds[i] = -1;
+#endif
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        if (m_fds[i] >= 0)
+            close(m_fds[i]);
+    }
+#endif
+}
+
+bool PerfCounters::IsAvailable() const
+{
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        if (m_fds[i] >= 0)
+            return true;
+    }
+    return false;
+}
+
+void PerfCounters::Start()
+{
+#if defined(__linux__)
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        if (m_fds[i] < 0)
+            continue;
+        ioctl(m_fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+PerfCounts PerfCounters::Stop()
+{
+    PerfCounts counts;
+#if defined(__linux__)
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        if (m_fds[i] >= 0)
+            ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        // the count, the time enabled and the time running
+        uint64_t data[3];
+        if (m_fds[i] < 0 || read(m_fds[i], data, sizeof(data)) !=
+            static_cast<ssize_t>(sizeof(data)))
+            continue;
+        uint64_t value = data[0];
+        if (data[2] > 0 && data[2] < data[1])  // multiplexed
+            value = static_cast<uint64_t>(
+                static_cast<double>(value) * data[1] / data[2]);
+        counts.values[i] = value;
+        counts.available[i] = true;
+    }
+#endif
+    return counts;
+}
+
+} // namespace common
@@ -0,0 +1,116 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#ifndef COMMON_SYSTEM_PERF_PERF_COUNTERS_H
+#define COMMON_SYSTEM_PERF_PERF_COUNTERS_H
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace common {
+
+/// the events counted by PerfCounters
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,        ///< the cache misses of the last level cache
+    PERF_BRANCH_MISSES,
+    PERF_TASK_CLOCK,        ///< the cpu time in nanoseconds, in software
+    PERF_NUM_EVENTS
+};
+
+/// @brief the counts of the events of a code region
+/// @details an event is not available if it cannot be counted, e.g. the
+/// hardware events in most virtual machines, and its count is 0 then.
+struct PerfCounts
+{
+    PerfCounts();
+
+    bool IsAvailable(PerfEvent event) const { return available[event]; }
+    uint64_t Get(PerfEvent event) const { return values[event]; }
+
+    /// @return instructions per cycle, or 0 if either is not available
+    double Ipc() const;
+
+    /// adds the counts of other, e.g. of another run of the same region
+    PerfCounts& operator+=(const PerfCounts& other);
+
+    /// @return the available counts, e.g.
+    /// "ipc=1.52 cycles=... instructions=... llc_misses=... branch_misses=...
+    /// task_clock_ms=...", or "unavailable"
+    std::string ToString() const;
+
+    uint64_t values[PERF_NUM_EVENTS];
+    bool available[PERF_NUM_EVENTS];
+};
+
+/// @brief counts the hardware events of the calling thread and its workers by
+/// perf_event_open(2), e.g. the instructions and the cache misses of a pass
+/// over the data, to tell why a change speeds it up or slows it down.
+/// @details every event is counted in user space only, so it works with the
+/// default perf_event_paranoid of 2. The events the kernel or the hardware
+/// cannot count are skipped, and if none can, or on other systems than
+/// Linux, Start and Stop do nothing and Stop returns no counts. The counts
+/// are scaled up by the time counted if the kernel multiplexes the counters.
+/// The threads the calling thread starts after the counters are opened are
+/// counted too, once they exit, e.g. the workers joined before Stop.
+class PerfCounters
+{
+public:
+    /// opens the counters of the calling thread, which must Start and Stop
+    PerfCounters();
+    ~PerfCounters();
+
+    /// @return whether any event can be counted
+    bool IsAvailable() const;
+    bool IsAvailable(PerfEvent event) const { return m_fds[event] >= 0; }
+
+    /// resets the counters and starts counting
+    void Start();
+
+    /// stops counting
+    /// @return the counts since Start
+    PerfCounts Stop();
+
+private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int m_fds[PERF_NUM_EVENTS];
+};
+
+/// @brief adds the counts of a scope to counts
+/// @details usage:
+/// {
+///     ScopedPerfCounting counting(&counters, &counts);
+///     ... // the region to count
+/// }
+/// The scopes of the same counters must not nest.
+class ScopedPerfCounting
+{
+public:
+    ScopedPerfCounting(PerfCounters* counters, PerfCounts* counts)
+        : m_counters(counters), m_counts(counts)
+    {
+        m_counters->Start();
+    }
+    ~ScopedPerfCounting()
+    {
+        *m_counts += m_counters->Stop();
+    }
+
+private:
+    ScopedPerfCounting(const ScopedPerfCounting&);
+    ScopedPerfCounting& operator=(const ScopedPerfCounting&);
+
+    PerfCounters* m_counters;
+    PerfCounts* m_counts;
+};
+
+} // namespace common
+
+#endif // COMMON_SYSTEM_PERF_PERF_COUNTERS_H
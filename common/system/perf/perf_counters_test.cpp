@@ -0,0 +1,125 @@
+// Copyright (c) 2013, The Toft Authors.
+// All rights reserved.
+//
+// Author: Lifeng Wang <ofandywang@gmail.com>
+
+#include "common/system/perf/perf_counters.h"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace common {
+
+namespace {
+
+double Busy(int n)
+{
+    volatile double sum = 0.0;
+    for (int i = 0; i < n; ++i)
+        sum += i * 0.5;
+    return sum;
+}
+
+} // namespace
+
+TEST(PerfCounts, Default)
+{
+    PerfCounts counts;
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        EXPECT_FALSE(counts.IsAvailable(static_cast<PerfEvent>(i)));
+        EXPECT_EQ(0U, counts.Get(static_cast<PerfEvent>(i)));
+    }
+    EXPECT_EQ(0.0, counts.Ipc());
+    EXPECT_EQ("unavailable", counts.ToString());
+}
+
+TEST(PerfCounts, Add)
+{
+    PerfCounts counts;
+    PerfCounts other;
+    other.values[PERF_CYCLES] = 100;
+    other.available[PERF_CYCLES] = true;
+    other.values[PERF_INSTRUCTIONS] = 150;
+    other.available[PERF_INSTRUCTIONS] = true;
+    counts += other;
+    counts += other;
+    EXPECT_TRUE(counts.IsAvailable(PERF_CYCLES));
+    EXPECT_FALSE(counts.IsAvailable(PERF_LLC_MISSES));
+    EXPECT_EQ(200U, counts.Get(PERF_CYCLES));
+    EXPECT_EQ(300U, counts.Get(PERF_INSTRUCTIONS));
+    EXPECT_DOUBLE_EQ(1.5, counts.Ipc());
+    EXPECT_EQ("ipc=1.500 cycles=200 instructions=300", counts.ToString());
+
+    counts.values[PERF_TASK_CLOCK] = 2500000;
+    counts.available[PERF_TASK_CLOCK] = true;
+    EXPECT_EQ("ipc=1.500 cycles=200 instructions=300 task_clock_ms=2.500",
+              counts.ToString());
+}
+
+TEST(PerfCounters, Count)
+{
+    PerfCounters counters;
+    PerfCounts counts;
+    {
+        ScopedPerfCounting counting(&counters, &counts);
+        Busy(1000000);
+    }
+    // the events of no counter are never available, so it is a no-op
+    // without perf_event_open.
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        const PerfEvent event = static_cast<PerfEvent>(i);
+        EXPECT_EQ(counters.IsAvailable(event), counts.IsAvailable(event));
+        if (counts.IsAvailable(event) && event != PERF_LLC_MISSES &&
+            event != PERF_BRANCH_MISSES)
+        {
+            EXPECT_GT(counts.Get(event), 0U);
+        }
+    }
+
+    // the scopes add up.
+    const PerfCounts once = counts;
+    {
+        ScopedPerfCounting counting(&counters, &counts);
+        Busy(1000000);
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        const PerfEvent event = static_cast<PerfEvent>(i);
+        EXPECT_GE(counts.Get(event), once.Get(event));
+    }
+    if (!counters.IsAvailable())
+    {
+        EXPECT_EQ("unavailable", counts.ToString());
+    }
+}
+
+TEST(PerfCounters, CountStartedThreads)
+{
+    // the work of a thread started while counting is counted, although the
+    // calling thread only waits for it.
+    PerfCounters counters;
+    PerfCounts alone;
+    {
+        ScopedPerfCounting counting(&counters, &alone);
+        Busy(20000000);
+    }
+    PerfCounts started;
+    {
+        ScopedPerfCounting counting(&counters, &started);
+        std::thread worker(Busy, 20000000);
+        worker.join();
+    }
+    const PerfEvent events[] = {PERF_INSTRUCTIONS, PERF_TASK_CLOCK};
+    for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i)
+    {
+        if (counters.IsAvailable(events[i]))
+        {
+            EXPECT_GT(started.Get(events[i]), alone.Get(events[i]) / 2);
+        }
+    }
+}
+
+} // namespace common
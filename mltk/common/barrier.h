@@ -0,0 +1,55 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A reusable barrier of a fixed number of threads.
+
+#ifndef MLTK_COMMON_BARRIER_H_
+#define MLTK_COMMON_BARRIER_H_
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace mltk {
+namespace common {
+
+// Barrier blocks the threads calling Wait() until all num_threads of them
+// have, and then releases them together. It is reusable right away, e.g. to
+// separate the phases of every step of a loop.
+class Barrier {
+ public:
+  explicit Barrier(int32_t num_threads)
+      : num_threads_(num_threads), num_waiting_(0), generation_(0) {
+    assert(num_threads > 0);
+  }
+  ~Barrier() {}
+
+  void Wait() {
+    if (num_threads_ == 1) { return; }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t generation = generation_;
+    if (++num_waiting_ == num_threads_) {
+      num_waiting_ = 0;
+      ++generation_;
+      cond_.notify_all();
+      return;
+    }
+    cond_.wait(lock, [this, generation] { return generation_ != generation; });
+  }
+
+ private:
+  const int32_t num_threads_;
+
+  std::mutex mutex_;  // guards num_waiting_ and generation_
+  std::condition_variable cond_;
+  int32_t num_waiting_;
+  uint64_t generation_;  // increases by one every time the threads go
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_BARRIER_H_
@@ -0,0 +1,37 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/barrier.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using mltk::common::Barrier;
+
+TEST(Barrier, Wait) {
+  const int32_t kNumThreads = 4;
+  const int32_t kNumSteps = 100;
+  Barrier barrier(kNumThreads);
+  std::atomic<int32_t> num_arrived(0);
+  std::atomic<bool> ok(true);
+
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kNumThreads; ++t) {
+    threads.push_back(std::thread([&] {
+      for (int32_t step = 0; step < kNumSteps; ++step) {
+        ++num_arrived;
+        barrier.Wait();
+        // no thread gets here before all have arrived at this step.
+        if (num_arrived.load() < (step + 1) * kNumThreads) { ok = false; }
+        barrier.Wait();
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) { threads[t].join(); }
+
+  EXPECT_TRUE(ok.load());
+  EXPECT_EQ(kNumThreads * kNumSteps, num_arrived.load());
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// The Count-Min Sketch, a streaming frequency estimator with bounded memory.
+//
+// Pls refer to 'Graham Cormode and S. Muthukrishnan. 2005. An Improved Data
+// Stream Summary: The Count-Min Sketch and its Applications. Journal of
+// Algorithms.'
+
+#ifndef MLTK_COMMON_COUNT_MIN_SKETCH_H_
+#define MLTK_COMMON_COUNT_MIN_SKETCH_H_
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mltk/common/city.h"
+#include "mltk/common/memory_breakdown.h"
+
+namespace mltk {
+namespace common {
+
+// CountMinSketch never underestimates a count. With probability at least
+// 1 - delta, Estimate(key) overestimates the true count by no more than
+// epsilon * N, where N is the total count added so far. It takes
+// ceil(e / epsilon) * ceil(ln(1 / delta)) counters whatever the number of
+// distinct keys is.
+class CountMinSketch {
+ public:
+  CountMinSketch(double epsilon, double delta) : total_count_(0) {
+    assert(epsilon > 0 && delta > 0 && delta < 1);
+    width_ = WidthOf(epsilon);
+    depth_ = DepthOf(delta);
+    table_.resize(width_ * depth_, 0);
+  }
+  ~CountMinSketch() {}
+
+  // Adds one occurrence of key, using the conservative update, which only
+  // raises the counters that are below the new estimate.
+  void Add(uint64_t key) {
+    const uint32_t estimate = Estimate(key);
+    if (estimate == UINT32_MAX) { return; }  // saturated
+    for (size_t row = 0; row < depth_; ++row) {
+      uint32_t& counter = table_[Index(row, key)];
+      if (counter == estimate) { ++counter; }
+    }
+    ++total_count_;
+  }
+
+  uint32_t Estimate(uint64_t key) const {
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < depth_; ++row) {
+      estimate = std::min(estimate, table_[Index(row, key)]);
+    }
+    return estimate;
+  }
+
+  size_t Width() const { return width_; }
+  size_t Depth() const { return depth_; }
+  uint64_t TotalCount() const { return total_count_; }
+
+  // The heap memory of the counters of a sketch of epsilon and delta, e.g.
+  // to estimate it before the sketch is created.
+  static size_t MemoryUsage(double epsilon, double delta) {
+    return MemoryBreakdown::HeapBytes(
+        WidthOf(epsilon) * DepthOf(delta) * sizeof(uint32_t));
+  }
+
+  void Clear() {
+    std::fill(table_.begin(), table_.end(), 0);
+    total_count_ = 0;
+  }
+
+ private:
+  static size_t WidthOf(double epsilon) {
+    return static_cast<size_t>(ceil(M_E / epsilon));
+  }
+  static size_t DepthOf(double delta) {
+    return std::max(static_cast<size_t>(ceil(log(1.0 / delta))),
+                    static_cast<size_t>(1));
+  }
+
+  size_t Index(size_t row, uint64_t key) const {
+    return row * width_ + Hash128to64(uint128(key, row)) % width_;
+  }
+
+  size_t width_;  // counters per row, ceil(e / epsilon)
+  size_t depth_;  // number of rows (hash functions), ceil(ln(1 / delta))
+  std::vector<uint32_t> table_;  // depth_ x width_ counters
+  uint64_t total_count_;
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_COUNT_MIN_SKETCH_H_
@@ -0,0 +1,35 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/count_min_sketch.h"
+
+#include <gtest/gtest.h>
+
+using mltk::common::CountMinSketch;
+
+TEST(CountMinSketch, Size) {
+  CountMinSketch sketch(0.001, 0.01);
+  EXPECT_EQ(2719u, sketch.Width());
+  EXPECT_EQ(5u, sketch.Depth());
+  EXPECT_EQ(0u, sketch.TotalCount());
+}
+
+TEST(CountMinSketch, Estimate) {
+  CountMinSketch sketch(0.001, 0.01);
+  for (uint64_t key = 0; key < 1000; ++key) {
+    for (uint64_t i = 0; i <= key % 7; ++i) { sketch.Add(key); }
+  }
+  EXPECT_EQ(3997u, sketch.TotalCount());
+
+  // never underestimate, and overestimate by no more than epsilon * N
+  // with high probability.
+  for (uint64_t key = 0; key < 1000; ++key) {
+    const uint32_t count = key % 7 + 1;
+    EXPECT_LE(count, sketch.Estimate(key));
+    EXPECT_GE(count + 4, sketch.Estimate(key));
+  }
+
+  sketch.Clear();
+  EXPECT_EQ(0u, sketch.TotalCount());
+  EXPECT_EQ(0u, sketch.Estimate(1));
+}
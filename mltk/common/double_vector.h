@@ -13,24 +13,28 @@
 #include <iostream>
 #include <vector>
 
+#include "mltk/common/scalar.h"
+
 namespace mltk {
 namespace common {
 
+// NOTE: the elements are stored as Scalar, which is double by default, and
+// the dot product is always accumulated in double.
 class DoubleVector {
  public:
   DoubleVector() {}
   explicit DoubleVector(const size_t n) { vec_.resize(n, 0); }
   DoubleVector(const size_t n, const double val) { vec_.resize(n, val); }
-  explicit DoubleVector(const std::vector<double>& vec) : vec_(vec) {}
+  explicit DoubleVector(const std::vector<Scalar>& vec) : vec_(vec) {}
   ~DoubleVector() {}
 
-  const std::vector<double>& STLVector() const { return vec_; }
-  std::vector<double>& STLVector() { return vec_; }
+  const std::vector<Scalar>& STLVector() const { return vec_; }
+  std::vector<Scalar>& STLVector() { return vec_; }
 
   size_t Size() const { return vec_.size(); }
 
-  double& operator[](int32_t i) { return vec_[i]; }
-  const double& operator[](int32_t i) const { return vec_[i]; }
+  Scalar& operator[](int32_t i) { return vec_[i]; }
+  const Scalar& operator[](int32_t i) const { return vec_[i]; }
 
   DoubleVector& operator+=(const DoubleVector& b) {
     assert(b.Size() == vec_.size());
@@ -55,13 +59,13 @@ class DoubleVector {
   }
 
  private:
-  std::vector<double> vec_;
+  std::vector<Scalar> vec_;
 };
 
 inline double DotProduct(const DoubleVector& a, const DoubleVector& b) {
   double sum = 0.0;
   for (size_t i = 0; i < a.Size(); ++i) {
-    sum += a[i] * b[i];
+    sum += static_cast<double>(a[i]) * b[i];
   }
   return sum;
 }
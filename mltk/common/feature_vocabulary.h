@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "mltk/common/feature.h"
+#include "mltk/common/memory_breakdown.h"
 
 namespace mltk {
 namespace common {
@@ -50,6 +51,11 @@ class FeatureVocabulary {
 
   int32_t Size() const { return id2feature_.size(); }
 
+  // the heap memory of the vocabulary.
+  size_t MemoryUsage() const {
+    return MemoryBreakdown::Of(feature2id_) + MemoryBreakdown::Of(id2feature_);
+  }
+
   void Clear() {
     feature2id_.clear();
     id2feature_.clear();
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "common/base/string/algorithm.h"
+#include "mltk/common/memory_breakdown.h"
 
 namespace mltk {
 namespace common {
@@ -39,6 +40,10 @@ class Instance {
     for (size_t i = 1; i < fields.size(); ++i) {
       std::vector<std::string> feature_info;
       ::common::SplitString(fields[i], ":", &feature_info);
+      if (feature_info.size() < 2) {
+        std::cerr << "Text format error. text: " << text << std::endl;
+        return false;
+      }
       const std::string& feature_name = feature_info[0];
       double value = atof(feature_info[1].c_str());
       features_.push_back(std::pair<std::string, double>(feature_name, value));
@@ -55,6 +60,15 @@ class Instance {
     features_.push_back(std::pair<std::string, double>(feature_name, value));
   }
 
+  // the heap memory of the instance.
+  size_t MemoryUsage() const {
+    size_t bytes = MemoryBreakdown::Of(label_) + MemoryBreakdown::Of(features_);
+    for (size_t i = 0; i < features_.size(); ++i) {
+      bytes += MemoryBreakdown::Of(features_[i].first);
+    }
+    return bytes;
+  }
+
   // A const interator over all features in an instance.
   class ConstIterator {
    public:
@@ -0,0 +1,95 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A lock-free histogram of latencies for percentiles, e.g. p50 and p99.
+
+#ifndef MLTK_COMMON_LATENCY_HISTOGRAM_H_
+#define MLTK_COMMON_LATENCY_HISTOGRAM_H_
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace mltk {
+namespace common {
+
+// LatencyHistogram counts latencies in log-linear buckets: every power of two
+// is split into 8 buckets, so a percentile is off by at most 12.5%, with a
+// few hundred counters for any latency up to 2^40 microseconds. Add() may be
+// called from many threads at the same time.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { Clear(); }
+  ~LatencyHistogram() {}
+
+  void Add(uint64_t latency_us) {
+    buckets_[Bucket(latency_us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (latency_us > max &&
+           !max_.compare_exchange_weak(max, latency_us,
+                                       std::memory_order_relaxed)) {}
+  }
+
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+
+  // Returns the latency below which a fraction p of all latencies fall, as
+  // the upper bound of its bucket, e.g. Percentile(0.99) for p99.
+  uint64_t Percentile(double p) const {
+    assert(p >= 0 && p <= 1);
+    uint64_t total = 0;
+    uint64_t counts[kNumBuckets];
+    for (int32_t i = 0; i < kNumBuckets; ++i) {
+      counts[i] = buckets_[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    if (total == 0) { return 0; }
+
+    const uint64_t rank = static_cast<uint64_t>(p * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int32_t i = 0; i < kNumBuckets; ++i) {
+      seen += counts[i];
+      if (seen >= rank) { return UpperBound(i); }
+    }
+    return UpperBound(kNumBuckets - 1);
+  }
+
+  void Clear() {
+    for (int32_t i = 0; i < kNumBuckets; ++i) { buckets_[i].store(0); }
+    count_.store(0);
+    max_.store(0);
+  }
+
+ private:
+  static const int32_t kSubBits = 3;  // 8 buckets per power of two
+  static const int32_t kMaxBits = 40;
+  static const int32_t kNumBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+  static int32_t Bucket(uint64_t v) {
+    if (v < (1u << kSubBits)) { return static_cast<int32_t>(v); }
+    int32_t bits = 63 - __builtin_clzll(v);  // floor(log2(v)) >= kSubBits
+    if (bits >= kMaxBits) { return kNumBuckets - 1; }
+    const int32_t sub = static_cast<int32_t>(v >> (bits - kSubBits))
+                        & ((1 << kSubBits) - 1);
+    return ((bits - kSubBits + 1) << kSubBits) + sub;
+  }
+
+  // the largest latency in bucket i
+  static uint64_t UpperBound(int32_t i) {
+    if (i < (1 << kSubBits)) { return i; }
+    const int32_t bits = (i >> kSubBits) + kSubBits - 1;
+    const uint64_t sub = i & ((1 << kSubBits) - 1);
+    return (((1ull << kSubBits) + sub + 1) << (bits - kSubBits)) - 1;
+  }
+
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> max_;
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_LATENCY_HISTOGRAM_H_
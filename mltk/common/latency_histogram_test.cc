@@ -0,0 +1,35 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/latency_histogram.h"
+
+#include <gtest/gtest.h>
+
+using mltk::common::LatencyHistogram;
+
+TEST(LatencyHistogram, Percentile) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.Count());
+  EXPECT_EQ(0u, histogram.Percentile(0.5));
+
+  for (uint64_t latency = 1; latency <= 1000; ++latency) {
+    histogram.Add(latency);
+  }
+  EXPECT_EQ(1000u, histogram.Count());
+  EXPECT_EQ(1000u, histogram.Max());
+
+  // exact below 8, and within 12.5% above.
+  EXPECT_EQ(1u, histogram.Percentile(0.0));
+  EXPECT_LE(500u, histogram.Percentile(0.5));
+  EXPECT_GE(500u * 9 / 8, histogram.Percentile(0.5));
+  EXPECT_LE(990u, histogram.Percentile(0.99));
+  EXPECT_GE(990u * 9 / 8, histogram.Percentile(0.99));
+  EXPECT_LE(1000u, histogram.Percentile(1.0));
+
+  histogram.Add(1ull << 50);  // out of range, counted in the last bucket
+  EXPECT_EQ(1ull << 50, histogram.Max());
+
+  histogram.Clear();
+  EXPECT_EQ(0u, histogram.Count());
+  EXPECT_EQ(0u, histogram.Percentile(0.99));
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/mem_instance.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mltk/common/city.h"
+
+namespace mltk {
+namespace common {
+
+namespace {
+
+// The fingerprint of a canonicalized instance, seeded by its label; every
+// feature takes two words, the name id and the bits of its value, as the keys
+// of PredictionCache.
+uint64_t Fingerprint(const MemInstance& mem_instance,
+                     std::vector<std::pair<uint64_t, uint64_t> >* buffer) {
+  buffer->clear();
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    const double value = citer.FeatureValue();
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer->push_back(std::make_pair(
+        static_cast<uint64_t>(citer.FeatureNameId()), bits));
+  }
+  return CityHash64WithSeed(reinterpret_cast<const char*>(buffer->data()),
+                            buffer->size() * sizeof(buffer->front()),
+                            static_cast<uint64_t>(mem_instance.label_id()));
+}
+
+}  // namespace
+
+void MemInstance::Canonicalize() {
+  std::sort(cross_items_.begin(), cross_items_.end());
+  if (values_.empty()) {
+    std::sort(feature_name_ids_.begin(), feature_name_ids_.end());
+    return;
+  }
+
+  std::vector<std::pair<int32_t, Scalar> > features(feature_name_ids_.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    features[i] = std::make_pair(feature_name_ids_[i], values_[i]);
+  }
+  std::sort(features.begin(), features.end());
+  for (size_t i = 0; i < features.size(); ++i) {
+    feature_name_ids_[i] = features[i].first;
+    values_[i] = features[i].second;
+  }
+}
+
+size_t CollapseDuplicateInstances(size_t num_instances,
+                                  std::vector<MemInstance>* instances) {
+  assert(instances != NULL && num_instances <= instances->size());
+
+  // the fingerprints of the instances kept, to their positions. An instance
+  // whose fingerprint collides with a different one's is kept as it is.
+  std::unordered_map<uint64_t, size_t> firsts;
+  firsts.reserve(num_instances);
+  std::vector<std::pair<uint64_t, uint64_t> > buffer;
+
+  size_t num_kept = 0;
+  for (size_t i = 0; i < num_instances; ++i) {
+    MemInstance& mem_instance = (*instances)[i];
+    mem_instance.Canonicalize();
+    const uint64_t fingerprint = Fingerprint(mem_instance, &buffer);
+
+    std::unordered_map<uint64_t, size_t>::const_iterator it
+        = firsts.find(fingerprint);
+    if (it != firsts.end() && (*instances)[it->second].SameAs(mem_instance)) {
+      MemInstance& first = (*instances)[it->second];
+      first.set_weight(first.weight() + mem_instance.weight());
+      continue;
+    }
+    if (it == firsts.end()) { firsts[fingerprint] = num_kept; }
+    if (num_kept != i) { (*instances)[num_kept].Swap(&mem_instance); }
+    ++num_kept;
+  }
+
+  if (num_kept < num_instances) {
+    instances->erase(instances->begin() + num_kept,
+                     instances->begin() + num_instances);
+  }
+  return num_kept;
+}
+
+}  // namespace common
+}  // namespace mltk
@@ -7,23 +7,52 @@
 #define MLTK_COMMON_MEM_INSTANCE_H_
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include <utility>
 #include <vector>
 
+#include "mltk/common/memory_breakdown.h"
+#include "mltk/common/scalar.h"
+
 namespace mltk {
 namespace common {
 
 // MemInstance is the inside data format of instance for training/testing,
 // which depends on Instance.
+//
+// The feature name ids and values are kept in two arrays. Most instances have
+// indicator features only, of value 1, whose values are not stored at all:
+// such a binary instance takes 4 bytes per feature, and the kernels check
+// IsBinary() to add the weights of its features without multiplying them.
+//
+// The features of the namespaces crossed by ModelData::UseFeatureCrosses are
+// kept once more as cross items, by the hash of their names, and the iterator
+// generates their pairwise products on the fly after the features, as the
+// feature name ids from kCrossNameIdBase on, so neither the crossed names nor
+// their products are ever stored.
 class MemInstance {
  public:
-  MemInstance() {}
-  explicit MemInstance(int32_t label_id) : label_id_(label_id) {}
+  // The feature name ids of the crossed features, the hashes of the crossed
+  // pairs of kCrossNameIdBits bits, which ModelData folds into its buckets,
+  // up to the largest feature name id of Feature.
+  enum {
+    kCrossNameIdBits = 22,
+    kCrossNameIdBase = 0x1000000 - (1 << kCrossNameIdBits)
+  };
+
+  MemInstance() : weight_(1.0f) {}
+  explicit MemInstance(int32_t label_id)
+      : label_id_(label_id), weight_(1.0f) {}
   ~MemInstance() {}
 
   void Clear() {
     label_id_ = -1;
-    features_.clear();
+    weight_ = 1.0f;
+    feature_name_ids_.clear();
+    values_.clear();
+    cross_items_.clear();
   }
 
   void set_label_id(int32_t label_id) {
@@ -32,39 +61,139 @@ class MemInstance {
   }
   int32_t label_id() const { return label_id_; }
 
+  // The weight of the instance in training, as if it occurred weight times,
+  // 1 by default.
+  void set_weight(float weight) {
+    assert(weight > 0);
+    weight_ = weight;
+  }
+  float weight() const { return weight_; }
+
+  // The values are stored from the first one other than 1 on, which also
+  // stores 1 for the features before it.
   void AddFeature(int32_t feature_name_id, double value) {
     assert(feature_name_id >= 0);
-    features_.push_back(std::pair<int32_t, double>(feature_name_id, value));
+    feature_name_ids_.push_back(feature_name_id);
+    if (!values_.empty()) {
+      values_.push_back(value);
+    } else if (static_cast<Scalar>(value) != 1) {
+      values_.reserve(feature_name_ids_.capacity());
+      values_.assign(feature_name_ids_.size() - 1, 1);
+      values_.push_back(value);
+    }
+  }
+
+  // Reserves the memory of exactly num_features features, of which the values
+  // only once one of them is not 1.
+  void Reserve(size_t num_features) {
+    feature_name_ids_.reserve(num_features);
+  }
+
+  // Adds a feature of namespace ns, 0 to 31, by the hash name_hash of its
+  // name, to be crossed with the other cross items of the namespaces of the
+  // bits of partners, which must be symmetric among the namespaces.
+  void AddCrossItem(int32_t ns, uint32_t name_hash, uint32_t partners,
+                    double value) {
+    assert(ns >= 0 && ns < 32);
+    CrossItem item;
+    item.key = (static_cast<uint64_t>(ns) << 32) | name_hash;
+    item.partners = partners;
+    item.value = value;
+    cross_items_.push_back(item);
+  }
+
+  size_t NumFeatures() const { return feature_name_ids_.size(); }
+  size_t NumCrossItems() const { return cross_items_.size(); }
+
+  // Returns true if every feature, and every crossed pair of them, is of
+  // value 1, so no value is stored.
+  bool IsBinary() const {
+    if (!values_.empty()) { return false; }
+    for (size_t i = 0; i < cross_items_.size(); ++i) {
+      if (cross_items_[i].value != 1) { return false; }
+    }
+    return true;
+  }
+
+  void Swap(MemInstance* other) {
+    std::swap(label_id_, other->label_id_);
+    std::swap(weight_, other->weight_);
+    feature_name_ids_.swap(other->feature_name_ids_);
+    values_.swap(other->values_);
+    cross_items_.swap(other->cross_items_);
+  }
+
+  // Renumbers the feature names as of Vocabulary::Renumber.
+  void RenumberFeatureNames(const std::vector<int32_t>& new_ids) {
+    for (size_t i = 0; i < feature_name_ids_.size(); ++i) {
+      feature_name_ids_[i] = new_ids[feature_name_ids_[i]];
+    }
+  }
+
+  // Sorts the features by id and value, and the cross items by namespace,
+  // hash and value, so equal instances compare equal.
+  void Canonicalize();
+
+  // Returns true if the instances have the same label and features in the
+  // same order, whatever their weights.
+  bool SameAs(const MemInstance& other) const {
+    return label_id_ == other.label_id_
+           && feature_name_ids_ == other.feature_name_ids_
+           && values_ == other.values_
+           && cross_items_ == other.cross_items_;
+  }
+
+  // the heap memory of the instance.
+  size_t MemoryUsage() const {
+    return MemoryBreakdown::Of(feature_name_ids_)
+           + MemoryBreakdown::Of(values_)
+           + MemoryBreakdown::Of(cross_items_);
   }
 
-  // A const interator over all features in an instance.
+  // A const interator over all features in an instance, followed by the
+  // crossed pairs of its cross items.
   class ConstIterator {
    public:
     explicit ConstIterator(const MemInstance& mem_instance)
-      : feature_idx_(0), mem_instance_(mem_instance) {}
+      : feature_idx_(0), cross_a_(0), cross_b_(1),
+        mem_instance_(mem_instance) {
+      SeekCross();
+    }
     ~ConstIterator() {}
 
     // Returns true if we are doing iterater.
-    bool Done() const { return feature_idx_ >= mem_instance_.features_.size(); }
+    bool Done() const {
+      return feature_idx_ >= mem_instance_.feature_name_ids_.size()
+             && cross_a_ >= mem_instance_.cross_items_.size();
+    }
 
     void Next() {
       assert(!Done());
-      ++feature_idx_;
+      if (feature_idx_ < mem_instance_.feature_name_ids_.size()) {
+        ++feature_idx_;
+      } else {
+        ++cross_b_;
+        SeekCross();
+      }
     }
 
     int32_t FeatureNameId() const {
       assert(!Done());
-      return mem_instance_.features_[feature_idx_].first;
-    }
-
-    double FeatureValue() const {
-      assert(!Done());
-      return mem_instance_.features_[feature_idx_].second;
+      if (feature_idx_ < mem_instance_.feature_name_ids_.size()) {
+        return mem_instance_.feature_name_ids_[feature_idx_];
+      }
+      return CrossNameId(mem_instance_.cross_items_[cross_a_],
+                         mem_instance_.cross_items_[cross_b_]);
     }
 
-    const std::pair<int32_t, double>& Feature() const {
+    Scalar FeatureValue() const {
       assert(!Done());
-      return mem_instance_.features_[feature_idx_];
+      if (feature_idx_ < mem_instance_.feature_name_ids_.size()) {
+        return mem_instance_.values_.empty()
+               ? 1 : mem_instance_.values_[feature_idx_];
+      }
+      return mem_instance_.cross_items_[cross_a_].value
+             * mem_instance_.cross_items_[cross_b_].value;
     }
 
     int32_t LabelId() const {
@@ -73,15 +202,69 @@ class MemInstance {
     }
 
    private:
+    // Moves to the first crossed pair from (cross_a_, cross_b_) on.
+    void SeekCross() {
+      const std::vector<CrossItem>& items = mem_instance_.cross_items_;
+      for (; cross_a_ < items.size(); ++cross_a_, cross_b_ = cross_a_ + 1) {
+        const uint32_t partners = items[cross_a_].partners;
+        for (; cross_b_ < items.size(); ++cross_b_) {
+          if (partners & (1u << (items[cross_b_].key >> 32))) { return; }
+        }
+      }
+    }
+
     size_t feature_idx_;
+    size_t cross_a_;  // the crossed pair of cross items
+    size_t cross_b_;
     const MemInstance& mem_instance_;
   };
 
  private:
+  struct CrossItem {
+    uint64_t key;  // the namespace in the high word, the hash in the low one
+    uint32_t partners;  // the bits of the namespaces crossed with
+    Scalar value;
+
+    bool operator==(const CrossItem& other) const {
+      return key == other.key && partners == other.partners
+             && value == other.value;
+    }
+    bool operator<(const CrossItem& other) const {
+      return key < other.key || (key == other.key && value < other.value);
+    }
+  };
+
+  // The feature name id of the pair of a and b, whichever comes first, which
+  // mixes their keys as Hash128to64 of CityHash.
+  static int32_t CrossNameId(const CrossItem& a, const CrossItem& b) {
+    const uint64_t kMul = 0x9ddfea08eb382d69ULL;
+    const uint64_t low = a.key < b.key ? a.key : b.key;
+    const uint64_t high = a.key < b.key ? b.key : a.key;
+    uint64_t h = (low ^ high) * kMul;
+    h ^= (h >> 47);
+    h = (high ^ h) * kMul;
+    h ^= (h >> 47);
+    h *= kMul;
+    return kCrossNameIdBase
+           + static_cast<int32_t>(h >> (64 - kCrossNameIdBits));
+  }
+
   int32_t label_id_;  // class id
-  std::vector<std::pair<int32_t, double> > features_;  // vector of features
+  float weight_;  // in the padding after label_id_
+  std::vector<int32_t> feature_name_ids_;
+  std::vector<Scalar> values_;  // of the features, empty if all of them are 1
+  std::vector<CrossItem> cross_items_;  // of the crossed namespaces
 };
 
+// Collapses the duplicates among the first num_instances of instances, i.e.
+// the ones of the same label and features in any order, into the first of
+// them, whose weight becomes the sum of theirs. The features of those
+// instances are canonicalized, the order of the instances kept, and so are
+// the instances after the first num_instances. Returns the number of the
+// first instances left.
+size_t CollapseDuplicateInstances(size_t num_instances,
+                                  std::vector<MemInstance>* instances);
+
 }  // namespace common
 }  // namespace mltk
 
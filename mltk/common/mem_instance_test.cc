@@ -3,9 +3,12 @@
 
 #include "mltk/common/mem_instance.h"
 
+#include <vector>
+
 #include <gtest/gtest.h>
 
 using mltk::common::MemInstance;
+using mltk::common::Scalar;
 
 TEST(MemInstance, Label) {
   MemInstance mem_instance;
@@ -26,17 +29,148 @@ TEST(MemInstance, Feature) {
 
   MemInstance::ConstIterator citer(mem_instance);
   EXPECT_EQ(1, citer.FeatureNameId());
-  EXPECT_EQ(0.65, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.65), citer.FeatureValue());
   citer.Next();
   EXPECT_EQ(2, citer.FeatureNameId());
-  EXPECT_EQ(0.8, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.8), citer.FeatureValue());
   citer.Next();
   EXPECT_EQ(3, citer.FeatureNameId());
-  EXPECT_EQ(0.45, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.45), citer.FeatureValue());
   citer.Next();
   EXPECT_EQ(4, citer.FeatureNameId());
-  EXPECT_EQ(0.6, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.6), citer.FeatureValue());
   citer.Next();
   ASSERT_TRUE(citer.Done());
 }
 
+
+TEST(MemInstance, CollapseDuplicateInstances) {
+  std::vector<MemInstance> instances(6);
+  instances[0].set_label_id(0);
+  instances[0].AddFeature(1, 0.5);
+  instances[0].AddFeature(2, 1.0);
+  instances[1].set_label_id(1);  // another label
+  instances[1].AddFeature(1, 0.5);
+  instances[1].AddFeature(2, 1.0);
+  instances[2].set_label_id(0);  // the features of 0 in another order
+  instances[2].AddFeature(2, 1.0);
+  instances[2].AddFeature(1, 0.5);
+  instances[2].set_weight(2.5);
+  instances[3].set_label_id(0);  // another value
+  instances[3].AddFeature(1, 0.5);
+  instances[3].AddFeature(2, 0.9);
+  instances[4].set_label_id(1);
+  instances[4].AddFeature(1, 0.5);
+  instances[4].AddFeature(2, 1.0);
+  instances[5].set_label_id(0);  // out of the range, so kept
+  instances[5].AddFeature(1, 0.5);
+  instances[5].AddFeature(2, 1.0);
+
+  EXPECT_EQ(3u, mltk::common::CollapseDuplicateInstances(5, &instances));
+  ASSERT_EQ(4u, instances.size());
+  EXPECT_EQ(0, instances[0].label_id());
+  EXPECT_FLOAT_EQ(3.5, instances[0].weight());
+  EXPECT_EQ(1, instances[1].label_id());
+  EXPECT_FLOAT_EQ(2.0, instances[1].weight());
+  EXPECT_EQ(0, instances[2].label_id());
+  EXPECT_FLOAT_EQ(1.0, instances[2].weight());
+  EXPECT_TRUE(instances[3].SameAs(instances[0]));
+  EXPECT_FLOAT_EQ(1.0, instances[3].weight());
+
+  instances[0].Clear();
+  EXPECT_FLOAT_EQ(1.0, instances[0].weight());
+}
+
+TEST(MemInstance, BinaryFeatures) {
+  MemInstance binary(0);
+  binary.AddFeature(3, 1.0);
+  binary.AddFeature(1, 1.0);
+  EXPECT_TRUE(binary.IsBinary());
+  EXPECT_EQ(2u, binary.NumFeatures());
+
+  // the values are stored from the first one other than 1 on.
+  MemInstance real(0);
+  real.AddFeature(3, 1.0);
+  real.AddFeature(1, 0.5);
+  real.AddFeature(2, 1.0);
+  EXPECT_FALSE(real.IsBinary());
+  EXPECT_LT(binary.MemoryUsage(), real.MemoryUsage());
+
+  MemInstance::ConstIterator citer(real);
+  EXPECT_EQ(3, citer.FeatureNameId());
+  EXPECT_EQ(static_cast<Scalar>(1.0), citer.FeatureValue());
+  citer.Next();
+  EXPECT_EQ(1, citer.FeatureNameId());
+  EXPECT_EQ(static_cast<Scalar>(0.5), citer.FeatureValue());
+  citer.Next();
+  EXPECT_EQ(2, citer.FeatureNameId());
+  EXPECT_EQ(static_cast<Scalar>(1.0), citer.FeatureValue());
+
+  real.Canonicalize();
+  MemInstance::ConstIterator sorted(real);
+  EXPECT_EQ(1, sorted.FeatureNameId());
+  EXPECT_EQ(static_cast<Scalar>(0.5), sorted.FeatureValue());
+
+  MemInstance first_real(0);
+  first_real.AddFeature(1, 0.5);
+  first_real.AddFeature(2, 1.0);
+  first_real.AddFeature(3, 1.0);
+  EXPECT_TRUE(first_real.SameAs(real));
+
+  real.Clear();
+  EXPECT_TRUE(real.IsBinary());
+}
+
+TEST(MemInstance, CrossItems) {
+  // namespace 0 crossed with 1, and 2 with itself.
+  MemInstance mem_instance(0);
+  mem_instance.AddFeature(7, 1.0);
+  mem_instance.AddCrossItem(0, 11, 1u << 1, 1.0);
+  mem_instance.AddCrossItem(1, 12, 1u << 0, 0.5);
+  mem_instance.AddCrossItem(1, 13, 1u << 0, 1.0);
+  mem_instance.AddCrossItem(2, 14, 1u << 2, 1.0);
+  mem_instance.AddCrossItem(2, 15, 1u << 2, 1.0);
+  EXPECT_EQ(5u, mem_instance.NumCrossItems());
+  EXPECT_FALSE(mem_instance.IsBinary());
+
+  // the feature, then the pairs 11 x 12, 11 x 13 and 14 x 15.
+  std::vector<int32_t> feature_name_ids;
+  std::vector<Scalar> values;
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    feature_name_ids.push_back(citer.FeatureNameId());
+    values.push_back(citer.FeatureValue());
+  }
+  ASSERT_EQ(4u, feature_name_ids.size());
+  EXPECT_EQ(7, feature_name_ids[0]);
+  for (size_t i = 1; i < feature_name_ids.size(); ++i) {
+    EXPECT_GE(feature_name_ids[i], MemInstance::kCrossNameIdBase);
+    EXPECT_LE(feature_name_ids[i], 0xffffff);
+  }
+  EXPECT_NE(feature_name_ids[1], feature_name_ids[2]);
+  EXPECT_EQ(static_cast<Scalar>(0.5), values[1]);
+  EXPECT_EQ(static_cast<Scalar>(1.0), values[2]);
+
+  // a pair is the same whichever of its items comes first.
+  MemInstance reversed(0);
+  reversed.AddCrossItem(1, 12, 1u << 0, 0.5);
+  reversed.AddCrossItem(0, 11, 1u << 1, 1.0);
+  MemInstance::ConstIterator citer(reversed);
+  EXPECT_EQ(feature_name_ids[1], citer.FeatureNameId());
+  citer.Next();
+  EXPECT_TRUE(citer.Done());
+
+  // no pair of the items of a namespace not crossed with itself.
+  MemInstance single(0);
+  single.AddCrossItem(0, 11, 1u << 1, 1.0);
+  single.AddCrossItem(0, 16, 1u << 1, 1.0);
+  EXPECT_TRUE(MemInstance::ConstIterator(single).Done());
+  EXPECT_TRUE(single.IsBinary());
+
+  MemInstance canonical(0);
+  canonical.AddCrossItem(0, 16, 1u << 1, 1.0);
+  canonical.AddCrossItem(0, 11, 1u << 1, 1.0);
+  EXPECT_FALSE(canonical.SameAs(single));
+  canonical.Canonicalize();
+  EXPECT_TRUE(canonical.SameAs(single));
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Accounting of the heap memory held by the containers of models and
+// optimizers.
+
+#ifndef MLTK_COMMON_MEMORY_BREAKDOWN_H_
+#define MLTK_COMMON_MEMORY_BREAKDOWN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mltk {
+namespace common {
+
+// MemoryBreakdown is a breakdown of memory into named items, e.g.
+// "lambdas=1.2MB all_features=3.4MB total=4.6MB".
+//
+// The estimators count the capacity of containers rather than their sizes,
+// and the overhead of the allocator, as of glibc malloc on 64-bit: a block
+// takes its size plus an 8 bytes header, rounded up to 16 bytes and 32 bytes
+// at least. A std::map node takes 32 bytes of links besides its value, and a
+// std::string keeps up to 15 characters inline, as in libstdc++.
+class MemoryBreakdown {
+ public:
+  MemoryBreakdown() {}
+  ~MemoryBreakdown() {}
+
+  void Add(const std::string& name, size_t bytes) {
+    items_.push_back(std::make_pair(name, bytes));
+  }
+
+  // Adds the items of breakdown, each prefixed by "prefix.".
+  void Add(const std::string& prefix, const MemoryBreakdown& breakdown) {
+    for (size_t i = 0; i < breakdown.items_.size(); ++i) {
+      Add(prefix + "." + breakdown.items_[i].first, breakdown.items_[i].second);
+    }
+  }
+
+  const std::vector<std::pair<std::string, size_t> >& Items() const {
+    return items_;
+  }
+
+  size_t Total() const {
+    size_t total = 0;
+    for (size_t i = 0; i < items_.size(); ++i) { total += items_[i].second; }
+    return total;
+  }
+
+  std::string ToString() const {
+    std::string str;
+    for (size_t i = 0; i < items_.size(); ++i) {
+      str += items_[i].first + "=" + Format(items_[i].second) + " ";
+    }
+    return str + "total=" + Format(Total());
+  }
+
+  // e.g. "512B", "1.5KB", "2.0MB" or "1.2GB".
+  static std::string Format(size_t bytes) {
+    static const char* kUnits[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = bytes;
+    int32_t unit = 0;
+    while (value >= 1024 && unit < 4) {
+      value /= 1024;
+      ++unit;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), unit == 0 ? "%.0f%s" : "%.1f%s",
+             value, kUnits[unit]);
+    return buf;
+  }
+
+  // the memory taken by a heap block of bytes.
+  static size_t HeapBytes(size_t bytes) {
+    if (bytes == 0) { return 0; }
+    const size_t block = (bytes + 8 + 15) & ~static_cast<size_t>(15);
+    return block < 32 ? 32 : block;
+  }
+
+  static size_t Of(const std::string& str) {
+    return str.capacity() > 15 ? HeapBytes(str.capacity() + 1) : 0;
+  }
+
+  template <typename T>
+  static size_t Of(const std::vector<T>& vec) {
+    return HeapBytes(vec.capacity() * sizeof(T));
+  }
+
+  template <typename K, typename V>
+  static size_t Of(const std::map<K, V>& map) {
+    return map.size() * MapNodeBytes<K, V>();
+  }
+
+  // the memory of a std::map node, excluding the heap memory of its value.
+  template <typename K, typename V>
+  static size_t MapNodeBytes() {
+    return HeapBytes(4 * sizeof(void*) + sizeof(std::pair<const K, V>));
+  }
+
+ private:
+  std::vector<std::pair<std::string, size_t> > items_;
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_MEMORY_BREAKDOWN_H_
@@ -0,0 +1,59 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/memory_breakdown.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mltk/common/instance.h"
+#include "mltk/common/model_data.h"
+
+using mltk::common::Instance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+
+TEST(MemoryBreakdown, HeapBytes) {
+  EXPECT_EQ(0u, MemoryBreakdown::HeapBytes(0));
+  EXPECT_EQ(32u, MemoryBreakdown::HeapBytes(1));
+  EXPECT_EQ(32u, MemoryBreakdown::HeapBytes(24));
+  EXPECT_EQ(48u, MemoryBreakdown::HeapBytes(25));
+  EXPECT_EQ(1040u, MemoryBreakdown::HeapBytes(1024));
+
+  EXPECT_EQ(0u, MemoryBreakdown::Of(std::string("short")));
+  std::vector<double> vec;
+  vec.reserve(128);
+  EXPECT_EQ(1040u, MemoryBreakdown::Of(vec));
+}
+
+TEST(MemoryBreakdown, ToString) {
+  MemoryBreakdown breakdown;
+  breakdown.Add("a", 512);
+  MemoryBreakdown inner;
+  inner.Add("b", 3 * 1024 * 1024 / 2);
+  breakdown.Add("x", inner);
+  EXPECT_EQ(512u + 3 * 1024 * 1024 / 2, breakdown.Total());
+  EXPECT_EQ("a=512B x.b=1.5MB total=1.5MB", breakdown.ToString());
+}
+
+TEST(MemoryBreakdown, ModelData) {
+  std::vector<Instance> instances;
+  Instance instance1("A");
+  instance1.AddFeature("f1", 1.0);
+  instance1.AddFeature("f2", 1.0);
+  instances.push_back(instance1);
+  Instance instance2("B");
+  instance2.AddFeature("f2", 1.0);
+  instance2.AddFeature("f3", 1.0);
+  instances.push_back(instance2);
+
+  ModelData model_data;
+  model_data.InitFromInstances(instances, 0);
+  const MemoryBreakdown breakdown = model_data.MemoryUsage();
+  EXPECT_EQ(5u, breakdown.Items().size());
+  for (size_t i = 0; i < breakdown.Items().size(); ++i) {
+    EXPECT_LT(0u, breakdown.Items()[i].second);
+  }
+}
@@ -6,12 +6,18 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "common/base/string/string_piece.h"
+#include "mltk/common/city.h"
+#include "mltk/common/count_min_sketch.h"
 #include "mltk/common/feature_vocabulary.h"
 #include "mltk/common/feature.h"
 #include "mltk/common/instance.h"
@@ -21,8 +27,181 @@
 namespace mltk {
 namespace common {
 
+namespace {
+
+using ::common::StringPiece;
+
+// Splits text by delim into the non-empty pieces, as ::common::SplitString,
+// but without copying them.
+void SplitPieces(const StringPiece& text,
+                 char delim,
+                 std::vector<StringPiece>* pieces) {
+  pieces->clear();
+  const char* p = text.data();
+  const char* end = p + text.size();
+  while (p != end) {
+    if (*p == delim) {
+      ++p;
+      continue;
+    }
+    const char* start = p;
+    while (++p != end && *p != delim) {}
+    pieces->push_back(StringPiece(start, p - start));
+  }
+}
+
+// Splits the field feature_name:feature_value of the data format, and
+// returns false if either is missing.
+bool SplitFeatureField(const StringPiece& field,
+                       StringPiece* feature_name,
+                       StringPiece* feature_value) {
+  std::vector<StringPiece> pieces;
+  SplitPieces(field, ':', &pieces);
+  if (pieces.size() < 2) { return false; }
+  *feature_name = pieces[0];
+  *feature_value = pieces[1];
+  return true;
+}
+
+// Restricts every list of feature ids of all to the active ones, in restricted,
+// which has as many lists.
+void RestrictFeatureIds(const std::vector<char>& active,
+                        const std::vector<std::vector<int32_t> >& all,
+                        std::vector<std::vector<int32_t> >* restricted) {
+  for (size_t i = 0; i < all.size(); ++i) {
+    const std::vector<int32_t>& feature_ids = all[i];
+    (*restricted)[i].clear();
+    for (size_t k = 0; k < feature_ids.size(); ++k) {
+      if (active[feature_ids[k]]) {
+        (*restricted)[i].push_back(feature_ids[k]);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+bool ModelData::UseFeatureCrosses(const std::string& spec,
+                                  int32_t hash_bits) {
+  std::vector<CrossNamespace> namespaces;
+  std::vector<StringPiece> pairs;
+  SplitPieces(spec, ',', &pairs);
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    std::vector<StringPiece> pair;
+    SplitPieces(pairs[i], ':', &pair);
+    if (pair.size() != 2) { return false; }
+
+    size_t k[2];
+    for (int32_t j = 0; j < 2; ++j) {
+      if (memchr(pair[j].data(), '^', pair[j].size()) != NULL) {
+        return false;
+      }
+      for (k[j] = 0; k[j] < namespaces.size(); ++k[j]) {
+        const std::string& name = namespaces[k[j]].name;
+        if (name.size() == pair[j].size()
+            && memcmp(name.data(), pair[j].data(), name.size()) == 0) {
+          break;
+        }
+      }
+      if (k[j] == namespaces.size()) {
+        if (namespaces.size() == 32) { return false; }
+        CrossNamespace ns;
+        pair[j].copy_to_string(&ns.name);
+        ns.partners = 0;
+        namespaces.push_back(ns);
+      }
+    }
+    namespaces[k[0]].partners |= 1u << k[1];
+    namespaces[k[1]].partners |= 1u << k[0];
+  }
+  if (!namespaces.empty()
+      && (hash_bits < 1 || hash_bits > MemInstance::kCrossNameIdBits)) {
+    return false;
+  }
+
+  cross_namespaces_.swap(namespaces);
+  if (cross_namespaces_.empty()) {
+    cross_spec_.clear();
+    cross_hash_bits_ = 0;
+    std::vector<std::vector<int32_t> >().swap(cross_features_);
+  } else {
+    cross_spec_ = spec;
+    cross_hash_bits_ = hash_bits;
+    cross_features_.assign(1 << hash_bits, std::vector<int32_t>());
+  }
+  return true;
+}
+
+void ModelData::AddCrossItem(const char* feature_name, size_t size,
+                             double value, MemInstance* mem_instance) const {
+  if (cross_namespaces_.empty()) { return; }
+  const char* delim
+      = static_cast<const char*>(memchr(feature_name, '^', size));
+  if (delim == NULL) { return; }
+
+  const size_t ns_size = delim - feature_name;
+  for (size_t k = 0; k < cross_namespaces_.size(); ++k) {
+    const std::string& ns = cross_namespaces_[k].name;
+    if (ns.size() == ns_size && memcmp(ns.data(), feature_name, ns_size) == 0) {
+      mem_instance->AddCrossItem(
+          k, static_cast<uint32_t>(CityHash64(feature_name, size)),
+          cross_namespaces_[k].partners, value);
+      return;
+    }
+  }
+}
+
+void ModelData::InitCrossFeatures(const std::vector<Instance>& instances,
+                                  int32_t feature_cutoff) {
+  // the buckets are few, so they are counted exactly anyway.
+  std::map<uint32_t, int32_t> feature_counter;
+  MemInstance mem_instance;
+  for (size_t n = 0; n < instances.size(); ++n) {
+    const int32_t label_id = label_vocab_->Id(instances[n].label());
+    mem_instance.Clear();
+    for (Instance::ConstIterator citer(instances[n]);
+         !citer.Done(); citer.Next()) {
+      const std::string& feature_name = citer.FeatureName();
+      AddCrossItem(feature_name.data(), feature_name.size(),
+                   citer.FeatureValue(), &mem_instance);
+    }
+    for (MemInstance::ConstIterator citer(mem_instance);
+         !citer.Done(); citer.Next()) {
+      feature_counter[
+          Feature(label_id, FoldNameId(citer.FeatureNameId())).Body()]++;
+    }
+  }
+
+  for (std::map<uint32_t, int32_t>::const_iterator iter
+           = feature_counter.begin();
+       iter != feature_counter.end(); ++iter) {
+    if (iter->second > feature_cutoff) {
+      feature_vocab_.Put(Feature(iter->first & 0xff, iter->first >> 8));
+    }
+  }
+}
+
+void ModelData::CheckNumFeatureNames() const {
+  if (cross_hash_bits_ > 0
+      && featurename_vocab_->Size() > MemInstance::kCrossNameIdBase) {
+    std::cerr << "error: too many feature names to cross the features."
+        << std::endl;
+    exit(1);
+  }
+}
+
+std::string ModelData::SavedFeatureName(int32_t feature_name_id) const {
+  if (!IsCrossNameId(feature_name_id)) {
+    return featurename_vocab_->Str(feature_name_id);
+  }
+  char buf[16];
+  snprintf(buf, sizeof(buf), ":%d", CrossBucket(feature_name_id));
+  return buf;
+}
+
 bool ModelData::Load(const std::string& filename) {
   Clear();
+  UseFeatureCrosses("", 0);
 
   FILE* fp = fopen(filename.c_str(), "r");
   if (!fp) {
@@ -41,8 +220,27 @@ bool ModelData::Load(const std::string& filename) {
     std::string w = line.substr(t2 + 1);
     sscanf(w.c_str(), "%lf", &lambda);
 
-    int32_t label_id = label_vocab_.Put(label_name);
-    int32_t feature_name_id = featurename_vocab_.Put(feature_name);
+    // the crosses of the model, by the line of no label, before the
+    // features of the crossed pairs, named by their buckets.
+    if (label_name.empty()) {
+      if (!UseFeatureCrosses(feature_name, static_cast<int32_t>(lambda))) {
+        std::cerr << "error: invalid feature crosses in " << filename << "!"
+            << std::endl;
+        fclose(fp);
+        return false;
+      }
+      continue;
+    }
+
+    int32_t label_id = label_vocab_->Put(label_name);
+    int32_t feature_name_id = 0;
+    if (cross_hash_bits_ > 0 && !feature_name.empty()
+        && feature_name[0] == ':') {
+      feature_name_id = FoldNameId(MemInstance::kCrossNameIdBase
+                                   + atoi(feature_name.c_str() + 1));
+    } else {
+      feature_name_id = featurename_vocab_->Put(feature_name);
+    }
     feature_vocab_.Put(Feature(label_id, feature_name_id));
     lambdas_.push_back(lambda);
   }
@@ -60,11 +258,30 @@ bool ModelData::Save(const std::string& filename) const {
     return false;
   }
 
-  for (StringMapType::const_iterator iter = featurename_vocab_.begin();
-       iter != featurename_vocab_.end();
+  if (cross_hash_bits_ > 0) {
+    fprintf(fp, "\t%s\t%d\n", cross_spec_.c_str(), cross_hash_bits_);
+  }
+
+  // a model numbered by frequency in the order of the feature ids, which
+  // Load numbers the features by, or else by feature name and label.
+  if (frequency_order_) {
+    for (int32_t id = 0; id < feature_vocab_.Size(); ++id) {
+      if (lambdas_[id] == 0) continue;  // ignore zero-weight features
+      const Feature& feature = feature_vocab_.GetFeature(id);
+      fprintf(fp, "%s\t%s\t%f\n",
+              label_vocab_->Str(feature.LabelId()).c_str(),
+              SavedFeatureName(feature.FeatureNameId()).c_str(),
+              lambdas_[id]);
+    }
+    fclose(fp);
+    return true;
+  }
+
+  for (StringMapType::const_iterator iter = featurename_vocab_->begin();
+       iter != featurename_vocab_->end();
        ++iter) {
-    for (int32_t label_id = 0; label_id < label_vocab_.Size(); ++label_id) {
-      std::string label = label_vocab_.Str(label_id);
+    for (int32_t label_id = 0; label_id < label_vocab_->Size(); ++label_id) {
+      std::string label = label_vocab_->Str(label_id);
       int32_t id = feature_vocab_.FeatureId(Feature(label_id, iter->second));
       if (id < 0) continue;
       if (lambdas_[id] == 0) continue;  // ignore zero-weight features
@@ -73,6 +290,24 @@ bool ModelData::Save(const std::string& filename) const {
               label.c_str(), iter->first.c_str(), lambdas_[id]);
     }
   }
+  if (cross_hash_bits_ > 0) {  // by bucket and label
+    std::vector<std::pair<uint32_t, int32_t> > crosses;
+    for (int32_t id = 0; id < feature_vocab_.Size(); ++id) {
+      const Feature& feature = feature_vocab_.GetFeature(id);
+      if (IsCrossNameId(feature.FeatureNameId()) && lambdas_[id] != 0) {
+        crosses.push_back(std::make_pair(feature.Body(), id));
+      }
+    }
+    std::sort(crosses.begin(), crosses.end());
+    for (size_t k = 0; k < crosses.size(); ++k) {
+      const int32_t id = crosses[k].second;
+      const Feature& feature = feature_vocab_.GetFeature(id);
+      fprintf(fp, "%s\t%s\t%f\n",
+              label_vocab_->Str(feature.LabelId()).c_str(),
+              SavedFeatureName(feature.FeatureNameId()).c_str(),
+              lambdas_[id]);
+    }
+  }
   fclose(fp);
 
   return true;
@@ -82,9 +317,35 @@ void ModelData::InitFromInstances(const std::vector<Instance>& instances,
                                   int32_t feature_cutoff) {
   Clear();
 
+  if (feature_count_error_rate_ > 0) {
+    InitVocabsBySketchCounting(instances, feature_cutoff);
+  } else {
+    InitVocabsByExactCounting(instances, feature_cutoff);
+  }
+  if (cross_hash_bits_ > 0) { InitCrossFeatures(instances, feature_cutoff); }
+
+  if (frequency_order_) {
+    std::vector<double> name_counts(featurename_vocab_->Size(), 0.0);
+    for (size_t n = 0; n < instances.size(); ++n) {
+      for (Instance::ConstIterator citer(instances[n]);
+           !citer.Done(); citer.Next()) {
+        const int32_t feature_name_id
+            = featurename_vocab_->Id(citer.FeatureName());
+        if (feature_name_id >= 0) { name_counts[feature_name_id] += 1; }
+      }
+    }
+    RenumberFeatures(RanksByCount(name_counts), true);
+  }
+
+  InitAllFeatures();
+  InitLambdas();
+}
+
+void ModelData::InitVocabsByExactCounting(
+    const std::vector<Instance>& instances, int32_t feature_cutoff) {
   std::map<uint32_t, int32_t> feature_counter;
   for (size_t n = 0; n < instances.size(); ++n) {
-    int32_t label_id = label_vocab_.Put(instances[n].label());
+    int32_t label_id = label_vocab_->Put(instances[n].label());
     if (label_id > Feature::MAX_LABEL_TYPES) {
       std::cerr << "error: too many types of labels." << std::endl;
       exit(1);
@@ -92,13 +353,13 @@ void ModelData::InitFromInstances(const std::vector<Instance>& instances,
 
     for (Instance::ConstIterator citer(instances[n]);
          !citer.Done(); citer.Next()) {
-      int32_t feature_name_id = featurename_vocab_.Put(citer.FeatureName());
+      int32_t feature_name_id = featurename_vocab_->Put(citer.FeatureName());
       feature_counter[Feature(label_id, feature_name_id).Body()]++;
     }
   }
 
   for (size_t n = 0; n < instances.size(); ++n) {
-    int32_t label_id = label_vocab_.Put(instances[n].label());
+    int32_t label_id = label_vocab_->Put(instances[n].label());
     if (label_id > Feature::MAX_LABEL_TYPES) {
       std::cerr << "error: too many types of labels." << std::endl;
       exit(1);
@@ -106,16 +367,55 @@ void ModelData::InitFromInstances(const std::vector<Instance>& instances,
 
     for (Instance::ConstIterator citer(instances[n]);
          !citer.Done(); citer.Next()) {
-      int32_t feature_name_id = featurename_vocab_.Put(citer.FeatureName());
+      int32_t feature_name_id = featurename_vocab_->Put(citer.FeatureName());
       Feature feature(label_id, feature_name_id);
       if (feature_counter[feature.Body()] > feature_cutoff) {
         feature_vocab_.Put(feature);
       }
     }
   }
+}
 
-  InitAllFeatures();
-  InitLambdas();
+void ModelData::InitVocabsBySketchCounting(
+    const std::vector<Instance>& instances, int32_t feature_cutoff) {
+  // f(x, y) is keyed on the hash of the feature name, seeded by the label id,
+  // so no feature name is interned before it is known to survive the cutoff.
+  CountMinSketch feature_counter(feature_count_error_rate_,
+                                 1.0 - feature_count_confidence_);
+  std::cerr << "count-min sketch: " << feature_counter.Depth() << " x "
+      << feature_counter.Width() << " counters...";
+
+  for (size_t n = 0; n < instances.size(); ++n) {
+    int32_t label_id = label_vocab_->Put(instances[n].label());
+    if (label_id > Feature::MAX_LABEL_TYPES) {
+      std::cerr << "error: too many types of labels." << std::endl;
+      exit(1);
+    }
+
+    for (Instance::ConstIterator citer(instances[n]);
+         !citer.Done(); citer.Next()) {
+      const std::string& feature_name = citer.FeatureName();
+      feature_counter.Add(CityHash64WithSeed(feature_name.data(),
+                                             feature_name.size(),
+                                             label_id));
+    }
+  }
+
+  for (size_t n = 0; n < instances.size(); ++n) {
+    int32_t label_id = label_vocab_->Id(instances[n].label());
+
+    for (Instance::ConstIterator citer(instances[n]);
+         !citer.Done(); citer.Next()) {
+      const std::string& feature_name = citer.FeatureName();
+      const uint32_t count = feature_counter.Estimate(
+          CityHash64WithSeed(feature_name.data(), feature_name.size(),
+                             label_id));
+      if (count > static_cast<uint32_t>(std::max(feature_cutoff, 0))) {
+        int32_t feature_name_id = featurename_vocab_->Put(feature_name);
+        feature_vocab_.Put(Feature(label_id, feature_name_id));
+      }
+    }
+  }
 }
 
 void ModelData::FormatInstance(const Instance& instance,
@@ -123,46 +423,330 @@ void ModelData::FormatInstance(const Instance& instance,
   assert(mem_instance != NULL);
   mem_instance->Clear();
 
-  mem_instance->set_label_id(label_vocab_.Id(instance.label()));
+  // the label of a test instance may be unknown, or a dummy placeholder.
+  const int32_t label_id = label_vocab_->Id(instance.label());
+  if (label_id >= 0) { mem_instance->set_label_id(label_id); }
   for (Instance::ConstIterator citer(instance);
        !citer.Done(); citer.Next()) {
-    int32_t feature_name_id = featurename_vocab_.Id(citer.FeatureName());
-    if (feature_name_id > 0) {
+    int32_t feature_name_id = featurename_vocab_->Id(citer.FeatureName());
+    if (feature_name_id >= 0) {
       mem_instance->AddFeature(feature_name_id, citer.FeatureValue());
     }
+    // the unknown feature names are crossed all the same.
+    const std::string& feature_name = citer.FeatureName();
+    AddCrossItem(feature_name.data(), feature_name.size(),
+                 citer.FeatureValue(), mem_instance);
+  }
+}
+
+void ModelData::PutInstance(const Instance& instance,
+                            MemInstance* mem_instance) {
+  InternInstance(instance, mem_instance);
+  PutFeatures(*mem_instance, 0, NULL);
+}
+
+void ModelData::PutFeatures(const MemInstance& mem_instance,
+                            int32_t feature_cutoff,
+                            std::map<uint32_t, double>* feature_counter) {
+  assert(!restricted_);
+  assert(feature_cutoff <= 0 || feature_counter != NULL);
+
+  const int32_t label_id = mem_instance.label_id();
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    const int32_t feature_name_id = FoldNameId(citer.FeatureNameId());
+    std::vector<int32_t>* feature_ids = NULL;
+    if (IsCrossNameId(feature_name_id)) {
+      feature_ids = &cross_features_[CrossBucket(feature_name_id)];
+    } else {
+      if (feature_name_id >= static_cast<int32_t>(all_features_.size())) {
+        all_features_.resize(feature_name_id + 1);
+      }
+      feature_ids = &all_features_[feature_name_id];
+    }
+
+    Feature feature(label_id, feature_name_id);
+    if (feature_cutoff > 0
+        && ((*feature_counter)[feature.Body()] += mem_instance.weight())
+           <= feature_cutoff) {
+      continue;
+    }
+    if (feature_vocab_.FeatureId(feature) < 0) {
+      feature_ids->push_back(feature_vocab_.Put(feature));
+      lambdas_.push_back(0.0);
+    }
+  }
+}
+
+void ModelData::InternInstance(const Instance& instance,
+                               MemInstance* mem_instance) {
+  assert(mem_instance != NULL);
+  mem_instance->Clear();
+
+  int32_t label_id = label_vocab_->Put(instance.label());
+  if (label_id > Feature::MAX_LABEL_TYPES) {
+    std::cerr << "error: too many types of labels." << std::endl;
+    exit(1);
   }
+  mem_instance->set_label_id(label_id);
+
+  for (Instance::ConstIterator citer(instance);
+       !citer.Done(); citer.Next()) {
+    const std::string& feature_name = citer.FeatureName();
+    int32_t feature_name_id = featurename_vocab_->Put(feature_name);
+    mem_instance->AddFeature(feature_name_id, citer.FeatureValue());
+    AddCrossItem(feature_name.data(), feature_name.size(),
+                 citer.FeatureValue(), mem_instance);
+  }
+  if (cross_hash_bits_ > 0) { CheckNumFeatureNames(); }
+}
+
+bool ModelData::InternText(const std::string& text,
+                           MemInstance* mem_instance) {
+  assert(mem_instance != NULL);
+  mem_instance->Clear();
+
+  // the whole line is checked first, so a malformed one is skipped without
+  // interning anything, as by Instance::ParseFromText.
+  std::vector<StringPiece> fields;
+  SplitPieces(text, '\t', &fields);
+  StringPiece feature_name;
+  StringPiece feature_value;
+  bool valid = fields.size() >= 2;
+  for (size_t i = 1; valid && i < fields.size(); ++i) {
+    valid = SplitFeatureField(fields[i], &feature_name, &feature_value);
+  }
+  if (!valid) {
+    std::cerr << "Text format error. text: " << text << std::endl;
+    return false;
+  }
+
+  // the only copies, which are reused by the fields.
+  std::string str;
+  fields[0].copy_to_string(&str);
+  int32_t label_id = label_vocab_->Put(str);
+  if (label_id > Feature::MAX_LABEL_TYPES) {
+    std::cerr << "error: too many types of labels." << std::endl;
+    exit(1);
+  }
+  mem_instance->set_label_id(label_id);
+
+  mem_instance->Reserve(fields.size() - 1);
+  for (size_t i = 1; i < fields.size(); ++i) {
+    SplitFeatureField(fields[i], &feature_name, &feature_value);
+    feature_name.copy_to_string(&str);
+    const int32_t feature_name_id = featurename_vocab_->Put(str);
+    feature_value.copy_to_string(&str);
+    const double value = atof(str.c_str());
+    mem_instance->AddFeature(feature_name_id, value);
+    AddCrossItem(feature_name.data(), feature_name.size(), value,
+                 mem_instance);
+  }
+  if (cross_hash_bits_ > 0) { CheckNumFeatureNames(); }
+  return true;
+}
+
+void ModelData::InitFromMemInstances(
+    const std::vector<const MemInstance*>& instances,
+    int32_t feature_cutoff) {
+  feature_vocab_.Clear();
+  lambdas_.clear();
+  all_features_.clear();
+
+  // an instance counts by its weight, as if it occurred weight times.
+  std::map<uint32_t, double> feature_counter;
+  for (size_t n = 0; n < instances.size(); ++n) {
+    const int32_t label_id = instances[n]->label_id();
+    const double weight = instances[n]->weight();
+    for (MemInstance::ConstIterator citer(*instances[n]);
+         !citer.Done(); citer.Next()) {
+      feature_counter[
+          Feature(label_id, FoldNameId(citer.FeatureNameId())).Body()]
+          += weight;
+    }
+  }
+
+  for (size_t n = 0; n < instances.size(); ++n) {
+    const int32_t label_id = instances[n]->label_id();
+    for (MemInstance::ConstIterator citer(*instances[n]);
+         !citer.Done(); citer.Next()) {
+      Feature feature(label_id, FoldNameId(citer.FeatureNameId()));
+      if (feature_counter[feature.Body()] > feature_cutoff) {
+        feature_vocab_.Put(feature);
+      }
+    }
+  }
+
+  // the feature names may be shared, and are kept.
+  if (frequency_order_) {
+    std::vector<double> name_counts(featurename_vocab_->Size(), 0.0);
+    for (size_t n = 0; n < instances.size(); ++n) {
+      for (MemInstance::ConstIterator citer(*instances[n]);
+           !citer.Done(); citer.Next()) {
+        if (IsCrossNameId(citer.FeatureNameId())) { continue; }
+        name_counts[citer.FeatureNameId()] += instances[n]->weight();
+      }
+    }
+    RenumberFeatures(RanksByCount(name_counts), false);
+  }
+
+  InitAllFeatures();
+  InitLambdas();
+}
+
+void ModelData::SortFeatureNamesByFrequency(
+    std::vector<MemInstance>* instances) {
+  assert(instances != NULL);
+  assert(featurename_vocab_.use_count() == 1);
+
+  std::vector<double> name_counts(featurename_vocab_->Size(), 0.0);
+  for (size_t n = 0; n < instances->size(); ++n) {
+    const MemInstance& mem_instance = (*instances)[n];
+    for (MemInstance::ConstIterator citer(mem_instance);
+         !citer.Done(); citer.Next()) {
+      if (IsCrossNameId(citer.FeatureNameId())) { continue; }
+      name_counts[citer.FeatureNameId()] += mem_instance.weight();
+    }
+  }
+
+  const std::vector<int32_t> ranks = RanksByCount(name_counts);
+  RenumberFeatures(ranks, true);
+  all_features_.clear();
+  InitAllFeatures();
+  for (size_t n = 0; n < instances->size(); ++n) {
+    (*instances)[n].RenumberFeatureNames(ranks);
+  }
+}
+
+std::vector<int32_t> ModelData::RanksByCount(
+    const std::vector<double>& counts) {
+  std::vector<std::pair<double, int32_t> > order(counts.size());
+  for (size_t i = 0; i < counts.size(); ++i) {
+    order[i] = std::make_pair(-counts[i], static_cast<int32_t>(i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<int32_t> ranks(counts.size());
+  for (size_t k = 0; k < order.size(); ++k) { ranks[order[k].second] = k; }
+  return ranks;
+}
+
+void ModelData::RenumberFeatures(const std::vector<int32_t>& name_ranks,
+                                 bool renumber_names) {
+  assert(!restricted_);
+  assert(static_cast<int32_t>(name_ranks.size()) == NumFeatureNames());
+
+  // (rank of the feature name, label, old feature id), the crossed pairs
+  // after all feature names by bucket.
+  std::vector<std::pair<uint64_t, int32_t> > order(feature_vocab_.Size());
+  for (int32_t id = 0; id < feature_vocab_.Size(); ++id) {
+    const Feature& feature = feature_vocab_.GetFeature(id);
+    const int32_t name_id = feature.FeatureNameId();
+    const int64_t rank = IsCrossNameId(name_id)
+        ? static_cast<int64_t>(name_ranks.size()) + CrossBucket(name_id)
+        : name_ranks[name_id];
+    order[id] = std::make_pair((static_cast<uint64_t>(rank) << 32)
+                               | static_cast<uint64_t>(feature.LabelId()),
+                               id);
+  }
+  std::sort(order.begin(), order.end());
+
+  const FeatureVocabulary features(feature_vocab_);
+  feature_vocab_.Clear();
+  for (size_t k = 0; k < order.size(); ++k) {
+    const Feature& feature = features.GetFeature(order[k].second);
+    feature_vocab_.Put(renumber_names
+                       && !IsCrossNameId(feature.FeatureNameId())
+                       ? Feature(feature.LabelId(),
+                                 name_ranks[feature.FeatureNameId()])
+                       : feature);
+  }
+  if (!lambdas_.empty()) {
+    std::vector<Scalar> lambdas(lambdas_.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+      lambdas[k] = lambdas_[order[k].second];
+    }
+    lambdas_.swap(lambdas);
+  }
+  if (renumber_names) { featurename_vocab_->Renumber(name_ranks); }
+}
+
+void ModelData::RestrictFeatures(const std::vector<char>& active) {
+  if (active.empty()) {
+    if (restricted_) {
+      all_features_.swap(unrestricted_features_);
+      std::vector<std::vector<int32_t> >().swap(unrestricted_features_);
+      cross_features_.swap(unrestricted_cross_features_);
+      std::vector<std::vector<int32_t> >().swap(unrestricted_cross_features_);
+      restricted_ = false;
+    }
+    return;
+  }
+
+  assert(static_cast<int32_t>(active.size()) == NumFeatures());
+  if (!restricted_) {
+    all_features_.swap(unrestricted_features_);
+    all_features_.resize(unrestricted_features_.size());
+    cross_features_.swap(unrestricted_cross_features_);
+    cross_features_.resize(unrestricted_cross_features_.size());
+    restricted_ = true;
+  }
+  // the restricted features keep the order of all, i.e. by label.
+  RestrictFeatureIds(active, unrestricted_features_, &all_features_);
+  RestrictFeatureIds(active, unrestricted_cross_features_, &cross_features_);
 }
 
 int32_t ModelData::CalcConditionalProbability(
     const MemInstance& mem_instance, std::vector<double>* prob_dist) const {
-  std::vector<double> powv(NumClasses(), 0.0);
+  // accumulate w * x in prob_dist itself, so the caller's buffer is the only
+  // memory used.
+  assert(!prob_dist->empty());
+  std::vector<double>& powv = *prob_dist;
+  std::fill(powv.begin(), powv.end(), 0.0);
 
+  const bool binary = mem_instance.IsBinary();
   for (MemInstance::ConstIterator citer(mem_instance);
        !citer.Done(); citer.Next()) {
     const std::vector<int32_t>& feature_ids = FeatureIds(citer.FeatureNameId());
+    if (binary) {  // add-only, as every value is 1
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        const int32_t feature_id = feature_ids[i];
+        powv[FeatureAt(feature_id).LabelId()] += lambdas_[feature_id];
+      }
+      continue;
+    }
+    const double value = citer.FeatureValue();
     for (size_t i = 0; i < feature_ids.size(); ++i) {
       const int32_t feature_id = feature_ids[i];
       powv[FeatureAt(feature_id).LabelId()]
-          += lambdas_[feature_id] * citer.FeatureValue();
+          += static_cast<double>(lambdas_[feature_id]) * value;
     }
   }
 
+  return Normalize(prob_dist);
+}
+
+int32_t ModelData::Normalize(std::vector<double>* prob_dist) {
+  assert(!prob_dist->empty());
+  std::vector<double>& powv = *prob_dist;
+  const int32_t num_classes = powv.size();
+
   std::vector<double>::const_iterator pmax
       = max_element(powv.begin(), powv.end());
   double sum = 0.0;
   double offset = std::max(0.0, *pmax - 700);  // to avoid overflow
-  for (int32_t label_id = 0; label_id < NumClasses(); ++label_id) {
+  for (int32_t label_id = 0; label_id < num_classes; ++label_id) {
     double pow_value = powv[label_id] - offset;
     double prod = exp(pow_value);  // exp(w * x)
     assert(prod != 0);
 
-    (*prob_dist)[label_id] = prod;
+    powv[label_id] = prod;
     sum += prod;
   }
 
   int32_t max_label = 0;
   if (sum > 0.0) {
-    for (int32_t label_id = 0; label_id < NumClasses(); ++label_id) {
+    for (int32_t label_id = 0; label_id < num_classes; ++label_id) {
       (*prob_dist)[label_id] /= sum;
       if ((*prob_dist)[label_id] > (*prob_dist)[max_label]) {
         max_label = label_id;
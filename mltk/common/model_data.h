@@ -11,6 +11,8 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,6 +21,8 @@
 #include "mltk/common/feature.h"
 #include "mltk/common/instance.h"
 #include "mltk/common/mem_instance.h"
+#include "mltk/common/memory_breakdown.h"
+#include "mltk/common/scalar.h"
 #include "mltk/common/vocabulary.h"
 
 namespace mltk {
@@ -26,7 +30,13 @@ namespace common {
 
 class ModelData {
  public:
-  ModelData() {}
+  ModelData() : label_vocab_(new Vocabulary()),
+                featurename_vocab_(new Vocabulary()),
+                restricted_(false),
+                feature_count_error_rate_(0.0),
+                feature_count_confidence_(0.0),
+                frequency_order_(false),
+                cross_hash_bits_(0) {}
   ~ModelData() {}
 
   // Load model data from filename.
@@ -39,30 +49,139 @@ class ModelData {
   void InitFromInstances(const std::vector<Instance>& instances,
                          int32_t feature_cutoff);
 
+  // By default, InitFromInstances counts every feature f(x, y) exactly, which
+  // needs memory proportional to the raw feature space. Approximate counting
+  // uses a count-min sketch of bounded size instead, and only interns the
+  // feature names which survive feature_cutoff. With probability confidence,
+  // a count is overestimated by no more than error_rate * (total number of
+  // feature occurrences), so rare features may survive the cutoff by mistake
+  // but frequent ones are never dropped. error_rate <= 0 means exact counting.
+  void UseApproximateFeatureCounting(double error_rate, double confidence) {
+    assert(error_rate <= 0 || (confidence > 0 && confidence < 1));
+    feature_count_error_rate_ = error_rate;
+    feature_count_confidence_ = confidence;
+  }
+
+  // Vocabulary::Put numbers the feature names, and so the features f(x, y),
+  // in the order they are first met, which scatters the lambdas of the
+  // feature names fired by nearly every instance over the whole model. With
+  // frequency order, InitFromInstances and InitFromMemInstances number the
+  // features in the descending order of the frequency of their feature names
+  // in the instances, counted by weight, the features of a feature name next
+  // to each other by label, so the hottest lambdas, and the expectations of
+  // the optimizers, share a few cache lines and pages. InitFromInstances
+  // numbers the feature names in that order too, as does
+  // SortFeatureNamesByFrequency for the instances interned before. Save
+  // writes the features of such a model in the order of their ids, which
+  // Load numbers them by, so the loaded model keeps the order.
+  void UseFrequencyOrder(bool frequency_order) {
+    frequency_order_ = frequency_order;
+  }
+
+  // The feature name ns^name is of namespace ns. Crosses the features of the
+  // pairs of namespaces in spec, comma-separated a:b, e.g. "u:i,q:q", on the
+  // fly: FormatInstance and the interning functions keep the features of the
+  // crossed namespaces once more by the hashes of their names, which
+  // MemInstance::ConstIterator multiplies pairwise, and the products are
+  // hashed into 2^hash_bits buckets, of a feature f(x, y) per label each. The
+  // crossed names are never made, nor interned, and the features of the
+  // buckets are saved and loaded with the spec. The spec must be set before
+  // the instances are formatted or interned, up to 32 namespaces, and the
+  // feature names are limited to MemInstance::kCrossNameIdBase. An empty spec
+  // crosses nothing. Returns false if spec or hash_bits, 1 to
+  // MemInstance::kCrossNameIdBits, is invalid, keeping the crosses.
+  bool UseFeatureCrosses(const std::string& spec, int32_t hash_bits);
+
+  const std::string& FeatureCrosses() const { return cross_spec_; }
+  int32_t CrossHashBits() const { return cross_hash_bits_; }
+
+  // Renumbers the feature names in the descending order of their frequency
+  // in instances, counted by weight, and the feature names of instances
+  // likewise, as well as the features f(x, y) if any. The vocabularies must
+  // not be shared.
+  void SortFeatureNamesByFrequency(std::vector<MemInstance>* instances);
+
+  // Initialize with the instances which are interned by the vocabularies of
+  // this model already, e.g. by InternInstance, counting the features f(x, y)
+  // they fire. The vocabularies are kept.
+  void InitFromMemInstances(const std::vector<const MemInstance*>& instances,
+                            int32_t feature_cutoff);
+
+  // Shares the label and feature name vocabularies of model_data, e.g. among
+  // the models trained on folds of the same data. The shared vocabularies are
+  // read-only then: neither model may intern new labels or feature names. A
+  // copy of a model shares its vocabularies likewise.
+  void ShareVocabularies(const ModelData& model_data) {
+    label_vocab_ = model_data.label_vocab_;
+    featurename_vocab_ = model_data.featurename_vocab_;
+  }
+
   void Clear() {
-    label_vocab_.Clear();
-    featurename_vocab_.Clear();
+    label_vocab_.reset(new Vocabulary());
+    featurename_vocab_.reset(new Vocabulary());
     feature_vocab_.Clear();
     lambdas_.clear();
     all_features_.clear();
+    unrestricted_features_.clear();
+    cross_features_.assign(cross_features_.size(), std::vector<int32_t>());
+    unrestricted_cross_features_.clear();
+    restricted_ = false;
   }
 
-  int32_t NumClasses() const { return label_vocab_.Size(); }
+  int32_t NumClasses() const { return label_vocab_->Size(); }
   int32_t NumFeatures() const { return feature_vocab_.Size(); }
+  int32_t NumFeatureNames() const { return featurename_vocab_->Size(); }
 
   // Transfer from class Instance to class MemInstance.
   void FormatInstance(const Instance& instance,
                       MemInstance* mem_instances) const;
 
+  // Like FormatInstance, but interns the label and the feature names of
+  // instance first, and adds the features f(x, y) it fires to the model with
+  // zero weights. Online learners use it to grow the model while reading the
+  // data, instead of InitFromInstances.
+  void PutInstance(const Instance& instance, MemInstance* mem_instance);
+
+  // The other half of PutInstance: adds the features f(x, y) fired by
+  // mem_instance, interned by this model already, with zero weights. With
+  // feature_cutoff > 0, a feature is only added once it has occurred more
+  // than feature_cutoff times, counted by weight in feature_counter, so the
+  // model ends up with the features of InitFromMemInstances. The vocabularies
+  // are never read, so another thread may go on interning meanwhile, e.g.
+  // while the model is trained on the instances interned so far; call
+  // SyncFeatureNames once it is done.
+  void PutFeatures(const MemInstance& mem_instance,
+                   int32_t feature_cutoff,
+                   std::map<uint32_t, double>* feature_counter);
+
+  // Gives the feature names which PutFeatures has not met, e.g. of heldout
+  // instances only, an empty list of features, so FeatureIds covers all.
+  void SyncFeatureNames() {
+    all_features_.resize(featurename_vocab_->Size());
+  }
+
+  // Like PutInstance, but only interns the label and the feature names of
+  // instance, without adding any features to the model.
+  void InternInstance(const Instance& instance, MemInstance* mem_instance);
+
+  // Like InternInstance, but parses the instance from text in the data
+  // format, as Instance::ParseFromText, without copying the label and the
+  // feature names unless they are new to the vocabularies. Returns false,
+  // interning nothing, if text is malformed.
+  bool InternText(const std::string& text, MemInstance* mem_instance);
+
   int32_t FeatureNameId(const std::string& feature_name) const {
-    return featurename_vocab_.Id(feature_name);
+    return featurename_vocab_->Id(feature_name);
   }
 
   int32_t LabelId(const std::string& label) const {
-    return label_vocab_.Id(label);
+    return label_vocab_->Id(label);
   }
   const std::string& Label(int32_t label_id) const {
-    return label_vocab_.Str(label_id);
+    return label_vocab_->Str(label_id);
+  }
+  const std::string& FeatureName(int32_t feature_name_id) const {
+    return featurename_vocab_->Str(feature_name_id);
   }
 
   const Feature& FeatureAt(int32_t feature_id) const {
@@ -73,14 +192,24 @@ class ModelData {
   }
 
   const std::vector<int32_t>& FeatureIds(int32_t feature_name_id) const {
-    assert(feature_name_id >= 0 && feature_name_id < featurename_vocab_.Size());
+    if (IsCrossNameId(feature_name_id)) {
+      return cross_features_[CrossBucket(feature_name_id)];
+    }
+    assert(feature_name_id >= 0 &&
+           feature_name_id < static_cast<int32_t>(all_features_.size()));
     return all_features_[feature_name_id];
   }
 
-  const std::vector<double>& Lambdas() const { return lambdas_; }
-  std::vector<double>* MutableLambdas() { return &lambdas_; }
+  // Restricts the features of every feature name, as returned by FeatureIds,
+  // to the ones of nonzero active[feature_id], so p(y|x) and the
+  // expectations skip the others, which must be of zero weight, e.g. the
+  // features screened out by L1 training. An empty active restores all.
+  void RestrictFeatures(const std::vector<char>& active);
+
+  const std::vector<Scalar>& Lambdas() const { return lambdas_; }
+  std::vector<Scalar>* MutableLambdas() { return &lambdas_; }
 
-  void UpdateLambdas(const std::vector<double>& lambdas) {
+  void UpdateLambdas(const std::vector<Scalar>& lambdas) {
     assert(lambdas_.size() == lambdas.size());
 
     for (size_t i = 0; i < lambdas.size(); ++i) {
@@ -90,7 +219,7 @@ class ModelData {
 
   double L1NormLambdas() const {
     double sum = 0.0;
-    for (size_t i = 0; i < lambdas_.size(); ++i) { sum += abs(lambdas_[i]); }
+    for (size_t i = 0; i < lambdas_.size(); ++i) { sum += fabs(lambdas_[i]); }
     return sum;
   }
 
@@ -102,42 +231,183 @@ class ModelData {
     return num_active;
   }
 
+  // The heap memory of the model by its members. The shared vocabularies are
+  // counted in every model sharing them.
+  MemoryBreakdown MemoryUsage() const {
+    MemoryBreakdown breakdown;
+    breakdown.Add("label_vocab", label_vocab_->MemoryUsage());
+    breakdown.Add("featurename_vocab", featurename_vocab_->MemoryUsage());
+    breakdown.Add("feature_vocab", feature_vocab_.MemoryUsage());
+    breakdown.Add("lambdas", MemoryBreakdown::Of(lambdas_));
+
+    size_t all_features_bytes = MemoryBreakdown::Of(all_features_)
+                                + MemoryBreakdown::Of(unrestricted_features_);
+    for (size_t i = 0; i < all_features_.size(); ++i) {
+      all_features_bytes += MemoryBreakdown::Of(all_features_[i]);
+    }
+    for (size_t i = 0; i < unrestricted_features_.size(); ++i) {
+      all_features_bytes += MemoryBreakdown::Of(unrestricted_features_[i]);
+    }
+    all_features_bytes += MemoryBreakdown::Of(cross_features_)
+                          + MemoryBreakdown::Of(unrestricted_cross_features_);
+    for (size_t i = 0; i < cross_features_.size(); ++i) {
+      all_features_bytes += MemoryBreakdown::Of(cross_features_[i]);
+    }
+    for (size_t i = 0; i < unrestricted_cross_features_.size(); ++i) {
+      all_features_bytes
+          += MemoryBreakdown::Of(unrestricted_cross_features_[i]);
+    }
+    breakdown.Add("all_features", all_features_bytes);
+    return breakdown;
+  }
+
+  // Calculates p(y|x) into prob_dist, which must have NumClasses() elements,
+  // and returns the most probable label id. While another thread interns new
+  // labels, e.g. for PutFeatures, it may have fewer, as long as it covers the
+  // labels of the features of mem_instance.
   int32_t CalcConditionalProbability(const MemInstance& mem_instance,
                                      std::vector<double>* prob_dist) const;
 
+  // Turns the scores w * x of the labels in prob_dist into p(y|x), and
+  // returns the most probable label id, as of CalcConditionalProbability.
+  static int32_t Normalize(std::vector<double>* prob_dist);
+
  private:
+  // the namespace of the feature names ns^name crossed by UseFeatureCrosses.
+  struct CrossNamespace {
+    std::string name;
+    uint32_t partners;  // the bits of the namespaces crossed with
+  };
+
+  // Returns true if feature_name_id is of a crossed pair, as of
+  // MemInstance::ConstIterator.
+  bool IsCrossNameId(int32_t feature_name_id) const {
+    return cross_hash_bits_ > 0
+           && feature_name_id >= MemInstance::kCrossNameIdBase;
+  }
+
+  // the bucket of the crossed pair of feature_name_id.
+  int32_t CrossBucket(int32_t feature_name_id) const {
+    return (feature_name_id - MemInstance::kCrossNameIdBase)
+           & ((1 << cross_hash_bits_) - 1);
+  }
+
+  // The feature name id of the features f(x, y) of feature_name_id, i.e. of
+  // its bucket if it is of a crossed pair.
+  int32_t FoldNameId(int32_t feature_name_id) const {
+    return IsCrossNameId(feature_name_id)
+           ? MemInstance::kCrossNameIdBase + CrossBucket(feature_name_id)
+           : feature_name_id;
+  }
+
+  // Adds the feature feature_name of size bytes to mem_instance as a cross
+  // item if its namespace is crossed.
+  void AddCrossItem(const char* feature_name, size_t size, double value,
+                    MemInstance* mem_instance) const;
+
+  // Adds the features of the crossed pairs of instances which occur more
+  // than feature_cutoff times, as InitVocabsByExactCounting.
+  void InitCrossFeatures(const std::vector<Instance>& instances,
+                         int32_t feature_cutoff);
+
+  // Exits if a feature name id is taken by the crossed pairs.
+  void CheckNumFeatureNames() const;
+
+  // The feature name of feature_name_id in the model file, which is
+  // ":<bucket>" for a crossed pair, as no feature name has ':'.
+  std::string SavedFeatureName(int32_t feature_name_id) const;
+
+  // Fills all_features_ and cross_features_ by the features of the model.
   void InitAllFeatures() {
+    CheckNumFeatureNames();
+    unrestricted_features_.clear();
+    unrestricted_cross_features_.clear();
+    restricted_ = false;
     for (int32_t feature_name_id = 0;
-         feature_name_id < featurename_vocab_.Size();
+         feature_name_id < featurename_vocab_->Size();
          ++feature_name_id) {
       all_features_.push_back(std::vector<int32_t>());
       std::vector<int32_t>& vi = all_features_.back();
 
-      for (int32_t label_id = 0; label_id < label_vocab_.Size(); ++label_id) {
+      for (int32_t label_id = 0; label_id < label_vocab_->Size(); ++label_id) {
         int32_t feature_id = feature_vocab_.FeatureId(
             Feature(label_id, feature_name_id));
         if (feature_id >= 0) { vi.push_back(feature_id); }
       }
     }
+    if (cross_hash_bits_ > 0) {
+      // by label within a bucket too.
+      cross_features_.assign(1 << cross_hash_bits_, std::vector<int32_t>());
+      std::vector<std::pair<uint32_t, int32_t> > crosses;
+      for (int32_t id = 0; id < feature_vocab_.Size(); ++id) {
+        const Feature& feature = feature_vocab_.GetFeature(id);
+        if (IsCrossNameId(feature.FeatureNameId())) {
+          crosses.push_back(std::make_pair(feature.Body(), id));
+        }
+      }
+      std::sort(crosses.begin(), crosses.end());
+      for (size_t k = 0; k < crosses.size(); ++k) {
+        const Feature& feature = feature_vocab_.GetFeature(crosses[k].second);
+        cross_features_[CrossBucket(feature.FeatureNameId())].push_back(
+            crosses[k].second);
+      }
+    }
   }
 
+  // The ranks of the ids by the descending counts, the first id of equal
+  // counts first.
+  static std::vector<int32_t> RanksByCount(const std::vector<double>& counts);
+
+  // Renumbers the features in the order of the ranks of their feature names,
+  // and then of their labels, keeping the lambdas. If renumber_names, the
+  // ranks become the ids of the feature names, too.
+  void RenumberFeatures(const std::vector<int32_t>& name_ranks,
+                        bool renumber_names);
+
+  // Initialize vocabularies with exact feature counting.
+  void InitVocabsByExactCounting(const std::vector<Instance>& instances,
+                                 int32_t feature_cutoff);
+
+  // Initialize vocabularies with approximate feature counting.
+  void InitVocabsBySketchCounting(const std::vector<Instance>& instances,
+                                  int32_t feature_cutoff);
+
   void InitLambdas() {
     lambdas_.resize(feature_vocab_.Size());
     for (int32_t i = 0; i < feature_vocab_.Size(); ++i) { lambdas_[i] = 0.0; }
   }
 
-  Vocabulary label_vocab_;  // label mapping, {y : id}
+  // label mapping, {y : id}
+  std::shared_ptr<Vocabulary> label_vocab_;
 
-  Vocabulary featurename_vocab_;  // vocabulary of feature names, {x : id}
+  // vocabulary of feature names, {x : id}
+  std::shared_ptr<Vocabulary> featurename_vocab_;
 
   FeatureVocabulary feature_vocab_;  // vocabulary of features, {f(x, y) : id}
 
-  std::vector<double> lambdas_;  // vector of lambda, weight for feature f(x, y)
+  std::vector<Scalar> lambdas_;  // vector of lambda, weight for feature f(x, y)
                                  // lambdas_.size() == feature_vocab_.size()
 
   // all possible features f(x, y), format:
   // [featurename_id, [feature1.id, feature2.id, ...]]
   std::vector<std::vector<int32_t> > all_features_;
+
+  // all features while they are restricted by RestrictFeatures.
+  std::vector<std::vector<int32_t> > unrestricted_features_;
+  bool restricted_;
+
+  double feature_count_error_rate_;  // > 0 for approximate feature counting
+  double feature_count_confidence_;
+  bool frequency_order_;  // whether to number the features by frequency
+
+  std::string cross_spec_;  // of UseFeatureCrosses, empty for no crosses
+  int32_t cross_hash_bits_;  // 0 for no crosses
+  std::vector<CrossNamespace> cross_namespaces_;  // by the namespace bits
+
+  // the features f(x, y) of every bucket of the crossed pairs, as of
+  // all_features_, and all of them while they are restricted.
+  std::vector<std::vector<int32_t> > cross_features_;
+  std::vector<std::vector<int32_t> > unrestricted_cross_features_;
 };
 
 }  // namespace common
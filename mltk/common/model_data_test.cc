@@ -3,6 +3,7 @@
 
 #include "mltk/common/model_data.h"
 
+#include <map>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -14,6 +15,7 @@ using mltk::common::Feature;
 using mltk::common::Instance;
 using mltk::common::MemInstance;
 using mltk::common::ModelData;
+using mltk::common::Scalar;
 
 TEST(ModelData, SaveAndLoad) {
   ModelData model_data1;
@@ -60,6 +62,291 @@ TEST(ModelData, InitFromInstances) {
   ASSERT_TRUE(model_data.Load("testdata/test_bak.model"));
 }
 
+TEST(ModelData, InitFromInstancesByApproximateCounting) {
+  std::vector<Instance> instances;
+
+  Instance instance1("IT");
+  instance1.AddFeature("Apple", 0.65);
+  instance1.AddFeature("Microsoft", 0.8);
+  instances.push_back(instance1);
+  instances.push_back(instance1);
+
+  Instance instance2("Finance");
+  instance2.AddFeature("Stock", 0.8);
+  instance2.AddFeature("Apple", 0.9);
+  instances.push_back(instance2);
+
+  ModelData model_data;
+  model_data.UseApproximateFeatureCounting(0.001, 0.99);
+  model_data.InitFromInstances(instances, 1);
+  EXPECT_EQ(2, model_data.NumClasses());
+  EXPECT_EQ(2, model_data.NumFeatures());  // (IT, Apple), (IT, Microsoft)
+  EXPECT_EQ(0, model_data.FeatureNameId("Apple"));
+  EXPECT_EQ(1, model_data.FeatureNameId("Microsoft"));
+  EXPECT_EQ(-1, model_data.FeatureNameId("Stock"));  // never interned
+
+  model_data.UseApproximateFeatureCounting(0, 0);
+  model_data.InitFromInstances(instances, 1);
+  EXPECT_EQ(2, model_data.NumFeatures());
+  EXPECT_EQ(2, model_data.FeatureNameId("Stock"));
+}
+
+TEST(ModelData, InitFromMemInstances) {
+  Instance instance1("IT");
+  instance1.AddFeature("Apple", 0.65);
+  instance1.AddFeature("Microsoft", 0.8);
+  Instance instance2("Finance");
+  instance2.AddFeature("Stock", 0.8);
+  instance2.AddFeature("Apple", 0.9);
+
+  ModelData vocabularies;
+  std::vector<MemInstance> mem_instances(3);
+  vocabularies.InternInstance(instance1, &mem_instances[0]);
+  vocabularies.InternInstance(instance1, &mem_instances[1]);
+  vocabularies.InternInstance(instance2, &mem_instances[2]);
+  EXPECT_EQ(2, vocabularies.NumClasses());
+  EXPECT_EQ(0, vocabularies.NumFeatures());
+  EXPECT_EQ(1, mem_instances[2].label_id());
+
+  std::vector<const MemInstance*> instances;
+  for (size_t i = 0; i < mem_instances.size(); ++i) {
+    instances.push_back(&mem_instances[i]);
+  }
+
+  ModelData model_data;
+  model_data.ShareVocabularies(vocabularies);
+  model_data.InitFromMemInstances(instances, 1);
+  EXPECT_EQ(2, model_data.NumClasses());
+  EXPECT_EQ(2, model_data.NumFeatures());  // (IT, Apple), (IT, Microsoft)
+  EXPECT_EQ(2, model_data.FeatureNameId("Stock"));
+  EXPECT_EQ(0u, model_data.FeatureIds(2).size());
+
+  model_data.InitFromMemInstances(instances, 0);
+  EXPECT_EQ(4, model_data.NumFeatures());
+  EXPECT_EQ(0, vocabularies.NumFeatures());
+}
+
+TEST(ModelData, FrequencyOrder) {
+  const char* texts[] = {"IT\tApple:1\tMicrosoft:1",
+                         "Finance\tStock:1\tApple:1",
+                         "IT\tApple:1",
+                         "Sports\tNBA:1\tStock:1"};
+  std::vector<Instance> instances(4);
+  instances[0].set_label("IT");
+  instances[0].AddFeature("Apple", 1);
+  instances[0].AddFeature("Microsoft", 1);
+  instances[1].set_label("Finance");
+  instances[1].AddFeature("Stock", 1);
+  instances[1].AddFeature("Apple", 1);
+  instances[2].set_label("IT");
+  instances[2].AddFeature("Apple", 1);
+  instances[3].set_label("Sports");
+  instances[3].AddFeature("NBA", 1);
+  instances[3].AddFeature("Stock", 1);
+
+  // Apple x 3, Stock x 2, then Microsoft and NBA as first met, and the
+  // features of a feature name by label: IT, Finance and Sports.
+  ModelData model_data;
+  model_data.UseFrequencyOrder(true);
+  model_data.InitFromInstances(instances, 0);
+  const char* feature_names[] = {"Apple", "Stock", "Microsoft", "NBA"};
+  for (int32_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(i, model_data.FeatureNameId(feature_names[i]));
+  }
+  const Feature features[] = {Feature(0, 0), Feature(1, 0), Feature(1, 1),
+                              Feature(2, 1), Feature(0, 2), Feature(2, 3)};
+  ASSERT_EQ(6, model_data.NumFeatures());
+  for (int32_t id = 0; id < 6; ++id) {
+    EXPECT_EQ(id, model_data.FeatureId(features[id]));
+  }
+
+  // Save and Load keep the order.
+  std::vector<Scalar> lambdas(6);
+  for (size_t id = 0; id < lambdas.size(); ++id) { lambdas[id] = id + 1; }
+  model_data.UpdateLambdas(lambdas);
+  ASSERT_TRUE(model_data.Save("testdata/test_bak.model"));
+  ModelData loaded;
+  ASSERT_TRUE(loaded.Load("testdata/test_bak.model"));
+  for (int32_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(i, loaded.FeatureNameId(feature_names[i]));
+  }
+  for (int32_t id = 0; id < 6; ++id) {
+    EXPECT_EQ(id, loaded.FeatureId(features[id]));
+  }
+  EXPECT_EQ(lambdas, loaded.Lambdas());
+
+  // the instances interned before are renumbered with the feature names.
+  ModelData interned;
+  std::vector<MemInstance> mem_instances(4);
+  for (size_t i = 0; i < mem_instances.size(); ++i) {
+    ASSERT_TRUE(interned.InternText(texts[i], &mem_instances[i]));
+  }
+  EXPECT_EQ(2, interned.FeatureNameId("Stock"));
+  interned.SortFeatureNamesByFrequency(&mem_instances);
+  for (int32_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(i, interned.FeatureNameId(feature_names[i]));
+  }
+  MemInstance::ConstIterator citer(mem_instances[3]);
+  EXPECT_EQ(3, citer.FeatureNameId());  // NBA
+  citer.Next();
+  EXPECT_EQ(1, citer.FeatureNameId());  // Stock
+
+  std::vector<const MemInstance*> pointers;
+  for (size_t i = 0; i < mem_instances.size(); ++i) {
+    pointers.push_back(&mem_instances[i]);
+  }
+  interned.UseFrequencyOrder(true);
+  interned.InitFromMemInstances(pointers, 0);
+  for (int32_t id = 0; id < 6; ++id) {
+    EXPECT_EQ(id, interned.FeatureId(features[id]));
+  }
+}
+
+TEST(ModelData, FeatureCrosses) {
+  ModelData model_data;
+  EXPECT_FALSE(model_data.UseFeatureCrosses("u:i:q", 8));
+  EXPECT_FALSE(model_data.UseFeatureCrosses("u:i", 0));
+  EXPECT_FALSE(model_data.UseFeatureCrosses("u^x:i", 8));
+  EXPECT_EQ(0, model_data.CrossHashBits());
+  ASSERT_TRUE(model_data.UseFeatureCrosses("u:i", 8));
+  EXPECT_EQ("u:i", model_data.FeatureCrosses());
+
+  // u^1 x i^1 and u^2 x i^1 of the first instance, u^1 x i^2 of the second.
+  std::vector<Instance> instances(3);
+  instances[0].set_label("click");
+  instances[0].AddFeature("u^1", 1);
+  instances[0].AddFeature("u^2", 1);
+  instances[0].AddFeature("i^1", 1);
+  instances[0].AddFeature("bias", 1);
+  instances[1].set_label("skip");
+  instances[1].AddFeature("u^1", 1);
+  instances[1].AddFeature("i^2", 1);
+  instances[2].set_label("skip");
+  instances[2].AddFeature("q^1", 1);
+  model_data.InitFromInstances(instances, 0);
+  EXPECT_EQ(6, model_data.NumFeatureNames());  // no crossed names
+
+  MemInstance mem_instance;
+  model_data.FormatInstance(instances[0], &mem_instance);
+  EXPECT_EQ(4u, mem_instance.NumFeatures());
+  EXPECT_EQ(3u, mem_instance.NumCrossItems());
+  int32_t num_crosses = 0;
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    if (citer.FeatureNameId() >= MemInstance::kCrossNameIdBase) {
+      EXPECT_EQ(1u, model_data.FeatureIds(citer.FeatureNameId()).size());
+      ++num_crosses;
+    }
+  }
+  EXPECT_EQ(2, num_crosses);
+  EXPECT_EQ(7 + 3, model_data.NumFeatures());
+
+  // the unknown feature names are crossed, too.
+  Instance unknown;
+  unknown.set_label("skip");
+  unknown.AddFeature("u^1", 1);
+  unknown.AddFeature("i^3", 1);
+  model_data.FormatInstance(unknown, &mem_instance);
+  EXPECT_EQ(1u, mem_instance.NumFeatures());
+  EXPECT_EQ(2u, mem_instance.NumCrossItems());
+
+  // Save and Load keep the crosses and the features of their buckets.
+  std::vector<Scalar> lambdas(model_data.NumFeatures());
+  for (size_t id = 0; id < lambdas.size(); ++id) { lambdas[id] = id + 1; }
+  model_data.UpdateLambdas(lambdas);
+  ASSERT_TRUE(model_data.Save("testdata/test_bak.model"));
+  ModelData loaded;
+  ASSERT_TRUE(loaded.Load("testdata/test_bak.model"));
+  EXPECT_EQ("u:i", loaded.FeatureCrosses());
+  EXPECT_EQ(8, loaded.CrossHashBits());
+  EXPECT_EQ(6, loaded.NumFeatureNames());
+  EXPECT_EQ(model_data.NumFeatures(), loaded.NumFeatures());
+  for (size_t i = 0; i < instances.size(); ++i) {
+    MemInstance formatted;
+    loaded.FormatInstance(instances[i], &formatted);
+    std::vector<double> probs(2);
+    std::vector<double> loaded_probs(2);
+    model_data.FormatInstance(instances[i], &mem_instance);
+    model_data.CalcConditionalProbability(mem_instance, &probs);
+    loaded.CalcConditionalProbability(formatted, &loaded_probs);
+    EXPECT_NEAR(probs[0], loaded_probs[0], 1E-6);
+  }
+
+  ASSERT_TRUE(loaded.UseFeatureCrosses("", 0));
+  EXPECT_EQ(0, loaded.CrossHashBits());
+}
+
+TEST(ModelData, PutFeatures) {
+  ModelData model_data;
+  std::vector<MemInstance> mem_instances(4);
+  ASSERT_TRUE(model_data.InternText("IT\tApple:0.65\tMicrosoft:0.8",
+                                    &mem_instances[0]));
+  ASSERT_TRUE(model_data.InternText("Finance\tStock:0.8\tApple:0.9",
+                                    &mem_instances[1]));
+  ASSERT_TRUE(model_data.InternText("IT\tApple:0.5", &mem_instances[2]));
+  ASSERT_TRUE(model_data.InternText("Sports\tNBA:1", &mem_instances[3]));
+
+  // the features of the first three instances occurring more than once.
+  std::map<uint32_t, double> feature_counter;
+  for (size_t i = 0; i < 3; ++i) {
+    model_data.PutFeatures(mem_instances[i], 1, &feature_counter);
+  }
+  EXPECT_EQ(1, model_data.NumFeatures());  // (IT, Apple)
+  EXPECT_EQ(0, model_data.FeatureId(Feature(0, 0)));
+  EXPECT_EQ(0u, model_data.FeatureIds(2).size());  // Stock
+  EXPECT_EQ(1u, model_data.Lambdas().size());
+
+  // NBA is interned but never met.
+  model_data.SyncFeatureNames();
+  EXPECT_EQ(0u, model_data.FeatureIds(model_data.FeatureNameId("NBA")).size());
+
+  // the same features as counted at once.
+  std::vector<const MemInstance*> instances;
+  for (size_t i = 0; i < 3; ++i) { instances.push_back(&mem_instances[i]); }
+  ModelData counted;
+  counted.ShareVocabularies(model_data);
+  counted.InitFromMemInstances(instances, 1);
+  EXPECT_EQ(counted.NumFeatures(), model_data.NumFeatures());
+
+  std::vector<double> prob_dist(model_data.NumClasses());
+  model_data.CalcConditionalProbability(mem_instances[3], &prob_dist);
+  EXPECT_NEAR(1.0 / 3, prob_dist[2], 1E-6);
+}
+
+TEST(ModelData, RestrictFeatures) {
+  Instance instance1("IT");
+  instance1.AddFeature("Apple", 0.65);
+  instance1.AddFeature("Microsoft", 0.8);
+  Instance instance2("Finance");
+  instance2.AddFeature("Stock", 0.8);
+  instance2.AddFeature("Apple", 0.9);
+  std::vector<Instance> instances;
+  instances.push_back(instance1);
+  instances.push_back(instance2);
+
+  ModelData model_data;
+  model_data.InitFromInstances(instances, 0);
+  ASSERT_EQ(4, model_data.NumFeatures());
+  const int32_t apple = model_data.FeatureNameId("Apple");
+  ASSERT_EQ(2u, model_data.FeatureIds(apple).size());
+
+  const int32_t finance_apple
+      = model_data.FeatureId(Feature(model_data.LabelId("Finance"), apple));
+  std::vector<char> active(model_data.NumFeatures(), 0);
+  active[finance_apple] = 1;
+  model_data.RestrictFeatures(active);
+  ASSERT_EQ(1u, model_data.FeatureIds(apple).size());
+  EXPECT_EQ(finance_apple, model_data.FeatureIds(apple)[0]);
+  EXPECT_EQ(0u, model_data.FeatureIds(
+      model_data.FeatureNameId("Microsoft")).size());
+  EXPECT_EQ(4, model_data.NumFeatures());
+
+  model_data.RestrictFeatures(std::vector<char>());
+  EXPECT_EQ(2u, model_data.FeatureIds(apple).size());
+  EXPECT_EQ(1u, model_data.FeatureIds(
+      model_data.FeatureNameId("Microsoft")).size());
+}
+
 class ModelDataTest : public ::testing::Test {
  public:
   void SetUp() {
@@ -86,10 +373,10 @@ TEST_F(ModelDataTest, FormatInstances) {
 
   MemInstance::ConstIterator citer(mem_instance);
   EXPECT_EQ(2, citer.FeatureNameId());
-  EXPECT_EQ(0.5, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.5), citer.FeatureValue());
   citer.Next();
   EXPECT_EQ(13, citer.FeatureNameId());
-  EXPECT_EQ(0.9, citer.FeatureValue());
+  EXPECT_EQ(static_cast<Scalar>(0.9), citer.FeatureValue());
   citer.Next();
   EXPECT_TRUE(citer.Done());
 }
@@ -115,22 +402,22 @@ TEST_F(ModelDataTest, Feature) {
 }
 
 TEST_F(ModelDataTest, Lambdas) {
-  const std::vector<double>& lambdas = model_data_.Lambdas();
+  const std::vector<Scalar>& lambdas = model_data_.Lambdas();
   ASSERT_EQ(167, lambdas.size());
 
-  EXPECT_EQ(0.614847, lambdas[0]);
-  EXPECT_EQ(-0.420031, lambdas[2]);
+  EXPECT_EQ(static_cast<Scalar>(0.614847), lambdas[0]);
+  EXPECT_EQ(static_cast<Scalar>(-0.420031), lambdas[2]);
 
-  std::vector<double>* lambdas_ptr = model_data_.MutableLambdas();
+  std::vector<Scalar>* lambdas_ptr = model_data_.MutableLambdas();
   (*lambdas_ptr)[0] = 0.1;
-  const std::vector<double>& lambdas1 = model_data_.Lambdas();
+  const std::vector<Scalar>& lambdas1 = model_data_.Lambdas();
   ASSERT_EQ(167, lambdas1.size());
-  EXPECT_EQ(0.1, lambdas1[0]);
+  EXPECT_EQ(static_cast<Scalar>(0.1), lambdas1[0]);
 
-  std::vector<double> new_lambdas(lambdas.size(), 0);
+  std::vector<Scalar> new_lambdas(lambdas.size(), 0);
   model_data_.UpdateLambdas(new_lambdas);
 
-  const std::vector<double>& lambdas2 = model_data_.Lambdas();
+  const std::vector<Scalar>& lambdas2 = model_data_.Lambdas();
   ASSERT_EQ(167, lambdas2.size());
 
   for (size_t i = 0; i < lambdas2.size(); ++i) {
@@ -151,7 +438,46 @@ TEST_F(ModelDataTest, CalcConditionalProbability) {
                                                                 &prob_dist);
   EXPECT_EQ(2, prob_dist.size());
   EXPECT_EQ(0, max_label_id);
+#ifdef MLTK_SINGLE_PRECISION
+  EXPECT_NEAR(.94365970390140463, prob_dist[0], 1E-6);
+  EXPECT_NEAR(.05634029609859529, prob_dist[1], 1E-6);
+#else
   EXPECT_EQ(.94365970390140463, prob_dist[0]);
   EXPECT_EQ(.05634029609859529, prob_dist[1]);
+#endif
 }
 
+
+TEST(ModelData, InternText) {
+  ModelData model_data;
+  MemInstance mem_instance;
+  ASSERT_TRUE(model_data.InternText("IT\tApple:0.65\t\tipad:0.45",
+                                    &mem_instance));
+  EXPECT_EQ(0, mem_instance.label_id());
+  EXPECT_EQ(1, model_data.NumClasses());
+  EXPECT_EQ(0, model_data.FeatureNameId("Apple"));
+  EXPECT_EQ(1, model_data.FeatureNameId("ipad"));
+
+  // the same ids as of InternInstance.
+  Instance instance("Finance");
+  instance.AddFeature("ipad", 0.5);
+  instance.AddFeature("Stock", 0.8);
+  MemInstance interned;
+  model_data.InternInstance(instance, &interned);
+  ASSERT_TRUE(model_data.InternText("Finance\tipad:0.5\tStock:0.8",
+                                    &mem_instance));
+  EXPECT_EQ(interned.label_id(), mem_instance.label_id());
+  MemInstance::ConstIterator citer1(interned);
+  MemInstance::ConstIterator citer2(mem_instance);
+  for (; !citer1.Done() && !citer2.Done(); citer1.Next(), citer2.Next()) {
+    EXPECT_EQ(citer1.FeatureNameId(), citer2.FeatureNameId());
+    EXPECT_FLOAT_EQ(citer1.FeatureValue(), citer2.FeatureValue());
+  }
+  EXPECT_TRUE(citer1.Done() && citer2.Done());
+
+  // a malformed line interns nothing.
+  EXPECT_FALSE(model_data.InternText("Sports\tNBA:1\tball", &mem_instance));
+  EXPECT_FALSE(model_data.InternText("Sports", &mem_instance));
+  EXPECT_EQ(2, model_data.NumClasses());
+  EXPECT_EQ(-1, model_data.FeatureNameId("NBA"));
+}
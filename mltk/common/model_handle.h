@@ -0,0 +1,67 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A handle to the current version of a read-only model, which can be replaced
+// while other threads are predicting with it.
+
+#ifndef MLTK_COMMON_MODEL_HANDLE_H_
+#define MLTK_COMMON_MODEL_HANDLE_H_
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace common {
+
+// ModelHandle follows the read-copy-update pattern. A reader takes a snapshot
+// by Get() and uses it for as long as it likes, without any lock. A writer
+// loads a new ModelData aside and publishes it by Reset() atomically. Readers
+// which hold the old snapshot finish on the old version, and its memory is
+// reclaimed when the last of them releases it.
+class ModelHandle {
+ public:
+  typedef std::shared_ptr<const ModelData> ConstModelPtr;
+
+  // A model and its version, published together by one atomic store, so the
+  // results computed from model can be tagged with exactly version.
+  struct Snapshot {
+    Snapshot(const ConstModelPtr& model, uint64_t version)
+        : model(model), version(version) {}
+
+    ConstModelPtr model;  // never NULL
+    uint64_t version;  // increases by one on every Reset()
+  };
+
+  ModelHandle()
+      : snapshot_(new Snapshot(ConstModelPtr(new ModelData()), 0)) {}
+  ~ModelHandle() {}
+
+  // Returns the current model and its version.
+  Snapshot Get() const { return *std::atomic_load(&snapshot_); }
+
+  // Publishes model as the current one, and returns its version.
+  uint64_t Reset(const ConstModelPtr& model) {
+    assert(model);
+    std::lock_guard<std::mutex> lock(reset_mutex_);
+    const uint64_t version = std::atomic_load(&snapshot_)->version + 1;
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(
+        new Snapshot(model, version)));
+    return version;
+  }
+
+ private:
+  // accessed by std::atomic_load/store only
+  std::shared_ptr<const Snapshot> snapshot_;
+  std::mutex reset_mutex_;  // serializes the writers, as rare as reloads
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_MODEL_HANDLE_H_
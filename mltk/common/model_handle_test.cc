@@ -0,0 +1,88 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/model_handle.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "mltk/common/instance.h"
+#include "mltk/common/model_data.h"
+
+using mltk::common::Instance;
+using mltk::common::ModelData;
+using mltk::common::ModelHandle;
+
+namespace {
+
+// A model with num_classes classes named "0", "1", ...
+std::shared_ptr<ModelData> NewModel(int32_t num_classes) {
+  std::vector<Instance> instances;
+  for (int32_t i = 0; i < num_classes; ++i) {
+    Instance instance(std::to_string(i));
+    instance.AddFeature("feature", 1.0);
+    instances.push_back(instance);
+  }
+  std::shared_ptr<ModelData> model_data(new ModelData());
+  model_data->InitFromInstances(instances, 0);
+  return model_data;
+}
+
+}  // namespace
+
+TEST(ModelHandle, Reset) {
+  ModelHandle handle;
+  EXPECT_EQ(0u, handle.Get().version);
+  ASSERT_TRUE(handle.Get().model != NULL);
+  EXPECT_EQ(0, handle.Get().model->NumClasses());
+
+  EXPECT_EQ(1u, handle.Reset(NewModel(2)));
+  ModelHandle::Snapshot snapshot = handle.Get();
+  EXPECT_EQ(1u, snapshot.version);
+  EXPECT_EQ(2, snapshot.model->NumClasses());
+
+  // the old snapshot survives the reset.
+  EXPECT_EQ(2u, handle.Reset(NewModel(3)));
+  EXPECT_EQ(2u, handle.Get().version);
+  EXPECT_EQ(3, handle.Get().model->NumClasses());
+  EXPECT_EQ(1u, snapshot.version);
+  EXPECT_EQ(2, snapshot.model->NumClasses());
+  EXPECT_EQ("1", snapshot.model->Label(1));
+}
+
+TEST(ModelHandle, ConcurrentReset) {
+  ModelHandle handle;
+  handle.Reset(NewModel(1));
+
+  std::atomic<bool> done(false);
+  std::atomic<int32_t> num_errors(0);
+  std::vector<std::thread> readers;
+  for (int32_t t = 0; t < 4; ++t) {
+    readers.push_back(std::thread([&handle, &done, &num_errors]() {
+      while (!done.load()) {
+        const ModelHandle::Snapshot snapshot = handle.Get();
+        const ModelHandle::ConstModelPtr& model_data = snapshot.model;
+        // model version v has exactly v classes.
+        const int32_t num_classes = model_data->NumClasses();
+        if (num_classes != static_cast<int32_t>(snapshot.version) ||
+            model_data->Label(num_classes - 1)
+                != std::to_string(num_classes - 1)) {
+          ++num_errors;
+        }
+      }
+    }));
+  }
+
+  for (int32_t num_classes = 2; num_classes <= 50; ++num_classes) {
+    handle.Reset(NewModel(num_classes));
+  }
+  done.store(true);
+  for (size_t t = 0; t < readers.size(); ++t) { readers[t].join(); }
+
+  EXPECT_EQ(0, num_errors.load());
+  EXPECT_EQ(50u, handle.Get().version);
+}
@@ -0,0 +1,26 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// The storage type of real numbers in models and training data.
+
+#ifndef MLTK_COMMON_SCALAR_H_
+#define MLTK_COMMON_SCALAR_H_
+
+namespace mltk {
+namespace common {
+
+// Scalar is the storage type of feature values, weights (lambdas), gradients
+// and the quasi-Newton history, which dominate the memory bandwidth of the
+// training passes. It is double by default. Build with -Dsingle_precision=ON
+// (MLTK_SINGLE_PRECISION) to store them in float, while sums over instances
+// and features, dot products and probabilities are still computed in double.
+#ifdef MLTK_SINGLE_PRECISION
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_SCALAR_H_
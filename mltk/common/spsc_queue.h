@@ -0,0 +1,97 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A bounded lock-free queue of a single producer and a single consumer.
+
+#ifndef MLTK_COMMON_SPSC_QUEUE_H_
+#define MLTK_COMMON_SPSC_QUEUE_H_
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace mltk {
+namespace common {
+
+// SpscQueue hands values over from one producer thread to one consumer
+// thread through a ring of capacity slots, whose indices are the only shared
+// state, so neither side ever takes a lock. The values are swapped in and
+// out rather than copied: the producer gets back the value a consumer swapped
+// into the slot before, e.g. a batch whose memory it reuses.
+//
+// Push and Pop yield the CPU while the queue is full or empty, so the two
+// threads share even a single core.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots_(capacity + 1), head_(0), tail_(0), closed_(false) {
+    assert(capacity > 0);
+  }
+  ~SpscQueue() {}
+
+  // Swaps *value into the queue, unless it is full. Producer only.
+  bool TryPush(T* value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = Next(tail);
+    if (next == head_.load(std::memory_order_acquire)) { return false; }
+
+    std::swap(slots_[tail], *value);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Swaps the oldest value of the queue out into *value, unless it is
+  // empty. Consumer only.
+  bool TryPop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) { return false; }
+
+    std::swap(slots_[head], *value);
+    head_.store(Next(head), std::memory_order_release);
+    return true;
+  }
+
+  // Like TryPush, but waits for a free slot.
+  void Push(T* value) {
+    assert(!closed_.load(std::memory_order_relaxed));
+    while (!TryPush(value)) { std::this_thread::yield(); }
+  }
+
+  // No value is pushed any more. Producer only.
+  void Close() { closed_.store(true, std::memory_order_release); }
+
+  // Like TryPop, but waits for a value. Returns false once the queue is
+  // closed and empty.
+  bool Pop(T* value) {
+    while (!TryPop(value)) {
+      // the values pushed before Close are visible once it is.
+      if (closed_.load(std::memory_order_acquire)) { return TryPop(value); }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+ private:
+  size_t Next(size_t index) const {
+    return index + 1 == slots_.size() ? 0 : index + 1;
+  }
+
+  // one more than the capacity, so a full ring differs from an empty one.
+  std::vector<T> slots_;
+
+  // the next slots to pop and to push, on cache lines of their own, as
+  // either side writes one of them and reads the other.
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  std::atomic<bool> closed_;
+};
+
+}  // namespace common
+}  // namespace mltk
+
+#endif  // MLTK_COMMON_SPSC_QUEUE_H_
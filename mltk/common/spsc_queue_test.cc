@@ -0,0 +1,63 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/common/spsc_queue.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using mltk::common::SpscQueue;
+
+TEST(SpscQueue, TryPushAndTryPop) {
+  SpscQueue<int> queue(2);
+  int value = 0;
+  EXPECT_FALSE(queue.TryPop(&value));
+
+  value = 1;
+  EXPECT_TRUE(queue.TryPush(&value));
+  value = 2;
+  EXPECT_TRUE(queue.TryPush(&value));
+  value = 3;
+  EXPECT_FALSE(queue.TryPush(&value));  // full
+
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(1, value);
+  value = 3;
+  EXPECT_TRUE(queue.TryPush(&value));  // around the ring
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(2, value);
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(3, value);
+  EXPECT_FALSE(queue.TryPop(&value));
+}
+
+TEST(SpscQueue, PushAndPop) {
+  const int kNumBatches = 10000;
+  SpscQueue<std::vector<int> > queue(4);
+
+  std::thread producer([&queue] {
+    std::vector<int> batch;
+    for (int i = 0; i < kNumBatches; ++i) {
+      batch.assign(i % 3 + 1, i);
+      queue.Push(&batch);
+    }
+    queue.Close();
+  });
+
+  // every batch arrives once, in order and intact.
+  std::vector<int> batch;
+  int num_batches = 0;
+  while (queue.Pop(&batch)) {
+    ASSERT_EQ(static_cast<size_t>(num_batches % 3 + 1), batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+      ASSERT_EQ(num_batches, batch[i]);
+    }
+    ++num_batches;
+  }
+  producer.join();
+
+  EXPECT_EQ(kNumBatches, num_batches);
+  EXPECT_FALSE(queue.Pop(&batch));
+}
@@ -13,6 +13,8 @@
 #include <string>
 #include <vector>
 
+#include "mltk/common/memory_breakdown.h"
+
 namespace mltk {
 namespace common {
 
@@ -48,11 +50,32 @@ class Vocabulary {
 
   size_t Size() const { return id2str_.size(); }
 
+  // Renumbers the string of id i as new_ids[i], where new_ids is a
+  // permutation of the ids.
+  void Renumber(const std::vector<int32_t>& new_ids) {
+    assert(new_ids.size() == id2str_.size());
+    std::vector<std::string> id2str(id2str_.size());
+    for (size_t i = 0; i < id2str_.size(); ++i) {
+      id2str[new_ids[i]].swap(id2str_[i]);
+      str2id_[id2str[new_ids[i]]] = new_ids[i];
+    }
+    id2str_.swap(id2str);
+  }
+
   void Clear() {
     str2id_.clear();
     id2str_.clear();
   }
 
+  // the heap memory of the vocabulary, in which every string is kept twice.
+  size_t MemoryUsage() const {
+    size_t bytes = MemoryBreakdown::Of(str2id_) + MemoryBreakdown::Of(id2str_);
+    for (size_t i = 0; i < id2str_.size(); ++i) {
+      bytes += 2 * MemoryBreakdown::Of(id2str_[i]);
+    }
+    return bytes;
+  }
+
   StringMapType::const_iterator begin() const { return str2id_.begin(); }
   StringMapType::const_iterator end() const { return str2id_.end(); }
 
@@ -3,6 +3,8 @@
 
 #include "mltk/common/vocabulary.h"
 
+#include <vector>
+
 #include <gtest/gtest.h>
 
 using mltk::common::StringMapType;
@@ -38,3 +40,21 @@ TEST(Vocabulary, PutAndGet) {
   ASSERT_EQ(0, vocab.Size());
 }
 
+
+TEST(Vocabulary, Renumber) {
+  Vocabulary vocab;
+  vocab.Put("Apple");
+  vocab.Put("Microsoft");
+  vocab.Put("ipad");
+
+  std::vector<int32_t> new_ids;
+  new_ids.push_back(2);
+  new_ids.push_back(0);
+  new_ids.push_back(1);
+  vocab.Renumber(new_ids);
+  ASSERT_EQ(3, vocab.Size());
+  EXPECT_EQ(2, vocab.Id("Apple"));
+  EXPECT_EQ(0, vocab.Id("Microsoft"));
+  EXPECT_EQ("ipad", vocab.Str(1));
+  EXPECT_EQ(3, vocab.Put("Google glass"));
+}
@@ -0,0 +1,248 @@
+#!/usr/bin/env python
+#coding=utf-8
+
+# Copyright(c) 2013 MLTK Project.
+# Author: Lifeng Wang (ofandywang@gmail.com)
+
+"""End-to-end throughput regression benchmark for maxent_trainer and
+maxent_predictor.
+
+For every corpus scale, a deterministic synthetic corpus is generated once by
+maxent_synthetic_data and cached in the work directory. Then maxent_trainer is
+run with each optimization method and maxent_predictor is run on the trained
+model. Wall time, peak RSS and instances/sec of every run are collected and
+compared against a stored baseline with a relative tolerance. The script
+exits with a non-zero status if any metric regresses.
+
+With --perf_counters, the trainer counts the hardware events of every pass of
+LBFGS, OWLQN and TRON, and the mean IPC and the mean LLC and branch misses of
+a pass are collected too, where the machine can count them.
+"""
+
+import json
+import logging
+import optparse
+import os
+import re
+import subprocess
+import sys
+import time
+
+SCALES = {'100K': 100000, '1M': 1000000, '10M': 10000000, '50M': 50000000}
+
+def generate_corpus(args, scale, num_instances, kind, seed):
+    """Generates the corpus for scale unless it is already cached.
+    """
+    filename = os.path.join(args.work_dir, 'synthetic.%s.%s' % (scale, kind))
+    if os.path.exists(filename):
+        return filename
+    logging.info('generating %s corpus %s.' % (kind, filename))
+    tmp_filename = filename + '.tmp'
+    subprocess.check_call([
+            os.path.join(args.bin_dir, 'maxent_synthetic_data'),
+            '--output_file=%s' % tmp_filename,
+            '--num_instances=%d' % num_instances,
+            '--num_classes=%d' % args.num_classes,
+            '--num_feature_names=%d' % args.num_feature_names,
+            '--features_per_instance=%d' % args.features_per_instance,
+            '--seed=%d' % seed])
+    os.rename(tmp_filename, filename)
+    return filename
+
+def run(cmd, log_filename):
+    """Runs cmd, returns (wall time in sec, peak rss in MB, stderr text).
+    """
+    logging.info('running %s' % ' '.join(cmd))
+    log = open(log_filename, 'w')
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall_time = time.time() - start
+    proc.returncode = status  # reaped by os.wait4
+    log.close()
+    output = open(log_filename).read()
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        raise RuntimeError('command failed (status %d), see %s'
+                % (status, log_filename))
+    # ru_maxrss is in kilobytes on Linux.
+    return wall_time, rusage.ru_maxrss / 1024.0, output
+
+def parse_perf_counts(output):
+    """Returns the mean counts of the passes printed by the trainer, e.g.
+    {'ipc': 1.5, 'llc_misses_per_pass': 1e6}, of the counted events only.
+    """
+    sums = {}
+    num_passes = 0
+    for line in output.splitlines():
+        line = line.strip()
+        if not line.startswith('pass: '):
+            continue
+        num_passes += 1
+        for item in line[len('pass: '):].split():
+            name, _, value = item.partition('=')
+            if name in ('ipc', 'llc_misses', 'branch_misses'):
+                sums[name] = sums.get(name, 0.0) + float(value)
+    counts = {}
+    for name, value in sums.items():
+        metric = name if name == 'ipc' else '%s_per_pass' % name
+        counts[metric] = value / num_passes
+    return counts
+
+def benchmark_scale(args, scale):
+    num_instances = SCALES[scale]
+    num_test = max(1, num_instances // 10)
+    train_file = generate_corpus(args, scale, num_instances, 'train', args.seed)
+    test_file = generate_corpus(args, scale, num_test, 'test', args.seed + 1)
+
+    results = {}
+    for method in args.methods.split(','):
+        key = '%s.%s' % (scale, method)
+        model_file = os.path.join(args.work_dir, '%s.model' % key)
+        cmd = [os.path.join(args.bin_dir, 'maxent_trainer'),
+               '--train_data_file=%s' % train_file,
+               '--model_file=%s' % model_file,
+               '--optim_method=%s' % method,
+               '--num_iterations=%d' % args.num_iterations,
+               '--feature_cutoff=%d' % args.feature_cutoff]
+        if method in ('OWLQN', 'SGD'):
+            cmd.append('--l1_reg=%f' % args.l1_reg)
+        else:
+            cmd.append('--l2_reg=%f' % args.l2_reg)
+        if args.perf_counters:
+            cmd.append('--perf_counters')
+        wall_time, rss, output = run(cmd,
+                os.path.join(args.work_dir, '%s.trainer.log' % key))
+        results['%s.trainer' % key] = {
+                'wall_time_sec': wall_time,
+                'peak_rss_mb': rss,
+                'instances_per_sec':
+                    num_instances * args.num_iterations / wall_time}
+        results['%s.trainer' % key].update(parse_perf_counts(output))
+
+        cmd = [os.path.join(args.bin_dir, 'maxent_predictor'),
+               '--test_data_file=%s' % test_file,
+               '--model_file=%s' % model_file]
+        wall_time, rss, output = run(cmd,
+                os.path.join(args.work_dir, '%s.predictor.log' % key))
+        result = {'wall_time_sec': wall_time,
+                  'peak_rss_mb': rss,
+                  'instances_per_sec': num_test / wall_time}
+        match = re.search(r'accuracy\(\d+ / \d+\): ([0-9.eE+-]+)', output)
+        if match:
+            result['accuracy'] = float(match.group(1))
+        results['%s.predictor' % key] = result
+    return results
+
+def compare(results, baseline, tolerance):
+    """Returns the list of regressions of results against baseline.
+    """
+    regressions = []
+    for key in sorted(results):
+        if key not in baseline:
+            logging.warning('%s: no baseline.' % key)
+            continue
+        for metric, value in sorted(results[key].items()):
+            if metric not in baseline[key]:
+                continue
+            expected = baseline[key][metric]
+            if metric in ('instances_per_sec', 'accuracy', 'ipc'):
+                regressed = value < expected * (1.0 - tolerance)
+            else:
+                regressed = value > expected * (1.0 + tolerance)
+            if regressed:
+                regressions.append('%s %s: %g (baseline %g)'
+                        % (key, metric, value, expected))
+    return regressions
+
+def main(args):
+    if not os.path.exists(args.work_dir):
+        os.makedirs(args.work_dir)
+
+    results = {}
+    for scale in args.scales.split(','):
+        if scale not in SCALES:
+            logging.error('unknown scale %s, use one of %s.'
+                    % (scale, ','.join(sorted(SCALES))))
+            return 1
+        results.update(benchmark_scale(args, scale))
+
+    print('%-28s %12s %12s %16s %10s' % ('run', 'wall(s)', 'rss(MB)',
+            'instances/s', 'accuracy'))
+    for key in sorted(results):
+        r = results[key]
+        print('%-28s %12.2f %12.1f %16.0f %10s' % (key, r['wall_time_sec'],
+                r['peak_rss_mb'], r['instances_per_sec'],
+                '%.4f' % r['accuracy'] if 'accuracy' in r else '-'))
+    for key in sorted(results):
+        counts = ['%s=%g' % (metric, results[key][metric])
+                  for metric in ('ipc', 'llc_misses_per_pass',
+                                 'branch_misses_per_pass')
+                  if metric in results[key]]
+        if counts:
+            print('%-28s %s' % (key, ' '.join(counts)))
+
+    if args.update_baseline:
+        baseline = {}
+        if os.path.exists(args.baseline):
+            baseline = json.load(open(args.baseline))
+        baseline.update(results)
+        fp = open(args.baseline, 'w')
+        json.dump(baseline, fp, indent=2, sort_keys=True)
+        fp.write('\n')
+        fp.close()
+        logging.info('baseline %s updated.' % args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        logging.warning('no baseline %s, run with --update_baseline first.'
+                % args.baseline)
+        return 0
+    regressions = compare(results, json.load(open(args.baseline)),
+                          args.tolerance)
+    for regression in regressions:
+        logging.error('regression: %s' % regression)
+    return 1 if regressions else 0
+
+if __name__ == '__main__':
+    parser = optparse.OptionParser('usage: python run_benchmark.py -h.')
+    parser.add_option('--bin_dir', help = 'the directory of maxent_trainer, '
+            'maxent_predictor and maxent_synthetic_data.')
+    parser.add_option('--work_dir', default = 'maxent_benchmark',
+            help = 'the directory of generated corpora, models and logs.')
+    parser.add_option('--baseline', default = os.path.join(
+            os.path.dirname(os.path.abspath(__file__)), 'baseline.json'),
+            help = 'the baseline file.')
+    parser.add_option('--update_baseline', action = 'store_true',
+            default = False, help = 'store the results as the new baseline.')
+    parser.add_option('--tolerance', type = float, default = 0.15,
+            help = 'the relative tolerance of every metric.')
+    parser.add_option('--scales', default = '1M',
+            help = 'comma separated corpus scales, 100K, 1M, 10M and 50M.')
+    parser.add_option('--methods', default = 'LBFGS,OWLQN,SGD',
+            help = 'comma separated optimization methods.')
+    parser.add_option('--num_iterations', type = int, default = 10,
+            help = 'the training iterations of every method.')
+    parser.add_option('--l1_reg', type = float, default = 1.0,
+            help = 'the L1 regularization of OWLQN and SGD.')
+    parser.add_option('--l2_reg', type = float, default = 1.0,
+            help = 'the L2 regularization of LBFGS, TRON and SVRG.')
+    parser.add_option('--feature_cutoff', type = int, default = 1,
+            help = 'the minmum frequency of feature.')
+    parser.add_option('--num_classes', type = int, default = 4,
+            help = 'the number of classes of the synthetic corpus.')
+    parser.add_option('--num_feature_names', type = int, default = 1000000,
+            help = 'the feature vocabulary size of the synthetic corpus.')
+    parser.add_option('--features_per_instance', type = int, default = 20,
+            help = 'the average number of features per instance.')
+    parser.add_option('--perf_counters', action = 'store_true',
+            default = False, help = 'collect the hardware events of the '
+            'training passes, e.g. IPC and LLC misses.')
+    parser.add_option('--seed', type = int, default = 20130101,
+            help = 'the random seed of the synthetic corpus.')
+
+    (args, _) = parser.parse_args()
+    if not args.bin_dir:
+        parser.error('--bin_dir is required.')
+    logging.basicConfig(filename = '', level = logging.INFO,
+            format = '%(asctime)s %(levelname)s %(message)s')
+    sys.exit(main(args))
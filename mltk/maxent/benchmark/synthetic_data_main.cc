@@ -0,0 +1,139 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Generates a deterministic synthetic corpus in the MaxEnt data format for
+// end-to-end benchmarks.
+//
+// Feature names are drawn from a Zipf distribution over a fixed vocabulary,
+// which mimics the long-tailed feature frequencies of NLP corpora. Every
+// feature name votes for a hidden class, and the label of an instance is the
+// class with the largest vote (with some label noise), so the corpus is
+// learnable and accuracy numbers are meaningful. The same flags always produce
+// byte-identical output.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_string(output_file, "", "the filename of the generated corpus.");
+DEFINE_int64(num_instances, 1000000, "the number of instances.");
+DEFINE_int32(num_classes, 4, "the number of classes.");
+DEFINE_int32(num_feature_names, 1000000, "the size of the feature vocabulary.");
+DEFINE_int32(features_per_instance, 20,
+             "the average number of features per instance.");
+DEFINE_double(zipf_exponent, 1.0,
+              "the exponent of the Zipf distribution over feature names.");
+DEFINE_double(binary_ratio, 0.7,
+              "the fraction of instances whose features are all binary.");
+DEFINE_double(label_noise, 0.05, "the probability of a random label.");
+DEFINE_int64(seed, 20130101, "the random seed of instances.");
+DEFINE_int64(model_seed, 20130917,
+             "the random seed of the hidden model, which must be the same for "
+             "the training and test corpora.");
+
+namespace {
+
+// A small deterministic generator (xorshift64*), so the corpus does not depend
+// on the libc rand() implementation.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed ? seed : 0x9e3779b97f4a7c15ULL) {}
+
+  uint64_t Next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 2685821657736338717ULL;
+  }
+
+  // Returns a double in [0, 1).
+  double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  int32_t Uniform(int32_t n) { return static_cast<int32_t>(Next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::google::ParseCommandLineFlags(&argc, &argv, true);
+
+  CHECK_GT(FLAGS_num_instances, 0);
+  CHECK_GT(FLAGS_num_classes, 1);
+  CHECK_GT(FLAGS_num_feature_names, 0);
+  CHECK_GT(FLAGS_features_per_instance, 0);
+
+  FILE* fp = FLAGS_output_file.empty() ? stdout
+      : fopen(FLAGS_output_file.c_str(), "w");
+  if (!fp) {
+    LOG(ERROR) << "Can't open output file '" << FLAGS_output_file << "'";
+    return -1;
+  }
+
+  // cumulative Zipf distribution over feature names
+  std::vector<double> cdf(FLAGS_num_feature_names);
+  double sum = 0.0;
+  for (int32_t i = 0; i < FLAGS_num_feature_names; ++i) {
+    sum += 1.0 / pow(i + 1.0, FLAGS_zipf_exponent);
+    cdf[i] = sum;
+  }
+  for (int32_t i = 0; i < FLAGS_num_feature_names; ++i) { cdf[i] /= sum; }
+
+  // the hidden class every feature name votes for
+  Random model_rand(FLAGS_model_seed);
+  std::vector<int32_t> hidden_class(FLAGS_num_feature_names);
+  for (int32_t i = 0; i < FLAGS_num_feature_names; ++i) {
+    hidden_class[i] = model_rand.Uniform(FLAGS_num_classes);
+  }
+
+  Random rand(FLAGS_seed);
+
+  std::vector<int32_t> feature_names;
+  std::vector<double> votes(FLAGS_num_classes);
+  for (int64_t n = 0; n < FLAGS_num_instances; ++n) {
+    const int32_t num_features = 1 + rand.Uniform(
+        2 * FLAGS_features_per_instance - 1);
+    const bool binary = rand.NextDouble() < FLAGS_binary_ratio;
+
+    feature_names.clear();
+    std::fill(votes.begin(), votes.end(), 0.0);
+    for (int32_t i = 0; i < num_features; ++i) {
+      const int32_t name = std::lower_bound(cdf.begin(), cdf.end(),
+                                            rand.NextDouble()) - cdf.begin();
+      feature_names.push_back(std::min(name, FLAGS_num_feature_names - 1));
+    }
+
+    std::string line;
+    char buf[64];
+    for (size_t i = 0; i < feature_names.size(); ++i) {
+      const double value = binary ? 1.0 : 0.1 + 0.9 * rand.NextDouble();
+      votes[hidden_class[feature_names[i]]] += value;
+      if (binary) {
+        snprintf(buf, sizeof(buf), "\tf%d:1", feature_names[i]);
+      } else {
+        snprintf(buf, sizeof(buf), "\tf%d:%.4f", feature_names[i], value);
+      }
+      line += buf;
+    }
+
+    int32_t label = std::max_element(votes.begin(), votes.end())
+        - votes.begin();
+    if (rand.NextDouble() < FLAGS_label_noise) {
+      label = rand.Uniform(FLAGS_num_classes);
+    }
+    fprintf(fp, "c%d%s\n", label, line.c_str());
+  }
+
+  if (fp != stdout) { fclose(fp); }
+
+  return 0;
+}
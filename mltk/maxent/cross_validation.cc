@@ -0,0 +1,247 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/cross_validation.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+#include "mltk/maxent/ftrl.h"
+#include "mltk/maxent/lbfgs.h"
+#include "mltk/maxent/optimizer.h"
+#include "mltk/maxent/owlqn.h"
+#include "mltk/maxent/sgd.h"
+#include "mltk/maxent/svrg.h"
+#include "mltk/maxent/tron.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::Instance;
+using mltk::common::MemInstance;
+using mltk::common::ModelData;
+
+CrossValidation::CrossValidation(int32_t num_folds,
+                                 int32_t num_threads,
+                                 uint32_t seed)
+    : num_folds_(num_folds), num_threads_(num_threads), seed_(seed) {
+  assert(num_folds > 1 && num_threads > 0);
+}
+
+void CrossValidation::AddInstance(const Instance& instance) {
+  instances_.push_back(MemInstance());
+  vocabularies_.InternInstance(instance, &instances_.back());
+}
+
+int64_t CrossValidation::LoadFromStream(std::istream* in) {
+  assert(in != NULL);
+  int64_t num_instances = 0;
+  std::string line;
+  Instance instance;
+  while (std::getline(*in, line)) {
+    if (!instance.ParseFromText(line)) { continue; }
+    AddInstance(instance);
+    ++num_instances;
+  }
+  return num_instances;
+}
+
+bool CrossValidation::Run(const std::vector<Params>& grid,
+                          std::vector<Result>* results) {
+  assert(results != NULL);
+  if (NumInstances() < num_folds_) {
+    std::cerr << "error: fewer instances than folds." << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < grid.size(); ++i) {
+    std::unique_ptr<Optimizer> optim(NewOptimizer(grid[i]));
+    if (!optim) {
+      std::cerr << "error: invalid optimization method : "
+          << grid[i].optim_method << std::endl;
+      return false;
+    }
+  }
+
+  SplitFolds();
+
+  // the jobs of a point are adjacent, so its folds finish about together.
+  const int32_t num_jobs = grid.size() * num_folds_;
+  std::vector<FoldResult> fold_results(num_jobs);
+  std::atomic<int32_t> next_job(0);
+  std::vector<std::thread> workers;
+  for (int32_t i = 0; i < std::min(num_threads_, num_jobs); ++i) {
+    workers.push_back(std::thread(&CrossValidation::Work, this,
+                                  std::cref(grid), &next_job, &fold_results));
+  }
+  for (size_t i = 0; i < workers.size(); ++i) { workers[i].join(); }
+
+  results->clear();
+  for (size_t i = 0; i < grid.size(); ++i) {
+    Result result;
+    result.params = grid[i];
+    result.heldout_logl = 0.0;
+    result.accuracy = 0.0;
+    result.num_features = 0.0;
+    result.num_active_features = 0.0;
+    result.train_seconds = 0.0;
+    for (int32_t fold = 0; fold < num_folds_; ++fold) {
+      const FoldResult& fold_result = fold_results[i * num_folds_ + fold];
+      result.heldout_logl += fold_result.heldout_logl / num_folds_;
+      result.accuracy += fold_result.accuracy / num_folds_;
+      result.num_features += fold_result.num_features
+                             / static_cast<double>(num_folds_);
+      result.num_active_features += fold_result.num_active_features
+                                    / static_cast<double>(num_folds_);
+      result.train_seconds += fold_result.train_seconds / num_folds_;
+    }
+
+    double variance = 0.0;
+    for (int32_t fold = 0; fold < num_folds_; ++fold) {
+      const double diff = fold_results[i * num_folds_ + fold].accuracy
+                          - result.accuracy;
+      variance += diff * diff / (num_folds_ - 1);
+    }
+    result.accuracy_stddev = sqrt(variance);
+    results->push_back(result);
+  }
+
+  return true;
+}
+
+Optimizer* CrossValidation::NewOptimizer(const Params& params) {
+  Optimizer* optim = NULL;
+  if (params.optim_method == "LBFGS") {
+    optim = new LBFGS(params.num_iterations, params.newton_m);
+    optim->UseL2Reg(params.l2_reg);
+  } else if (params.optim_method == "OWLQN") {
+    optim = new OWLQN(params.num_iterations, params.newton_m);
+    optim->UseL1Reg(params.l1_reg);
+  } else if (params.optim_method == "TRON") {
+    optim = new TRON(params.num_iterations);
+    optim->UseL2Reg(params.l2_reg);
+  } else if (params.optim_method == "SGD") {
+    optim = new SGD(params.num_iterations, params.sgd_learning_rate);
+    optim->UseL1Reg(params.l1_reg);
+  } else if (params.optim_method == "SVRG") {
+    optim = new SVRG(params.num_iterations);
+    optim->UseL2Reg(params.l2_reg);
+  } else if (params.optim_method == "FTRL") {
+    optim = new FTRL(FTRL::FTRL_PROXIMAL, params.num_iterations,
+                     params.ftrl_alpha, params.ftrl_beta);
+    optim->UseL1Reg(params.l1_reg);
+    optim->UseL2Reg(params.l2_reg);
+  } else if (params.optim_method == "ADAGRAD") {
+    optim = new FTRL(FTRL::ADAGRAD, params.num_iterations,
+                     params.ftrl_alpha, params.ftrl_beta);
+  }
+  return optim;
+}
+
+void CrossValidation::PrintResults(const std::vector<Result>& results,
+                                   std::ostream* out) {
+  assert(out != NULL);
+  *out << "optim_method\tl1_reg\tl2_reg\tfeature_cutoff\tnewton_m"
+      << "\theldout_logl(err)\taccuracy\tstddev\tfeatures\tactive_features"
+      << "\ttrain_seconds" << std::endl;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    *out << result.params.optim_method
+        << "\t" << result.params.l1_reg
+        << "\t" << result.params.l2_reg
+        << "\t" << result.params.feature_cutoff
+        << "\t" << result.params.newton_m
+        << "\t" << -1 * result.heldout_logl
+        << "\t" << result.accuracy
+        << "\t" << result.accuracy_stddev
+        << "\t" << result.num_features
+        << "\t" << result.num_active_features
+        << "\t" << result.train_seconds << std::endl;
+  }
+}
+
+void CrossValidation::SplitFolds() {
+  // a random permutation of the instances is dealt to the folds in turn, so
+  // the folds differ in size by one at most.
+  std::vector<int32_t> fold_of(instances_.size());
+  for (size_t n = 0; n < fold_of.size(); ++n) { fold_of[n] = n; }
+  std::mt19937 generator(seed_);
+  std::shuffle(fold_of.begin(), fold_of.end(), generator);
+
+  std::vector<int32_t> permutation(fold_of);
+  for (size_t i = 0; i < permutation.size(); ++i) {
+    fold_of[permutation[i]] = i % num_folds_;
+  }
+
+  train_data_.assign(num_folds_, std::vector<const MemInstance*>());
+  heldout_data_.assign(num_folds_, std::vector<const MemInstance*>());
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    for (int32_t fold = 0; fold < num_folds_; ++fold) {
+      if (fold == fold_of[n]) {
+        heldout_data_[fold].push_back(&instances_[n]);
+      } else {
+        train_data_[fold].push_back(&instances_[n]);
+      }
+    }
+  }
+}
+
+void CrossValidation::Work(const std::vector<Params>& grid,
+                           std::atomic<int32_t>* next_job,
+                           std::vector<FoldResult>* fold_results) {
+  const int32_t num_jobs = fold_results->size();
+  for (int32_t job = (*next_job)++; job < num_jobs; job = (*next_job)++) {
+    RunJob(grid[job / num_folds_], job % num_folds_, &(*fold_results)[job]);
+  }
+}
+
+void CrossValidation::RunJob(const Params& params,
+                             int32_t fold,
+                             FoldResult* fold_result) {
+  std::unique_ptr<Optimizer> optim(NewOptimizer(params));
+  assert(optim);
+
+  // the model is only trained on the training folds, and is evaluated on
+  // the heldout fold here instead of by the optimizer in every iteration.
+  ModelData model_data;
+  model_data.ShareVocabularies(vocabularies_);
+  const std::chrono::steady_clock::time_point start_time
+      = std::chrono::steady_clock::now();
+  optim->EstimateParamater(train_data_[fold],
+                           std::vector<const MemInstance*>(),
+                           params.feature_cutoff,
+                           &model_data);
+  fold_result->train_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+
+  const std::vector<const MemInstance*>& heldout_data = heldout_data_[fold];
+  std::vector<double> prob_dist(model_data.NumClasses());
+  double logl = 0.0;
+  int32_t ncorrect = 0;
+  for (size_t n = 0; n < heldout_data.size(); ++n) {
+    const int32_t label_id = model_data.CalcConditionalProbability(
+        *heldout_data[n], &prob_dist);
+    logl += log(prob_dist[heldout_data[n]->label_id()]);
+    if (label_id == heldout_data[n]->label_id()) { ++ncorrect; }
+  }
+  fold_result->heldout_logl = logl / heldout_data.size();
+  fold_result->accuracy = static_cast<double>(ncorrect) / heldout_data.size();
+  fold_result->num_features = model_data.NumFeatures();
+  fold_result->num_active_features = model_data.NumActiveFeatures();
+}
+
+}  // namespace maxent
+}  // namespace mltk
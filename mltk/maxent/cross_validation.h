@@ -0,0 +1,129 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Parallel k-fold cross-validation of MaxEnt over a grid of hyperparameters.
+
+#ifndef MLTK_MAXENT_CROSS_VALIDATION_H_
+#define MLTK_MAXENT_CROSS_VALIDATION_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+#include "mltk/maxent/optimizer.h"
+
+namespace mltk {
+namespace maxent {
+
+// CrossValidation interns the instances once into read-only MemInstances and
+// vocabularies, which all the models share. Every point of the grid is
+// trained and evaluated on num_folds folds, and the folds x points jobs run
+// on a pool of num_threads threads, each of which holds one model and one
+// optimizer at a time.
+//
+// The instances are assigned to the folds at random by seed, and every model
+// counts its features for feature_cutoff on its own training folds only.
+class CrossValidation {
+ public:
+  // One point of the grid. The regularizers and newton_m only apply to the
+  // optimizers supporting them, as in maxent_trainer.
+  struct Params {
+    Params() : optim_method("LBFGS"), num_iterations(100), newton_m(10),
+               sgd_learning_rate(1.0), ftrl_alpha(0.1), ftrl_beta(1.0),
+               l1_reg(0.0), l2_reg(0.0), feature_cutoff(1) {}
+
+    // LBFGS, OWLQN, TRON, SGD, SVRG, FTRL or ADAGRAD
+    std::string optim_method;
+    int32_t num_iterations;
+    int32_t newton_m;
+    double sgd_learning_rate;
+    double ftrl_alpha;
+    double ftrl_beta;
+    double l1_reg;
+    double l2_reg;
+    int32_t feature_cutoff;
+  };
+
+  // The metrics of a point of the grid, averaged over the folds.
+  struct Result {
+    Params params;
+    double heldout_logl;  // the mean log-likelihood of a heldout instance
+    double accuracy;  // on the heldout folds
+    double accuracy_stddev;  // across the folds
+    double num_features;
+    double num_active_features;  // the features of nonzero weights
+    double train_seconds;  // the wall time to train one fold
+  };
+
+  CrossValidation(int32_t num_folds, int32_t num_threads, uint32_t seed = 0);
+  ~CrossValidation() {}
+
+  void AddInstance(const common::Instance& instance);
+
+  // Adds the instances read from in, one instance per line, and returns the
+  // number of them.
+  int64_t LoadFromStream(std::istream* in);
+
+  int64_t NumInstances() const { return instances_.size(); }
+  int32_t NumClasses() const { return vocabularies_.NumClasses(); }
+
+  // Cross-validates every point of grid, and fills results in the same
+  // order. Returns false if an optimizer is unknown, or there are fewer
+  // instances than folds.
+  bool Run(const std::vector<Params>& grid, std::vector<Result>* results);
+
+  // Creates the optimizer of params, or NULL if optim_method is unknown.
+  static Optimizer* NewOptimizer(const Params& params);
+
+  // Prints results as a tab-separated table with a header line.
+  static void PrintResults(const std::vector<Result>& results,
+                           std::ostream* out);
+
+ private:
+  // the metrics of a model trained on all but one fold.
+  struct FoldResult {
+    FoldResult() : heldout_logl(0.0), accuracy(0.0), num_features(0),
+                   num_active_features(0), train_seconds(0.0) {}
+
+    double heldout_logl;
+    double accuracy;
+    int32_t num_features;
+    int32_t num_active_features;
+    double train_seconds;
+  };
+
+  // Splits the instances into the training and heldout data of every fold.
+  void SplitFolds();
+
+  // Runs the jobs of the folds x points one by one, taking the next one from
+  // next_job, until all are taken.
+  void Work(const std::vector<Params>& grid,
+            std::atomic<int32_t>* next_job,
+            std::vector<FoldResult>* fold_results);
+
+  void RunJob(const Params& params, int32_t fold, FoldResult* fold_result);
+
+  int32_t num_folds_;
+  int32_t num_threads_;
+  uint32_t seed_;
+
+  // the shared vocabularies, and the instances interned by them.
+  common::ModelData vocabularies_;
+  std::vector<common::MemInstance> instances_;
+
+  // the instances in the training and heldout data of every fold.
+  std::vector<std::vector<const common::MemInstance*> > train_data_;
+  std::vector<std::vector<const common::MemInstance*> > heldout_data_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_CROSS_VALIDATION_H_
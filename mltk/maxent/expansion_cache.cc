@@ -0,0 +1,161 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/expansion_cache.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mltk/common/memory_breakdown.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+namespace {
+
+// a feature f(x, y) fired by an instance.
+struct Expansion {
+  int32_t label_id;
+  int32_t feature_id;
+  Scalar value;
+
+  bool operator<(const Expansion& other) const {
+    return label_id < other.label_id;
+  }
+};
+
+}  // namespace
+
+size_t ExpansionCache::Init(const ModelData& model_data,
+                            const std::vector<const MemInstance*>& instances,
+                            size_t max_bytes) {
+  Clear();
+  size_t bytes = sizeof(uint32_t) + sizeof(size_t);  // the first offsets
+  if (bytes > max_bytes) { return 0; }
+  instance_runs_.push_back(0);
+  run_begins_.push_back(0);
+
+  std::vector<Expansion> expansions;
+  for (size_t n = 0; n < instances.size(); ++n) {
+    // the features in the order of the feature names within every label, so
+    // the sums are the same as on the fly.
+    expansions.clear();
+    for (MemInstance::ConstIterator citer(*instances[n]);
+         !citer.Done(); citer.Next()) {
+      const std::vector<int32_t>& feature_ids
+          = model_data.FeatureIds(citer.FeatureNameId());
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        Expansion expansion;
+        expansion.label_id = model_data.FeatureAt(feature_ids[i]).LabelId();
+        expansion.feature_id = feature_ids[i];
+        expansion.value = citer.FeatureValue();
+        expansions.push_back(expansion);
+      }
+    }
+    std::stable_sort(expansions.begin(), expansions.end());
+    size_t num_runs = 0;
+    for (size_t i = 0; i < expansions.size(); ++i) {
+      if (i == 0 || expansions[i].label_id != expansions[i - 1].label_id) {
+        ++num_runs;
+      }
+    }
+
+    // the values are stored from the first instance not binary on, which
+    // also stores 1 for the features before it.
+    const bool binary = values_.empty() && instances[n]->IsBinary();
+    size_t instance_bytes = sizeof(uint32_t)
+        + num_runs * (sizeof(size_t) + sizeof(int32_t))
+        + expansions.size() * sizeof(int32_t);
+    if (!binary) {
+      instance_bytes += (values_.empty() ? feature_ids_.size() : 0)
+          * sizeof(Scalar) + expansions.size() * sizeof(Scalar);
+    }
+    if (bytes + instance_bytes > max_bytes) { break; }
+    bytes += instance_bytes;
+
+    if (!binary && values_.empty()) { values_.assign(feature_ids_.size(), 1); }
+    for (size_t i = 0; i < expansions.size(); ++i) {
+      if (i == 0 || expansions[i].label_id != expansions[i - 1].label_id) {
+        if (i > 0) { run_begins_.push_back(feature_ids_.size()); }
+        run_labels_.push_back(expansions[i].label_id);
+      }
+      feature_ids_.push_back(expansions[i].feature_id);
+      if (!binary) { values_.push_back(expansions[i].value); }
+    }
+    if (!expansions.empty()) { run_begins_.push_back(feature_ids_.size()); }
+    instance_runs_.push_back(run_labels_.size());
+  }
+
+  instance_runs_.shrink_to_fit();
+  run_begins_.shrink_to_fit();
+  run_labels_.shrink_to_fit();
+  feature_ids_.shrink_to_fit();
+  values_.shrink_to_fit();
+  return NumInstances();
+}
+
+void ExpansionCache::Clear() {
+  std::vector<uint32_t>().swap(instance_runs_);
+  std::vector<size_t>().swap(run_begins_);
+  std::vector<int32_t>().swap(run_labels_);
+  std::vector<int32_t>().swap(feature_ids_);
+  std::vector<Scalar>().swap(values_);
+}
+
+int32_t ExpansionCache::CalcConditionalProbability(
+    size_t n,
+    const std::vector<Scalar>& lambdas,
+    std::vector<double>* prob_dist) const {
+  assert(n < NumInstances());
+  std::fill(prob_dist->begin(), prob_dist->end(), 0.0);
+
+  for (uint32_t r = instance_runs_[n]; r < instance_runs_[n + 1]; ++r) {
+    double score = 0.0;
+    if (values_.empty()) {  // add-only, as every value is 1
+      for (size_t k = run_begins_[r]; k < run_begins_[r + 1]; ++k) {
+        score += lambdas[feature_ids_[k]];
+      }
+    } else {
+      for (size_t k = run_begins_[r]; k < run_begins_[r + 1]; ++k) {
+        score += static_cast<double>(lambdas[feature_ids_[k]]) * values_[k];
+      }
+    }
+    (*prob_dist)[run_labels_[r]] = score;
+  }
+
+  return ModelData::Normalize(prob_dist);
+}
+
+void ExpansionCache::AddExpectation(size_t n,
+                                    const std::vector<double>& factors,
+                                    std::vector<double>* expectation) const {
+  assert(n < NumInstances());
+  for (uint32_t r = instance_runs_[n]; r < instance_runs_[n + 1]; ++r) {
+    const double factor = factors[run_labels_[r]];
+    if (values_.empty()) {
+      for (size_t k = run_begins_[r]; k < run_begins_[r + 1]; ++k) {
+        (*expectation)[feature_ids_[k]] += factor;
+      }
+    } else {
+      for (size_t k = run_begins_[r]; k < run_begins_[r + 1]; ++k) {
+        (*expectation)[feature_ids_[k]] += factor * values_[k];
+      }
+    }
+  }
+}
+
+size_t ExpansionCache::MemoryUsage() const {
+  return MemoryBreakdown::Of(instance_runs_) + MemoryBreakdown::Of(run_begins_)
+         + MemoryBreakdown::Of(run_labels_) + MemoryBreakdown::Of(feature_ids_)
+         + MemoryBreakdown::Of(values_);
+}
+
+}  // namespace maxent
+}  // namespace mltk
@@ -0,0 +1,79 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// The features f(x, y) of the training instances, expanded once from their
+// feature names for the passes of the batch optimizers.
+
+#ifndef MLTK_MAXENT_EXPANSION_CACHE_H_
+#define MLTK_MAXENT_EXPANSION_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+#include "mltk/common/scalar.h"
+
+namespace mltk {
+namespace maxent {
+
+// Every pass over the instances looks up the features of every feature name
+// by ModelData::FeatureIds, and the label of every feature by FeatureAt,
+// though they never change during the estimation. ExpansionCache does it once,
+// and keeps the features of every instance in contiguous arrays, grouped by
+// label into runs: the score of a label sums up a run, and the expectation of
+// its features adds a run, without any lookup or branch.
+//
+// The arrays take 4 bytes per feature, plus the value unless all instances
+// are binary, and 12 bytes per run. Init expands the first instances within a
+// memory budget only, and the callers expand the others on the fly.
+class ExpansionCache {
+ public:
+  ExpansionCache() {}
+  ~ExpansionCache() {}
+
+  // Expands the features of model_data fired by the first instances whose
+  // expansions fit in max_bytes, and returns the number of them.
+  size_t Init(const common::ModelData& model_data,
+              const std::vector<const common::MemInstance*>& instances,
+              size_t max_bytes);
+
+  void Clear();
+
+  // the first NumInstances() instances of Init are expanded.
+  size_t NumInstances() const {
+    return instance_runs_.empty() ? 0 : instance_runs_.size() - 1;
+  }
+
+  // Calculates p(y|x) of instance n by lambdas into prob_dist, and returns
+  // the most probable label id, as ModelData::CalcConditionalProbability.
+  int32_t CalcConditionalProbability(size_t n,
+                                     const std::vector<common::Scalar>& lambdas,
+                                     std::vector<double>* prob_dist) const;
+
+  // Adds factors[y] * f(x, y) of instance n to expectation[f] for every
+  // feature f(x, y) it fires.
+  void AddExpectation(size_t n,
+                      const std::vector<double>& factors,
+                      std::vector<double>* expectation) const;
+
+  size_t MemoryUsage() const;
+
+ private:
+  // the runs of instance n are [instance_runs_[n], instance_runs_[n + 1]).
+  std::vector<uint32_t> instance_runs_;
+  // the features of run r are [run_begins_[r], run_begins_[r + 1]), of the
+  // label run_labels_[r].
+  std::vector<size_t> run_begins_;
+  std::vector<int32_t> run_labels_;
+  std::vector<int32_t> feature_ids_;
+  // of the features, empty if all of them are 1, as of MemInstance.
+  std::vector<common::Scalar> values_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_EXPANSION_CACHE_H_
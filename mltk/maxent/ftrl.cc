@@ -0,0 +1,250 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/ftrl.h"
+
+#include <assert.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mltk/common/feature.h"
+#include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::Feature;
+using mltk::common::Instance;
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+const static int64_t kReportInterval = 100000;  // instances between reports
+
+void FTRL::EstimateParamater(const std::vector<Instance>& instances,
+                             int32_t num_heldout,
+                             int32_t feature_cutoff,
+                             ModelData* model_data) {
+  Prepare(model_data);
+  if (feature_cutoff > 1) {
+    std::cerr << "warning: feature_cutoff is ignored in online learning."
+        << std::endl;
+  }
+  if (num_heldout >= static_cast<int32_t>(instances.size())) {
+    std::cerr << "error: too much heldout data. no training data is available."
+        << std::endl;
+    exit(1);
+  }
+
+  // the model is grown by all training instances before any update, which
+  // is the same as growing it while updating, since an unseen feature has
+  // zero weight either way. The heldout data may fire features unseen in
+  // training, which are ignored just as in prediction.
+  size_t num_train = instances.size() - num_heldout;
+  instances_.clear();
+  instances_.resize(instances.size());
+  for (size_t n = 0; n < instances.size(); ++n) {
+    if (n < num_train) {
+      model_data_->PutInstance(instances[n], &instances_[n]);
+    } else {
+      model_data_->FormatInstance(instances[n], &instances_[n]);
+    }
+  }
+  num_train = CollapseDuplicates(num_train);
+
+  train_data_.clear();
+  heldout_data_.clear();
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    if (n < num_train) {
+      train_data_.push_back(&instances_[n]);
+    } else {
+      heldout_data_.push_back(&instances_[n]);
+    }
+  }
+
+  Optimize();
+}
+
+void FTRL::EstimateParamater(
+    const std::vector<const MemInstance*>& train_data,
+    const std::vector<const MemInstance*>& heldout_data,
+    int32_t feature_cutoff,
+    ModelData* model_data) {
+  Prepare(model_data);
+  if (train_data.size() == 0) {
+    std::cerr << "error: no training data." << std::endl;
+    exit(1);
+  }
+
+  model_data_->InitFromMemInstances(train_data, feature_cutoff);
+  instances_.clear();
+  train_data_ = train_data;
+  heldout_data_ = heldout_data;
+
+  Optimize();
+}
+
+void FTRL::Optimize() {
+  const size_t num_train = train_data_.size();
+  for (int32_t iter = 0; iter < num_iter_; ++iter) {
+    num_iterations_ = iter + 1;
+    double ncorrect = 0.0;  // the weight of the instances predicted right
+    double logl = 0.0;
+    double weight = 0.0;
+    for (size_t n = 0; n < num_train; ++n) {
+      const MemInstance& mem_instance = *train_data_[n];
+      bool correct = false;
+      logl += mem_instance.weight() * Update(mem_instance, &correct);
+      if (correct) { ncorrect += mem_instance.weight(); }
+      weight += mem_instance.weight();
+    }
+
+    std::cerr << "iter = " << iter + 1 << ", obj(err) = " << -logl / weight
+        << ", accuracy = " << ncorrect / weight << std::endl;
+  }
+
+  if (heldout_data_.size() > 0) {
+    double heldout_logl = CalcHeldoutLikelihood();
+    std::cerr << "\t heldout_logl(err) = " << -1 * heldout_logl
+        << ", accuracy = " << heldout_accuracy_ << std::endl;
+  }
+}
+
+bool FTRL::EstimateParamaterFromStream(std::istream* in,
+                                       ModelData* model_data) {
+  assert(in != NULL);
+  Prepare(model_data);
+
+  int64_t num_instances = 0;
+  int64_t ncorrect = 0;
+  double logl = 0.0;
+  std::string line;
+  Instance instance;
+  MemInstance mem_instance;
+  while (std::getline(*in, line)) {
+    if (!instance.ParseFromText(line)) { continue; }
+
+    model_data_->PutInstance(instance, &mem_instance);
+    bool correct = false;
+    logl += Update(mem_instance, &correct);
+    if (correct) { ++ncorrect; }
+
+    if (++num_instances % kReportInterval == 0) {
+      ReportProgress(num_instances, logl, ncorrect);
+    }
+  }
+  if (num_instances == 0) {
+    std::cerr << "error: no training data." << std::endl;
+    return false;
+  }
+  if (num_instances % kReportInterval != 0) {
+    ReportProgress(num_instances, logl, ncorrect);
+  }
+
+  return true;
+}
+
+void FTRL::Prepare(ModelData* model_data) {
+  assert(model_data != NULL);
+  model_data_ = model_data;
+  z_.clear();
+  n_.clear();
+  CheckSettings();
+}
+
+void FTRL::AddStateMemoryUsage(int32_t num_features,
+                               MemoryBreakdown* breakdown) const {
+  // n_, and z_ of FTRL_PROXIMAL.
+  const size_t vector_bytes
+      = MemoryBreakdown::HeapBytes(num_features * sizeof(double));
+  breakdown->Add("accumulators",
+                 (mode_ == FTRL_PROXIMAL ? 2 : 1) * vector_bytes);
+}
+
+void FTRL::CheckSettings() {
+  std::cerr << "performing " << (mode_ == ADAGRAD ? "AdaGrad" : "FTRL")
+      << std::endl;
+  std::cerr << "alpha = " << alpha_ << ", beta = " << beta_ << std::endl;
+  if (l1reg_ > 0) { std::cerr << "L1 regularizer = " << l1reg_ << std::endl; }
+  if (l2reg_ > 0) { std::cerr << "L2 regularizer = " << l2reg_ << std::endl; }
+  if (mode_ == ADAGRAD && (l1reg_ > 0 || l2reg_ > 0)) {
+    std::cerr << "error: regularization is currently not supported in "
+        << "AdaGrad, pls use FTRL." << std::endl;
+    exit(1);
+  }
+}
+
+double FTRL::Update(const MemInstance& mem_instance, bool* correct) {
+  // the state of features first seen in this instance
+  const size_t num_features = model_data_->NumFeatures();
+  if (n_.size() < num_features) {
+    n_.resize(num_features, 0.0);
+    if (mode_ == FTRL_PROXIMAL) { z_.resize(num_features, 0.0); }
+  }
+
+  // the weights are always up to date, as w_i only changes with z_i and n_i.
+  prob_dist_.resize(model_data_->NumClasses());
+  const int32_t max_label = model_data_->CalcConditionalProbability(
+      mem_instance, &prob_dist_);
+  *correct = (max_label == mem_instance.label_id());
+
+  // an instance of weight w updates as w copies of it in a row would, if
+  // their gradient stayed the same: the gradient sums up w times, and so does
+  // its square in the learning rate, so the step grows only with sqrt(w).
+  const double weight = mem_instance.weight();
+  std::vector<Scalar>* lambdas = model_data_->MutableLambdas();
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    const std::vector<int32_t>& feature_ids
+        = model_data_->FeatureIds(citer.FeatureNameId());
+    const double value = citer.FeatureValue();  // 1 if binary
+    for (size_t i = 0; i < feature_ids.size(); ++i) {
+      const int32_t feature_id = feature_ids[i];
+      const Feature& feature = model_data_->FeatureAt(feature_id);
+      const double me = prob_dist_[feature.LabelId()];
+      const double ee = (feature.LabelId() == citer.LabelId() ? 1.0 : 0);
+      const double grad = (me - ee) * value;
+      if (grad == 0) { continue; }
+
+      double& n = n_[feature_id];
+      if (mode_ == ADAGRAD) {
+        n += weight * grad * grad;
+        (*lambdas)[feature_id] -= alpha_ / (beta_ + sqrt(n)) * weight * grad;
+      } else {
+        const double sigma
+            = (sqrt(n + weight * grad * grad) - sqrt(n)) / alpha_;
+        z_[feature_id] += weight * grad - sigma * (*lambdas)[feature_id];
+        n += weight * grad * grad;
+        (*lambdas)[feature_id] = Weight(feature_id);
+      }
+    }
+  }
+
+  return log(prob_dist_[mem_instance.label_id()]);
+}
+
+double FTRL::Weight(int32_t feature_id) const {
+  const double z = z_[feature_id];
+  if (fabs(z) <= l1reg_) { return 0.0; }
+
+  const double sign = z < 0 ? -1.0 : 1.0;
+  return - (z - sign * l1reg_)
+         / ((beta_ + sqrt(n_[feature_id])) / alpha_ + l2reg_);
+}
+
+void FTRL::ReportProgress(int64_t num_instances, double logl,
+                          int64_t ncorrect) {
+  std::cerr << "instances = " << num_instances
+      << ", features = " << model_data_->NumFeatures()
+      << ", progressive obj(err) = " << -logl / num_instances
+      << ", accuracy = " << static_cast<double>(ncorrect) / num_instances
+      << std::endl;
+}
+
+}  // namespace maxent
+}  // namespace mltk
@@ -0,0 +1,104 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Implementation of online learning with per-coordinate adaptive learning
+// rates, AdaGrad and FTRL-Proximal.
+//
+// Pls refer to 'John Duchi, Elad Hazan, and Yoram Singer. 2011. Adaptive
+// Subgradient Methods for Online Learning and Stochastic Optimization. JMLR'
+// and 'H. Brendan McMahan, et al. 2013. Ad Click Prediction: a View from the
+// Trenches. In Proceedings of KDD'
+
+#ifndef MLTK_MAXENT_FTRL_H_
+#define MLTK_MAXENT_FTRL_H_
+
+#include "mltk/maxent/optimizer.h"
+
+#include <istream>
+#include <vector>
+
+namespace mltk {
+
+namespace common {
+class Instance;
+class MemInstance;
+class ModelData;
+}  // namespace common
+
+namespace maxent {
+
+// FTRL learns the model from a sequence of instances in a single pass. The
+// vocabularies, the weights and the per-feature state grow lazily as new
+// labels and features show up, so the data never needs to be in memory.
+//
+// The learning rate of feature i after t instances is
+//
+//     eta_t,i = alpha / (beta + sqrt(sum_{s=1}^t g_s,i^2))
+//
+// ADAGRAD takes a gradient step with it, while FTRL_PROXIMAL solves the
+// follow-the-regularized-leader problem in closed form, which supports the
+// L1 (sparse models) and L2 regularization. Unlike the batch optimizers, the
+// regularizers are not normalized by the number of instances, which is
+// unknown in a stream.
+class FTRL : public Optimizer {
+ public:
+  enum Mode { ADAGRAD, FTRL_PROXIMAL };
+
+  FTRL(Mode mode = FTRL_PROXIMAL, int32_t num_iter = 1,
+       double alpha = 0.1, double beta = 1.0)
+      : mode_(mode), num_iter_(num_iter), alpha_(alpha), beta_(beta) {}
+  virtual ~FTRL() {}
+
+  // Makes num_iter passes over the instances in order. feature_cutoff is
+  // ignored, since features are added to the model as soon as they are seen.
+  virtual void EstimateParamater(const std::vector<common::Instance>& instances,
+                                 int32_t num_heldout,
+                                 int32_t feature_cutoff,
+                                 common::ModelData* model_data);
+
+  // Makes num_iter passes over train_data, whose features surviving
+  // feature_cutoff are counted first as in the batch optimizers.
+  virtual void EstimateParamater(
+      const std::vector<const common::MemInstance*>& train_data,
+      const std::vector<const common::MemInstance*>& heldout_data,
+      int32_t feature_cutoff,
+      common::ModelData* model_data);
+
+  // Makes a single pass over the instances read from in, one instance per
+  // line in the training data format.
+  virtual bool EstimateParamaterFromStream(std::istream* in,
+                                           common::ModelData* model_data);
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
+
+ private:
+  void Prepare(common::ModelData* model_data);
+
+  // Updates the model with one instance, and returns log p(y|x) under the
+  // model before the update, a.k.a. the progressive validation.
+  double Update(const common::MemInstance& mem_instance, bool* correct);
+
+  // w_i of FTRL_PROXIMAL in closed form.
+  double Weight(int32_t feature_id) const;
+
+  void ReportProgress(int64_t num_instances, double logl, int64_t ncorrect);
+
+  Mode mode_;
+  int32_t num_iter_;  // the passes over instances in EstimateParamater
+  double alpha_;  // the learning rate
+  double beta_;  // the smoothing of learning rate for rare features
+
+  std::vector<double> z_;  // FTRL: sum_t {g_t,i - sigma_t,i * w_t,i}
+  std::vector<double> n_;  // sum_t {g_t,i^2}
+  std::vector<double> prob_dist_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_FTRL_H_
@@ -20,40 +20,51 @@ namespace maxent {
 
 using mltk::common::DoubleVector;
 using mltk::common::Instance;
+using mltk::common::MemoryBreakdown;
 using mltk::common::ModelData;
+using mltk::common::Scalar;
 
 const static double line_search_alpha_ = 0.1;
 const static double line_search_beta_ = 0.5;
 // stopping criteria
 const static double MIN_GRAD_NORM = 0.0001;
 
-void LBFGS::EstimateParamater(const std::vector<Instance>& instances,
-                              int32_t num_heldout,
-                              int32_t feature_cutoff,
-                              ModelData* model_data) {
+void LBFGS::AddStateMemoryUsage(int32_t num_features,
+                                MemoryBreakdown* breakdown) const {
+  Optimizer::AddStateMemoryUsage(num_features, breakdown);
+  // the history of m pairs (s, y), and the working vectors of an iteration,
+  // e.g. x, grad, dx, x1, grad1 and the two-loop recursion.
+  const size_t vector_bytes
+      = MemoryBreakdown::HeapBytes(num_features * sizeof(Scalar));
+  breakdown->Add("history", 2 * m_ * vector_bytes);
+  breakdown->Add("working_vectors", 8 * vector_bytes);
+}
+
+void LBFGS::CheckSettings() {
   std::cerr << "performing LBFGS" << std::endl;
   if (l1reg_ > 0) {
     std::cerr << "error: L1 regularization is not supported in LBFGS,"
         << "you can use OWLQN method instead." << std::endl;
     exit(1);
   }
+}
 
-  InitFromInstances(instances, num_heldout, feature_cutoff, model_data);
-
-  std::vector<double> x = PerformLBFGS();
+void LBFGS::Optimize() {
+  std::vector<Scalar> x = PerformLBFGS();
   model_data_->UpdateLambdas(x);
 }
 
-std::vector<double> LBFGS::PerformLBFGS() {
-  const std::vector<double> lambdas = model_data_->Lambdas();
+std::vector<Scalar> LBFGS::PerformLBFGS() {
+  const std::vector<Scalar> lambdas = model_data_->Lambdas();
   assert(static_cast<int32_t>(lambdas.size()) == model_data_->NumFeatures());
 
-  std::vector<double> x0(lambdas.size());
+  std::vector<Scalar> x0(lambdas.size());
   for (int32_t i = 0; i < lambdas.size(); ++i) { x0[i] = lambdas[i]; }
 
   DoubleVector x(x0);
   DoubleVector grad(lambdas.size());
   double f = FunctionGradient(x.STLVector(), &(grad.STLVector()));
+  num_iterations_ = 0;
 
   DoubleVector* s = new DoubleVector[m_];
   DoubleVector* y = new DoubleVector[m_];
@@ -70,8 +81,11 @@ std::vector<double> LBFGS::PerformLBFGS() {
           << ", accuracy = " << heldout_accuracy_ << std::endl;
     }
 
+    num_iterations_ = iter + 1;
     // stopping criteria 2
     if (sqrt(DotProduct(grad, grad)) < MIN_GRAD_NORM) { break; }
+    // stopping criteria 3
+    if (Converged(iter, f)) { break; }
 
     DoubleVector dx = -1 * ApproximateHg(iter, grad, s, y, z);
 
@@ -13,6 +13,8 @@
 
 #include <vector>
 
+#include "mltk/common/scalar.h"
+
 namespace mltk {
 
 namespace common {
@@ -28,13 +30,15 @@ class LBFGS : public Optimizer {
   LBFGS(int32_t num_iter = 300, int32_t m = 10) : num_iter_(num_iter), m_(m) {}
   virtual ~LBFGS() {}
 
-  virtual void EstimateParamater(const std::vector<common::Instance>& instances,
-                                 int32_t num_heldout,
-                                 int32_t feature_cutoff,
-                                 common::ModelData* model_data);
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
 
  private:
-  std::vector<double> PerformLBFGS();
+  std::vector<common::Scalar> PerformLBFGS();
 
   common::DoubleVector ApproximateHg(const int32_t iter,
                                      const common::DoubleVector& grad,
@@ -6,6 +6,8 @@
 #include <assert.h>
 #include <math.h>
 #include <algorithm>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,14 +21,19 @@ namespace maxent {
 
 using mltk::common::Instance;
 using mltk::common::MemInstance;
+using mltk::common::ModelData;
+using mltk::common::ModelHandle;
 
 bool MaxEnt::LoadModel(const std::string& filename) {
-  model_data_.Clear();
-  return model_data_.Load(filename);
+  std::shared_ptr<ModelData> model_data(new ModelData());
+  if (!model_data->Load(filename)) { return false; }
+
+  model_.Reset(model_data);
+  return true;
 }
 
 bool MaxEnt::SaveModel(const std::string& filename) const {
-  return model_data_.Save(filename);
+  return model_.Get().model->Save(filename);
 }
 
 bool MaxEnt::Train(const std::vector<Instance>& instances,
@@ -34,30 +41,214 @@ bool MaxEnt::Train(const std::vector<Instance>& instances,
                    int32_t feature_cutoff) {
   // parameter estimation
   std::cerr << "parameter estimation ..." << std::endl;
-  model_data_.Clear();
+  std::shared_ptr<ModelData> model_data(new ModelData());
+  model_data->UseApproximateFeatureCounting(feature_count_error_rate_,
+                                            feature_count_confidence_);
+  model_data->UseFrequencyOrder(frequency_order_);
+  model_data->UseFeatureCrosses(cross_spec_, cross_hash_bits_);
   assert(optimizer_ != NULL);
 
+  optimizer_->UseDeduplication(deduplication_);
   optimizer_->EstimateParamater(instances,
                                 num_heldout,
                                 feature_cutoff,
-                                &model_data_);
+                                model_data.get());
 
   // count the number of active features
-  std::cerr << "number of active features = " << model_data_.NumActiveFeatures()
+  std::cerr << "number of active features = " << model_data->NumActiveFeatures()
+      << std::endl;
+  std::cerr << "memory of model: " << model_data->MemoryUsage().ToString()
       << std::endl;
   std::cerr << "parameter estimation done" << std::endl;
 
+  trained_model_ = model_data;
+  model_.Reset(model_data);
+  std::vector<MemInstance>().swap(instances_);  // not pointed to any more
+  return true;
+}
+
+bool MaxEnt::TrainFromText(std::istream* in,
+                           int32_t num_heldout,
+                           int32_t feature_cutoff) {
+  assert(in != NULL);
+  assert(optimizer_ != NULL);
+
+  std::shared_ptr<ModelData> model_data(new ModelData());
+  model_data->UseFeatureCrosses(cross_spec_, cross_hash_bits_);
+  if (pipelined_loading_) {
+    if (deduplication_ || frequency_order_) {
+      std::cerr << "error: deduplication and frequency order need the "
+          << "instances loaded before training." << std::endl;
+      return false;
+    }
+    std::cerr << "parameter estimation ..." << std::endl;
+    if (!optimizer_->EstimateParamaterFromText(in,
+                                               num_heldout,
+                                               feature_cutoff,
+                                               model_data.get())) {
+      return false;
+    }
+
+    std::cerr << "number of active features = "
+        << model_data->NumActiveFeatures() << std::endl;
+    std::cerr << "memory of model: " << model_data->MemoryUsage().ToString()
+        << std::endl;
+    std::cerr << "parameter estimation done" << std::endl;
+
+    // the optimizer keeps the instances, as of Train.
+    trained_model_ = model_data;
+    model_.Reset(model_data);
+    std::vector<MemInstance>().swap(instances_);
+    return true;
+  }
+
+  std::cerr << "loading instances ...";
+  std::vector<MemInstance> instances;
+  std::string line;
+  while (std::getline(*in, line)) {
+    instances.push_back(MemInstance());
+    if (!model_data->InternText(line, &instances.back())) {
+      instances.pop_back();
+    }
+  }
+  instances.shrink_to_fit();
+  std::cerr << "done" << std::endl;
+  if (num_heldout < 0
+      || num_heldout >= static_cast<int32_t>(instances.size())) {
+    std::cerr << "error: too much heldout data. no training data is available."
+        << std::endl;
+    return false;
+  }
+  size_t num_train = instances.size() - num_heldout;
+  if (deduplication_) {
+    std::cerr << "collapse duplicate instances...";
+    const size_t num_left
+        = common::CollapseDuplicateInstances(num_train, &instances);
+    std::cerr << "done, " << num_train << " -> " << num_left << std::endl;
+    num_train = num_left;
+  }
+  if (frequency_order_) {
+    std::cerr << "sorting feature names by frequency...";
+    model_data->UseFrequencyOrder(true);
+    model_data->SortFeatureNamesByFrequency(&instances);
+    std::cerr << "done" << std::endl;
+  }
+
+  size_t instances_bytes = common::MemoryBreakdown::Of(instances);
+  for (size_t n = 0; n < instances.size(); ++n) {
+    instances_bytes += instances[n].MemoryUsage();
+  }
+  std::cerr << "memory of instances: "
+      << common::MemoryBreakdown::Format(instances_bytes) << std::endl;
+
+  // the instances of the last training are released, since the optimizer
+  // points to the new ones from now on.
+  instances_.swap(instances);
+  std::vector<MemInstance>().swap(instances);
+  std::vector<const MemInstance*> train_data;
+  std::vector<const MemInstance*> heldout_data;
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    if (n < num_train) {
+      train_data.push_back(&instances_[n]);
+    } else {
+      heldout_data.push_back(&instances_[n]);
+    }
+  }
+
+  std::cerr << "parameter estimation ..." << std::endl;
+  optimizer_->EstimateParamater(train_data,
+                                heldout_data,
+                                feature_cutoff,
+                                model_data.get());
+
+  std::cerr << "number of active features = " << model_data->NumActiveFeatures()
+      << std::endl;
+  std::cerr << "memory of model: " << model_data->MemoryUsage().ToString()
+      << std::endl;
+  std::cerr << "parameter estimation done" << std::endl;
+
+  trained_model_ = model_data;
+  model_.Reset(model_data);
+  return true;
+}
+
+bool MaxEnt::RetrainWithL1Reg(double l1_reg) {
+  if (!trained_model_) {
+    std::cerr << "error: no model is trained before." << std::endl;
+    return false;
+  }
+  assert(optimizer_ != NULL);
+
+  // the current model may be in use, so a copy of it is optimized instead.
+  std::cerr << "parameter estimation with L1 regularization " << l1_reg
+      << " ..." << std::endl;
+  std::shared_ptr<ModelData> model_data(new ModelData(*trained_model_));
+  if (!optimizer_->ReestimateWithL1Reg(l1_reg, model_data.get())) {
+    return false;
+  }
+
+  std::cerr << "number of active features = " << model_data->NumActiveFeatures()
+      << std::endl;
+  std::cerr << "memory of model: " << model_data->MemoryUsage().ToString()
+      << std::endl;
+  std::cerr << "parameter estimation done" << std::endl;
+
+  trained_model_ = model_data;
+  model_.Reset(model_data);
+  return true;
+}
+
+bool MaxEnt::TrainFromStream(std::istream* in) {
+  std::cerr << "parameter estimation ..." << std::endl;
+  std::shared_ptr<ModelData> model_data(new ModelData());
+  model_data->UseFeatureCrosses(cross_spec_, cross_hash_bits_);
+  assert(optimizer_ != NULL);
+
+  if (!optimizer_->EstimateParamaterFromStream(in, model_data.get())) {
+    return false;
+  }
+
+  std::cerr << "number of classes = " << model_data->NumClasses() << std::endl;
+  std::cerr << "number of features = " << model_data->NumFeatures()
+      << std::endl;
+  std::cerr << "number of active features = " << model_data->NumActiveFeatures()
+      << std::endl;
+  std::cerr << "memory of model: " << model_data->MemoryUsage().ToString()
+      << std::endl;
+  std::cerr << "parameter estimation done" << std::endl;
+
+  trained_model_ = model_data;
+  model_.Reset(model_data);
   return true;
 }
 
 std::vector<double> MaxEnt::Predict(Instance* instance) const {
+  // hold the snapshot, so the model stays alive even if it is replaced, and
+  // its results are cached under its own version.
+  const ModelHandle::Snapshot snapshot = model_.Get();
+  const ModelHandle::ConstModelPtr& model_data = snapshot.model;
+  const uint64_t model_version = snapshot.version;
+
   MemInstance mem_instance;
-  model_data_.FormatInstance(*instance, &mem_instance);
+  model_data->FormatInstance(*instance, &mem_instance);
+
+  std::vector<double> prob_dist(model_data->NumClasses());
+  int32_t label_id = 0;
+  uint64_t key = 0;
+  if (prediction_cache_) {
+    std::vector<std::pair<uint64_t, uint64_t> > buffer;
+    key = PredictionCache::Key(mem_instance, &buffer);
+    if (prediction_cache_->Lookup(key, model_version, &prob_dist, &label_id)) {
+      instance->set_label(model_data->Label(label_id));
+      return prob_dist;
+    }
+  }
 
-  std::vector<double> prob_dist(model_data_.NumClasses());
-  int32_t label_id = model_data_.CalcConditionalProbability(mem_instance,
-                                                            &prob_dist);
-  instance->set_label(model_data_.Label(label_id));
+  label_id = model_data->CalcConditionalProbability(mem_instance, &prob_dist);
+  instance->set_label(model_data->Label(label_id));
+  if (prediction_cache_) {
+    prediction_cache_->Insert(key, model_version, prob_dist, label_id);
+  }
 
   return prob_dist;
 }
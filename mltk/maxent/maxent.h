@@ -123,11 +123,15 @@
 #ifndef MLTK_MAXENT_MAXENT_H_
 #define MLTK_MAXENT_MAXENT_H_
 
+#include <istream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "mltk/common/mem_instance.h"
 #include "mltk/common/model_data.h"
+#include "mltk/common/model_handle.h"
+#include "mltk/maxent/prediction_cache.h"
 
 namespace mltk {
 
@@ -141,13 +145,30 @@ namespace maxent {
 
 class Optimizer;
 
+// MaxEnt is safe to predict from many threads, while LoadModel, Train or
+// TrainFromStream replaces the model on another. The new model is built aside
+// and swapped in atomically, so a prediction never blocks and always sees one
+// consistent version of the model.
 class MaxEnt {
  public:
-  MaxEnt() : optimizer_(NULL) {}
-  explicit MaxEnt(Optimizer* optimizer) : optimizer_(optimizer) {}
+  MaxEnt() : optimizer_(NULL),
+             feature_count_error_rate_(0.0),
+             feature_count_confidence_(0.0),
+             deduplication_(false),
+             pipelined_loading_(false),
+             frequency_order_(false),
+             cross_hash_bits_(0) {}
+  explicit MaxEnt(Optimizer* optimizer)
+      : optimizer_(optimizer),
+        feature_count_error_rate_(0.0),
+        feature_count_confidence_(0.0),
+        deduplication_(false),
+        pipelined_loading_(false),
+        frequency_order_(false),
+        cross_hash_bits_(0) {}
   ~MaxEnt() {}
 
-  // Load model from file.
+  // Load model from file. On failure, the current model is kept.
   //
   // Line format: label_name \t feature_name \t weight(lambda)
   bool LoadModel(const std::string& filename);
@@ -155,16 +176,77 @@ class MaxEnt {
   // Save model to file.
   bool SaveModel(const std::string& filename) const;
 
-  int32_t NumClasses() const { return model_data_.NumClasses(); }
+  int32_t NumClasses() const { return model_.Get().model->NumClasses(); }
 
-  const common::ModelData& GetModelData() const { return model_data_; }
+  // Returns a snapshot of the current model, which is still valid after the
+  // model is replaced.
+  common::ModelHandle::ConstModelPtr GetModelData() const {
+    return model_.Get().model;
+  }
+
+  // Returns the current model with its version, to tag the results computed
+  // from it, e.g. in a cache.
+  common::ModelHandle::Snapshot GetModelSnapshot() const {
+    return model_.Get();
+  }
 
-  const std::string& GetClassLabel(int32_t label_id) const {
-    return model_data_.Label(label_id);
+  // The version of the current model, which increases by one every time the
+  // model is loaded or trained. A model read after it may be newer already,
+  // so tag results with the version of GetModelSnapshot() instead.
+  uint64_t ModelVersion() const { return model_.Get().version; }
+
+  std::string GetClassLabel(int32_t label_id) const {
+    return model_.Get().model->Label(label_id);
   }
 
   int32_t GetClassId(const std::string& label) const {
-    return model_data_.LabelId(label);
+    return model_.Get().model->LabelId(label);
+  }
+
+  // Use approximate feature counting for feature_cutoff in training, pls
+  // refer to common::ModelData::UseApproximateFeatureCounting.
+  void UseApproximateFeatureCounting(double error_rate, double confidence) {
+    assert(error_rate <= 0 || (confidence > 0 && confidence < 1));
+    feature_count_error_rate_ = error_rate;
+    feature_count_confidence_ = confidence;
+  }
+
+  // Collapse the duplicate training instances into one weighted instance
+  // each before training, pls refer to common::CollapseDuplicateInstances.
+  // The model is the same as trained on the duplicates, but every iteration
+  // goes over the distinct instances only, which pays off on the corpora of
+  // many repeated instances, e.g. short queries or clicks.
+  void UseDeduplication(bool deduplication) { deduplication_ = deduplication; }
+
+  // Number the features, and the feature names, of the trained model in the
+  // descending order of their frequency in the instances, pls refer to
+  // common::ModelData::UseFrequencyOrder, so the lambdas of the hottest
+  // features are next to each other in training and prediction. Train and
+  // TrainFromText support it, but no pipelined loading.
+  void UseFrequencyOrder(bool frequency_order) {
+    frequency_order_ = frequency_order;
+  }
+
+  // Cross the features of the pairs of namespaces in spec, hashed into
+  // 2^hash_bits buckets, in the models trained, pls refer to
+  // common::ModelData::UseFeatureCrosses. The crosses are saved with the
+  // model, so the loaded one predicts with them too. Returns false if spec or
+  // hash_bits is invalid.
+  bool UseFeatureCrosses(const std::string& spec, int32_t hash_bits) {
+    common::ModelData model_data;
+    if (!model_data.UseFeatureCrosses(spec, hash_bits)) { return false; }
+    cross_spec_ = spec;
+    cross_hash_bits_ = hash_bits;
+    return true;
+  }
+
+  // Let TrainFromText train the first iteration on the instances read so far
+  // while a reader thread interns the rest, pls refer to
+  // Optimizer::EstimateParamaterFromText, so the first model is ready about
+  // when the slower of loading and an iteration is done, rather than both.
+  // Only SGD supports it, and no deduplication.
+  void UsePipelinedLoading(bool pipelined_loading) {
+    pipelined_loading_ = pipelined_loading;
   }
 
   // Training
@@ -172,13 +254,62 @@ class MaxEnt {
              int32_t num_heldout = 0,
              int32_t feature_cutoff = 0);
 
+  // Training in a single pass over the instances read from in, one instance
+  // per line, which needs an online optimizer, e.g. FTRL.
+  bool TrainFromStream(std::istream* in);
+
+  // Training on the instances read from in, one instance per line, of which
+  // the last num_heldout are heldout. Unlike Train, the labels and feature
+  // names are interned while parsing, so only one copy of every string is
+  // kept, in the model, and the instances are kept as ids and values, which
+  // take a fraction of the memory of common::Instance. The features are
+  // counted for feature_cutoff on the training instances, and exactly.
+  bool TrainFromText(std::istream* in,
+                     int32_t num_heldout = 0,
+                     int32_t feature_cutoff = 0);
+
+  // Retrains the model of the last Train on the same instances, which must
+  // still be alive, or of the last TrainFromText, with another L1
+  // regularization, warm-started from the lambdas of that model. Retraining
+  // along a decreasing sequence of l1_reg, a.k.a. the L1 regularization path,
+  // takes a fraction of the iterations of training every model from scratch.
+  // Only OWLQN and SGD support it.
+  bool RetrainWithL1Reg(double l1_reg);
+
+  // Cache the predictions of up to capacity feature vectors for ttl (0 for
+  // ever), pls refer to PredictionCache. The cache is invalidated whenever
+  // the model is replaced.
+  void UsePredictionCache(size_t capacity, std::chrono::milliseconds ttl) {
+    prediction_cache_.reset(new PredictionCache(capacity, ttl));
+  }
+
+  // NULL if no cache is used.
+  PredictionCache* GetPredictionCache() const {
+    return prediction_cache_.get();
+  }
+
   // Predict
   std::vector<double> Predict(common::Instance* instance) const;
 
  private:
   Optimizer* optimizer_;  // the optimization algorithm
 
-  common::ModelData model_data_;  // the maxent model
+  common::ModelHandle model_;  // the current maxent model
+
+  // the model last estimated by optimizer_, which it still points to.
+  std::shared_ptr<common::ModelData> trained_model_;
+
+  // the instances of the last TrainFromText, which optimizer_ points to.
+  std::vector<common::MemInstance> instances_;
+  std::unique_ptr<PredictionCache> prediction_cache_;
+
+  double feature_count_error_rate_;
+  double feature_count_confidence_;
+  bool deduplication_;
+  bool pipelined_loading_;
+  bool frequency_order_;
+  std::string cross_spec_;  // of the feature crosses, empty for none
+  int32_t cross_hash_bits_;
 };
 
 }  // namespace maxent
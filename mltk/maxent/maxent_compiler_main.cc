@@ -0,0 +1,50 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mltk/common/model_data.h"
+#include "mltk/maxent/model_compiler.h"
+
+DEFINE_string(model_file, "", "the filename of maxent model.");
+DEFINE_string(output_file, "",
+              "the filename of the compiled C++ header, empty for stdout.");
+DEFINE_string(cpp_namespace, "maxent_model",
+              "the C++ namespace of the compiled model, e.g. spam::model.");
+
+int main(int argc, char** argv) {
+  ::google::ParseCommandLineFlags(&argc, &argv, true);
+
+  mltk::common::ModelData model_data;
+  CHECK(model_data.Load(FLAGS_model_file));
+  LOG(INFO) << "Compile the model of " << model_data.NumClasses()
+      << " labels and " << model_data.NumFeatureNames()
+      << " feature names into namespace " << FLAGS_cpp_namespace;
+
+  if (FLAGS_output_file.empty()) {
+    return mltk::maxent::CompileModel(model_data, FLAGS_cpp_namespace,
+                                      FLAGS_model_file, &std::cout) ? 0 : -1;
+  }
+
+  std::ofstream fout(FLAGS_output_file.c_str());
+  if (!fout) {
+    LOG(ERROR) << "Can't open output file '" << FLAGS_output_file << "'";
+    return -1;
+  }
+  if (!mltk::maxent::CompileModel(model_data, FLAGS_cpp_namespace,
+                                  FLAGS_model_file, &fout)) {
+    return -1;
+  }
+  fout.close();
+  if (!fout) {
+    LOG(ERROR) << "Can't write output file '" << FLAGS_output_file << "'";
+    return -1;
+  }
+
+  return 0;
+}
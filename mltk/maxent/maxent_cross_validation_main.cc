@@ -0,0 +1,153 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/cross_validation.h"
+
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "common/base/string/algorithm.h"
+
+DEFINE_string(train_data_file, "",
+              "the filename of training data, '-' for stdin.");
+DEFINE_int32(num_folds, 5, "the number of folds.");
+DEFINE_int32(num_threads, 4, "the number of models trained concurrently.");
+DEFINE_int32(seed, 0, "the random seed of assigning instances to folds.");
+DEFINE_int32(num_iterations, 100, "the total iterations.");
+DEFINE_double(sgd_learning_rate, 1.0, "the learning rate of SGD.");
+DEFINE_double(ftrl_alpha, 0.1, "the learning rate of FTRL and ADAGRAD.");
+DEFINE_double(ftrl_beta, 1.0,
+              "the learning rate smoothing of FTRL and ADAGRAD.");
+
+// the grid, every point of which is one combination of the values below.
+DEFINE_string(optim_method, "LBFGS",
+              "the comma-separated optimization methods, of LBFGS, OWLQN, "
+              "TRON, SGD, SVRG, FTRL and ADAGRAD.");
+DEFINE_string(l1_reg, "0", "the comma-separated L1 regularizations, for "
+              "OWLQN, SGD and FTRL.");
+DEFINE_string(l2_reg, "0", "the comma-separated L2 regularizations, for "
+              "LBFGS, TRON, SVRG and FTRL.");
+DEFINE_string(feature_cutoff, "1",
+              "the comma-separated minmum frequencies of feature.");
+DEFINE_string(newton_m, "10", "the comma-separated cache sizes for newton "
+              "methods, OWLQN and LBFGS.");
+
+using mltk::maxent::CrossValidation;
+
+static std::vector<std::string> SplitList(const std::string& list) {
+  std::vector<std::string> values;
+  common::SplitString(list, ",", &values);
+  if (values.empty()) { LOG(FATAL) << "Empty list of values : " << list; }
+  return values;
+}
+
+static std::vector<double> SplitDoubles(const std::string& list) {
+  std::vector<std::string> strs = SplitList(list);
+  std::vector<double> values;
+  for (size_t i = 0; i < strs.size(); ++i) {
+    values.push_back(atof(strs[i].c_str()));
+  }
+  return values;
+}
+
+static std::vector<int32_t> SplitInts(const std::string& list) {
+  std::vector<std::string> strs = SplitList(list);
+  std::vector<int32_t> values;
+  for (size_t i = 0; i < strs.size(); ++i) {
+    values.push_back(atoi(strs[i].c_str()));
+  }
+  return values;
+}
+
+// The values of a regularizer which the method does not use collapse into a
+// single zero, so no point of the grid is trained twice.
+static std::vector<double> ValuesFor(const std::vector<double>& values,
+                                     bool used) {
+  return used ? values : std::vector<double>(1, 0.0);
+}
+
+int main(int argc, char** argv) {
+  ::google::ParseCommandLineFlags(&argc, &argv, true);
+
+  const std::vector<std::string> methods = SplitList(FLAGS_optim_method);
+  const std::vector<double> l1_regs = SplitDoubles(FLAGS_l1_reg);
+  const std::vector<double> l2_regs = SplitDoubles(FLAGS_l2_reg);
+  const std::vector<int32_t> feature_cutoffs = SplitInts(FLAGS_feature_cutoff);
+  const std::vector<int32_t> newton_ms = SplitInts(FLAGS_newton_m);
+
+  std::vector<CrossValidation::Params> grid;
+  for (size_t i = 0; i < methods.size(); ++i) {
+    const std::string& method = methods[i];
+    const bool newton = (method == "LBFGS" || method == "OWLQN");
+    const std::vector<double> method_l1_regs = ValuesFor(
+        l1_regs, method == "OWLQN" || method == "SGD" || method == "FTRL");
+    const std::vector<double> method_l2_regs = ValuesFor(
+        l2_regs, method == "LBFGS" || method == "TRON" || method == "SVRG"
+                 || method == "FTRL");
+    // likewise newton_m, into its first value.
+    const std::vector<int32_t> method_newton_ms
+        = newton ? newton_ms : std::vector<int32_t>(1, newton_ms[0]);
+
+    for (size_t j = 0; j < method_l1_regs.size(); ++j) {
+      for (size_t k = 0; k < method_l2_regs.size(); ++k) {
+        for (size_t l = 0; l < feature_cutoffs.size(); ++l) {
+          for (size_t m = 0; m < method_newton_ms.size(); ++m) {
+            CrossValidation::Params params;
+            params.optim_method = method;
+            params.num_iterations = FLAGS_num_iterations;
+            params.newton_m = method_newton_ms[m];
+            params.sgd_learning_rate = FLAGS_sgd_learning_rate;
+            params.ftrl_alpha = FLAGS_ftrl_alpha;
+            params.ftrl_beta = FLAGS_ftrl_beta;
+            params.l1_reg = method_l1_regs[j];
+            params.l2_reg = method_l2_regs[k];
+            params.feature_cutoff = feature_cutoffs[l];
+            grid.push_back(params);
+          }
+        }
+      }
+    }
+  }
+
+  CrossValidation cross_validation(FLAGS_num_folds, FLAGS_num_threads,
+                                   FLAGS_seed);
+
+  std::ifstream fin;
+  std::istream* in = &std::cin;
+  if (FLAGS_train_data_file != "-") {
+    fin.open(FLAGS_train_data_file.c_str());
+    if (!fin) {
+      LOG(ERROR) << "Can't open train_data file '" << FLAGS_train_data_file
+          << "'";
+      return -1;
+    }
+    in = &fin;
+  }
+  LOG(INFO) << "Load training data from " << FLAGS_train_data_file;
+  cross_validation.LoadFromStream(in);
+  if (fin.is_open()) { fin.close(); }
+  LOG(INFO) << cross_validation.NumInstances() << " instances of "
+      << cross_validation.NumClasses() << " classes.";
+
+  LOG(INFO) << "Cross-validate " << grid.size() << " points in "
+      << FLAGS_num_folds << " folds on " << FLAGS_num_threads << " threads.";
+  std::vector<CrossValidation::Result> results;
+  if (!cross_validation.Run(grid, &results)) { return -1; }
+
+  CrossValidation::PrintResults(results, &std::cout);
+
+  size_t best = 0;
+  for (size_t i = 1; i < results.size(); ++i) {
+    if (results[i].heldout_logl > results[best].heldout_logl) { best = i; }
+  }
+  LOG(INFO) << "The best point by heldout likelihood is #" << best + 1
+      << " of the table.";
+
+  return 0;
+}
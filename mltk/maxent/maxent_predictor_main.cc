@@ -4,7 +4,10 @@
 #include "mltk/maxent/maxent.h"
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
 #include <fstream>
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -13,15 +16,62 @@
 
 #include "common/base/string/algorithm.h"
 #include "mltk/common/instance.h"
+#include "mltk/maxent/prediction_server.h"
 
 DEFINE_string(test_data_file, "", "the filename of test data.");
 DEFINE_string(model_file, "", "the filename of maxent model.");
+DEFINE_string(server_mode, "",
+              "run as a prediction server instead of testing, 'stdio' for "
+              "requests on stdin and answers on stdout, or 'unix' for a unix "
+              "domain socket.");
+DEFINE_string(socket_path, "/tmp/maxent.sock",
+              "the unix domain socket path of server_mode 'unix'.");
+DEFINE_int32(num_threads, 4, "the number of prediction threads of server.");
+DEFINE_int32(max_batch_size, 32, "the most requests in a batch of server.");
+DEFINE_int32(max_batch_delay_us, 200,
+             "the longest wait in microseconds for a batch to fill.");
+DEFINE_int32(cache_capacity, 0,
+             "the number of predictions to cache, 0 for no cache.");
+DEFINE_int32(cache_ttl_ms, 0,
+             "the time to live in milliseconds of a cached prediction, 0 for "
+             "ever.");
+
+namespace {
+
+int RunServer(mltk::maxent::MaxEnt* maxent) {
+  mltk::maxent::PredictionServer::Options options;
+  options.num_threads = FLAGS_num_threads;
+  options.max_batch_size = FLAGS_max_batch_size;
+  options.max_batch_delay_us = FLAGS_max_batch_delay_us;
+  mltk::maxent::PredictionServer server(maxent, options);
+
+  if (FLAGS_server_mode == "stdio") {
+    server.Serve(STDIN_FILENO, STDOUT_FILENO);
+  } else if (FLAGS_server_mode == "unix") {
+    LOG(INFO) << "Listen on " << FLAGS_socket_path;
+    if (!server.ServeUnixSocket(FLAGS_socket_path)) { return -1; }
+  } else {
+    LOG(ERROR) << "Invalid server mode : " << FLAGS_server_mode;
+    return -1;
+  }
+  LOG(INFO) << server.Stats();
+
+  return 0;
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
   ::google::ParseCommandLineFlags(&argc, &argv, true);
 
   mltk::maxent::MaxEnt maxent;
   CHECK(maxent.LoadModel(FLAGS_model_file));
+  if (FLAGS_cache_capacity > 0) {
+    maxent.UsePredictionCache(FLAGS_cache_capacity,
+                              std::chrono::milliseconds(FLAGS_cache_ttl_ms));
+  }
+
+  if (!FLAGS_server_mode.empty()) { return RunServer(&maxent); }
 
   int32_t ncorrect = 0;
   int32_t ntotal = 0;
@@ -45,6 +95,10 @@ int main(int argc, char** argv) {
   }
   fin.close();
 
+  if (maxent.GetPredictionCache() != NULL) {
+    LOG(INFO) << "cache hit rate = "
+        << maxent.GetPredictionCache()->HitRate();
+  }
   LOG(ERROR) << "accuracy(" << ncorrect << " / " << ntotal << "): "
       << static_cast<double>(ncorrect) / ntotal;
 
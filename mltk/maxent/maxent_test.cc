@@ -3,23 +3,87 @@
 
 #include "mltk/maxent/maxent.h"
 
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 
 #include <gtest/gtest.h>
 #include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/maxent/cross_validation.h"
+#include "mltk/maxent/expansion_cache.h"
+#include "mltk/maxent/ftrl.h"
 #include "mltk/maxent/lbfgs.h"
 #include "mltk/maxent/optimizer.h"
 #include "mltk/maxent/owlqn.h"
+#include "mltk/maxent/parallel_expectation.h"
+#include "mltk/maxent/parameter_mixing.h"
+#include "mltk/maxent/prediction_cache.h"
+#include "mltk/maxent/prediction_server.h"
 #include "mltk/maxent/sgd.h"
+#include "mltk/maxent/svrg.h"
+#include "mltk/maxent/tron.h"
 
 using mltk::common::Instance;
+using mltk::common::MemInstance;
+using mltk::maxent::CrossValidation;
+using mltk::maxent::FTRL;
 using mltk::maxent::LBFGS;
 using mltk::maxent::MaxEnt;
 using mltk::maxent::Optimizer;
 using mltk::maxent::OWLQN;
+using mltk::maxent::ParallelExpectation;
+using mltk::maxent::ParameterMixing;
+using mltk::maxent::PredictionCache;
+using mltk::maxent::PredictionServer;
 using mltk::maxent::SGD;
+using mltk::maxent::SVRG;
+using mltk::maxent::TRON;
 
 const static std::string kModelFile = "maxent.model";
+const static double kEpsilon = 1E-6;
+
+namespace {
+
+// num_instances lines of 3 labels, of a cue each and 4 noisy features out of
+// 13, whose values are 0.2 to 0.8 if real_valued, or 1 otherwise. Unless
+// separable, every 4th instance lacks its cue, so the weights of the cues do
+// not grow without bound under a weak regularizer.
+std::string SyntheticText(int32_t num_instances, bool real_valued,
+                          bool separable) {
+  std::ostringstream text;
+  for (int32_t n = 0; n < num_instances; ++n) {
+    text << "label" << n % 3;
+    for (int32_t k = 0; k < 4; ++k) {
+      text << "\tfeature" << (n * 7 + k * 5) % 13 << ":"
+           << (real_valued ? 0.2 * (k + 1) : 1.0);
+    }
+    if (separable || n % 4 != 0) { text << "\tlabel" << n % 3 << "_cue:1"; }
+    text << "\n";
+  }
+  return text.str();
+}
+
+// the instances of the lines of text.
+std::vector<Instance> ParseInstances(const std::string& text) {
+  std::vector<Instance> instances;
+  std::istringstream stream(text);
+  std::string line;
+  while (std::getline(stream, line)) {
+    instances.push_back(Instance());
+    EXPECT_TRUE(instances.back().ParseFromText(line));
+  }
+  return instances;
+}
+
+}  // namespace
 
 TEST(MaxEnt, TrainUsingSGD) {
   Optimizer* optim = new SGD(50, 1);
@@ -116,11 +180,304 @@ TEST(MaxEnt, TrainUsingOWLQN) {
   ASSERT_TRUE(maxent1.LoadModel(kModelFile));
 
   EXPECT_EQ(2, maxent1.NumClasses());
-  // reestablish a mapping table
-  EXPECT_EQ(0, maxent1.GetClassId("Finance"));
-  EXPECT_EQ(1, maxent1.GetClassId("IT"));
-  EXPECT_EQ("Finance", maxent1.GetClassLabel(0));
-  EXPECT_EQ("IT", maxent1.GetClassLabel(1));
+  // reestablish a mapping table, by the first feature saved: (IT, Apple)
+  EXPECT_EQ(0, maxent1.GetClassId("IT"));
+  EXPECT_EQ(1, maxent1.GetClassId("Finance"));
+  EXPECT_EQ("IT", maxent1.GetClassLabel(0));
+  EXPECT_EQ("Finance", maxent1.GetClassLabel(1));
+
+  delete optim;
+}
+
+TEST(MaxEnt, TrainUsingOWLQNWithActiveSet) {
+  // 4 labels of a cue each and many noisy features, most of which a strong L1
+  // keeps zero.
+  std::vector<Instance> instances;
+  for (int32_t n = 0; n < 400; ++n) {
+    std::ostringstream label;
+    label << "label" << n % 4;
+    Instance instance(label.str());
+    if (n % 5 != 0) { instance.AddFeature("cue_" + label.str(), 1.0); }
+    for (int32_t k = 0; k < 6; ++k) {
+      std::ostringstream feature_name;
+      feature_name << "feature" << (n * 7 + k * 13 + (n % 4) * k) % 97;
+      instance.AddFeature(feature_name.str(), 1.0);
+    }
+    instances.push_back(instance);
+  }
+
+  std::vector<mltk::common::Scalar> lambdas[2];
+  for (int32_t screening = 0; screening < 2; ++screening) {
+    OWLQN optim(200, 10);
+    optim.UseL1Reg(4);
+    optim.UseConvergenceTolerance(1E-8);
+    optim.UseActiveSet(screening == 1 ? 5 : 0);
+    mltk::common::ModelData model_data;
+    optim.EstimateParamater(instances, 0, 0, &model_data);
+    lambdas[screening] = model_data.Lambdas();
+  }
+
+  // the same solution, though the screened out features are never updated.
+  ASSERT_EQ(lambdas[0].size(), lambdas[1].size());
+  int32_t num_active = 0;
+  for (size_t i = 0; i < lambdas[0].size(); ++i) {
+    EXPECT_NEAR(lambdas[0][i], lambdas[1][i], 1E-2);
+    if (lambdas[1][i] != 0) { ++num_active; }
+  }
+  EXPECT_GT(num_active, 0);
+  EXPECT_LT(num_active, static_cast<int32_t>(lambdas[0].size()) / 2);
+}
+
+TEST(MaxEnt, TrainFromTextUsingOWLQN) {
+  Optimizer* optim = new OWLQN(100, 10);
+  optim->UseL1Reg(0.1);
+  MaxEnt maxent(optim);
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 10; ++i) {
+    stream << "IT\tApple:0.68\tipad:0.5\n";
+    stream << "Finance\tWall Street:0.8\tQE:0.9\n";
+    stream << "Sports\tNBA\n";  // malformed, and skipped
+  }
+  ASSERT_TRUE(maxent.TrainFromText(&stream, 2, 0));
+
+  EXPECT_EQ(2, maxent.NumClasses());
+  EXPECT_EQ(0, maxent.GetClassId("IT"));
+  EXPECT_EQ(1, maxent.GetClassId("Finance"));
+  EXPECT_EQ(4, maxent.GetModelData()->NumFeatures());
+
+  Instance instance("IT");
+  instance.AddFeature("Wall Street", 0.8);
+  instance.AddFeature("QE", 0.9);
+  maxent.Predict(&instance);
+  EXPECT_EQ("Finance", instance.label());
+
+  // the instances are kept for retraining.
+  const int32_t num_active_features
+      = maxent.GetModelData()->NumActiveFeatures();
+  ASSERT_TRUE(maxent.RetrainWithL1Reg(0.01));
+  EXPECT_LE(num_active_features, maxent.GetModelData()->NumActiveFeatures());
+
+  std::stringstream heldout_only;
+  heldout_only << "IT\tApple:1\n";
+  EXPECT_FALSE(maxent.TrainFromText(&heldout_only, 1, 0));
+
+  delete optim;
+}
+
+TEST(MaxEnt, TrainFromTextWithDeduplication) {
+  // distinct instances repeated unevenly, with their features in any order.
+  std::string text;
+  for (int32_t i = 0; i < 6; ++i) {
+    text += "IT\tApple:0.68\tipad:0.5\n";
+    text += (i % 2 == 0 ? "IT\tipad:0.5\tApple:0.68\n" : "IT\tipad:0.9\n");
+    if (i % 3 == 0) { text += "Finance\tWall Street:0.8\tQE:0.9\n"; }
+    text += "Finance\tQE:0.9\tApple:0.2\n";
+    if (i % 3 == 0) { text += "Sports\tNBA:1\tipad:0.3\n"; }
+  }
+  text += "IT\tApple:0.68\n";  // heldout
+
+  std::vector<std::vector<double> > probs[2];
+  for (int32_t dedup = 0; dedup < 2; ++dedup) {
+    Optimizer* optim = new OWLQN(100, 10);
+    optim->UseL1Reg(0.1);
+    MaxEnt maxent(optim);
+    maxent.UseDeduplication(dedup == 1);
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 1, 0));
+
+    Instance apple("IT");
+    apple.AddFeature("Apple", 0.68);
+    probs[dedup].push_back(maxent.Predict(&apple));
+    Instance mixed("IT");
+    mixed.AddFeature("QE", 0.9);
+    mixed.AddFeature("ipad", 0.3);
+    probs[dedup].push_back(maxent.Predict(&mixed));
+    delete optim;
+  }
+
+  // the same model as trained on the duplicates.
+  for (size_t i = 0; i < probs[0].size(); ++i) {
+    ASSERT_EQ(probs[0][i].size(), probs[1][i].size());
+    for (size_t k = 0; k < probs[0][i].size(); ++k) {
+      EXPECT_NEAR(probs[0][i][k], probs[1][i][k], 1E-4);
+    }
+  }
+}
+
+TEST(MaxEnt, TrainFromTextUsingPipelinedSGD) {
+  // more instances than a batch of the reader, and a label and a feature
+  // name of the heldout instances only.
+  std::string text;
+  for (int32_t i = 0; i < 1500; ++i) {
+    text += "IT\tApple:0.68\tipad:0.5\n";
+    text += "Finance\tWall Street:0.8\tQE:0.9\n";
+    if (i == 500) { text += "Finance\tApple:1\trare:1\n"; }
+  }
+  text += "Sports\tNBA:1\n";
+  text += "IT\tApple:0.68\n";
+  text += "Sports\tNBA\n";  // malformed, and skipped
+
+  SGD loaded_sgd(3, 1);
+  MaxEnt loaded(&loaded_sgd);
+  std::stringstream loaded_stream(text);
+  ASSERT_TRUE(loaded.TrainFromText(&loaded_stream, 2, 1));
+
+  SGD* sgd = new SGD(3, 1);
+  sgd->UseL1Reg(0.1);
+  MaxEnt maxent(sgd);
+  maxent.UsePipelinedLoading(true);
+  std::stringstream stream(text);
+  ASSERT_TRUE(maxent.TrainFromText(&stream, 2, 1));
+  EXPECT_EQ(3, sgd->NumIterations());
+
+  // the features of the loaded instances, by feature_cutoff, which cuts off
+  // (Finance, Apple) and (Finance, rare).
+  EXPECT_EQ(3, maxent.NumClasses());
+  EXPECT_EQ(2, maxent.GetClassId("Sports"));
+  EXPECT_EQ(4, maxent.GetModelData()->NumFeatures());
+  EXPECT_EQ(loaded.GetModelData()->NumFeatures(),
+            maxent.GetModelData()->NumFeatures());
+  EXPECT_EQ(0u, maxent.GetModelData()->FeatureIds(
+      maxent.GetModelData()->FeatureNameId("NBA")).size());
+
+  Instance instance("IT");
+  instance.AddFeature("Wall Street", 0.8);
+  instance.AddFeature("QE", 0.9);
+  maxent.Predict(&instance);
+  EXPECT_EQ("Finance", instance.label());
+
+  // the instances are kept for retraining.
+  ASSERT_TRUE(maxent.RetrainWithL1Reg(0.01));
+  instance.AddFeature("Apple", 0.68);
+  instance.AddFeature("ipad", 0.5);
+  maxent.Predict(&instance);
+  EXPECT_EQ("Finance", instance.label());
+
+  std::stringstream heldout_only("IT\tApple:1\n");
+  EXPECT_FALSE(maxent.TrainFromText(&heldout_only, 1, 0));
+
+  maxent.UseDeduplication(true);
+  std::stringstream deduplicated(text);
+  EXPECT_FALSE(maxent.TrainFromText(&deduplicated, 2, 1));
+
+  delete sgd;
+}
+
+TEST(MaxEnt, RetrainWithL1RegUsingOWLQN) {
+  Optimizer* optim = new OWLQN(300, 10);
+  optim->UseL1Reg(10);
+  optim->UseConvergenceTolerance(1e-6);
+
+  MaxEnt maxent(optim);
+  EXPECT_FALSE(maxent.RetrainWithL1Reg(1));
+
+  std::vector<Instance> instances;
+  for (int32_t i = 0; i < 10; ++i) {
+    Instance instance1("IT");
+    instance1.AddFeature("Apple", 0.68);
+    instance1.AddFeature("ipad", 0.5 + i * 0.01);
+    instances.push_back(instance1);
+
+    Instance instance2("Finance");
+    instance2.AddFeature("Wall Street", 0.8);
+    instance2.AddFeature("Apple", 0.2 + i * 0.01);
+    instances.push_back(instance2);
+  }
+  ASSERT_TRUE(maxent.Train(instances, 4, 0));
+  const int32_t num_active_features
+      = maxent.GetModelData()->NumActiveFeatures();
+  double logl = 0.0;
+  double accuracy = 0.0;
+  ASSERT_TRUE(optim->EvaluateHeldout(&logl, &accuracy));
+
+  // a weaker regularizer keeps more features and fits better, and the first
+  // model is still intact.
+  mltk::common::ModelHandle::ConstModelPtr model_data = maxent.GetModelData();
+  ASSERT_TRUE(maxent.RetrainWithL1Reg(0.1));
+  EXPECT_GT(maxent.GetModelData()->NumActiveFeatures(), num_active_features);
+  EXPECT_EQ(num_active_features, model_data->NumActiveFeatures());
+  double path_logl = 0.0;
+  ASSERT_TRUE(optim->EvaluateHeldout(&path_logl, &accuracy));
+  EXPECT_GT(path_logl, logl);
+  EXPECT_NEAR(1.0, accuracy, kEpsilon);
+  EXPECT_GT(optim->NumIterations(), 0);
+  EXPECT_LT(optim->NumIterations(), 300);
+
+  delete optim;
+}
+
+TEST(MaxEnt, TrainUsingFTRL) {
+  Optimizer* optim = new FTRL(FTRL::FTRL_PROXIMAL, 50, 0.5, 1.0);
+  optim->UseL1Reg(0.1);
+  optim->UseL2Reg(0.1);
+
+  MaxEnt maxent(optim);
+  EXPECT_EQ(0, maxent.NumClasses());
+
+  std::vector<Instance> instances;
+  Instance instance1("IT");
+  instance1.AddFeature("Apple", 0.68);
+  instance1.AddFeature("ipad", 0.5);
+  instances.push_back(instance1);
+  instances.push_back(instance1);
+
+  Instance instance2("IT");
+  instance2.AddFeature("Macbook Air", 0.8);
+  instance2.AddFeature("iphone 4s", 0.9);
+  instances.push_back(instance2);
+  instances.push_back(instance2);
+
+  Instance instance3("Finance");
+  instance3.AddFeature("Wall Street", 0.8);
+  instance3.AddFeature("QE", 0.9);
+  instance3.AddFeature("stock", 0.88);
+  instances.push_back(instance3);
+  instances.push_back(instance3);
+
+  ASSERT_TRUE(maxent.Train(instances, 0, 0));
+
+  EXPECT_EQ(2, maxent.NumClasses());
+
+  EXPECT_EQ(0, maxent.GetClassId("IT"));
+  EXPECT_EQ(1, maxent.GetClassId("Finance"));
+  EXPECT_EQ("IT", maxent.GetClassLabel(0));
+  EXPECT_EQ("Finance", maxent.GetClassLabel(1));
+
+  Instance instance4("Finance");
+  instance4.AddFeature("Apple", 1.0);
+  instance4.AddFeature("ipad", 1.0);
+  maxent.Predict(&instance4);
+  EXPECT_EQ("IT", instance4.label());
+
+  delete optim;
+}
+
+TEST(MaxEnt, TrainFromStreamUsingAdaGrad) {
+  Optimizer* optim = new FTRL(FTRL::ADAGRAD, 1, 0.5, 1.0);
+
+  MaxEnt maxent(optim);
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 20; ++i) {
+    stream << "IT\tApple:0.68\tipad:0.5\n";
+    stream << "Finance\tWall Street:0.8\tQE:0.9\tstock:0.88\n";
+    stream << "IT\tMacbook Air:0.8\tiphone 4s:0.9\n";
+  }
+  ASSERT_TRUE(maxent.TrainFromStream(&stream));
+
+  EXPECT_EQ(2, maxent.NumClasses());
+  EXPECT_EQ(0, maxent.GetClassId("IT"));
+  EXPECT_EQ(1, maxent.GetClassId("Finance"));
+
+  Instance instance("IT");
+  instance.AddFeature("Wall Street", 0.8);
+  instance.AddFeature("QE", 0.9);
+  maxent.Predict(&instance);
+  EXPECT_EQ("Finance", instance.label());
+
+  std::stringstream empty_stream;
+  EXPECT_FALSE(maxent.TrainFromStream(&empty_stream));
 
   delete optim;
 }
@@ -177,7 +534,58 @@ TEST(MaxEnt, TrainUsingLBFGS) {
   delete optim;
 }
 
-const static double kEpsilon = 1E-6;
+TEST(MaxEnt, TrainUsingTRON) {
+  const std::vector<Instance> instances
+      = ParseInstances(SyntheticText(300, true, false));
+
+  // the same L2 solution as LBFGS, in fewer iterations.
+  LBFGS lbfgs(500, 10);
+  lbfgs.UseL2Reg(1);
+  lbfgs.UseConvergenceTolerance(1E-10);
+  mltk::common::ModelData expected;
+  lbfgs.EstimateParamater(instances, 0, 0, &expected);
+
+  TRON tron(100);
+  tron.UseL2Reg(1);
+  mltk::common::ModelData model_data;
+  tron.EstimateParamater(instances, 0, 0, &model_data);
+  EXPECT_LT(tron.NumIterations(), lbfgs.NumIterations());
+  EXPECT_GT(tron.NumDataPasses(), tron.NumIterations());
+
+  ASSERT_EQ(expected.NumFeatures(), model_data.NumFeatures());
+  for (int32_t i = 0; i < model_data.NumFeatures(); ++i) {
+    EXPECT_NEAR(expected.Lambdas()[i], model_data.Lambdas()[i], 1E-3);
+  }
+}
+
+TEST(MaxEnt, TrainUsingSVRG) {
+  // binary features, of many duplicates and the first 100 instances
+  // repeated. SVRG collapses them into weighted instances, which it draws by
+  // weight.
+  std::vector<Instance> instances
+      = ParseInstances(SyntheticText(300, false, false));
+  for (int32_t n = 0; n < 100; ++n) { instances.push_back(instances[n]); }
+
+  // close to the L2 solution of LBFGS on the repeated ones, in a few passes.
+  LBFGS lbfgs(500, 10);
+  lbfgs.UseL2Reg(1);
+  lbfgs.UseConvergenceTolerance(1E-10);
+  mltk::common::ModelData expected;
+  lbfgs.EstimateParamater(instances, 0, 0, &expected);
+
+  SVRG svrg(15);
+  svrg.UseL2Reg(1);
+  svrg.UseDeduplication(true);
+  mltk::common::ModelData model_data;
+  svrg.EstimateParamater(instances, 0, 0, &model_data);
+  EXPECT_GE(30, svrg.NumDataPasses());
+
+  ASSERT_EQ(expected.NumFeatures(), model_data.NumFeatures());
+  for (int32_t i = 0; i < model_data.NumFeatures(); ++i) {
+    EXPECT_NEAR(expected.Lambdas()[i], model_data.Lambdas()[i], 1E-2);
+  }
+}
+
 TEST(MaxEnt, Predict) {
   MaxEnt maxent;
   ASSERT_TRUE(maxent.LoadModel(kModelFile));
@@ -205,3 +613,670 @@ TEST(MaxEnt, Predict) {
               kEpsilon);
 }
 
+
+TEST(MaxEnt, ReloadModel) {
+  MaxEnt maxent;
+  EXPECT_EQ(0u, maxent.ModelVersion());
+  ASSERT_TRUE(maxent.LoadModel(kModelFile));
+  EXPECT_EQ(1u, maxent.ModelVersion());
+
+  mltk::common::ModelHandle::ConstModelPtr model_data = maxent.GetModelData();
+  ASSERT_TRUE(maxent.LoadModel(kModelFile));
+  EXPECT_EQ(2u, maxent.ModelVersion());
+  EXPECT_NE(model_data.get(), maxent.GetModelData().get());
+  EXPECT_EQ(2, model_data->NumClasses());
+
+  // a failed reload keeps the current model.
+  EXPECT_FALSE(maxent.LoadModel("no_such.model"));
+  EXPECT_EQ(2u, maxent.ModelVersion());
+  EXPECT_EQ(2, maxent.NumClasses());
+}
+
+TEST(MaxEnt, PredictionServer) {
+  FTRL optim(FTRL::ADAGRAD, 1, 0.5, 1.0);
+  MaxEnt maxent(&optim);
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 20; ++i) {
+    stream << "IT\tApple:0.68\tipad:0.5\n";
+    stream << "Finance\tWall Street:0.8\tQE:0.9\tstock:0.88\n";
+    stream << "IT\tMacbook Air:0.8\tiphone 4s:0.9\n";
+  }
+  ASSERT_TRUE(maxent.TrainFromStream(&stream));
+
+  int request_pipe[2];
+  int answer_pipe[2];
+  ASSERT_EQ(0, pipe(request_pipe));
+  ASSERT_EQ(0, pipe(answer_pipe));
+
+  std::string requests;
+  for (int32_t i = 0; i < 100; ++i) {
+    requests += "?\tWall Street:0.8\tQE:0.9\n";
+    requests += "?\tMacbook Air:0.5\tiphone 4s:0.8\n";
+  }
+  requests += "?\tQE\n";
+  requests += "STATS\n";
+  requests += "RELOAD no_such.model";  // without the last '\n'
+  ASSERT_EQ(static_cast<ssize_t>(requests.size()),
+            write(request_pipe[1], requests.data(), requests.size()));
+  close(request_pipe[1]);
+
+  {
+    PredictionServer::Options options;
+    options.num_threads = 3;
+    options.max_batch_size = 8;
+    PredictionServer server(&maxent, options);
+    ASSERT_TRUE(server.Serve(request_pipe[0], answer_pipe[1]));
+  }
+  close(request_pipe[0]);
+  close(answer_pipe[1]);
+
+  std::string answers;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(answer_pipe[0], buf, sizeof(buf))) > 0) {
+    answers.append(buf, n);
+  }
+  close(answer_pipe[0]);
+
+  // answered in the order of requests
+  std::istringstream answer_stream(answers);
+  std::string line;
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(std::getline(answer_stream, line));
+    EXPECT_EQ(0u, line.find("Finance\t"));
+    ASSERT_TRUE(std::getline(answer_stream, line));
+    EXPECT_EQ(0u, line.find("IT\t"));
+  }
+  ASSERT_TRUE(std::getline(answer_stream, line));
+  EXPECT_EQ("ERROR invalid instance", line);
+  ASSERT_TRUE(std::getline(answer_stream, line));
+  EXPECT_EQ(0u, line.find("requests="));
+  ASSERT_TRUE(std::getline(answer_stream, line));
+  EXPECT_EQ("ERROR cannot load model no_such.model", line);
+  EXPECT_FALSE(std::getline(answer_stream, line));
+}
+
+TEST(MaxEnt, PredictionServerWithStalledClient) {
+  FTRL optim(FTRL::ADAGRAD, 1, 0.5, 1.0);
+  MaxEnt maxent(&optim);
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 20; ++i) {
+    stream << "Finance\tWall Street:0.8\tQE:0.9\tstock:0.88\n";
+    stream << "IT\tMacbook Air:0.8\tiphone 4s:0.9\n";
+  }
+  ASSERT_TRUE(maxent.TrainFromStream(&stream));
+
+  PredictionServer::Options options;
+  options.num_threads = 2;
+  PredictionServer server(&maxent, options);
+
+  // a client which sends more answers' worth of requests than a pipe holds,
+  // and reads none of them for now.
+  const int32_t kNumStalled = 4000;
+  int stalled_requests[2];
+  int stalled_answers[2];
+  ASSERT_EQ(0, pipe(stalled_requests));
+  ASSERT_EQ(0, pipe(stalled_answers));
+  std::thread stalled_writer([&stalled_requests] {
+    std::string requests;
+    for (int32_t i = 0; i < kNumStalled; ++i) {
+      requests += "?\tWall Street:0.8\tQE:0.9\n";
+    }
+    EXPECT_EQ(static_cast<ssize_t>(requests.size()),
+              write(stalled_requests[1], requests.data(), requests.size()));
+    close(stalled_requests[1]);
+  });
+  std::thread stalled([&server, &stalled_requests, &stalled_answers] {
+    EXPECT_TRUE(server.Serve(stalled_requests[0], stalled_answers[1]));
+  });
+
+  // another client is still answered, as the stalled one blocks the worker
+  // writing to it only.
+  int request_pipe[2];
+  int answer_pipe[2];
+  ASSERT_EQ(0, pipe(request_pipe));
+  ASSERT_EQ(0, pipe(answer_pipe));
+  const std::string request = "?\tMacbook Air:0.5\tiphone 4s:0.8\n";
+  EXPECT_EQ(static_cast<ssize_t>(request.size()),
+            write(request_pipe[1], request.data(), request.size()));
+  close(request_pipe[1]);
+  EXPECT_TRUE(server.Serve(request_pipe[0], answer_pipe[1]));
+  close(request_pipe[0]);
+  close(answer_pipe[1]);
+  char buf[4096];
+  const ssize_t n = read(answer_pipe[0], buf, sizeof(buf));
+  close(answer_pipe[0]);
+  ASSERT_GT(n, 0);
+  EXPECT_EQ(0u, std::string(buf, n).find("IT\t"));
+
+  // the stalled client reads all of its answers at last.
+  int32_t num_answers = 0;
+  ssize_t m;
+  while (num_answers < kNumStalled &&
+         (m = read(stalled_answers[0], buf, sizeof(buf))) > 0) {
+    num_answers += std::count(buf, buf + m, '\n');
+  }
+  stalled.join();
+  stalled_writer.join();
+  close(stalled_requests[0]);
+  close(stalled_answers[0]);
+  close(stalled_answers[1]);
+  EXPECT_EQ(kNumStalled, num_answers);
+}
+
+TEST(PredictionCache, Key) {
+  std::vector<std::pair<uint64_t, uint64_t> > buffer;
+  MemInstance mem_instance1;
+  mem_instance1.AddFeature(1, 0.5);
+  mem_instance1.AddFeature(3, 1.0);
+  MemInstance mem_instance2;
+  mem_instance2.AddFeature(3, 1.0);
+  mem_instance2.AddFeature(1, 0.5);
+  MemInstance mem_instance3;
+  mem_instance3.AddFeature(1, 1.0);
+  mem_instance3.AddFeature(3, 0.5);
+
+  const uint64_t key = PredictionCache::Key(mem_instance1, &buffer);
+  EXPECT_EQ(key, PredictionCache::Key(mem_instance2, &buffer));
+  EXPECT_NE(key, PredictionCache::Key(mem_instance3, &buffer));
+}
+
+TEST(PredictionCache, LookupAndInsert) {
+  PredictionCache cache(4, std::chrono::milliseconds(0), 1);
+  std::vector<double> prob_dist(2, 0.5);
+  int32_t label_id = -1;
+
+  EXPECT_FALSE(cache.Lookup(1, 1, &prob_dist, &label_id));
+  cache.Insert(1, 1, std::vector<double>(2, 0.25), 1);
+  ASSERT_TRUE(cache.Lookup(1, 1, &prob_dist, &label_id));
+  EXPECT_EQ(1, label_id);
+  EXPECT_EQ(0.25, prob_dist[0]);
+  EXPECT_EQ(0.5, cache.HitRate());
+
+  // the least recently used key 2 is evicted, not key 1.
+  for (uint64_t key = 2; key <= 4; ++key) {
+    cache.Insert(key, 1, prob_dist, 0);
+  }
+  EXPECT_EQ(4u, cache.Size());
+  EXPECT_TRUE(cache.Lookup(1, 1, &prob_dist, &label_id));
+  cache.Insert(5, 1, prob_dist, 0);
+  EXPECT_EQ(4u, cache.Size());
+  EXPECT_TRUE(cache.Lookup(1, 1, &prob_dist, &label_id));
+  EXPECT_FALSE(cache.Lookup(2, 1, &prob_dist, &label_id));
+
+  // an entry of another number of classes cannot be of the model.
+  std::vector<double> three_classes(3, 0.0);
+  EXPECT_FALSE(cache.Lookup(1, 1, &three_classes, &label_id));
+  EXPECT_EQ(0.0, three_classes[0]);
+
+  // a new model version invalidates everything, and an old one is ignored.
+  EXPECT_FALSE(cache.Lookup(1, 2, &prob_dist, &label_id));
+  EXPECT_EQ(0u, cache.Size());
+  cache.Insert(1, 1, prob_dist, 0);
+  EXPECT_EQ(0u, cache.Size());
+
+  cache.Clear();
+  EXPECT_EQ(0u, cache.NumHits());
+  EXPECT_EQ(0u, cache.NumMisses());
+}
+
+TEST(PredictionCache, Expire) {
+  PredictionCache cache(16, std::chrono::milliseconds(20));
+  std::vector<double> prob_dist(2, 0.5);
+  int32_t label_id = -1;
+  cache.Insert(1, 1, prob_dist, 0);
+  EXPECT_TRUE(cache.Lookup(1, 1, &prob_dist, &label_id));
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  EXPECT_FALSE(cache.Lookup(1, 1, &prob_dist, &label_id));
+}
+
+TEST(MaxEnt, PredictUsingCache) {
+  FTRL optim(FTRL::ADAGRAD, 1, 0.5, 1.0);
+  MaxEnt maxent(&optim);
+  maxent.UsePredictionCache(100, std::chrono::milliseconds(0));
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 20; ++i) {
+    stream << "IT\tApple:0.68\tipad:0.5\n";
+    stream << "Finance\tWall Street:0.8\tQE:0.9\tstock:0.88\n";
+  }
+  ASSERT_TRUE(maxent.TrainFromStream(&stream));
+
+  Instance instance1("?");
+  instance1.AddFeature("QE", 0.9);
+  instance1.AddFeature("Wall Street", 0.8);
+  Instance instance2("?");
+  instance2.AddFeature("Wall Street", 0.8);
+  instance2.AddFeature("QE", 0.9);
+  instance2.AddFeature("unknown", 1.0);
+
+  std::vector<double> prob_dist1 = maxent.Predict(&instance1);
+  std::vector<double> prob_dist2 = maxent.Predict(&instance2);
+  EXPECT_EQ("Finance", instance1.label());
+  EXPECT_EQ("Finance", instance2.label());
+  EXPECT_EQ(prob_dist1, prob_dist2);
+  EXPECT_EQ(1u, maxent.GetPredictionCache()->NumHits());
+  EXPECT_EQ(1u, maxent.GetPredictionCache()->NumMisses());
+
+  // retraining replaces the model, and the cache with it.
+  std::stringstream stream2("IT\tQE:1\nIT\tWall Street:1\n");
+  ASSERT_TRUE(maxent.TrainFromStream(&stream2));
+  maxent.Predict(&instance1);
+  EXPECT_EQ("IT", instance1.label());
+  EXPECT_EQ(1u, maxent.GetPredictionCache()->NumHits());
+}
+
+TEST(CrossValidation, Run) {
+  CrossValidation cross_validation(3, 2);
+
+  std::stringstream stream;
+  for (int32_t i = 0; i < 10; ++i) {
+    stream << "IT\tApple:0.68\tipad:0.5\n";
+    stream << "Finance\tWall Street:0.8\tQE:0.9\tstock:0.88\n";
+    stream << "IT\tMacbook Air:0.8\tiphone 4s:0.9\n";
+  }
+  EXPECT_EQ(30, cross_validation.LoadFromStream(&stream));
+  EXPECT_EQ(30, cross_validation.NumInstances());
+  EXPECT_EQ(2, cross_validation.NumClasses());
+
+  std::vector<CrossValidation::Params> grid(3);
+  grid[0].optim_method = "ADAGRAD";
+  grid[1].optim_method = "FTRL";
+  grid[1].l1_reg = 0.01;
+  grid[2].optim_method = "FTRL";
+  grid[2].l1_reg = 100;  // every weight is zero
+  for (size_t i = 0; i < grid.size(); ++i) {
+    grid[i].num_iterations = 5;
+    grid[i].ftrl_alpha = 0.5;
+  }
+
+  std::vector<CrossValidation::Result> results;
+  ASSERT_TRUE(cross_validation.Run(grid, &results));
+  ASSERT_EQ(3u, results.size());
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_EQ(grid[i].optim_method, results[i].params.optim_method);
+    EXPECT_NEAR(1.0, results[i].accuracy, kEpsilon);
+    EXPECT_NEAR(0.0, results[i].accuracy_stddev, kEpsilon);
+    EXPECT_GT(results[i].heldout_logl, results[2].heldout_logl);
+    EXPECT_EQ(7, results[i].num_features);
+  }
+  EXPECT_EQ(0, results[2].num_active_features);
+
+  std::stringstream table;
+  CrossValidation::PrintResults(results, &table);
+  std::string line;
+  int32_t num_lines = 0;
+  while (std::getline(table, line)) { ++num_lines; }
+  EXPECT_EQ(4, num_lines);
+
+  grid[0].optim_method = "UNKNOWN";
+  EXPECT_FALSE(cross_validation.Run(grid, &results));
+}
+
+TEST(ParallelExpectation, Update) {
+  // 7 labels of 3 features each out of 10, with random weights.
+  std::vector<Instance> instances;
+  for (int32_t n = 0; n < 600; ++n) {
+    std::ostringstream label;
+    label << "label" << n % 7;
+    Instance instance(label.str());
+    for (int32_t k = 0; k < 3; ++k) {
+      std::ostringstream feature_name;
+      feature_name << "feature" << (n * 3 + k * 5 + n % 7) % 10;
+      instance.AddFeature(feature_name.str(), 0.1 * (k + 1));
+    }
+    instances.push_back(instance);
+  }
+  mltk::common::ModelData model_data;
+  model_data.InitFromInstances(instances, 0);
+  std::vector<mltk::common::Scalar>* lambdas = model_data.MutableLambdas();
+  for (size_t i = 0; i < lambdas->size(); ++i) {
+    (*lambdas)[i] = (i * 37 % 11) / 5.0 - 1.0;
+  }
+
+  std::vector<MemInstance> mem_instances(instances.size());
+  std::vector<const MemInstance*> data;
+  for (size_t n = 0; n < instances.size(); ++n) {
+    model_data.InternInstance(instances[n], &mem_instances[n]);
+    mem_instances[n].set_weight(1 + n % 3);
+    data.push_back(&mem_instances[n]);
+  }
+
+  // the single-threaded expectation.
+  std::vector<double> expected(model_data.NumFeatures(), 0.0);
+  double expected_logl = 0.0;
+  double expected_num_correct = 0.0;
+  std::vector<double> expected_probs;
+  std::vector<double> prob_dist(model_data.NumClasses());
+  for (size_t n = 0; n < data.size(); ++n) {
+    const int32_t label_id = model_data.CalcConditionalProbability(
+        *data[n], &prob_dist);
+    expected_probs.insert(expected_probs.end(),
+                          prob_dist.begin(), prob_dist.end());
+    const double weight = data[n]->weight();
+    expected_logl += weight * log(prob_dist[data[n]->label_id()]);
+    if (label_id == data[n]->label_id()) { expected_num_correct += weight; }
+    for (MemInstance::ConstIterator citer(*data[n]);
+         !citer.Done(); citer.Next()) {
+      const std::vector<int32_t>& feature_ids
+          = model_data.FeatureIds(citer.FeatureNameId());
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        expected[feature_ids[i]]
+            += prob_dist[model_data.FeatureAt(feature_ids[i]).LabelId()]
+               * weight * citer.FeatureValue();
+      }
+    }
+  }
+
+  // more label threads than labels leave some of them idle.
+  std::vector<std::unique_ptr<ParallelExpectation> > parallel_expectations;
+  const int32_t grids[][2] = {{1, 1}, {3, 1}, {1, 3}, {2, 4}, {1, 9}};
+  for (size_t g = 0; g < sizeof(grids) / sizeof(grids[0]); ++g) {
+    parallel_expectations.push_back(std::unique_ptr<ParallelExpectation>(
+        new ParallelExpectation(grids[g][0], grids[g][1])));
+  }
+  EXPECT_FALSE(parallel_expectations.back()->UseTopology(
+      ::common::NumaTopology()));
+
+  // laid out on 2 and 3 nodes of a cpu each, which may not exist and leave
+  // the threads unpinned. A node of no shard is left out.
+  const int32_t numa_grids[][2] = {{4, 1}, {3, 2}, {1, 3}};
+  for (int32_t num_nodes = 2; num_nodes <= 3; ++num_nodes) {
+    std::vector<std::vector<int> > node_cpus(num_nodes);
+    for (int32_t node = 0; node < num_nodes; ++node) {
+      node_cpus[node].push_back(node);
+    }
+    for (size_t g = 0; g < sizeof(numa_grids) / sizeof(numa_grids[0]); ++g) {
+      ParallelExpectation* parallel_expectation
+          = new ParallelExpectation(numa_grids[g][0], numa_grids[g][1]);
+      parallel_expectations.push_back(
+          std::unique_ptr<ParallelExpectation>(parallel_expectation));
+      ASSERT_TRUE(parallel_expectation->UseTopology(
+          ::common::NumaTopology(node_cpus)));
+      parallel_expectation->Distribute(model_data, data);
+      EXPECT_GT(parallel_expectation->MemoryUsage(model_data.NumFeatures()),
+                numa_grids[g][0] * model_data.NumFeatures() * sizeof(double));
+    }
+  }
+
+  for (size_t p = 0; p < parallel_expectations.size(); ++p) {
+    for (int32_t round = 0; round < 2; ++round) {  // the buffers are reused
+      std::vector<double> expectation(model_data.NumFeatures(), 0.0);
+      double num_correct = 0.0;
+      std::vector<double> probs(expected_probs.size());
+      const double logl = parallel_expectations[p]->Update(
+          model_data, data, &expectation, &num_correct, &probs);
+      EXPECT_NEAR(expected_logl, logl, kEpsilon);
+      EXPECT_DOUBLE_EQ(expected_num_correct, num_correct);
+      for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(expected[i], expectation[i], kEpsilon);
+      }
+      for (size_t i = 0; i < expected_probs.size(); ++i) {
+        EXPECT_NEAR(expected_probs[i], probs[i], kEpsilon);
+      }
+    }
+  }
+}
+
+TEST(ExpansionCache, Init) {
+  // binary instances, then valued ones, of 5 labels and repeated names.
+  mltk::common::ModelData model_data;
+  std::vector<MemInstance> mem_instances(100);
+  std::vector<const MemInstance*> data;
+  for (size_t n = 0; n < mem_instances.size(); ++n) {
+    std::ostringstream text;
+    text << "label" << n % 5;
+    for (size_t k = 0; k < 4; ++k) {
+      text << "\tfeature" << (n * 7 + k * 3) % 11 << ":"
+           << (n < 30 ? 1.0 : 0.5 + k);
+    }
+    text << "\tfeature" << n % 11 << ":1";
+    ASSERT_TRUE(model_data.InternText(text.str(), &mem_instances[n]));
+    data.push_back(&mem_instances[n]);
+  }
+  model_data.InitFromMemInstances(data, 0);
+  std::vector<mltk::common::Scalar>* lambdas = model_data.MutableLambdas();
+  for (size_t i = 0; i < lambdas->size(); ++i) {
+    (*lambdas)[i] = (i * 37 % 11) / 5.0 - 1.0;
+  }
+
+  mltk::maxent::ExpansionCache cache;
+  EXPECT_EQ(data.size(), cache.Init(model_data, data, 1 << 20));
+  EXPECT_GT(cache.MemoryUsage(), 0u);
+
+  // the same sums as on the fly.
+  std::vector<double> expected(model_data.NumClasses());
+  std::vector<double> prob_dist(model_data.NumClasses());
+  std::vector<double> expected_expectation(model_data.NumFeatures(), 0.0);
+  std::vector<double> expectation(model_data.NumFeatures(), 0.0);
+  for (size_t n = 0; n < data.size(); ++n) {
+    const int32_t expected_label
+        = model_data.CalcConditionalProbability(*data[n], &expected);
+    EXPECT_EQ(expected_label,
+              cache.CalcConditionalProbability(n, *lambdas, &prob_dist));
+    for (size_t y = 0; y < expected.size(); ++y) {
+      EXPECT_DOUBLE_EQ(expected[y], prob_dist[y]);
+    }
+
+    for (MemInstance::ConstIterator citer(*data[n]);
+         !citer.Done(); citer.Next()) {
+      const std::vector<int32_t>& feature_ids
+          = model_data.FeatureIds(citer.FeatureNameId());
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        expected_expectation[feature_ids[i]]
+            += expected[model_data.FeatureAt(feature_ids[i]).LabelId()]
+               * citer.FeatureValue();
+      }
+    }
+    cache.AddExpectation(n, prob_dist, &expectation);
+  }
+  for (size_t i = 0; i < expectation.size(); ++i) {
+    EXPECT_NEAR(expected_expectation[i], expectation[i], kEpsilon);
+  }
+
+  // the first instances within the budget, binary ones without values.
+  const size_t num_expanded = cache.Init(model_data, data, 2048);
+  EXPECT_GT(num_expanded, 0u);
+  EXPECT_LT(num_expanded, 30u);
+  EXPECT_LE(cache.MemoryUsage(), 2048u);
+  EXPECT_EQ(0u, cache.Init(model_data, data, 0));
+}
+
+TEST(MaxEnt, TrainUsingLBFGSWithExpansionCache) {
+  const std::string text = SyntheticText(300, true, true);
+
+  // no cache, a cache of some instances and one of all of them.
+  const size_t budgets[] = {0, 4096, 1 << 20};
+  std::vector<std::vector<mltk::common::Scalar> > lambdas;
+  for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); ++b) {
+    LBFGS lbfgs(30, 10);
+    lbfgs.UseL2Reg(1.0);
+    lbfgs.UseExpansionCache(budgets[b]);
+    MaxEnt maxent(&lbfgs);
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 10, 0));
+    lambdas.push_back(maxent.GetModelData()->Lambdas());
+  }
+  for (size_t b = 1; b < lambdas.size(); ++b) {
+    ASSERT_EQ(lambdas[0].size(), lambdas[b].size());
+    for (size_t i = 0; i < lambdas[0].size(); ++i) {
+      EXPECT_NEAR(lambdas[0][i], lambdas[b][i], kEpsilon);
+    }
+  }
+}
+
+TEST(MaxEnt, TrainUsingLBFGSWithPerfCounters) {
+  const std::string text = SyntheticText(300, false, true);
+
+  // the counts are the ones the counters can count, if any, and the model
+  // is the same.
+  std::vector<std::vector<mltk::common::Scalar> > lambdas;
+  for (int32_t counting = 0; counting < 2; ++counting) {
+    LBFGS lbfgs(20, 10);
+    lbfgs.UseL2Reg(1.0);
+    lbfgs.UsePerfCounters(counting == 1);
+    MaxEnt maxent(&lbfgs);
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 0, 0));
+    lambdas.push_back(maxent.GetModelData()->Lambdas());
+
+    const ::common::PerfCounts& counts = lbfgs.PassPerfCounts();
+    const ::common::PerfCounters counters;
+    for (int32_t i = 0; i < ::common::PERF_NUM_EVENTS; ++i) {
+      const ::common::PerfEvent event = static_cast< ::common::PerfEvent>(i);
+      EXPECT_EQ(counting == 1 && counters.IsAvailable(event),
+                counts.IsAvailable(event));
+    }
+    if (counts.IsAvailable(::common::PERF_INSTRUCTIONS)) {
+      EXPECT_GT(counts.Get(::common::PERF_INSTRUCTIONS), 0U);
+    }
+  }
+  ASSERT_EQ(lambdas[0].size(), lambdas[1].size());
+  for (size_t i = 0; i < lambdas[0].size(); ++i) {
+    EXPECT_EQ(lambdas[0][i], lambdas[1][i]);
+  }
+}
+
+TEST(MaxEnt, TrainFromTextInFrequencyOrder) {
+  const std::string text = SyntheticText(300, true, true);
+  std::vector<Instance> instances = ParseInstances(text);
+
+  // the same model, whichever the ids of the features, also once saved.
+  std::vector<std::vector<double> > probs[2];
+  for (int32_t sorted = 0; sorted < 2; ++sorted) {
+    LBFGS lbfgs(30, 10);
+    lbfgs.UseL2Reg(1.0);
+    MaxEnt maxent(&lbfgs);
+    maxent.UseFrequencyOrder(sorted == 1);
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 10, 0));
+    ASSERT_TRUE(maxent.SaveModel(kModelFile));
+    MaxEnt loaded;
+    ASSERT_TRUE(loaded.LoadModel(kModelFile));
+    for (size_t n = 0; n < instances.size(); n += 7) {
+      std::vector<double> prob_dist = maxent.Predict(&instances[n]);
+      const std::vector<double> loaded_prob_dist
+          = loaded.Predict(&instances[n]);
+      for (int32_t y = 0; y < maxent.NumClasses(); ++y) {
+        EXPECT_NEAR(prob_dist[y], loaded_prob_dist[
+            loaded.GetClassId(maxent.GetClassLabel(y))], 1E-5);
+      }
+      probs[sorted].push_back(prob_dist);
+    }
+    if (sorted == 1) {
+      // the features grouped by their names, the cues of 100 instances
+      // each before the noisy ones of 96 instances at most.
+      const mltk::common::ModelHandle::ConstModelPtr model
+          = maxent.GetModelData();
+      for (int32_t id = 1; id < model->NumFeatures(); ++id) {
+        EXPECT_LE(model->FeatureAt(id - 1).FeatureNameId(),
+                  model->FeatureAt(id).FeatureNameId());
+      }
+      EXPECT_LT(model->FeatureNameId("label1_cue"),
+                model->FeatureNameId("feature0"));
+    }
+  }
+  for (size_t i = 0; i < probs[0].size(); ++i) {
+    for (size_t y = 0; y < probs[0][i].size(); ++y) {
+      EXPECT_NEAR(probs[0][i][y], probs[1][i][y], kEpsilon);
+    }
+  }
+}
+
+TEST(MaxEnt, TrainWithFeatureCrosses) {
+  // the parity of the user and the item, which no sum of their weights
+  // separates, but the weights of their pairs do.
+  std::string text;
+  std::vector<Instance> instances;
+  for (int32_t n = 0; n < 200; ++n) {
+    std::ostringstream line;
+    line << "label" << (n % 4 + n / 4 % 4) % 2 << "\tu^" << n % 4 << ":1\ti^"
+         << (n / 4) % 4 << ":1\tbias:1";
+    text += line.str() + "\n";
+    instances.push_back(Instance());
+    ASSERT_TRUE(instances.back().ParseFromText(line.str()));
+  }
+
+  double accuracies[2];
+  for (int32_t crossed = 0; crossed < 2; ++crossed) {
+    LBFGS lbfgs(100, 10);
+    lbfgs.UseL2Reg(0.1);
+    MaxEnt maxent(&lbfgs);
+    EXPECT_FALSE(maxent.UseFeatureCrosses("u", 10));
+    ASSERT_TRUE(maxent.UseFeatureCrosses(crossed == 1 ? "u:i" : "", 10));
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 0, 0));
+    EXPECT_EQ(9, maxent.GetModelData()->NumFeatureNames());
+
+    int32_t ncorrect = 0;
+    for (size_t n = 0; n < instances.size(); ++n) {
+      Instance instance = instances[n];
+      maxent.Predict(&instance);
+      if (instance.label() == instances[n].label()) { ++ncorrect; }
+    }
+    accuracies[crossed] = static_cast<double>(ncorrect) / instances.size();
+
+    if (crossed == 0) { continue; }  // of zero weights, by the symmetry
+
+    // Train on the instances crosses the same, and the loaded model too.
+    LBFGS trained_lbfgs(100, 10);
+    trained_lbfgs.UseL2Reg(0.1);
+    MaxEnt trained(&trained_lbfgs);
+    ASSERT_TRUE(trained.UseFeatureCrosses("u:i", 10));
+    ASSERT_TRUE(trained.Train(instances, 0, 0));
+    ASSERT_TRUE(trained.SaveModel(kModelFile));
+    MaxEnt loaded;
+    ASSERT_TRUE(loaded.LoadModel(kModelFile));
+    for (size_t n = 0; n < instances.size(); n += 7) {
+      Instance instance = instances[n];  // labeled by Predict
+      std::vector<double> prob_dist = maxent.Predict(&instance);
+      std::vector<double> trained_prob_dist = trained.Predict(&instance);
+      std::vector<double> loaded_prob_dist = loaded.Predict(&instance);
+      for (int32_t y = 0; y < maxent.NumClasses(); ++y) {
+        const int32_t trained_y
+            = trained.GetClassId(maxent.GetClassLabel(y));
+        EXPECT_NEAR(prob_dist[y], trained_prob_dist[trained_y], 1E-4);
+        EXPECT_NEAR(trained_prob_dist[trained_y],
+                    loaded_prob_dist[loaded.GetClassId(
+                        maxent.GetClassLabel(y))], 1E-5);
+      }
+    }
+  }
+  EXPECT_LT(accuracies[0], 0.8);
+  EXPECT_EQ(1.0, accuracies[1]);
+}
+
+TEST(MaxEnt, TrainUsingParameterMixing) {
+  const std::string text = SyntheticText(300, true, true);
+
+  // a worker of a round on all the data is the optimizer itself.
+  std::vector<std::vector<mltk::common::Scalar> > lambdas;
+  for (int32_t mixing = 0; mixing < 2; ++mixing) {
+    std::unique_ptr<Optimizer> optimizer(new LBFGS(10, 10));
+    optimizer->UseL2Reg(1.0);
+    if (mixing == 1) {
+      optimizer.reset(new ParameterMixing(optimizer.release(), 1, 1));
+    }
+    MaxEnt maxent(optimizer.get());
+    std::stringstream stream(text);
+    ASSERT_TRUE(maxent.TrainFromText(&stream, 10, 0));
+    lambdas.push_back(maxent.GetModelData()->Lambdas());
+  }
+  ASSERT_EQ(lambdas[0].size(), lambdas[1].size());
+  for (size_t i = 0; i < lambdas[0].size(); ++i) {
+    EXPECT_NEAR(lambdas[0][i], lambdas[1][i], kEpsilon);
+  }
+
+  // the mixed lambdas of 3 workers learn the cues, too.
+  ParameterMixing mixing(new SGD(2), 3, 5);
+  MaxEnt maxent(&mixing);
+  std::stringstream stream(text);
+  ASSERT_TRUE(maxent.TrainFromText(&stream, 30, 0));
+  EXPECT_EQ(5, mixing.NumIterations());
+  double logl = 0.0;
+  double accuracy = 0.0;
+  ASSERT_TRUE(mixing.EvaluateHeldout(&logl, &accuracy));
+  EXPECT_DOUBLE_EQ(1.0, accuracy);
+}
@@ -3,8 +3,13 @@
 
 #include "mltk/maxent/maxent.h"
 
+#include <math.h>
 #include <stdlib.h>
+
+#include <algorithm>
 #include <fstream>
+#include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -12,24 +17,281 @@
 #include <glog/logging.h>
 
 #include "common/base/string/algorithm.h"
+#include "mltk/common/count_min_sketch.h"
 #include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/memory_breakdown.h"
+#include "mltk/common/model_data.h"
+#include "mltk/maxent/expansion_cache.h"
+#include "mltk/maxent/ftrl.h"
 #include "mltk/maxent/lbfgs.h"
 #include "mltk/maxent/optimizer.h"
 #include "mltk/maxent/owlqn.h"
+#include "mltk/maxent/parameter_mixing.h"
 #include "mltk/maxent/sgd.h"
+#include "mltk/maxent/svrg.h"
+#include "mltk/maxent/tron.h"
 
-DEFINE_string(train_data_file, "", "the filename of training data.");
+DEFINE_string(train_data_file, "",
+              "the filename of training data, '-' for stdin.");
 DEFINE_string(model_file, "", "the filename of maxent model.");
 DEFINE_string(optim_method, "LBFGS",
-              "the optimization method, LBFGS, OWLQN, or SGD.");
+              "the optimization method, LBFGS, OWLQN, TRON, SGD, SVRG, FTRL "
+              "or ADAGRAD.");
 DEFINE_int32(num_iterations, 100, "the total iterations.");
 DEFINE_int32(newton_m, 10,
              "the cache size for newton methods, OWLQN and LBFGS.");
 DEFINE_int32(sgd_learning_rate, 1.0, "the learning rate of SGD.");
+DEFINE_double(svrg_learning_rate, 2.0,
+              "the learning rate of SVRG, relative to 1 / the mean squared "
+              "norm of the instances.");
+DEFINE_double(ftrl_alpha, 0.1, "the learning rate of FTRL and ADAGRAD.");
+DEFINE_double(ftrl_beta, 1.0,
+              "the learning rate smoothing of FTRL and ADAGRAD.");
+DEFINE_bool(streaming, false,
+            "train FTRL or ADAGRAD in a single pass over the training data, "
+            "without loading it into memory.");
 DEFINE_double(l1_reg, 0.0, "the L1 regularization.");
 DEFINE_double(l2_reg, 0.0, "the L2 regularization.");
+DEFINE_string(l1_path, "",
+              "the comma-separated decreasing L1 regularizations of OWLQN or "
+              "SGD. The model of each is trained from the previous one, and "
+              "saved to <model_file>.<i>.");
+DEFINE_double(convergence_tolerance, 0.0,
+              "stop LBFGS, OWLQN, TRON and SVRG once the objective decreases "
+              "by less than the relative tolerance over 5 iterations. 0 means "
+              "never.");
+DEFINE_int32(active_set_interval, 0,
+             "the iterations between the optimality checks of the active set "
+             "of OWLQN, which screens out the zero features while they are "
+             "optimal. 0 means no screening.");
+DEFINE_int32(num_data_threads, 1,
+             "the number of data shards of LBFGS and OWLQN, each of which "
+             "takes a thread per label range and a copy of the expectations.");
+DEFINE_int32(num_label_threads, 1,
+             "the number of label ranges of LBFGS and OWLQN, whose threads "
+             "share the expectations of their data shard.");
+DEFINE_bool(numa_aware, false,
+            "lay the data shards of num_data_threads out on the NUMA nodes, "
+            "copying their instances on the node and pinning their threads "
+            "to its cpus. A single node keeps the uniform layout.");
+DEFINE_int32(expansion_cache_mb, 0,
+             "the memory in MB to keep the features f(x, y) of the training "
+             "instances expanded once for the expectations of LBFGS, OWLQN, "
+             "TRON and SVRG on a single thread. The instances beyond it are "
+             "expanded in every pass. 0 means no cache.");
+DEFINE_bool(perf_counters, false,
+            "count the hardware events of every pass of LBFGS, OWLQN and TRON "
+            "over the training data, e.g. IPC and LLC misses, on the "
+            "training threads if perf_event_open permits.");
+DEFINE_int32(mixing_workers, 0,
+             "the number of worker processes of iterative parameter mixing, "
+             "each of which runs num_iterations iterations of optim_method "
+             "on its shard of the training data every round, before their "
+             "lambdas are averaged. 0 means no mixing.");
+DEFINE_int32(mixing_rounds, 10, "the rounds of iterative parameter mixing.");
 DEFINE_int32(num_heldout, 0, "the number of heldout data.");
 DEFINE_int32(feature_cutoff, 1, "the minmum frequency of feature.");
+DEFINE_double(feature_count_error_rate, 0.0,
+              "the error rate of approximate feature counting for "
+              "feature_cutoff, relative to the total number of feature "
+              "occurrences. 0 means exact counting.");
+DEFINE_double(feature_count_confidence, 0.99,
+              "the confidence of approximate feature counting.");
+DEFINE_bool(dedup_instances, false,
+            "collapse the duplicate training instances into weighted ones, "
+            "so every iteration goes over the distinct instances only.");
+DEFINE_bool(frequency_order, false,
+            "number the features and the feature names in the descending "
+            "order of their frequency in the training data, so the lambdas "
+            "of the hottest ones share cache lines.");
+DEFINE_string(feature_crosses, "",
+              "the comma-separated pairs a:b of the namespaces of the feature "
+              "names ns^name whose features are crossed on the fly, e.g. "
+              "u:i,q:q.");
+DEFINE_int32(cross_hash_bits, 18,
+             "the crossed features are hashed into 2^cross_hash_bits "
+             "buckets.");
+DEFINE_bool(pipelined_loading, false,
+            "train the first iteration of SGD on the training data while a "
+            "reader thread is still loading it.");
+DEFINE_bool(dry_run, false,
+            "estimate the peak memory of training from a sample of the "
+            "training data, and exit without training.");
+DEFINE_int32(dry_run_sample_size, 10000,
+             "the number of instances at the head of the training data "
+             "which dry_run samples.");
+
+using mltk::common::CountMinSketch;
+using mltk::common::Instance;
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+
+// The growth of a vocabulary when the data grows by ratio, by Heaps' law
+// size ~ n^beta, where beta is fitted to the sizes of the vocabulary on half
+// of a sample and on the whole sample.
+static double VocabularyGrowth(int32_t half_size,
+                               int32_t full_size,
+                               double ratio) {
+  double beta = 1.0;
+  if (half_size > 0 && full_size > 0) {
+    beta = log(static_cast<double>(full_size) / half_size) / log(2.0);
+  }
+  return pow(ratio, std::min(std::max(beta, 0.0), 1.0));
+}
+
+static size_t Scale(size_t bytes, double growth) {
+  return static_cast<size_t>(bytes * growth);
+}
+
+// Estimates the memory of every phase of training on the whole training data
+// of data_bytes bytes from its first dry_run_sample_size instances in in, and
+// prints them with the peak memory. The vocabularies are extrapolated by
+// Heaps' law, and the instances linearly.
+static bool DryRun(const mltk::maxent::Optimizer& optim,
+                   int64_t data_bytes,
+                   std::istream* in) {
+  std::vector<Instance> sample;
+  int64_t sample_bytes = 0;
+  std::string line;
+  while (static_cast<int32_t>(sample.size()) < FLAGS_dry_run_sample_size
+         && std::getline(*in, line)) {
+    sample_bytes += line.size() + 1;
+    Instance instance;
+    if (instance.ParseFromText(line)) { sample.push_back(instance); }
+  }
+  if (sample.size() < 2) {
+    LOG(ERROR) << "Too few instances to sample.";
+    return false;
+  }
+  const double ratio = std::max(
+      static_cast<double>(data_bytes) / sample_bytes, 1.0);
+  const int64_t num_instances = static_cast<int64_t>(sample.size() * ratio);
+
+  // the raw feature space, and the features surviving feature_cutoff.
+  const bool approximate = FLAGS_feature_count_error_rate > 0;
+  const std::vector<Instance> half(sample.begin(),
+                                   sample.begin() + sample.size() / 2);
+  ModelData raw_half_model, raw_model, half_model, model;
+  raw_half_model.UseFeatureCrosses(FLAGS_feature_crosses,
+                                   FLAGS_cross_hash_bits);
+  raw_model.UseFeatureCrosses(FLAGS_feature_crosses, FLAGS_cross_hash_bits);
+  half_model.UseFeatureCrosses(FLAGS_feature_crosses, FLAGS_cross_hash_bits);
+  model.UseFeatureCrosses(FLAGS_feature_crosses, FLAGS_cross_hash_bits);
+  raw_half_model.InitFromInstances(half, 0);
+  raw_model.InitFromInstances(sample, 0);
+  if (approximate) {
+    half_model.UseApproximateFeatureCounting(FLAGS_feature_count_error_rate,
+                                             FLAGS_feature_count_confidence);
+    model.UseApproximateFeatureCounting(FLAGS_feature_count_error_rate,
+                                        FLAGS_feature_count_confidence);
+  }
+  half_model.InitFromInstances(half, FLAGS_feature_cutoff);
+  model.InitFromInstances(sample, FLAGS_feature_cutoff);
+
+  const double raw_feature_growth = VocabularyGrowth(
+      raw_half_model.NumFeatures(), raw_model.NumFeatures(), ratio);
+  const double featurename_growth = VocabularyGrowth(
+      half_model.NumFeatureNames(), model.NumFeatureNames(), ratio);
+  const double feature_growth = VocabularyGrowth(
+      half_model.NumFeatures(), model.NumFeatures(), ratio);
+  const int32_t num_features
+      = static_cast<int32_t>(model.NumFeatures() * feature_growth);
+
+  // the instances are loaded as strings for approximate counting, or
+  // interned while parsing.
+  size_t mem_instances_bytes = 0;
+  for (size_t n = 0; n < sample.size(); ++n) {
+    MemInstance mem_instance;
+    model.FormatInstance(sample[n], &mem_instance);
+    mem_instances_bytes += mem_instance.MemoryUsage();
+  }
+  mem_instances_bytes = Scale(mem_instances_bytes, ratio)
+      + MemoryBreakdown::HeapBytes(num_instances * sizeof(MemInstance));
+
+  MemoryBreakdown load;
+  if (!FLAGS_streaming && approximate) {
+    size_t instances_bytes = 0;
+    for (size_t n = 0; n < sample.size(); ++n) {
+      instances_bytes += sample[n].MemoryUsage();
+    }
+    load.Add("instances", Scale(instances_bytes, ratio)
+             + MemoryBreakdown::HeapBytes(num_instances * sizeof(Instance)));
+  } else if (!FLAGS_streaming) {
+    load.Add("instances", mem_instances_bytes);
+  }
+
+  // the labels do not grow, the feature names and their features do.
+  MemoryBreakdown model_usage;
+  const MemoryBreakdown sample_model_usage = model.MemoryUsage();
+  for (size_t i = 0; i < sample_model_usage.Items().size(); ++i) {
+    const std::string& name = sample_model_usage.Items()[i].first;
+    double growth = feature_growth;
+    if (name == "label_vocab") {
+      growth = 1.0;
+    } else if (name == "featurename_vocab" || name == "all_features") {
+      growth = featurename_growth;
+    }
+    model_usage.Add(name, Scale(sample_model_usage.Items()[i].second, growth));
+  }
+
+  MemoryBreakdown count;
+  if (!FLAGS_streaming) {
+    if (approximate) {
+      count.Add("feature_counter", CountMinSketch::MemoryUsage(
+          FLAGS_feature_count_error_rate,
+          1.0 - FLAGS_feature_count_confidence));
+    } else {
+      count.Add("feature_counter",
+                Scale(raw_model.NumFeatures(), raw_feature_growth)
+                * MemoryBreakdown::MapNodeBytes<uint32_t, double>());
+    }
+  }
+
+  MemoryBreakdown optimize;
+  if (!FLAGS_streaming) {
+    if (approximate) { optimize.Add("instances", mem_instances_bytes); }
+    optimize.Add("train_data", MemoryBreakdown::HeapBytes(
+        num_instances * sizeof(const MemInstance*)));
+  }
+  if (!FLAGS_streaming && FLAGS_expansion_cache_mb > 0) {
+    // the expansions grow with the instances and the features per feature
+    // name, up to the budget.
+    std::vector<MemInstance> mem_instances(sample.size());
+    std::vector<const MemInstance*> data;
+    for (size_t n = 0; n < sample.size(); ++n) {
+      model.FormatInstance(sample[n], &mem_instances[n]);
+      data.push_back(&mem_instances[n]);
+    }
+    const size_t max_bytes
+        = static_cast<size_t>(FLAGS_expansion_cache_mb) << 20;
+    mltk::maxent::ExpansionCache cache;
+    cache.Init(model, data, max_bytes);
+    const double growth = ratio * feature_growth / featurename_growth;
+    optimize.Add("expansion_cache",
+                 std::min(Scale(cache.MemoryUsage(), growth), max_bytes));
+  }
+  optim.AddStateMemoryUsage(num_features, &optimize);
+
+  // the instances and the model live through training, while the feature
+  // counter is freed before the optimizer allocates its state.
+  const size_t peak = load.Total() + model_usage.Total()
+                      + std::max(count.Total(), optimize.Total());
+
+  std::cout << "sample: " << sample.size() << " instances, about "
+      << num_instances << " instances of " << model.NumClasses()
+      << " classes in the training data" << std::endl;
+  std::cout << "growth: feature names x" << featurename_growth
+      << ", features x" << feature_growth << ", about " << num_features
+      << " features" << std::endl;
+  std::cout << "load: " << load.ToString() << std::endl;
+  std::cout << "model: " << model_usage.ToString() << std::endl;
+  std::cout << "count features: " << count.ToString() << std::endl;
+  std::cout << "optimize: " << optimize.ToString() << std::endl;
+  std::cout << "peak: " << MemoryBreakdown::Format(peak) << std::endl;
+  return true;
+}
 
 int main(int argc, char** argv) {
   ::google::ParseCommandLineFlags(&argc, &argv, true);
@@ -40,38 +302,197 @@ int main(int argc, char** argv) {
     optim = new mltk::maxent::LBFGS(FLAGS_num_iterations, FLAGS_newton_m);
     optim->UseL2Reg(FLAGS_l2_reg);
   } else if (FLAGS_optim_method == "OWLQN") {
-    optim = new mltk::maxent::OWLQN(FLAGS_num_iterations, FLAGS_newton_m);
+    mltk::maxent::OWLQN* owlqn
+        = new mltk::maxent::OWLQN(FLAGS_num_iterations, FLAGS_newton_m);
+    owlqn->UseActiveSet(FLAGS_active_set_interval);
+    optim = owlqn;
     optim->UseL1Reg(FLAGS_l1_reg);
+  } else if (FLAGS_optim_method == "TRON") {
+    optim = new mltk::maxent::TRON(FLAGS_num_iterations);
+    optim->UseL2Reg(FLAGS_l2_reg);
   } else if (FLAGS_optim_method == "SGD") {
     optim = new mltk::maxent::SGD(FLAGS_num_iterations,
                                   FLAGS_sgd_learning_rate);
     optim->UseL1Reg(FLAGS_l1_reg);
+  } else if (FLAGS_optim_method == "SVRG") {
+    optim = new mltk::maxent::SVRG(FLAGS_num_iterations,
+                                   FLAGS_svrg_learning_rate);
+    optim->UseL2Reg(FLAGS_l2_reg);
+  } else if (FLAGS_optim_method == "FTRL") {
+    optim = new mltk::maxent::FTRL(mltk::maxent::FTRL::FTRL_PROXIMAL,
+                                   FLAGS_num_iterations,
+                                   FLAGS_ftrl_alpha,
+                                   FLAGS_ftrl_beta);
+    optim->UseL1Reg(FLAGS_l1_reg);
+    optim->UseL2Reg(FLAGS_l2_reg);
+  } else if (FLAGS_optim_method == "ADAGRAD") {
+    optim = new mltk::maxent::FTRL(mltk::maxent::FTRL::ADAGRAD,
+                                   FLAGS_num_iterations,
+                                   FLAGS_ftrl_alpha,
+                                   FLAGS_ftrl_beta);
   } else {
     LOG(FATAL) << "Invalid optimization method : " << FLAGS_optim_method;
   }
 
+  optim->UseConvergenceTolerance(FLAGS_convergence_tolerance);
+  if (FLAGS_num_data_threads < 1 || FLAGS_num_label_threads < 1) {
+    LOG(FATAL) << "Invalid num_data_threads or num_label_threads.";
+  }
+  optim->UseThreads(FLAGS_num_data_threads, FLAGS_num_label_threads);
+  optim->UseNumaLayout(FLAGS_numa_aware);
+  if (FLAGS_expansion_cache_mb < 0) {
+    LOG(FATAL) << "Invalid expansion_cache_mb : " << FLAGS_expansion_cache_mb;
+  }
+  optim->UseExpansionCache(
+      static_cast<size_t>(FLAGS_expansion_cache_mb) << 20);
+  optim->UsePerfCounters(FLAGS_perf_counters);
+  if (FLAGS_mixing_workers < 0) {
+    LOG(FATAL) << "Invalid mixing_workers : " << FLAGS_mixing_workers;
+  }
+  if (FLAGS_mixing_workers > 0) {
+    if (FLAGS_streaming || FLAGS_pipelined_loading || !FLAGS_l1_path.empty()) {
+      LOG(FATAL) << "mixing_workers needs no streaming, pipelined_loading or "
+          << "l1_path";
+    }
+    LOG(INFO) << "Mix the lambdas of " << FLAGS_mixing_workers
+        << " workers every " << FLAGS_num_iterations << " iterations.";
+    optim = new mltk::maxent::ParameterMixing(optim, FLAGS_mixing_workers,
+                                              FLAGS_mixing_rounds);
+    optim->UseConvergenceTolerance(FLAGS_convergence_tolerance);
+  }
+
+  std::vector<double> l1_path;
+  if (!FLAGS_l1_path.empty()) {
+    std::vector<std::string> values;
+    common::SplitString(FLAGS_l1_path, ",", &values);
+    for (size_t i = 0; i < values.size(); ++i) {
+      l1_path.push_back(atof(values[i].c_str()));
+    }
+    if (l1_path.empty() || FLAGS_streaming) {
+      LOG(FATAL) << "Invalid l1_path : " << FLAGS_l1_path;
+    }
+    optim->UseL1Reg(l1_path[0]);
+  }
+
   mltk::maxent::MaxEnt maxent(optim);
+  if (FLAGS_feature_count_error_rate > 0) {
+    LOG(INFO) << "Use approximate feature counting, error rate = "
+        << FLAGS_feature_count_error_rate << ", confidence = "
+        << FLAGS_feature_count_confidence;
+    maxent.UseApproximateFeatureCounting(FLAGS_feature_count_error_rate,
+                                         FLAGS_feature_count_confidence);
+  }
+  if (FLAGS_dedup_instances) {
+    if (FLAGS_streaming) { LOG(FATAL) << "dedup_instances needs no streaming"; }
+    LOG(INFO) << "Collapse the duplicate training instances.";
+    maxent.UseDeduplication(true);
+  }
+  if (FLAGS_frequency_order) {
+    if (FLAGS_streaming) { LOG(FATAL) << "frequency_order needs no streaming"; }
+    LOG(INFO) << "Number the features by frequency.";
+    maxent.UseFrequencyOrder(true);
+  }
+  if (!FLAGS_feature_crosses.empty()) {
+    if (!maxent.UseFeatureCrosses(FLAGS_feature_crosses,
+                                  FLAGS_cross_hash_bits)) {
+      LOG(FATAL) << "Invalid feature_crosses : " << FLAGS_feature_crosses
+          << " or cross_hash_bits : " << FLAGS_cross_hash_bits;
+    }
+    LOG(INFO) << "Cross the features of " << FLAGS_feature_crosses
+        << " into 2^" << FLAGS_cross_hash_bits << " buckets.";
+  }
+  if (FLAGS_pipelined_loading) {
+    if (FLAGS_streaming || FLAGS_feature_count_error_rate > 0
+        || FLAGS_dedup_instances || FLAGS_frequency_order) {
+      LOG(FATAL) << "pipelined_loading needs no streaming, approximate "
+          << "feature counting, dedup_instances or frequency_order";
+    }
+    LOG(INFO) << "Train while loading the training data.";
+    maxent.UsePipelinedLoading(true);
+  }
 
-  LOG(INFO) << "Load training data from " << FLAGS_train_data_file;
-  std::ifstream fin(FLAGS_train_data_file.c_str());
-  if (!fin) {
-    LOG(ERROR) << "Can't open train_data file '" << FLAGS_train_data_file
-        << "'";
-    return -1;
+  std::ifstream fin;
+  std::istream* in = &std::cin;
+  if (FLAGS_train_data_file != "-") {
+    fin.open(FLAGS_train_data_file.c_str());
+    if (!fin) {
+      LOG(ERROR) << "Can't open train_data file '" << FLAGS_train_data_file
+          << "'";
+      return -1;
+    }
+    in = &fin;
   }
 
-  std::vector<mltk::common::Instance> instances;
-  std::string line;
-  while (std::getline(fin, line)) {
-    mltk::common::Instance instance;
-    if (instance.ParseFromText(line)) {
-      instances.push_back(instance);
+  if (FLAGS_dry_run) {
+    if (!fin.is_open()) {
+      LOG(ERROR) << "dry_run needs a train_data file rather than stdin.";
+      return -1;
+    }
+    fin.seekg(0, std::ios::end);
+    const int64_t data_bytes = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+    LOG(INFO) << "Estimate the memory of training on "
+        << FLAGS_train_data_file;
+    const bool ok = DryRun(*optim, data_bytes, in);
+    delete optim;
+    return ok ? 0 : -1;
+  }
+
+  if (FLAGS_streaming) {
+    LOG(INFO) << "MaxEnt model training from " << FLAGS_train_data_file;
+    if (!maxent.TrainFromStream(in)) { return -1; }
+  } else if (FLAGS_feature_count_error_rate > 0) {
+    // approximate counting interns only the surviving feature names, so the
+    // instances are loaded with their names first.
+    LOG(INFO) << "Load training data from " << FLAGS_train_data_file;
+    std::vector<mltk::common::Instance> instances;
+    std::string line;
+    while (std::getline(*in, line)) {
+      mltk::common::Instance instance;
+      if (instance.ParseFromText(line)) {
+        instances.push_back(instance);
+      }
+    }
+    size_t instances_bytes = MemoryBreakdown::Of(instances);
+    for (size_t n = 0; n < instances.size(); ++n) {
+      instances_bytes += instances[n].MemoryUsage();
     }
+    LOG(INFO) << instances.size() << " instances loaded, memory of instances: "
+        << MemoryBreakdown::Format(instances_bytes);
+
+    LOG(INFO) << "MaxEnt model training.";
+    maxent.Train(instances, FLAGS_num_heldout, FLAGS_feature_cutoff);
+  } else {
+    LOG(INFO) << "MaxEnt model training from " << FLAGS_train_data_file;
+    if (!maxent.TrainFromText(in, FLAGS_num_heldout, FLAGS_feature_cutoff)) {
+      return -1;
+    }
+  }
+  if (FLAGS_perf_counters) {
+    LOG(INFO) << "Perf counts of all passes: "
+        << optim->PassPerfCounts().ToString();
   }
-  fin.close();
 
-  LOG(INFO) << "MaxEnt model training.";
-  maxent.Train(instances, FLAGS_num_heldout, FLAGS_feature_cutoff);
+  // every point of the path: l1_reg, iterations, active features, and the
+  // heldout loss and accuracy if any.
+  for (size_t i = 0; i < l1_path.size(); ++i) {
+    if (i > 0 && !maxent.RetrainWithL1Reg(l1_path[i])) { return -1; }
+
+    std::ostringstream model_file;
+    model_file << FLAGS_model_file << "." << i + 1;
+    LOG(INFO) << "Save model to " << model_file.str();
+    maxent.SaveModel(model_file.str());
+
+    std::cout << l1_path[i] << "\t" << optim->NumIterations() << "\t"
+        << maxent.GetModelData()->NumActiveFeatures();
+    double heldout_logl = 0.0;
+    double heldout_accuracy = 0.0;
+    if (optim->EvaluateHeldout(&heldout_logl, &heldout_accuracy)) {
+      std::cout << "\t" << -1 * heldout_logl << "\t" << heldout_accuracy;
+    }
+    std::cout << std::endl;
+  }
+  if (fin.is_open()) { fin.close(); }
 
   LOG(INFO) << "Save model to " << FLAGS_model_file;
   maxent.SaveModel(FLAGS_model_file);
@@ -0,0 +1,403 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/model_compiler.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mltk/common/scalar.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+namespace {
+
+const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t kFnvPrime = 0x100000001b3ULL;
+const uint64_t kGoldenRatio = 0x9e3779b97f4a7c15ULL;
+
+// the keys per bucket on average.
+const size_t kBucketSize = 4;
+
+// the displacements tried for a bucket before Build gives up.
+const uint32_t kMaxDisplacement = 1 << 24;
+
+// the row of hash h of a key in a bucket of displacement d.
+inline uint32_t DisplacedRow(uint64_t h, uint32_t d, size_t num_rows) {
+  return PerfectHash::Mix(h + d * kGoldenRatio) % num_rows;
+}
+
+// The code of PerfectHash::Hash, PerfectHash::Mix and ModelData::Normalize in
+// the compiled models.
+const char kInternalFunctions[] =
+    "inline uint64_t Hash(const char* key, size_t length) {\n"
+    "  uint64_t h = 0xcbf29ce484222325ULL;\n"
+    "  for (size_t i = 0; i < length; ++i) {\n"
+    "    h ^= static_cast<unsigned char>(key[i]);\n"
+    "    h *= 0x100000001b3ULL;\n"
+    "  }\n"
+    "  return h;\n"
+    "}\n"
+    "\n"
+    "inline uint64_t Mix(uint64_t h) {\n"
+    "  h ^= h >> 33;\n"
+    "  h *= 0xff51afd7ed558ccdULL;\n"
+    "  h ^= h >> 33;\n"
+    "  h *= 0xc4ceb9fe1a85ec53ULL;\n"
+    "  h ^= h >> 33;\n"
+    "  return h;\n"
+    "}\n"
+    "\n"
+    "inline int32_t Normalize(double* prob_dist) {\n"
+    "  double max_score = prob_dist[0];\n"
+    "  for (int32_t y = 1; y < kNumLabels; ++y) {\n"
+    "    if (prob_dist[y] > max_score) { max_score = prob_dist[y]; }\n"
+    "  }\n"
+    "  // to avoid overflow\n"
+    "  const double offset = max_score - 700 > 0.0 ? max_score - 700 : 0.0;\n"
+    "  double sum = 0.0;\n"
+    "  for (int32_t y = 0; y < kNumLabels; ++y) {\n"
+    "    prob_dist[y] = exp(prob_dist[y] - offset);\n"
+    "    sum += prob_dist[y];\n"
+    "  }\n"
+    "  int32_t max_label = 0;\n"
+    "  if (sum > 0.0) {\n"
+    "    for (int32_t y = 0; y < kNumLabels; ++y) {\n"
+    "      prob_dist[y] /= sum;\n"
+    "      if (prob_dist[y] > prob_dist[max_label]) { max_label = y; }\n"
+    "    }\n"
+    "  }\n"
+    "  return max_label;\n"
+    "}\n";
+
+// s as a C++ string literal, every byte but the printable ASCII ones escaped
+// in octal.
+std::string Quote(const std::string& s) {
+  std::string quoted = "\"";
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\' || c == '?') {
+      quoted += '\\';
+      quoted += c;
+    } else if (c < 0x20 || c >= 0x7f) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\%03o", c);
+      quoted += buf;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// Splits name_space "a::b" into its namespaces, and returns false if any of
+// them is not an identifier.
+bool SplitNamespace(const std::string& name_space,
+                    std::vector<std::string>* names) {
+  names->clear();
+  std::string::size_type begin = 0;
+  while (true) {
+    const std::string::size_type end = name_space.find("::", begin);
+    const std::string name = name_space.substr(begin, end - begin);
+    if (name.empty() || isdigit(static_cast<unsigned char>(name[0]))) {
+      return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+      if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '_') {
+        return false;
+      }
+    }
+    names->push_back(name);
+    if (end == std::string::npos) { return true; }
+    begin = end + 2;
+  }
+}
+
+}  // namespace
+
+uint64_t PerfectHash::Hash(const char* key, size_t length) {
+  uint64_t h = kFnvOffsetBasis;
+  for (size_t i = 0; i < length; ++i) {
+    h ^= static_cast<unsigned char>(key[i]);
+    h *= kFnvPrime;
+  }
+  return h;
+}
+
+uint64_t PerfectHash::Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+bool PerfectHash::Build(const std::vector<std::string>& keys) {
+  rows_.clear();
+  displacements_.clear();
+  if (keys.empty()) { return false; }
+
+  const size_t num_rows = keys.size();
+  const size_t num_buckets = (num_rows + kBucketSize - 1) / kBucketSize;
+  std::vector<uint64_t> hashes(num_rows);
+  std::vector<std::vector<int32_t> > buckets(num_buckets);
+  for (size_t i = 0; i < num_rows; ++i) {
+    hashes[i] = Hash(keys[i].data(), keys[i].size());
+    buckets[hashes[i] % num_buckets].push_back(i);
+  }
+
+  // the largest buckets first, while most rows are free.
+  std::vector<int32_t> order(num_buckets);
+  for (size_t b = 0; b < num_buckets; ++b) { order[b] = b; }
+  std::stable_sort(order.begin(), order.end(),
+                   [&buckets](int32_t a, int32_t b) {
+                     return buckets[a].size() > buckets[b].size();
+                   });
+
+  std::vector<int32_t> key_of_row(num_rows, -1);
+  std::vector<uint32_t> displacements(num_buckets, 0);
+  std::vector<uint32_t> rows;
+  for (size_t k = 0; k < num_buckets; ++k) {
+    const std::vector<int32_t>& bucket = buckets[order[k]];
+    if (bucket.empty()) { break; }
+    // the keys of the same hash, e.g. duplicates, land on the same row.
+    for (size_t i = 1; i < bucket.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (hashes[bucket[i]] == hashes[bucket[j]]) { return false; }
+      }
+    }
+
+    uint32_t d = 0;
+    for (; d < kMaxDisplacement; ++d) {
+      rows.clear();
+      for (size_t i = 0; i < bucket.size(); ++i) {
+        const uint32_t row = DisplacedRow(hashes[bucket[i]], d, num_rows);
+        if (key_of_row[row] >= 0
+            || std::find(rows.begin(), rows.end(), row) != rows.end()) {
+          break;
+        }
+        rows.push_back(row);
+      }
+      if (rows.size() == bucket.size()) { break; }
+    }
+    if (d == kMaxDisplacement) { return false; }
+
+    displacements[order[k]] = d;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      key_of_row[rows[i]] = bucket[i];
+    }
+  }
+
+  rows_.resize(num_rows);
+  for (size_t row = 0; row < num_rows; ++row) {
+    assert(key_of_row[row] >= 0);
+    rows_[row] = keys[key_of_row[row]];
+  }
+  displacements_.swap(displacements);
+  return true;
+}
+
+int32_t PerfectHash::Row(const char* key, size_t length) const {
+  assert(!rows_.empty());
+  const uint64_t h = Hash(key, length);
+  return DisplacedRow(h, displacements_[h % displacements_.size()],
+                      rows_.size());
+}
+
+bool CompileModel(const ModelData& model_data,
+                  const std::string& name_space,
+                  const std::string& source,
+                  std::ostream* out) {
+  std::vector<std::string> namespaces;
+  if (!SplitNamespace(name_space, &namespaces)) {
+    std::cerr << "error: invalid namespace " << name_space << "!"
+        << std::endl;
+    return false;
+  }
+  if (model_data.CrossHashBits() > 0) {
+    std::cerr << "error: the feature crosses of a model cannot be compiled."
+        << std::endl;
+    return false;
+  }
+  const int32_t num_labels = model_data.NumClasses();
+  const int32_t num_names = model_data.NumFeatureNames();
+  if (num_labels == 0 || num_names == 0) {
+    std::cerr << "error: an empty model cannot be compiled." << std::endl;
+    return false;
+  }
+
+  std::vector<std::string> names(num_names);
+  for (int32_t id = 0; id < num_names; ++id) {
+    names[id] = model_data.FeatureName(id);
+  }
+  PerfectHash perfect_hash;
+  if (!perfect_hash.Build(names)) {
+    std::cerr << "error: cannot hash the feature names perfectly."
+        << std::endl;
+    return false;
+  }
+
+  // the dense weights by feature name id and label id.
+  std::vector<double> weights(static_cast<size_t>(num_names) * num_labels);
+  for (int32_t id = 0; id < model_data.NumFeatures(); ++id) {
+    const common::Feature& feature = model_data.FeatureAt(id);
+    weights[static_cast<size_t>(feature.FeatureNameId()) * num_labels
+            + feature.LabelId()] = model_data.Lambdas()[id];
+  }
+
+  std::string guard;
+  for (size_t i = 0; i < namespaces.size(); ++i) {
+    for (size_t k = 0; k < namespaces[i].size(); ++k) {
+      guard += toupper(static_cast<unsigned char>(namespaces[i][k]));
+    }
+    guard += '_';
+  }
+  guard += "H_";
+
+  const char* weight_type = sizeof(Scalar) == sizeof(float) ? "float"
+                                                            : "double";
+  const char* weight_format = sizeof(Scalar) == sizeof(float) ? "%.9g"
+                                                              : "%.17g";
+
+  std::ostream& o = *out;
+  o << "// Generated by maxent_compiler from " << source
+    << ". DO NOT EDIT!\n"
+    << "//\n"
+    << "// The maxent model of " << num_labels << " labels and " << num_names
+    << " feature names, pls refer to\n"
+    << "// mltk/maxent/model_compiler.h.\n"
+    << "\n"
+    << "#ifndef " << guard << "\n"
+    << "#define " << guard << "\n"
+    << "\n"
+    << "#include <math.h>\n"
+    << "#include <stddef.h>\n"
+    << "#include <stdint.h>\n"
+    << "#include <string.h>\n"
+    << "\n";
+  for (size_t i = 0; i < namespaces.size(); ++i) {
+    o << "namespace " << namespaces[i] << " {\n";
+  }
+  o << "\n"
+    << "constexpr int32_t kNumLabels = " << num_labels << ";\n"
+    << "constexpr int32_t kNumFeatureNames = " << num_names << ";\n"
+    << "\n"
+    << "// the labels by label id.\n"
+    << "constexpr const char* kLabels[kNumLabels] = {\n";
+  for (int32_t y = 0; y < num_labels; ++y) {
+    o << "  " << Quote(model_data.Label(y)) << ",\n";
+  }
+  o << "};\n"
+    << "\n"
+    << "namespace internal {\n"
+    << "\n"
+    << "constexpr size_t kNumBuckets = "
+    << perfect_hash.Displacements().size() << ";\n"
+    << "\n"
+    << "// the displacement of every bucket of the perfect hash.\n"
+    << "constexpr uint32_t kDisplacements[kNumBuckets] = {";
+  for (size_t b = 0; b < perfect_hash.Displacements().size(); ++b) {
+    o << (b % 10 == 0 ? "\n  " : " ") << perfect_hash.Displacements()[b]
+      << ",";
+  }
+  o << "\n};\n"
+    << "\n"
+    << "// the feature name of every row, from kNameOffsets[row] to\n"
+    << "// kNameOffsets[row + 1] of kNames.\n"
+    << "constexpr char kNames[] =";
+  for (int32_t row = 0; row < num_names; ++row) {
+    o << "\n    " << Quote(perfect_hash.Rows()[row]);
+  }
+  o << ";\n"
+    << "constexpr uint32_t kNameOffsets[kNumFeatureNames + 1] = {";
+  size_t offset = 0;
+  for (int32_t row = 0; row <= num_names; ++row) {
+    o << (row % 10 == 0 ? "\n  " : " ") << offset << ",";
+    if (row < num_names) { offset += perfect_hash.Rows()[row].size(); }
+  }
+  o << "\n};\n"
+    << "\n"
+    << "// the weights of every row by label id.\n"
+    << "constexpr " << weight_type
+    << " kWeights[kNumFeatureNames][kNumLabels] = {\n";
+  char buf[32];
+  for (int32_t row = 0; row < num_names; ++row) {
+    const std::string& name = perfect_hash.Rows()[row];
+    const size_t name_id = model_data.FeatureNameId(name);
+    o << "  {";
+    for (int32_t y = 0; y < num_labels; ++y) {
+      snprintf(buf, sizeof(buf), weight_format, weights[name_id * num_labels
+                                                        + y]);
+      o << (y > 0 ? ", " : "") << buf;
+    }
+    o << "},\n";
+  }
+  o << "};\n"
+    << "\n"
+    << kInternalFunctions
+    << "\n"
+    << "}  // namespace internal\n"
+    << "\n"
+    << "// Returns the row of the feature name of length bytes, or -1 if the "
+    << "model has\n"
+    << "// no such feature name.\n"
+    << "inline int32_t FindFeature(const char* name, size_t length) {\n"
+    << "  const uint64_t h = internal::Hash(name, length);\n"
+    << "  const uint64_t d = internal::kDisplacements[h % "
+    << "internal::kNumBuckets];\n"
+    << "  const int32_t row = static_cast<int32_t>(\n"
+    << "      internal::Mix(h + d * 0x9e3779b97f4a7c15ULL) % "
+    << "kNumFeatureNames);\n"
+    << "  const uint32_t begin = internal::kNameOffsets[row];\n"
+    << "  if (internal::kNameOffsets[row + 1] - begin != length\n"
+    << "      || memcmp(internal::kNames + begin, name, length) != 0) {\n"
+    << "    return -1;\n"
+    << "  }\n"
+    << "  return row;\n"
+    << "}\n"
+    << "\n"
+    << "// Adds value times the weights of row to scores[kNumLabels].\n"
+    << "inline void AddFeature(int32_t row, double value, double* scores) {\n"
+    << "  const " << weight_type << "* weights = internal::kWeights[row];\n";
+  for (int32_t y = 0; y < num_labels; ++y) {
+    o << "  scores[" << y << "] += weights[" << y << "] * value;\n";
+  }
+  o << "}\n"
+    << "\n"
+    << "// Calculates p(y|x) of the num_features features names[i] of "
+    << "values[i] into\n"
+    << "// prob_dist[kNumLabels], skipping the unknown feature names, and "
+    << "returns the\n"
+    << "// most probable label id.\n"
+    << "inline int32_t Predict(const char* const* names, const double* "
+    << "values,\n"
+    << "                       size_t num_features, double* prob_dist) {\n"
+    << "  for (int32_t y = 0; y < kNumLabels; ++y) { prob_dist[y] = 0.0; }\n"
+    << "  for (size_t i = 0; i < num_features; ++i) {\n"
+    << "    const int32_t row = FindFeature(names[i], strlen(names[i]));\n"
+    << "    if (row >= 0) { AddFeature(row, values[i], prob_dist); }\n"
+    << "  }\n"
+    << "  return internal::Normalize(prob_dist);\n"
+    << "}\n"
+    << "\n";
+  for (size_t i = namespaces.size(); i > 0; --i) {
+    o << "}  // namespace " << namespaces[i - 1] << "\n";
+  }
+  o << "\n"
+    << "#endif  // " << guard << "\n";
+  return static_cast<bool>(o);
+}
+
+}  // namespace maxent
+}  // namespace mltk
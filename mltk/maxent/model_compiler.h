@@ -0,0 +1,79 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Compiles a small maxent model of a fixed feature inventory into a
+// self-contained C++ header.
+
+#ifndef MLTK_MAXENT_MODEL_COMPILER_H_
+#define MLTK_MAXENT_MODEL_COMPILER_H_
+
+#include <stdint.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+// A minimal perfect hash of a fixed set of keys into the rows 0 ... n-1, by
+// hash and displace: every key is hashed once into 64 bits, which pick its
+// bucket, and the displacement of the bucket picks its row. Build tries the
+// displacements of the buckets from the largest bucket on, until all the keys
+// of a bucket land on free rows. The compiled models look their feature names
+// up this way, with the code of PerfectHash printed into them.
+class PerfectHash {
+ public:
+  PerfectHash() {}
+  ~PerfectHash() {}
+
+  // Returns false if keys has duplicates, or cannot be hashed perfectly.
+  bool Build(const std::vector<std::string>& keys);
+
+  // Returns the row of a key of Build in 0 ... NumRows() - 1, or any row for
+  // the other keys.
+  int32_t Row(const char* key, size_t length) const;
+
+  int32_t NumRows() const { return rows_.size(); }
+
+  // the keys of Build by row.
+  const std::vector<std::string>& Rows() const { return rows_; }
+
+  // the displacement of every bucket.
+  const std::vector<uint32_t>& Displacements() const {
+    return displacements_;
+  }
+
+  // FNV-1a of the bytes of key, and the finalizer of MurmurHash3.
+  static uint64_t Hash(const char* key, size_t length);
+  static uint64_t Mix(uint64_t h);
+
+ private:
+  std::vector<std::string> rows_;
+  std::vector<uint32_t> displacements_;
+};
+
+// Prints the model of model_data into out as a C++ header of namespace
+// name_space, e.g. "spam::model", which depends on the C library only.
+// The header keeps the labels, a PerfectHash of the feature names into the
+// rows of a constexpr table of their weights of every label, and inline
+// functions to look up a feature name, to add the weights of a feature to the
+// scores, unrolled over the labels, and to calculate p(y|x) of an instance,
+// as ModelData::CalcConditionalProbability does. source names the model in
+// the comment of the header.
+//
+// The weights are kept dense, NumFeatureNames() x NumClasses(), so it suits
+// the models of a few thousand feature names and a handful of labels, e.g. of
+// the latency-critical paths. Returns false, printing why, if the model is
+// empty, crosses features, or name_space is not a C++ namespace.
+bool CompileModel(const common::ModelData& model_data,
+                  const std::string& name_space,
+                  const std::string& source,
+                  std::ostream* out);
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_MODEL_COMPILER_H_
@@ -0,0 +1,132 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/model_compiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "mltk/common/instance.h"
+#include "mltk/common/model_data.h"
+#include "mltk/maxent/maxent.h"
+
+// the header compiled from kTestModelFile by maxent_compiler on build.
+#include "compiled_test_model.h"
+
+using mltk::common::Instance;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+using mltk::maxent::CompileModel;
+using mltk::maxent::MaxEnt;
+using mltk::maxent::PerfectHash;
+
+const static std::string kTestModelFile = MLTK_TEST_MODEL_FILE;
+
+TEST(PerfectHash, Build) {
+  std::vector<std::string> keys;
+  for (int32_t i = 0; i < 1000; ++i) {
+    std::ostringstream key;
+    key << "feature" << i;
+    keys.push_back(key.str());
+  }
+  keys.push_back("");
+  keys.push_back(std::string("\0\1", 2));
+
+  PerfectHash perfect_hash;
+  ASSERT_TRUE(perfect_hash.Build(keys));
+  ASSERT_EQ(static_cast<int32_t>(keys.size()), perfect_hash.NumRows());
+  std::set<int32_t> rows;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const int32_t row = perfect_hash.Row(keys[i].data(), keys[i].size());
+    ASSERT_GE(row, 0);
+    ASSERT_LT(row, perfect_hash.NumRows());
+    EXPECT_EQ(keys[i], perfect_hash.Rows()[row]);
+    rows.insert(row);
+  }
+  EXPECT_EQ(keys.size(), rows.size());
+
+  keys.push_back("feature7");
+  EXPECT_FALSE(perfect_hash.Build(keys));
+  EXPECT_FALSE(perfect_hash.Build(std::vector<std::string>()));
+}
+
+TEST(ModelCompiler, Compile) {
+  ModelData model_data;
+  ASSERT_TRUE(model_data.Load(kTestModelFile));
+
+  std::ostringstream header;
+  ASSERT_TRUE(CompileModel(model_data, "spam::model", "test.model", &header));
+  EXPECT_NE(std::string::npos, header.str().find("#ifndef SPAM_MODEL_H_"));
+  EXPECT_NE(std::string::npos, header.str().find("namespace model {"));
+
+  std::ostringstream invalid;
+  EXPECT_FALSE(CompileModel(model_data, "spam::", "test.model", &invalid));
+  EXPECT_FALSE(CompileModel(model_data, "1spam", "test.model", &invalid));
+  EXPECT_FALSE(CompileModel(model_data, "spam-model", "test.model",
+                            &invalid));
+  EXPECT_FALSE(CompileModel(ModelData(), "spam", "test.model", &invalid));
+
+  ASSERT_TRUE(model_data.UseFeatureCrosses("u:i", 8));
+  EXPECT_FALSE(CompileModel(model_data, "spam", "test.model", &invalid));
+}
+
+TEST(ModelCompiler, CompiledModel) {
+  ModelData model_data;
+  ASSERT_TRUE(model_data.Load(kTestModelFile));
+  ASSERT_EQ(model_data.NumClasses(), test_model::kNumLabels);
+  ASSERT_EQ(model_data.NumFeatureNames(), test_model::kNumFeatureNames);
+  for (int32_t y = 0; y < test_model::kNumLabels; ++y) {
+    EXPECT_EQ(model_data.Label(y), test_model::kLabels[y]);
+  }
+
+  std::set<int32_t> rows;
+  std::vector<std::string> names;
+  for (int32_t id = 0; id < model_data.NumFeatureNames(); ++id) {
+    const std::string& name = model_data.FeatureName(id);
+    const int32_t row = test_model::FindFeature(name.data(), name.size());
+    ASSERT_GE(row, 0);
+    rows.insert(row);
+    names.push_back(name);
+  }
+  EXPECT_EQ(names.size(), rows.size());
+  EXPECT_EQ(-1, test_model::FindFeature("no_such_feature", 15));
+  EXPECT_EQ(-1, test_model::FindFeature(names[0].data(),
+                                        names[0].size() - 1));
+
+  // the unknown feature names are skipped, as MaxEnt::Predict does.
+  names.push_back("no_such_feature");
+  MaxEnt maxent;
+  ASSERT_TRUE(maxent.LoadModel(kTestModelFile));
+  srand(1);
+  for (int32_t n = 0; n < 200; ++n) {
+    Instance instance;
+    std::vector<const char*> feature_names;
+    std::vector<double> values;
+    const int32_t num_features = 1 + rand() % 10;
+    for (int32_t i = 0; i < num_features; ++i) {
+      feature_names.push_back(names[rand() % names.size()].c_str());
+      // as stored in a MemInstance, e.g. rounded to float by single_precision.
+      values.push_back(static_cast<Scalar>(
+          n % 2 == 0 ? 1.0 : (rand() % 100) / 10.0));
+      instance.AddFeature(feature_names.back(), values.back());
+    }
+
+    std::vector<double> prob_dist(test_model::kNumLabels);
+    const int32_t label_id = test_model::Predict(feature_names.data(),
+                                                 values.data(),
+                                                 feature_names.size(),
+                                                 prob_dist.data());
+    const std::vector<double> expected = maxent.Predict(&instance);
+    ASSERT_EQ(expected.size(), prob_dist.size());
+    for (size_t y = 0; y < expected.size(); ++y) {
+      EXPECT_NEAR(expected[y], prob_dist[y], 1E-9);
+    }
+    EXPECT_EQ(instance.label(), test_model::kLabels[label_id]);
+  }
+}
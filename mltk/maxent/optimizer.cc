@@ -3,6 +3,10 @@
 
 #include "mltk/maxent/optimizer.h"
 
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
 #include <vector>
 
 #include "mltk/common/instance.h"
@@ -15,6 +19,55 @@ namespace maxent {
 using mltk::common::Instance;
 using mltk::common::MemInstance;
 using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+void Optimizer::EstimateParamater(const std::vector<Instance>& instances,
+                                  int32_t num_heldout,
+                                  int32_t feature_cutoff,
+                                  ModelData* model_data) {
+  CheckSettings();
+  InitFromInstances(instances, num_heldout, feature_cutoff, model_data);
+  Optimize();
+}
+
+void Optimizer::EstimateParamater(
+    const std::vector<const MemInstance*>& train_data,
+    const std::vector<const MemInstance*>& heldout_data,
+    int32_t feature_cutoff,
+    ModelData* model_data) {
+  CheckSettings();
+  InitFromMemInstances(train_data, heldout_data, feature_cutoff, model_data);
+  Optimize();
+}
+
+bool Optimizer::EstimateParamaterOnShard(
+    const std::vector<const MemInstance*>& shard,
+    double total_weight,
+    ModelData* model_data) {
+  assert(model_data != NULL);
+  assert(total_weight > 0);
+  CheckSettings();
+  if (shard.size() == 0) {
+    std::cerr << "error: no training data." << std::endl;
+    return false;
+  }
+  model_data_ = model_data;
+  instances_.clear();
+  train_data_ = shard;
+  heldout_data_.clear();
+
+  // InitEstimation normalizes the regularizers by the weight of the shard.
+  double shard_weight = 0.0;
+  for (size_t n = 0; n < shard.size(); ++n) {
+    shard_weight += shard[n]->weight();
+  }
+  l1reg_ *= shard_weight / total_weight;
+  l2reg_ *= shard_weight / total_weight;
+
+  if (!InitEstimation()) { return false; }
+  Optimize();
+  return true;
+}
 
 bool Optimizer::InitFromInstances(const std::vector<Instance>& instances,
                                   int32_t num_heldout,
@@ -29,44 +82,96 @@ bool Optimizer::InitFromInstances(const std::vector<Instance>& instances,
   model_data_->InitFromInstances(instances, feature_cutoff);
 
   // mapping common::Instance to common::MemInstance
+  instances_.clear();
+  instances_.resize(instances.size());
   for (size_t n = 0; n < instances.size(); ++n) {
-    train_data_.push_back(MemInstance());
-    MemInstance& mem_instance = train_data_.back();
-
-    model_data_->FormatInstance(instances[n], &mem_instance);
+    model_data_->FormatInstance(instances[n], &instances_[n]);
   }
-  if (train_data_.size() == 0) {
+  if (instances_.size() == 0) {
     std::cerr << "error: no training data." << std::endl;
     return false;
   }
   std::cerr << "done" << std::endl;
 
   // preparing for heldout data
-  if (num_heldout >= static_cast<int32_t>(train_data_.size())) {
+  if (num_heldout >= static_cast<int32_t>(instances_.size())) {
     std::cerr << "error: too much heldout data. no training data is available."
         << std::endl;
     return false;
   }
-  for (int32_t i = 0; i < num_heldout; ++i) {
-    heldout_data_.push_back(train_data_.back());
-    train_data_.pop_back();
+  const size_t num_train = CollapseDuplicates(instances_.size() - num_heldout);
+  train_data_.clear();
+  heldout_data_.clear();
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    if (n < num_train) {
+      train_data_.push_back(&instances_[n]);
+    } else {
+      heldout_data_.push_back(&instances_[n]);
+    }
   }
 
+  return InitEstimation();
+}
+
+size_t Optimizer::CollapseDuplicates(size_t num_train) {
+  if (!deduplication_) { return num_train; }
+
+  std::cerr << "collapse duplicate instances...";
+  const size_t num_left
+      = common::CollapseDuplicateInstances(num_train, &instances_);
+  std::cerr << "done, " << num_train << " -> " << num_left << std::endl;
+  return num_left;
+}
+
+bool Optimizer::InitFromMemInstances(
+    const std::vector<const MemInstance*>& train_data,
+    const std::vector<const MemInstance*>& heldout_data,
+    int32_t feature_cutoff,
+    ModelData* model_data) {
+  std::cerr << "preparing for estimation..." << std::endl;
+  if (train_data.size() == 0) {
+    std::cerr << "error: no training data." << std::endl;
+    return false;
+  }
+
+  // initialize model on the training data only
+  std::cerr << "initialize model data...";
+  assert(model_data != NULL);
+  model_data_ = model_data;
+  model_data_->InitFromMemInstances(train_data, feature_cutoff);
+  std::cerr << "done" << std::endl;
+
+  instances_.clear();
+  train_data_ = train_data;
+  heldout_data_ = heldout_data;
+
+  return InitEstimation();
+}
+
+bool Optimizer::InitEstimation() {
   std::cerr << "number of classes = " << model_data_->NumClasses() << std::endl;
   std::cerr << "number of features = " << model_data_->NumFeatures()
       << std::endl;
   std::cerr << "number of training instances = " << train_data_.size()
       << std::endl;
+  train_weight_ = 0.0;
+  for (size_t n = 0; n < train_data_.size(); ++n) {
+    train_weight_ += train_data_[n]->weight();
+  }
+  if (train_weight_ != train_data_.size()) {
+    std::cerr << "weight of training instances = " << train_weight_
+        << std::endl;
+  }
   std::cerr << "number of heldout instances = " << heldout_data_.size()
       << std::endl;
 
   // normalize l1 & l2 regularizer
   if (l1reg_ > 0) {
-    l1reg_ /= train_data_.size();
+    l1reg_ /= train_weight_;
     std::cerr << "L1 regularizer = " << l1reg_ << std::endl;
   }
   if (l2reg_ > 0) {
-    l2reg_ /= train_data_.size();
+    l2reg_ /= train_weight_;
     std::cerr << "L2 regularizer = " << l2reg_ << std::endl;
   }
   if (l1reg_ > 0 && l2reg_ > 0) {
@@ -77,11 +182,118 @@ bool Optimizer::InitFromInstances(const std::vector<Instance>& instances,
 
   InitEmpiricalExpection();
 
+  // the counters count the calling thread, i.e. the one of the estimation,
+  // and the threads of parallel_expectation_ it starts every pass.
+  perf_counters_.reset();
+  pass_perf_counts_ = ::common::PerfCounts();
+  if (perf_counting_) {
+    perf_counters_.reset(new ::common::PerfCounters());
+    if (!perf_counters_->IsAvailable()) {
+      std::cerr << "warning: no performance counter is available, e.g. by "
+          << "perf_event_paranoid." << std::endl;
+      perf_counters_.reset();
+    }
+  }
+
+  expansion_cache_.Clear();
+  if (expansion_cache_bytes_ > 0 && !parallel_expectation_) {
+    std::cerr << "expanding instances...";
+    const size_t num_expanded = expansion_cache_.Init(
+        *model_data_, train_data_, expansion_cache_bytes_);
+    std::cerr << "done, " << num_expanded << " of " << train_data_.size()
+        << std::endl;
+  }
+
+  if (parallel_expectation_ && numa_layout_) {
+    const ::common::NumaTopology topology = ::common::NumaTopology::Detect();
+    if (parallel_expectation_->UseTopology(topology)) {
+      std::cerr << "distributing instances on NUMA nodes "
+          << topology.ToString() << "...";
+      parallel_expectation_->Distribute(*model_data_, train_data_);
+      std::cerr << "done" << std::endl;
+    } else {
+      std::cerr << "a single NUMA node, the layout stays uniform."
+          << std::endl;
+    }
+  }
+
+  std::cerr << "memory of model: "
+      << model_data_->MemoryUsage().ToString() << std::endl;
+  std::cerr << "memory of optimizer: " << MemoryUsage().ToString()
+      << std::endl;
+
+  return true;
+}
+
+common::MemoryBreakdown Optimizer::MemoryUsage() const {
+  common::MemoryBreakdown breakdown;
+  size_t instances_bytes = common::MemoryBreakdown::Of(instances_);
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    instances_bytes += instances_[n].MemoryUsage();
+  }
+  breakdown.Add("instances", instances_bytes);
+  breakdown.Add("train_data", common::MemoryBreakdown::Of(train_data_));
+  breakdown.Add("heldout_data", common::MemoryBreakdown::Of(heldout_data_));
+  breakdown.Add("expansion_cache", expansion_cache_.MemoryUsage());
+  if (model_data_ != NULL) {
+    AddStateMemoryUsage(model_data_->NumFeatures(), &breakdown);
+  }
+  return breakdown;
+}
+
+void Optimizer::AddStateMemoryUsage(
+    int32_t num_features, common::MemoryBreakdown* breakdown) const {
+  breakdown->Add("expectations", 2 * common::MemoryBreakdown::HeapBytes(
+      num_features * sizeof(double)));
+  if (parallel_expectation_) {
+    breakdown->Add(parallel_expectation_->IsNumaAware()
+                   ? "numa_shards" : "shard_expectations",
+                   parallel_expectation_->MemoryUsage(num_features));
+  }
+}
+
+bool Optimizer::WarmRestart(double l1reg, ModelData* model_data) {
+  if (model_data_ == NULL || train_data_.size() == 0) {
+    std::cerr << "error: no model is estimated before." << std::endl;
+    return false;
+  }
+  assert(model_data != NULL);
+  assert(model_data->NumFeatures() == model_data_->NumFeatures());
+  model_data_ = model_data;
+
+  // the empirical expectation stays, as the features and data do.
+  l1reg_ = l1reg / train_weight_;
+  std::cerr << "L1 regularizer = " << l1reg_ << std::endl;
+  pass_perf_counts_ = ::common::PerfCounts();
+  Optimize();
+
+  return true;
+}
+
+bool Optimizer::Converged(int32_t iter, double f) {
+  static const size_t kPast = 5;  // the iterations to compare against
+  if (tolerance_ <= 0) { return false; }
+  if (iter == 0) { objectives_.clear(); }
+  objectives_.push_back(f);
+  if (objectives_.size() <= kPast) { return false; }
+
+  const double past = objectives_.front();  // of iteration iter - kPast
+  objectives_.erase(objectives_.begin());
+  return past - f < tolerance_ * fabs(f);
+}
+
+bool Optimizer::EvaluateHeldout(double* logl, double* accuracy) {
+  assert(logl != NULL && accuracy != NULL);
+  if (model_data_ == NULL || heldout_data_.size() == 0) { return false; }
+
+  *logl = CalcHeldoutLikelihood();
+  *accuracy = heldout_accuracy_;
   return true;
 }
 
 void Optimizer::InitEmpiricalExpection() {
-  // calc E_p1 (f), p1(x, y) = count(x, y) / N
+  // calc E_p1 (f), p1(x, y) = count(x, y) / N, where an instance counts by
+  // its weight
   std::cerr << "calculating empirical expectation...";
 
   empirical_expectation_.resize(model_data_->NumFeatures());
@@ -90,14 +302,16 @@ void Optimizer::InitEmpiricalExpection() {
   }
 
   for (size_t n = 0; n < train_data_.size(); ++n) {
-    for (MemInstance::ConstIterator citer(train_data_[n]);
+    const double weight = train_data_[n]->weight();
+    for (MemInstance::ConstIterator citer(*train_data_[n]);
          !citer.Done(); citer.Next()) {
       const std::vector<int32_t> feature_ids
           = model_data_->FeatureIds(citer.FeatureNameId());
       for (size_t i = 0; i < feature_ids.size(); ++i) {
         if (model_data_->FeatureAt(feature_ids[i]).LabelId()
             == citer.LabelId()) {
-          empirical_expectation_[feature_ids[i]] += citer.FeatureValue();
+          empirical_expectation_[feature_ids[i]]
+              += weight * citer.FeatureValue();
           break;
         }
       }
@@ -105,17 +319,29 @@ void Optimizer::InitEmpiricalExpection() {
   }
 
   for (int32_t i = 0; i < model_data_->NumFeatures(); ++i) {
-    empirical_expectation_[i] /= train_data_.size();
+    empirical_expectation_[i] /= train_weight_;
   }
   std::cerr << "done" << std::endl;
 }
 
-double Optimizer::FunctionGradient(const std::vector<double>& x,
-                                   std::vector<double>* grad) {
+double Optimizer::FunctionGradient(const std::vector<Scalar>& x,
+                                   std::vector<Scalar>* grad,
+                                   std::vector<double>* probs) {
   assert(static_cast<size_t>(model_data_->NumFeatures()) == x.size());
 
   model_data_->UpdateLambdas(x);
-  double score = UpdateModelExpectation();
+  double score = 0.0;
+  if (perf_counters_) {
+    ::common::PerfCounts counts;
+    {
+      ::common::ScopedPerfCounting counting(perf_counters_.get(), &counts);
+      score = UpdateModelExpectation(probs);
+    }
+    pass_perf_counts_ += counts;
+    std::cerr << "\tpass: " << counts.ToString() << std::endl;
+  } else {
+    score = UpdateModelExpectation(probs);
+  }
 
   // update gradient
   if (l2reg_ == 0) {
@@ -124,7 +350,7 @@ double Optimizer::FunctionGradient(const std::vector<double>& x,
     }
   } else {
     const double c = l2reg_ * 2;
-    const std::vector<double>& lambdas = model_data_->Lambdas();
+    const std::vector<Scalar>& lambdas = model_data_->Lambdas();
     for (size_t i = 0; i < x.size(); ++i) {
       (*grad)[i] = model_expectation_[i] - empirical_expectation_[i]
                    + c * lambdas[i];
@@ -134,64 +360,118 @@ double Optimizer::FunctionGradient(const std::vector<double>& x,
   return -score;
 }
 
-double Optimizer::UpdateModelExpectation() {
+double Optimizer::UpdateModelExpectation(std::vector<double>* probs) {
   double logl = 0;
-  int32_t ncorrect = 0;
+  double ncorrect = 0;  // the weight of the instances predicted right
 
   model_expectation_.resize(model_data_->NumFeatures());
   for (int i = 0; i < model_data_->NumFeatures(); ++i) {
     model_expectation_[i] = 0;
   }
+  const int32_t num_classes = model_data_->NumClasses();
+  if (probs != NULL) { probs->resize(train_data_.size() * num_classes); }
 
-  for (size_t n = 0; n < train_data_.size(); ++n) {
-    std::vector<double> prob_dist(model_data_->NumClasses());
-    int32_t max_label = model_data_->CalcConditionalProbability(
-        train_data_[n], &prob_dist);
+  if (parallel_expectation_) {
+    logl = parallel_expectation_->Update(*model_data_, train_data_,
+                                         &model_expectation_, &ncorrect,
+                                         probs);
+  } else {
+    const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+    const size_t num_expanded = expansion_cache_.NumInstances();
+    for (size_t n = 0; n < train_data_.size(); ++n) {
+      std::vector<double> prob_dist(num_classes);
+      const bool expanded = n < num_expanded;
+      int32_t max_label = expanded
+          ? expansion_cache_.CalcConditionalProbability(n, lambdas, &prob_dist)
+          : model_data_->CalcConditionalProbability(*train_data_[n],
+                                                    &prob_dist);
+      if (probs != NULL) {
+        std::copy(prob_dist.begin(), prob_dist.end(),
+                  probs->begin() + n * num_classes);
+      }
 
-    logl += log(prob_dist[train_data_[n].label_id()]);
-    if (max_label == train_data_[n].label_id()) { ++ncorrect; }
+      const double weight = train_data_[n]->weight();
+      logl += weight * log(prob_dist[train_data_[n]->label_id()]);
+      if (max_label == train_data_[n]->label_id()) { ncorrect += weight; }
 
-    // model_expectation
-    for (MemInstance::ConstIterator citer(train_data_[n]);
-         !citer.Done(); citer.Next()) {
-      const std::vector<int32_t>& feature_ids
-          = model_data_->FeatureIds(citer.FeatureNameId());
-      for (size_t i = 0; i < feature_ids.size(); ++i) {
-        const int32_t feature_id = feature_ids[i];
-        model_expectation_[feature_id]
-          += prob_dist[model_data_->FeatureAt(feature_id).LabelId()]
-             * citer.FeatureValue();
+      // model_expectation, by the probabilities weighted once per instance,
+      // so a binary instance only adds them up.
+      for (size_t k = 0; k < prob_dist.size(); ++k) { prob_dist[k] *= weight; }
+      if (expanded) {
+        expansion_cache_.AddExpectation(n, prob_dist, &model_expectation_);
+        continue;
+      }
+      const bool binary = train_data_[n]->IsBinary();
+      for (MemInstance::ConstIterator citer(*train_data_[n]);
+           !citer.Done(); citer.Next()) {
+        const std::vector<int32_t>& feature_ids
+            = model_data_->FeatureIds(citer.FeatureNameId());
+        if (binary) {
+          for (size_t i = 0; i < feature_ids.size(); ++i) {
+            const int32_t feature_id = feature_ids[i];
+            model_expectation_[feature_id]
+              += prob_dist[model_data_->FeatureAt(feature_id).LabelId()];
+          }
+          continue;
+        }
+        const double value = citer.FeatureValue();
+        for (size_t i = 0; i < feature_ids.size(); ++i) {
+          const int32_t feature_id = feature_ids[i];
+          model_expectation_[feature_id]
+            += prob_dist[model_data_->FeatureAt(feature_id).LabelId()] * value;
+        }
       }
     }
   }
 
-  const std::vector<double>& lambdas = model_data_->Lambdas();
   for (int32_t i = 0; i < model_data_->NumFeatures(); ++i) {
-    model_expectation_[i] /= train_data_.size();
-    if (l2reg_ > 0) { logl -= lambdas[i] * lambdas[i] * l2reg_; }
+    model_expectation_[i] /= train_weight_;
   }
+  logl /= train_weight_;
 
-  train_accuracy_ = static_cast<double>(ncorrect) / train_data_.size();
+  // l2reg_ is normalized by the weight already, as in the gradient.
+  if (l2reg_ > 0) {
+    const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+    for (int32_t i = 0; i < model_data_->NumFeatures(); ++i) {
+      logl -= lambdas[i] * lambdas[i] * l2reg_;
+    }
+  }
+
+  train_accuracy_ = ncorrect / train_weight_;
 
-  return logl / train_data_.size();
+  return logl;
+}
+
+void Optimizer::DrawByWeight(const std::vector<double>& cumulative_weights,
+                             std::vector<int32_t>* instance_ids) {
+  const double total_weight = cumulative_weights.back();
+  for (size_t i = 0; i < instance_ids->size(); ++i) {
+    const double r = (rand() + 0.5) / (RAND_MAX + 1.0) * total_weight;
+    (*instance_ids)[i] = std::upper_bound(cumulative_weights.begin(),
+                                          cumulative_weights.end(), r)
+                         - cumulative_weights.begin();
+  }
 }
 
 double Optimizer::CalcHeldoutLikelihood() {
   double logl = 0;
-  int32_t ncorrect = 0;
+  double ncorrect = 0;
+  double heldout_weight = 0;
 
-  for (std::vector<MemInstance>::const_iterator citer = heldout_data_.begin();
-       citer != heldout_data_.end(); ++citer) {
+  for (size_t n = 0; n < heldout_data_.size(); ++n) {
+    const MemInstance& mem_instance = *heldout_data_[n];
     std::vector<double> prob_dist(model_data_->NumClasses());
-    int32_t label_id = model_data_->CalcConditionalProbability(*citer,
+    int32_t label_id = model_data_->CalcConditionalProbability(mem_instance,
                                                               &prob_dist);
-    logl += log(prob_dist[citer->label_id()]);
-    if (label_id == citer->label_id()) { ++ncorrect; }
+    const double weight = mem_instance.weight();
+    logl += weight * log(prob_dist[mem_instance.label_id()]);
+    if (label_id == mem_instance.label_id()) { ncorrect += weight; }
+    heldout_weight += weight;
   }
 
-  heldout_accuracy_ = static_cast<double>(ncorrect) / heldout_data_.size();
+  heldout_accuracy_ = ncorrect / heldout_weight;
 
-  return logl / heldout_data_.size();
+  return logl / heldout_weight;
 }
 
 }  // namespace maxent
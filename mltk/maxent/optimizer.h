@@ -6,31 +6,176 @@
 #ifndef MLTK_MAXENT_OPTIMIZER_H_
 #define MLTK_MAXENT_OPTIMIZER_H_
 
+#include <iostream>
+#include <memory>
 #include <vector>
 
+#include "common/system/perf/perf_counters.h"
 #include "mltk/common/instance.h"
 #include "mltk/common/mem_instance.h"
+#include "mltk/common/memory_breakdown.h"
 #include "mltk/common/model_data.h"
+#include "mltk/common/scalar.h"
+#include "mltk/maxent/expansion_cache.h"
+#include "mltk/maxent/parallel_expectation.h"
 
 namespace mltk {
 namespace maxent {
 
 class Optimizer {
  public:
-  Optimizer() : model_data_(NULL), l1reg_(0.0), l2reg_(0.0) {}
+  Optimizer() : train_weight_(0.0), model_data_(NULL), l1reg_(0.0),
+                l2reg_(0.0), tolerance_(0.0), num_iterations_(0),
+                deduplication_(false), numa_layout_(false),
+                expansion_cache_bytes_(0), perf_counting_(false) {}
   virtual ~Optimizer() {}
 
   void UseL1Reg(double l1reg) { l1reg_ = l1reg; }
   void UseL2Reg(double l2reg) { l2reg_ = l2reg; }
 
-  // paramater estimation
+  // Stops LBFGS and OWLQN before the total iterations once the objective
+  // decreases by less than tolerance, relatively, over the last few
+  // iterations. 0 means never.
+  void UseConvergenceTolerance(double tolerance) { tolerance_ = tolerance; }
+
+  // Collapses the duplicate training instances formatted from
+  // common::Instance into weighted ones before the estimation, pls refer to
+  // common::CollapseDuplicateInstances. The instances owned by the caller are
+  // never changed, but may be collapsed before, and weighted anyway.
+  void UseDeduplication(bool deduplication) { deduplication_ = deduplication; }
+
+  // Calculates the model expectation of LBFGS and OWLQN on num_data_threads x
+  // num_label_threads threads, pls refer to ParallelExpectation. Label
+  // threads share the memory of their data shard, so they suit the models of
+  // many labels. 1 x 1 means a single thread.
+  void UseThreads(int32_t num_data_threads, int32_t num_label_threads) {
+    if (num_data_threads * num_label_threads > 1) {
+      parallel_expectation_.reset(
+          new ParallelExpectation(num_data_threads, num_label_threads));
+    } else {
+      parallel_expectation_.reset();
+    }
+  }
+
+  // Lays the data shards of UseThreads out on the NUMA nodes of the machine,
+  // with the threads of every shard pinned to the cpus of its node, pls refer
+  // to ParallelExpectation::UseTopology. It keeps the uniform layout on a
+  // single node, and copies the training instances once more otherwise.
+  void UseNumaLayout(bool numa_layout) { numa_layout_ = numa_layout; }
+
+  // Expands the features f(x, y) of the training instances once for the
+  // model expectation of every pass on a single thread, e.g. of LBFGS, OWLQN,
+  // TRON and SVRG, pls refer to ExpansionCache. The instances beyond
+  // max_bytes are expanded on the fly every pass. 0 means no cache.
+  void UseExpansionCache(size_t max_bytes) {
+    expansion_cache_bytes_ = max_bytes;
+  }
+
+  // Counts the hardware events of every pass of FunctionGradient over the
+  // training data, e.g. of LBFGS, OWLQN and TRON, and prints them after the
+  // pass, e.g. its IPC and LLC misses, pls refer to ::common::PerfCounters.
+  // The threads of UseThreads are counted too, as every pass starts and joins
+  // them. It warns and does nothing if no counter is available, e.g. in most
+  // virtual machines.
+  void UsePerfCounters(bool perf_counters) { perf_counting_ = perf_counters; }
+
+  // the counts of all the passes counted by the last estimation.
+  const ::common::PerfCounts& PassPerfCounts() const {
+    return pass_perf_counts_;
+  }
+
+  // paramater estimation, holding out the last num_heldout instances.
   virtual void EstimateParamater(const std::vector<common::Instance>& instances,
                                  int32_t num_heldout,
                                  int32_t feature_cutoff,
-                                 common::ModelData* model_data) = 0;
+                                 common::ModelData* model_data);
+
+  // paramater estimation on the instances interned by the vocabularies of
+  // model_data already, e.g. by ModelData::InternInstance. The instances are
+  // only read, so many optimizers may share them at the same time, e.g. the
+  // folds of cross-validation. The features are counted on train_data only.
+  virtual void EstimateParamater(
+      const std::vector<const common::MemInstance*>& train_data,
+      const std::vector<const common::MemInstance*>& heldout_data,
+      int32_t feature_cutoff,
+      common::ModelData* model_data);
+
+  // paramater estimation on a shard of the training data of model_data,
+  // whose features are kept, starting from the lambdas it has, e.g. a
+  // worker of ParameterMixing. The regularizers are normalized by
+  // total_weight, the weight of all shards, rather than by the one of
+  // shard, so the objectives of the shards add up to the one of all of them.
+  // Returns false if the shard is empty or the settings are invalid.
+  bool EstimateParamaterOnShard(
+      const std::vector<const common::MemInstance*>& shard,
+      double total_weight,
+      common::ModelData* model_data);
+
+  // Reestimates the model of the last estimation on the same data with
+  // another L1 regularizer, warm-started from the lambdas of model_data, which
+  // is that model or a copy of it. The data of the last estimation must still
+  // be alive. Along a decreasing sequence of l1reg, a.k.a. the L1
+  // regularization path, every solve starts near its solution, so it takes a
+  // fraction of the iterations from zero lambdas. Only OWLQN and SGD support
+  // it.
+  virtual bool ReestimateWithL1Reg(double l1reg,
+                                   common::ModelData* model_data) {
+    std::cerr << "error: the L1 regularization path is not supported by the "
+        << "optimizer, pls use OWLQN or SGD." << std::endl;
+    return false;
+  }
+
+  // The heap memory of the optimizer by its members, excluding the model and
+  // the instances owned by the caller.
+  common::MemoryBreakdown MemoryUsage() const;
+
+  // Adds the memory of the state of optimizing num_features features, e.g.
+  // the expectations and the LBFGS history, whether it is allocated yet or
+  // not, so it also estimates the memory before training.
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+  // the iterations taken by the last estimation.
+  int32_t NumIterations() const { return num_iterations_; }
+
+  // The mean log-likelihood and the accuracy of the last estimated model on
+  // its heldout data. Returns false if there is no heldout data.
+  bool EvaluateHeldout(double* logl, double* accuracy);
+
+  // paramater estimation in a single pass over the instances read from in,
+  // one instance per line. Only online optimizers support it.
+  virtual bool EstimateParamaterFromStream(std::istream* in,
+                                           common::ModelData* model_data) {
+    std::cerr << "error: training from a stream is not supported by the "
+        << "optimizer, pls use FTRL or ADAGRAD." << std::endl;
+    return false;
+  }
+
+  // paramater estimation on the instances read from in, one instance per
+  // line, of which the last num_heldout are heldout, interning them on a
+  // reader thread while the first iteration trains on the ones read so far.
+  // The instances are kept, as of EstimateParamater, and the features are
+  // counted on the training instances for feature_cutoff. Only SGD supports
+  // it.
+  virtual bool EstimateParamaterFromText(std::istream* in,
+                                         int32_t num_heldout,
+                                         int32_t feature_cutoff,
+                                         common::ModelData* model_data) {
+    std::cerr << "error: training while loading is not supported by the "
+        << "optimizer, pls use SGD." << std::endl;
+    return false;
+  }
 
  protected:
+  // Prints the method, and exits if its settings are not supported, e.g. the
+  // regularizers.
+  virtual void CheckSettings() {}
+
+  // Optimizes the lambdas of model_data_ on train_data_.
+  virtual void Optimize() = 0;
+
   void Clear() {
+    instances_.clear();
     train_data_.clear();
     heldout_data_.clear();
     model_data_ = NULL;
@@ -45,14 +190,47 @@ class Optimizer {
                          int32_t feature_cutoff,
                          common::ModelData* model_data);
 
+  // Collapses the duplicates of the first num_train instances of instances_
+  // if deduplication_, and returns the number of them left.
+  size_t CollapseDuplicates(size_t num_train);
+
+  bool InitFromMemInstances(
+      const std::vector<const common::MemInstance*>& train_data,
+      const std::vector<const common::MemInstance*>& heldout_data,
+      int32_t feature_cutoff,
+      common::ModelData* model_data);
+
+  // Normalizes the regularizers and calculates the empirical expection, once
+  // the model and the data are initialized.
+  bool InitEstimation();
+
+  // Optimizes the model of the last estimation again with l1reg, starting
+  // from the lambdas of model_data.
+  bool WarmRestart(double l1reg, common::ModelData* model_data);
+
+  // Returns true once the objective f of iteration iter has decreased by
+  // less than tolerance_ relatively over the last few iterations.
+  bool Converged(int32_t iter, double f);
+
   // Calculate empirical expection based on training data.
   void InitEmpiricalExpection();
 
-  double FunctionGradient(const std::vector<double>& x,
-                          std::vector<double>* grad);
+  // The objective at x and its gradient. If probs is not NULL, p(y|x) of
+  // every training instance is kept in it too, as of UpdateModelExpectation.
+  double FunctionGradient(const std::vector<common::Scalar>& x,
+                          std::vector<common::Scalar>* grad,
+                          std::vector<double>* probs = NULL);
 
   // Update E_p (f), formula: E_p (f) = sum_x,y P1(x)P(y|x)f(x, y)
-  double UpdateModelExpectation();
+  // If probs is not NULL, it gets p(y|x) of the training instance n at
+  // n * NumClasses() + y, e.g. for the Hessian of TRON.
+  double UpdateModelExpectation(std::vector<double>* probs = NULL);
+
+  // Draws instance_ids->size() instances with replacement, each with the
+  // probability of its weight, by the cumulative weights of the instances.
+  // The stochastic optimizers train on weighted instances this way.
+  static void DrawByWeight(const std::vector<double>& cumulative_weights,
+                           std::vector<int32_t>* instance_ids);
 
   // Calculate p(y|x)
   int32_t CalcConditionalProbability(const common::MemInstance& mem_instance,
@@ -60,10 +238,15 @@ class Optimizer {
   double CalcHeldoutLikelihood();
 
  protected:
-  std::vector<common::MemInstance> train_data_;  // training data
+  // the instances formatted by InitFromInstances, which train_data_ and
+  // heldout_data_ point to. Empty if the instances are owned by the caller.
+  std::vector<common::MemInstance> instances_;
+
+  std::vector<const common::MemInstance*> train_data_;  // training data
+  double train_weight_;  // the total weight of the training data
   double train_accuracy_;  // current accuracy on the training data
 
-  std::vector<common::MemInstance> heldout_data_;  // heldout data
+  std::vector<const common::MemInstance*> heldout_data_;  // heldout data
   double heldout_accuracy_;  // current accuracy on the heldout data
 
   common::ModelData* model_data_;  // the maxent model
@@ -71,10 +254,18 @@ class Optimizer {
   double l1reg_;  // L1-regularization
   double l2reg_;  // L2-regularization
 
+  double tolerance_;  // the relative decrease of objective to converge
+  std::vector<double> objectives_;  // of the last few iterations
+
+  int32_t num_iterations_;  // the iterations of the last estimation
+
   // E_p1(f), which is the expected value of f(x,y) with respect to the
   // empirical distribution p1(x,y).
   //
   // E_p1 (f) = sum_x,y P1(x, y)f(x, y)
+  //
+  // NOTE: both expectations are accumulated over all instances, so they are
+  // kept in double even if common::Scalar is float.
   std::vector<double> empirical_expectation_;
 
   // E_p(f), which is the expected value of f(x,y) with respect to the
@@ -82,6 +273,22 @@ class Optimizer {
   //
   // E_p (f) = sum_x,y P1(x)P(y|x)f(x, y)
   std::vector<double> model_expectation_;
+
+  bool deduplication_;  // whether to collapse the formatted instances
+
+  // calculates model_expectation_ on many threads, NULL for one.
+  std::unique_ptr<ParallelExpectation> parallel_expectation_;
+  bool numa_layout_;  // whether to lay its shards out on the NUMA nodes
+
+  // the expanded training instances of model_expectation_ on one thread.
+  size_t expansion_cache_bytes_;
+  ExpansionCache expansion_cache_;
+
+  // counts the passes of FunctionGradient if perf_counting_, opened on the
+  // thread of the estimation. NULL if no counter is available.
+  bool perf_counting_;
+  std::unique_ptr< ::common::PerfCounters> perf_counters_;
+  ::common::PerfCounts pass_perf_counts_;
 };
 
 }  // namespace maxent
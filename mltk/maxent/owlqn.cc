@@ -8,6 +8,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -20,7 +21,9 @@ namespace maxent {
 
 using mltk::common::DoubleVector;
 using mltk::common::Instance;
+using mltk::common::MemoryBreakdown;
 using mltk::common::ModelData;
+using mltk::common::Scalar;
 
 const static double LINE_SEARCH_ALPHA = 0.1;
 const static double LINE_SEARCH_BETA = 0.5;
@@ -28,16 +31,42 @@ const static double LINE_SEARCH_BETA = 0.5;
 // stopping criteria
 const static double MIN_GRAD_NORM = 0.0001;
 
+// a zero feature whose gradient is within SCREENING_RATIO * [-C, C] is
+// screened out of the active set.
+const static double SCREENING_RATIO = 0.9;
+
 inline int32_t Sign(double x) {
   if (x > 0) { return 1; }
   if (x < 0) { return -1; }
   return 0;
 };
 
-void OWLQN::EstimateParamater(const std::vector<Instance>& instances,
-                              int32_t num_heldout,
-                              int32_t feature_cutoff,
-                              ModelData* model_data) {
+// v of the features of from, as of the features of to, both sorted: zero for
+// the ones not in from.
+DoubleVector Remap(const DoubleVector& v,
+                   const std::vector<int32_t>& from,
+                   const std::vector<int32_t>& to) {
+  DoubleVector result(to.size());
+  size_t j = 0;
+  for (size_t k = 0; k < to.size(); ++k) {
+    while (j < from.size() && from[j] < to[k]) { ++j; }
+    if (j < from.size() && from[j] == to[k]) { result[k] = v[j]; }
+  }
+  return result;
+}
+
+void OWLQN::AddStateMemoryUsage(int32_t num_features,
+                                MemoryBreakdown* breakdown) const {
+  Optimizer::AddStateMemoryUsage(num_features, breakdown);
+  // the history of m pairs (s, y), and the working vectors of an iteration,
+  // e.g. x, grad, the pseudo-gradient, dx, x1, grad1 and the orthant.
+  const size_t vector_bytes
+      = MemoryBreakdown::HeapBytes(num_features * sizeof(Scalar));
+  breakdown->Add("history", 2 * m_ * vector_bytes);
+  breakdown->Add("working_vectors", 10 * vector_bytes);
+}
+
+void OWLQN::CheckSettings() {
   // NOTE(l1reg_ > 0): The LBFGS limited-memory quasi-Newton method is the
   // algorithm of choice for optimizing the parameters of large-scale
   // log-linear models with L2-regularization, but it cannot be used for an
@@ -49,27 +78,35 @@ void OWLQN::EstimateParamater(const std::vector<Instance>& instances,
         << "you can use LBFGS method instead." << std::endl;
     exit(1);
   }
+}
 
-  InitFromInstances(instances, num_heldout, feature_cutoff, model_data);
+bool OWLQN::ReestimateWithL1Reg(double l1reg, ModelData* model_data) {
+  CheckSettings();
+  return WarmRestart(l1reg, model_data);
+}
 
-  std::vector<double> x = PerformOWLQN();
+void OWLQN::Optimize() {
+  std::vector<Scalar> x = PerformOWLQN();
   model_data_->UpdateLambdas(x);
 }
 
-std::vector<double> OWLQN::PerformOWLQN() {
-  const std::vector<double> lambdas = model_data_->Lambdas();
-  assert(static_cast<int32_t>(lambdas.size()) == model_data_->NumFeatures());
+std::vector<Scalar> OWLQN::PerformOWLQN() {
+  const int32_t num_features = model_data_->NumFeatures();
+  assert(static_cast<int32_t>(model_data_->Lambdas().size()) == num_features);
 
-  std::vector<double> x0(lambdas.size());
-  for (int32_t i = 0; i < lambdas.size(); ++i) { x0[i] = lambdas[i]; }
+  active_.resize(num_features);
+  for (int32_t i = 0; i < num_features; ++i) { active_[i] = i; }
+  if (active_set_interval_ > 0) { UpdateActiveSet(l1reg_); }
 
-  DoubleVector x(x0);
-  DoubleVector grad(lambdas.size());
+  DoubleVector x = ActiveLambdas();
+  DoubleVector grad(x.Size());
   double f = RegularizedFuncGrad(l1reg_, x, grad);
+  num_iterations_ = 0;
 
   DoubleVector* s = new DoubleVector[m_];
   DoubleVector* y = new DoubleVector[m_];
   double* z = new double[m_];  // rho
+  int32_t history_begin = 0;  // the iteration of the first (s, y) pair
 
   for (int32_t iter = 0; iter < num_iter_; ++iter) {  // stopping criteria 1
     DoubleVector pg = PseudoGradient(x, grad, l1reg_);
@@ -83,18 +120,47 @@ std::vector<double> OWLQN::PerformOWLQN() {
           << ", accuracy = " << heldout_accuracy_ << std::endl;
     }
 
-    // stopping criteria 2
-    if (sqrt(DotProduct(pg, pg)) < MIN_GRAD_NORM) { break; }
+    num_iterations_ = iter + 1;
+    // stopping criteria 2 and 3
+    bool stop = sqrt(DotProduct(pg, pg)) < MIN_GRAD_NORM || Converged(iter, f);
+
+    // the optimum of the active features is the one of all only if no other
+    // feature violates the optimality conditions. The features and so the
+    // dimensions change, and the history is carried over: a feature that
+    // joins had not moved, and its gradient change is taken as zero.
+    if (active_set_interval_ > 0
+        && (stop || (iter + 1) % active_set_interval_ == 0)) {
+      const std::vector<int32_t> previous_active = active_;
+      if (UpdateActiveSet(l1reg_)) {
+        x = ActiveLambdas();
+        grad = DoubleVector(x.Size());
+        f = RegularizedFuncGrad(l1reg_, x, grad);
+        pg = PseudoGradient(x, grad, l1reg_);
+        for (int32_t j = 0; j < std::min(iter - history_begin, m_); ++j) {
+          s[j] = Remap(s[j], previous_active, active_);
+          y[j] = Remap(y[j], previous_active, active_);
+          const double ys = DotProduct(y[j], s[j]);
+          if (ys <= 0) {  // no curvature left, so restarts
+            history_begin = iter;
+            break;
+          }
+          z[j] = 1.0 / ys;
+        }
+        stop = false;
+      }
+    }
+    if (stop) { break; }
 
-    DoubleVector dx = -1 * ApproximateHg(iter, pg, s, y, z);
+    const int32_t k = iter - history_begin;
+    DoubleVector dx = -1 * ApproximateHg(k, pg, s, y, z);
     if (DotProduct(dx, pg) >= 0) { dx.Project(-1 * pg); }
 
-    DoubleVector x1(lambdas.size()), grad1(lambdas.size());
+    DoubleVector x1(x.Size()), grad1(x.Size());
     f = ConstrainedLineSearch(l1reg_, x, pg, f, dx, x1, grad1);
 
-    s[iter % m_] = x1 - x;
-    y[iter % m_] = grad1 - grad;
-    z[iter % m_] = 1.0 / DotProduct(y[iter % m_], s[iter % m_]);
+    s[k % m_] = x1 - x;
+    y[k % m_] = grad1 - grad;
+    z[k % m_] = 1.0 / DotProduct(y[k % m_], s[k % m_]);
 
     x = x1;
     grad = grad1;
@@ -103,15 +169,56 @@ std::vector<double> OWLQN::PerformOWLQN() {
   delete[] y;
   delete[] z;
 
-  return x.STLVector();
+  // the screened out features are zero.
+  model_data_->RestrictFeatures(std::vector<char>());
+  std::vector<Scalar> lambdas(num_features, 0);
+  for (size_t k = 0; k < active_.size(); ++k) { lambdas[active_[k]] = x[k]; }
+  return lambdas;
+}
+
+bool OWLQN::UpdateActiveSet(const double C) {
+  model_data_->RestrictFeatures(std::vector<char>());
+  UpdateModelExpectation();
+
+  const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+  const int32_t num_features = model_data_->NumFeatures();
+  std::vector<int32_t> active;
+  std::vector<char> is_active(num_features, 0);
+  for (int32_t i = 0; i < num_features; ++i) {
+    const double grad = model_expectation_[i] - empirical_expectation_[i];
+    if (lambdas[i] != 0 || fabs(grad) > SCREENING_RATIO * C) {
+      active.push_back(i);
+      is_active[i] = 1;
+    }
+  }
+  const bool changed = (active != active_);
+  active_.swap(active);
+  std::cerr << "active features = " << active_.size() << " of "
+      << num_features << std::endl;
+
+  model_data_->RestrictFeatures(is_active);
+  return changed;
+}
+
+DoubleVector OWLQN::ActiveLambdas() const {
+  const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+  DoubleVector x(active_.size());
+  for (size_t k = 0; k < active_.size(); ++k) { x[k] = lambdas[active_[k]]; }
+  return x;
 }
 
 double OWLQN::RegularizedFuncGrad(const double C,
                                   const DoubleVector& x,
                                   DoubleVector& grad) {
-  double f = FunctionGradient(x.STLVector(), &(grad.STLVector()));
-  for (size_t i = 0; i < x.Size(); i++) {
-    f += C * fabs(x[i]);
+  // the lambdas of the features screened out stay zero.
+  std::vector<Scalar>* lambdas = model_data_->MutableLambdas();
+  for (size_t k = 0; k < active_.size(); ++k) { (*lambdas)[active_[k]] = x[k]; }
+  double f = -UpdateModelExpectation();
+
+  for (size_t k = 0; k < active_.size(); ++k) {
+    const int32_t i = active_[k];
+    grad[k] = model_expectation_[i] - empirical_expectation_[i];
+    f += C * fabs(x[k]);
   }
   return f;
 }
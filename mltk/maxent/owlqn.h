@@ -13,6 +13,8 @@
 
 #include <vector>
 
+#include "mltk/common/scalar.h"
+
 namespace mltk {
 
 namespace common {
@@ -25,17 +27,41 @@ namespace maxent {
 
 class OWLQN : public Optimizer {
  public:
-  OWLQN(int32_t num_iter = 300, int32_t m = 10) : num_iter_(num_iter), m_(m) {}
+  OWLQN(int32_t num_iter = 300, int32_t m = 10)
+      : num_iter_(num_iter), m_(m), active_set_interval_(0) {}
   virtual ~OWLQN() {}
 
-  virtual void EstimateParamater(const std::vector<common::Instance>& instances,
-                                 int32_t num_heldout,
-                                 int32_t feature_cutoff,
-                                 common::ModelData* model_data);
+  // Optimizes the active features only, i.e. the nonzero ones and the zero
+  // ones whose gradient is near or out of [-l1reg, l1reg], and screens out
+  // the others, which stay zero as long as it is in. Every interval
+  // iterations, and before stopping, the gradient of all features is
+  // checked against the optimality conditions, and the active set updated,
+  // so the solution is the same as without screening. With strong L1, the
+  // vector operations and the expectations cost in proportion to the
+  // sparsity of the model. 0 means no screening.
+  void UseActiveSet(int32_t interval) { active_set_interval_ = interval; }
+
+  virtual bool ReestimateWithL1Reg(double l1reg,
+                                   common::ModelData* model_data);
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
 
  private:
-  std::vector<double> PerformOWLQN();
+  std::vector<common::Scalar> PerformOWLQN();
 
+  // Updates active_ by the gradient of all features at the current lambdas,
+  // and restricts the model to it. Returns true if it changed.
+  bool UpdateActiveSet(const double C);
+
+  // The lambdas of the active features.
+  common::DoubleVector ActiveLambdas() const;
+
+  // x and grad are of the active features only.
   double RegularizedFuncGrad(const double C,
                              const common::DoubleVector& x,
                              common::DoubleVector& grad);
@@ -60,6 +86,9 @@ class OWLQN : public Optimizer {
 
   int32_t num_iter_;  // the total iterations
   int32_t m_;
+
+  int32_t active_set_interval_;  // 0 if all features are active
+  std::vector<int32_t> active_;  // the ids of the active features
 };
 
 }  // namespace maxent
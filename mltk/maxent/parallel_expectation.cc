@@ -0,0 +1,425 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/parallel_expectation.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mltk/common/memory_breakdown.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+
+namespace {
+
+// the instances of a block, whose scores are kept at a time.
+const int32_t kBlockSize = 256;
+
+// The features of feature_ids whose labels are in [label_begin, label_end),
+// as [*begin, *end) of feature_ids, which are sorted by label.
+void LabelRange(const ModelData& model_data,
+                const std::vector<int32_t>& feature_ids,
+                int32_t label_begin,
+                int32_t label_end,
+                size_t* begin,
+                size_t* end) {
+  struct LabelLess {
+    explicit LabelLess(const ModelData& model_data) : model_data(model_data) {}
+    bool operator()(int32_t feature_id, int32_t label_id) const {
+      return model_data.FeatureAt(feature_id).LabelId() < label_id;
+    }
+    const ModelData& model_data;
+  };
+  const LabelLess label_less(model_data);
+  *begin = std::lower_bound(feature_ids.begin(), feature_ids.end(),
+                            label_begin, label_less) - feature_ids.begin();
+  *end = std::lower_bound(feature_ids.begin() + *begin, feature_ids.end(),
+                          label_end, label_less) - feature_ids.begin();
+}
+
+}  // namespace
+
+ParallelExpectation::ParallelExpectation(int32_t num_data_threads,
+                                         int32_t num_label_threads)
+    : num_data_threads_(num_data_threads),
+      num_label_threads_(num_label_threads),
+      num_distributed_(0),
+      pin_failed_(false),
+      model_data_(NULL),
+      instances_(NULL),
+      expectation_(NULL),
+      probs_(NULL) {
+  assert(num_data_threads > 0 && num_label_threads > 0);
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard(num_label_threads_)));
+  }
+}
+
+bool ParallelExpectation::UseTopology(
+    const ::common::NumaTopology& topology) {
+  topology_ = topology;
+  nodes_.clear();
+  barrier_.reset();
+  num_distributed_ = 0;
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    Shard* shard = shards_[d].get();
+    shard->node = 0;
+    std::vector<MemInstance>().swap(shard->instances);
+    std::vector<double>().swap(shard->expectation);
+  }
+  if (topology_.IsUniform()) { return false; }
+
+  // shard d on node d * num_nodes / num_data_threads, so the shards of a node
+  // are consecutive, and the nodes of no shard are left NULL.
+  const int32_t num_nodes = topology_.NumNodes();
+  nodes_.resize(num_nodes);
+  for (int32_t first = 0, end = 0; first < num_data_threads_; first = end) {
+    const int32_t node = first * num_nodes / num_data_threads_;
+    for (end = first; end < num_data_threads_
+         && end * num_nodes / num_data_threads_ == node; ++end) {
+      shards_[end]->node = node;
+    }
+    nodes_[node].reset(new Node((end - first) * num_label_threads_,
+                                first, end));
+  }
+  barrier_.reset(new common::Barrier(num_data_threads_ * num_label_threads_));
+  return true;
+}
+
+void ParallelExpectation::Distribute(
+    const ModelData& model_data,
+    const std::vector<const MemInstance*>& instances) {
+  if (!IsNumaAware()) { return; }
+  std::vector<std::thread> distributors;
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    distributors.push_back(std::thread(&ParallelExpectation::DistributeShard,
+                                       this, d, model_data.NumFeatures(),
+                                       model_data.NumClasses(),
+                                       std::cref(instances)));
+  }
+  for (size_t i = 0; i < distributors.size(); ++i) { distributors[i].join(); }
+  num_distributed_ = instances.size();
+}
+
+double ParallelExpectation::Update(
+    const ModelData& model_data,
+    const std::vector<const MemInstance*>& instances,
+    std::vector<double>* expectation,
+    double* num_correct,
+    std::vector<double>* probs) {
+  assert(expectation != NULL && num_correct != NULL);
+  assert(static_cast<int32_t>(expectation->size()) == model_data.NumFeatures());
+  assert(probs == NULL
+         || probs->size() == instances.size() * model_data.NumClasses());
+  model_data_ = &model_data;
+  instances_ = &instances;
+  expectation_ = expectation;
+  probs_ = probs;
+
+  // the buffers of the NUMA-aware layout are allocated by Distribute, and
+  // zeroed by the threads of their node.
+  const bool numa_aware = IsNumaAware();
+  assert(!numa_aware || num_distributed_ == instances.size());
+  const size_t block_size = kBlockSize;
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    Shard* shard = shards_[d].get();
+    if (d > 0 && !numa_aware) {
+      shard->expectation.assign(expectation->size(), 0.0);
+    }
+    shard->scores.resize(block_size * model_data.NumClasses());
+    shard->partial_maxes.resize(num_label_threads_ * block_size);
+    shard->partial_argmaxes.resize(num_label_threads_ * block_size);
+    shard->partial_sums.resize(num_label_threads_ * block_size);
+    shard->logl = 0.0;
+    shard->num_correct = 0.0;
+  }
+
+  std::vector<std::thread> workers;
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    for (int32_t l = 0; l < num_label_threads_; ++l) {
+      workers.push_back(std::thread(&ParallelExpectation::Work, this, d, l));
+    }
+  }
+  for (size_t i = 0; i < workers.size(); ++i) { workers[i].join(); }
+
+  double logl = 0.0;
+  *num_correct = 0.0;
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    const Shard& shard = *shards_[d];
+    if (d > 0 && !numa_aware) {  // reduced by the threads otherwise
+      for (size_t i = 0; i < expectation->size(); ++i) {
+        (*expectation)[i] += shard.expectation[i];
+      }
+    }
+    logl += shard.logl;
+    *num_correct += shard.num_correct;
+  }
+  return logl;
+}
+
+size_t ParallelExpectation::MemoryUsage(int32_t num_features) const {
+  const size_t buffer
+      = MemoryBreakdown::HeapBytes(num_features * sizeof(double));
+  if (!IsNumaAware()) { return (num_data_threads_ - 1) * buffer; }
+
+  size_t bytes = num_data_threads_ * buffer;
+  const size_t lambdas
+      = MemoryBreakdown::HeapBytes(num_features * sizeof(common::Scalar));
+  for (size_t k = 0; k < nodes_.size(); ++k) {
+    if (nodes_[k] != NULL) { bytes += lambdas; }
+  }
+  for (int32_t d = 0; d < num_data_threads_; ++d) {
+    const std::vector<MemInstance>& copies = shards_[d]->instances;
+    bytes += MemoryBreakdown::Of(copies);
+    for (size_t n = 0; n < copies.size(); ++n) {
+      bytes += copies[n].MemoryUsage();
+    }
+  }
+  return bytes;
+}
+
+void ParallelExpectation::DistributeShard(
+    int32_t data_shard,
+    int32_t num_features,
+    int32_t num_classes,
+    const std::vector<const MemInstance*>& instances) {
+  Shard* shard = shards_[data_shard].get();
+  PinToNode(shard->node);
+
+  // allocated, and first touched, by this thread on the node of the shard.
+  const size_t begin = data_shard * instances.size() / num_data_threads_;
+  const size_t end = (data_shard + 1) * instances.size() / num_data_threads_;
+  std::vector<MemInstance> copies;
+  copies.reserve(end - begin);
+  for (size_t n = begin; n < end; ++n) { copies.push_back(*instances[n]); }
+  shard->instances.swap(copies);
+
+  const size_t block_size = kBlockSize;
+  std::vector<double>(num_features, 0.0).swap(shard->expectation);
+  std::vector<double>(block_size * num_classes, 0.0).swap(shard->scores);
+  std::vector<double>(num_label_threads_ * block_size, 0.0)
+      .swap(shard->partial_maxes);
+  std::vector<int32_t>(num_label_threads_ * block_size, 0)
+      .swap(shard->partial_argmaxes);
+  std::vector<double>(num_label_threads_ * block_size, 0.0)
+      .swap(shard->partial_sums);
+
+  Node* node = nodes_[shard->node].get();
+  if (data_shard == node->first_shard) {
+    std::vector<common::Scalar>(num_features, 0.0f).swap(node->lambdas);
+  }
+}
+
+void ParallelExpectation::PinToNode(int32_t node) {
+  if (!::common::PinCurrentThread(topology_.NodeCpus(node))
+      && !pin_failed_.exchange(true)) {
+    std::cerr << "warning: cannot pin threads to the cpus of NUMA node "
+              << node << ", which may run anywhere." << std::endl;
+  }
+}
+
+void ParallelExpectation::Reduce(int32_t data_shard, int32_t label_shard) {
+  Node* node = nodes_[shards_[data_shard]->node].get();
+  const size_t num_features = expectation_->size();
+
+  // the shards of the node into its first one, by the threads of the node.
+  node->barrier.Wait();
+  const size_t num_node_threads
+      = (node->end_shard - node->first_shard) * num_label_threads_;
+  const size_t node_thread
+      = (data_shard - node->first_shard) * num_label_threads_ + label_shard;
+  size_t begin = node_thread * num_features / num_node_threads;
+  size_t end = (node_thread + 1) * num_features / num_node_threads;
+  std::vector<double>& node_sum = shards_[node->first_shard]->expectation;
+  for (int32_t d = node->first_shard + 1; d < node->end_shard; ++d) {
+    const std::vector<double>& part = shards_[d]->expectation;
+    for (size_t i = begin; i < end; ++i) { node_sum[i] += part[i]; }
+  }
+
+  // the nodes into the expectation of the caller, by all threads.
+  barrier_->Wait();
+  const size_t num_threads = num_data_threads_ * num_label_threads_;
+  const size_t thread = data_shard * num_label_threads_ + label_shard;
+  begin = thread * num_features / num_threads;
+  end = (thread + 1) * num_features / num_threads;
+  std::vector<double>& expectation = *expectation_;
+  for (size_t k = 0; k < nodes_.size(); ++k) {
+    if (nodes_[k] == NULL) { continue; }
+    const std::vector<double>& part
+        = shards_[nodes_[k]->first_shard]->expectation;
+    for (size_t i = begin; i < end; ++i) { expectation[i] += part[i]; }
+  }
+}
+
+void ParallelExpectation::Work(int32_t data_shard, int32_t label_shard) {
+  const ModelData& model_data = *model_data_;
+  const std::vector<const MemInstance*>& instances = *instances_;
+  Shard* shard = shards_[data_shard].get();
+
+  // the lambdas of the node, and the buffer of the shard, are refreshed on
+  // the node of the NUMA-aware layout.
+  Node* node = IsNumaAware() ? nodes_[shard->node].get() : NULL;
+  if (node != NULL) {
+    PinToNode(shard->node);
+    if (data_shard == node->first_shard && label_shard == 0) {
+      assert(node->lambdas.size() == model_data.Lambdas().size());
+      std::copy(model_data.Lambdas().begin(), model_data.Lambdas().end(),
+                node->lambdas.begin());
+    }
+    if (label_shard == 0) {
+      std::fill(shard->expectation.begin(), shard->expectation.end(), 0.0);
+    }
+    node->barrier.Wait();
+  }
+  const std::vector<common::Scalar>& lambdas
+      = node != NULL ? node->lambdas : model_data.Lambdas();
+  std::vector<double>& expectation
+      = data_shard == 0 && node == NULL ? *expectation_ : shard->expectation;
+
+  const int32_t num_classes = model_data.NumClasses();
+  const int32_t label_begin = label_shard * num_classes / num_label_threads_;
+  const int32_t label_end
+      = (label_shard + 1) * num_classes / num_label_threads_;
+  const size_t begin = data_shard * instances.size() / num_data_threads_;
+  const size_t end = (data_shard + 1) * instances.size() / num_data_threads_;
+
+  for (size_t block_begin = begin; block_begin < end;
+       block_begin += kBlockSize) {
+    const size_t block_end = std::min(block_begin + kBlockSize, end);
+
+    // w * x of the labels of the range, and their max.
+    for (size_t n = block_begin; n < block_end; ++n) {
+      const size_t i = n - block_begin;
+      double* scores = &shard->scores[i * num_classes];
+      std::fill(scores + label_begin, scores + label_end, 0.0);
+      const MemInstance& instance
+          = node != NULL ? shard->instances[n - begin] : *instances[n];
+      const bool binary = instance.IsBinary();
+      for (MemInstance::ConstIterator citer(instance);
+           !citer.Done(); citer.Next()) {
+        const std::vector<int32_t>& feature_ids
+            = model_data.FeatureIds(citer.FeatureNameId());
+        size_t first = 0;
+        size_t last = 0;
+        LabelRange(model_data, feature_ids, label_begin, label_end,
+                   &first, &last);
+        if (binary) {  // add-only, as every value is 1
+          for (size_t k = first; k < last; ++k) {
+            const int32_t feature_id = feature_ids[k];
+            scores[model_data.FeatureAt(feature_id).LabelId()]
+                += lambdas[feature_id];
+          }
+          continue;
+        }
+        const double value = citer.FeatureValue();
+        for (size_t k = first; k < last; ++k) {
+          const int32_t feature_id = feature_ids[k];
+          scores[model_data.FeatureAt(feature_id).LabelId()]
+              += static_cast<double>(lambdas[feature_id]) * value;
+        }
+      }
+
+      int32_t argmax = -1;
+      for (int32_t label_id = label_begin; label_id < label_end; ++label_id) {
+        if (argmax < 0 || scores[label_id] > scores[argmax]) {
+          argmax = label_id;
+        }
+      }
+      const size_t j = label_shard * kBlockSize + i;
+      shard->partial_argmaxes[j] = argmax;
+      shard->partial_maxes[j] = argmax < 0 ? -HUGE_VAL : scores[argmax];
+    }
+    shard->barrier.Wait();
+
+    // exp(w * x) of the labels of the range, offset as in
+    // ModelData::CalcConditionalProbability, and their sum.
+    for (size_t n = block_begin; n < block_end; ++n) {
+      const size_t i = n - block_begin;
+      double max = -HUGE_VAL;
+      for (int32_t l = 0; l < num_label_threads_; ++l) {
+        max = std::max(max, shard->partial_maxes[l * kBlockSize + i]);
+      }
+      const double offset = std::max(0.0, max - 700);  // to avoid overflow
+
+      double* scores = &shard->scores[i * num_classes];
+      double sum = 0.0;
+      for (int32_t label_id = label_begin; label_id < label_end; ++label_id) {
+        scores[label_id] = exp(scores[label_id] - offset);
+        sum += scores[label_id];
+      }
+      shard->partial_sums[label_shard * kBlockSize + i] = sum;
+    }
+    shard->barrier.Wait();
+
+    // p(y|x) * f(x, y) of the features of the labels of the range.
+    for (size_t n = block_begin; n < block_end; ++n) {
+      const size_t i = n - block_begin;
+      double sum = 0.0;
+      for (int32_t l = 0; l < num_label_threads_; ++l) {
+        sum += shard->partial_sums[l * kBlockSize + i];
+      }
+      const double* scores = &shard->scores[i * num_classes];
+      const MemInstance& instance
+          = node != NULL ? shard->instances[n - begin] : *instances[n];
+      const double weight = instance.weight();
+      const double scale = weight / sum;  // of the scores into p(y|x) * weight
+      if (probs_ != NULL) {
+        double* probs = &(*probs_)[n * num_classes];
+        for (int32_t label_id = label_begin; label_id < label_end;
+             ++label_id) {
+          probs[label_id] = scores[label_id] / sum;
+        }
+      }
+
+      for (MemInstance::ConstIterator citer(instance);
+           !citer.Done(); citer.Next()) {
+        const std::vector<int32_t>& feature_ids
+            = model_data.FeatureIds(citer.FeatureNameId());
+        size_t first = 0;
+        size_t last = 0;
+        LabelRange(model_data, feature_ids, label_begin, label_end,
+                   &first, &last);
+        const double factor = scale * citer.FeatureValue();
+        for (size_t k = first; k < last; ++k) {
+          const int32_t feature_id = feature_ids[k];
+          expectation[feature_id]
+              += scores[model_data.FeatureAt(feature_id).LabelId()] * factor;
+        }
+      }
+
+      if (label_shard == 0) {
+        const int32_t label_id = instance.label_id();
+        shard->logl += weight * log(scores[label_id] / sum);
+
+        // the first label of the max score, as of CalcConditionalProbability.
+        int32_t max_label = 0;
+        double max = -HUGE_VAL;
+        for (int32_t l = 0; l < num_label_threads_; ++l) {
+          const size_t j = l * kBlockSize + i;
+          if (shard->partial_argmaxes[j] >= 0
+              && shard->partial_maxes[j] > max) {
+            max = shard->partial_maxes[j];
+            max_label = shard->partial_argmaxes[j];
+          }
+        }
+        if (max_label == label_id) { shard->num_correct += weight; }
+      }
+    }
+    shard->barrier.Wait();
+  }
+  if (node != NULL) { Reduce(data_shard, label_shard); }
+}
+
+}  // namespace maxent
+}  // namespace mltk
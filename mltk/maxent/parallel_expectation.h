@@ -0,0 +1,162 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// The model expectation E_p(f) of MaxEnt on a grid of threads, sharding the
+// instances (data parallelism) and the labels (model parallelism).
+
+#ifndef MLTK_MAXENT_PARALLEL_EXPECTATION_H_
+#define MLTK_MAXENT_PARALLEL_EXPECTATION_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "common/system/numa/numa_topology.h"
+#include "mltk/common/barrier.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+// ParallelExpectation runs num_data_threads x num_label_threads threads. The
+// instances are split into num_data_threads shards, and the labels into
+// num_label_threads ranges. The thread (d, l) processes every instance of
+// shard d for the labels of range l only, so the threads of a shard write
+// disjoint features of one expectation buffer. The buffers take
+// num_data_threads x the memory of the expectation, however many label
+// threads there are, which suits models of hundreds of labels.
+//
+// Since p(y|x) is normalized over all labels, the threads of a shard go
+// through it in blocks of instances, in three phases separated by a barrier:
+// the scores of their labels, their exp(scores) and partial sums, and the
+// expectations of their features.
+//
+// On a machine of many NUMA nodes, e.g. of two sockets, the instances are
+// where the loading thread allocated them, and the buffers and the lambdas
+// where Update and the model did, so most of the traffic of the threads goes
+// to remote memory. UseTopology lays the data shards out on the nodes, shard d
+// on node d * num_nodes / num_data_threads: Distribute copies the instances of
+// every shard, and allocates its buffers, on a thread pinned to the cpus of
+// its node, so the pages are first touched there, and the threads of every
+// Update are pinned to the cpus of the node of their shard. Every node keeps a
+// copy of the lambdas, refreshed by every Update, and the expectations are
+// reduced hierarchically: the buffers of the shards of a node into the one of
+// its first shard by the threads of the node, and those of the nodes into the
+// expectation of the caller by all threads, every thread over a range of the
+// features. The copies take the memory of the training instances once more.
+class ParallelExpectation {
+ public:
+  ParallelExpectation(int32_t num_data_threads, int32_t num_label_threads);
+  ~ParallelExpectation() {}
+
+  int32_t NumDataThreads() const { return num_data_threads_; }
+  int32_t NumLabelThreads() const { return num_label_threads_; }
+
+  // Lays the data shards out on the nodes of topology, to be distributed by
+  // Distribute before Update. Returns false, and keeps the uniform layout, if
+  // topology has a single node.
+  bool UseTopology(const ::common::NumaTopology& topology);
+  bool IsNumaAware() const { return !topology_.IsUniform(); }
+
+  // Copies the instances of every data shard, and allocates its buffers for
+  // model_data, on the node of the shard, if IsNumaAware(). Update must go
+  // over the same instances and features then, until the next Distribute.
+  void Distribute(const common::ModelData& model_data,
+                  const std::vector<const common::MemInstance*>& instances);
+
+  // Sums p(y|x) * f(x, y) of every feature over the instances, weighted by
+  // theirs, into expectation, which has model_data.NumFeatures() elements.
+  // Returns the weighted sum of log p(y|x) of the instances, and the weight of
+  // the ones whose most probable label is right in num_correct. If probs is
+  // not NULL, it gets p(y|x) of instance n at n * NumClasses() + y, and must
+  // have that many elements.
+  //
+  // The features of a feature name must be sorted by label, as by
+  // ModelData::InitFromInstances.
+  double Update(const common::ModelData& model_data,
+                const std::vector<const common::MemInstance*>& instances,
+                std::vector<double>* expectation,
+                double* num_correct,
+                std::vector<double>* probs = NULL);
+
+  // The memory of the expectation buffers besides the one of the caller, and
+  // of the copies of Distribute if distributed.
+  size_t MemoryUsage(int32_t num_features) const;
+
+ private:
+  // the state of a data shard, shared by its label threads.
+  struct Shard {
+    Shard(int32_t num_label_threads) : barrier(num_label_threads),
+                                       logl(0.0), num_correct(0.0),
+                                       node(0) {}
+
+    common::Barrier barrier;
+    // unused by the first shard, but of the NUMA-aware layout
+    std::vector<double> expectation;
+    std::vector<double> scores;  // of a block, kBlockSize x num_classes
+    // of every instance of a block by the label threads, num_label_threads x
+    // kBlockSize: the max score and its label, and the sum of exp(scores).
+    std::vector<double> partial_maxes;
+    std::vector<int32_t> partial_argmaxes;
+    std::vector<double> partial_sums;
+    double logl;  // by the first label thread
+    double num_correct;
+
+    // of the NUMA-aware layout, by Distribute.
+    int32_t node;
+    std::vector<common::MemInstance> instances;
+  };
+
+  // the shards of a NUMA node, [first_shard, end_shard).
+  struct Node {
+    Node(int32_t num_threads, int32_t first_shard, int32_t end_shard)
+        : barrier(num_threads), first_shard(first_shard),
+          end_shard(end_shard) {}
+
+    common::Barrier barrier;  // of the threads of the node
+    int32_t first_shard;
+    int32_t end_shard;
+    std::vector<common::Scalar> lambdas;  // the copy of the node
+  };
+
+  void Work(int32_t data_shard, int32_t label_shard);
+
+  // Distributes the instances of shard, and allocates its buffers, on the
+  // thread of Distribute of the shard.
+  void DistributeShard(int32_t data_shard, int32_t num_features,
+                       int32_t num_classes,
+                       const std::vector<const common::MemInstance*>&
+                           instances);
+
+  // Pins the calling thread to the cpus of node, warning once if it cannot.
+  void PinToNode(int32_t node);
+
+  // Reduces the expectations of the shards into the one of the caller, on
+  // the thread (data_shard, label_shard) of the NUMA-aware layout.
+  void Reduce(int32_t data_shard, int32_t label_shard);
+
+  int32_t num_data_threads_;
+  int32_t num_label_threads_;
+  std::vector<std::unique_ptr<Shard> > shards_;
+
+  // the NUMA-aware layout, uniform for a single node.
+  ::common::NumaTopology topology_;
+  std::vector<std::unique_ptr<Node> > nodes_;
+  std::unique_ptr<common::Barrier> barrier_;  // of all threads
+  size_t num_distributed_;  // the instances of Distribute
+  std::atomic<bool> pin_failed_;
+
+  // the arguments of Update.
+  const common::ModelData* model_data_;
+  const std::vector<const common::MemInstance*>* instances_;
+  std::vector<double>* expectation_;
+  std::vector<double>* probs_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_PARALLEL_EXPECTATION_H_
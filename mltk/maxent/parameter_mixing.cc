@@ -0,0 +1,235 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/parameter_mixing.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+namespace {
+
+// the sums of a worker over its shard before the lambdas, i.e. the weighted
+// log p(y|x) and the weight of the right predictions.
+const size_t kNumSums = 2;
+
+bool WriteFully(int fd, const void* data, size_t bytes) {
+  const char* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = write(fd, p, bytes);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+bool ReadFully(int fd, void* data, size_t bytes) {
+  char* p = static_cast<char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = read(fd, p, bytes);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+}  // namespace
+
+void ParameterMixing::AddStateMemoryUsage(int32_t num_features,
+                                          MemoryBreakdown* breakdown) const {
+  // the empirical expectation only, which is calculated but never updated.
+  breakdown->Add("expectations",
+                 MemoryBreakdown::HeapBytes(num_features * sizeof(double)));
+  // the mixed lambdas, and the lambdas of a worker read at a time.
+  breakdown->Add("mixing", MemoryBreakdown::HeapBytes(
+      num_features * sizeof(double))
+      + MemoryBreakdown::HeapBytes(num_features * sizeof(Scalar)));
+
+  // every worker writes its own copy of the lambdas, and of its state.
+  MemoryBreakdown worker;
+  worker.Add("lambdas",
+             MemoryBreakdown::HeapBytes(num_features * sizeof(Scalar)));
+  optimizer_->AddStateMemoryUsage(num_features, &worker);
+  for (size_t i = 0; i < worker.Items().size(); ++i) {
+    breakdown->Add("workers." + worker.Items()[i].first,
+                   num_workers_ * worker.Items()[i].second);
+  }
+}
+
+void ParameterMixing::CheckSettings() {
+  std::cerr << "performing iterative parameter mixing of " << num_workers_
+      << " workers" << std::endl;
+  if (!optimizer_ || num_workers_ < 1 || num_rounds_ < 1) {
+    std::cerr << "error: parameter mixing needs an optimizer, and at least "
+        << "one worker and one round." << std::endl;
+    exit(1);
+  }
+  if (l1reg_ > 0 || l2reg_ > 0) {
+    std::cerr << "error: the regularizers of parameter mixing are the ones "
+        << "of its optimizer." << std::endl;
+    exit(1);
+  }
+}
+
+void ParameterMixing::Optimize() {
+  const size_t num_workers = std::min(static_cast<size_t>(num_workers_),
+                                      train_data_.size());
+  std::vector<std::vector<const MemInstance*> > shards(num_workers);
+  for (size_t n = 0; n < train_data_.size(); ++n) {
+    shards[n % num_workers].push_back(train_data_[n]);
+  }
+
+  const int32_t num_features = model_data_->NumFeatures();
+  std::vector<double> mixed(num_features);
+  std::vector<Scalar> lambdas(num_features);
+  num_iterations_ = 0;
+  for (int32_t round = 0; round < num_rounds_; ++round) {
+    // the heldout data at the lambdas the round starts from, as the
+    // training data is by the workers.
+    double heldout_logl = 0.0;
+    if (heldout_data_.size() > 0) { heldout_logl = CalcHeldoutLikelihood(); }
+
+    double logl = 0.0;
+    double ncorrect = 0.0;
+    std::fill(mixed.begin(), mixed.end(), 0.0);
+    if (!MixRound(shards, &mixed, &logl, &ncorrect)) {
+      std::cerr << "error: a worker of round " << round + 1 << " failed."
+          << std::endl;
+      exit(1);
+    }
+    num_iterations_ = round + 1;
+
+    const double f = -logl / train_weight_;
+    train_accuracy_ = ncorrect / train_weight_;
+    std::cerr << "round = " << round + 1 << ", logl(err) = " << f
+        << ", accuracy = " << train_accuracy_ << std::endl;
+    if (heldout_data_.size() > 0) {
+      std::cerr << "\theldout_logl(err) = " << -1 * heldout_logl
+          << ", accuracy = " << heldout_accuracy_ << std::endl;
+    }
+
+    for (int32_t i = 0; i < num_features; ++i) {
+      lambdas[i] = mixed[i] / train_weight_;
+    }
+    model_data_->UpdateLambdas(lambdas);
+
+    if (Converged(round, f)) { break; }
+  }
+}
+
+bool ParameterMixing::MixRound(
+    const std::vector<std::vector<const MemInstance*> >& shards,
+    std::vector<double>* mixed,
+    double* logl,
+    double* ncorrect) {
+  // the buffered output would be written by every worker too.
+  std::cout.flush();
+  std::cerr.flush();
+
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  bool ok = true;
+  for (size_t w = 0; w < shards.size(); ++w) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+      ok = false;
+      break;
+    }
+    // every worker draws its own random numbers, e.g. the order of SGD.
+    const unsigned seed = rand();
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(pipe_fds[0]);
+      for (size_t k = 0; k < fds.size(); ++k) { close(fds[k]); }
+      srand(seed);
+      _exit(RunWorker(shards[w], pipe_fds[1]) ? 0 : 1);
+    }
+    close(pipe_fds[1]);
+    if (pid < 0) {
+      close(pipe_fds[0]);
+      ok = false;
+      break;
+    }
+    pids.push_back(pid);
+    fds.push_back(pipe_fds[0]);
+  }
+
+  // A worker done before the ones ahead of it waits on its pipe till they
+  // are read, so the lambdas are summed in the same order every time.
+  std::vector<double> sums(kNumSums);
+  std::vector<Scalar> lambdas(mixed->size());
+  for (size_t w = 0; w < fds.size(); ++w) {
+    const size_t lambdas_bytes = lambdas.size() * sizeof(Scalar);
+    if (ok && ReadFully(fds[w], sums.data(), kNumSums * sizeof(double))
+        && ReadFully(fds[w], lambdas.data(), lambdas_bytes)) {
+      double weight = 0.0;
+      for (size_t n = 0; n < shards[w].size(); ++n) {
+        weight += shards[w][n]->weight();
+      }
+      *logl += sums[0];
+      *ncorrect += sums[1];
+      for (size_t i = 0; i < lambdas.size(); ++i) {
+        (*mixed)[i] += weight * lambdas[i];
+      }
+    } else {
+      ok = false;
+    }
+    close(fds[w]);
+  }
+
+  for (size_t w = 0; w < pids.size(); ++w) {
+    int status = 0;
+    while (waitpid(pids[w], &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { ok = false; }
+  }
+  return ok;
+}
+
+bool ParameterMixing::RunWorker(const std::vector<const MemInstance*>& shard,
+                                int fd) {
+  std::cerr.rdbuf(NULL);  // the workers would print over each other
+
+  std::vector<double> sums(kNumSums, 0.0);
+  std::vector<double> prob_dist(model_data_->NumClasses());
+  for (size_t n = 0; n < shard.size(); ++n) {
+    const int32_t label_id
+        = model_data_->CalcConditionalProbability(*shard[n], &prob_dist);
+    const double weight = shard[n]->weight();
+    sums[0] += weight * log(prob_dist[shard[n]->label_id()]);
+    if (label_id == shard[n]->label_id()) { sums[1] += weight; }
+  }
+
+  if (!optimizer_->EstimateParamaterOnShard(shard, train_weight_,
+                                            model_data_)) {
+    return false;
+  }
+  const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+  return WriteFully(fd, sums.data(), kNumSums * sizeof(double))
+         && WriteFully(fd, lambdas.data(), lambdas.size() * sizeof(Scalar));
+}
+
+}  // namespace maxent
+}  // namespace mltk
@@ -0,0 +1,86 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Implementation of iterative parameter mixing over sharded training data.
+//
+// Pls refer to 'Gideon Mann, Ryan McDonald, Mehryar Mohri, Nathan Silberman
+// and Dan Walker. 2009. Efficient Large-Scale Distributed Training of
+// Conditional Maximum Entropy Models. NIPS.' and 'Ryan McDonald, Keith Hall
+// and Gideon Mann. 2010. Distributed Training Strategies for the Structured
+// Perceptron. NAACL.'
+
+#ifndef MLTK_MAXENT_PARAMETER_MIXING_H_
+#define MLTK_MAXENT_PARAMETER_MIXING_H_
+
+#include "mltk/maxent/optimizer.h"
+
+#include <memory>
+#include <vector>
+
+#include "mltk/common/mem_instance.h"
+
+namespace mltk {
+
+namespace common {
+class ModelData;
+}  // namespace common
+
+namespace maxent {
+
+// ParameterMixing splits the training data into num_workers shards, the
+// instances n of n % num_workers == w making shard w. Every round, a worker
+// process per shard runs the iterations of optimizer on its shard from the
+// mixed lambdas, and the lambdas of the workers are averaged, weighted by
+// the weight of their shards, into the mixed lambdas of the next round. A
+// round costs the iterations of optimizer on 1 / num_workers of the data, and
+// only one vector of lambdas goes from every worker to the mixer, through a
+// pipe, which suits clusters of little bandwidth.
+//
+// The workers are forked from the mixer every round, so they share the
+// instances and the model copy-on-write. The regularizers of optimizer are
+// normalized by the weight of all shards, as of
+// Optimizer::EstimateParamaterOnShard, and its settings apply to every
+// worker, e.g. its threads. The workers print nothing, and the objective of a
+// round is the mean negative log-likelihood of the training data at the
+// lambdas it starts from, as the workers evaluate it on their shards.
+class ParameterMixing : public Optimizer {
+ public:
+  // Takes the ownership of optimizer, e.g. SGD or LBFGS of a few iterations.
+  ParameterMixing(Optimizer* optimizer,
+                  int32_t num_workers = 4,
+                  int32_t num_rounds = 10)
+      : optimizer_(optimizer), num_workers_(num_workers),
+        num_rounds_(num_rounds) {}
+  virtual ~ParameterMixing() {}
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
+
+ private:
+  // Runs optimizer_ on shard w in a worker process from the lambdas of
+  // model_data_, and adds the lambdas it ends up with, weighted by the
+  // weight of the shard, to mixed. Adds the weighted log p(y|x) and the
+  // weight of the right predictions of the shard at the lambdas before to
+  // logl and ncorrect. Returns false if any worker fails.
+  bool MixRound(const std::vector<std::vector<const common::MemInstance*> >&
+                    shards,
+                std::vector<double>* mixed,
+                double* logl,
+                double* ncorrect);
+
+  // The work of a worker process, which writes its result to fd.
+  bool RunWorker(const std::vector<const common::MemInstance*>& shard, int fd);
+
+  std::unique_ptr<Optimizer> optimizer_;  // of the workers
+  int32_t num_workers_;
+  int32_t num_rounds_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_PARAMETER_MIXING_H_
@@ -0,0 +1,137 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/prediction_cache.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "mltk/common/city.h"
+#include "mltk/common/mem_instance.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::MemInstance;
+
+PredictionCache::PredictionCache(size_t capacity,
+                                 std::chrono::milliseconds ttl,
+                                 int32_t num_shards)
+    : ttl_(ttl), shards_(num_shards), num_hits_(0), num_misses_(0) {
+  assert(capacity > 0 && num_shards > 0);
+  shard_capacity_ = std::max(capacity / num_shards, static_cast<size_t>(1));
+}
+
+uint64_t PredictionCache::Key(
+    const MemInstance& mem_instance,
+    std::vector<std::pair<uint64_t, uint64_t> >* buffer) {
+  // every feature takes two words, the name id and the bits of its value.
+  buffer->clear();
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    const double value = citer.FeatureValue();
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer->push_back(std::make_pair(
+        static_cast<uint64_t>(citer.FeatureNameId()), bits));
+  }
+  std::sort(buffer->begin(), buffer->end());
+
+  return CityHash64(reinterpret_cast<const char*>(buffer->data()),
+                    buffer->size() * sizeof(buffer->front()));
+}
+
+bool PredictionCache::Lookup(uint64_t key, uint64_t model_version,
+                             std::vector<double>* prob_dist,
+                             int32_t* label_id) {
+  Shard& shard = ShardOf(key);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.Validate(model_version);
+
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator iter
+        = shard.index.find(key);
+    if (iter != shard.index.end() && shard.model_version == model_version
+        && iter->second->prob_dist.size() == prob_dist->size()) {
+      std::list<Entry>::iterator entry = iter->second;
+      if (ttl_.count() > 0 && Clock::now() >= entry->expire_time) {
+        shard.index.erase(iter);
+        shard.lru.erase(entry);
+      } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+        *prob_dist = entry->prob_dist;
+        *label_id = entry->label_id;
+        ++num_hits_;
+        return true;
+      }
+    }
+  }
+  ++num_misses_;
+  return false;
+}
+
+void PredictionCache::Insert(uint64_t key, uint64_t model_version,
+                             const std::vector<double>& prob_dist,
+                             int32_t label_id) {
+  Shard& shard = ShardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.Validate(model_version);
+  // predicted by an older model, which a newer one has replaced meanwhile.
+  if (shard.model_version != model_version) { return; }
+
+  std::list<Entry>::iterator entry;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator iter
+      = shard.index.find(key);
+  if (iter != shard.index.end()) {
+    entry = iter->second;
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+  } else {
+    if (shard.lru.size() >= shard_capacity_) {  // evict the LRU entry
+      entry = --shard.lru.end();
+      shard.index.erase(entry->key);
+      shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    } else {
+      shard.lru.push_front(Entry());
+      entry = shard.lru.begin();
+    }
+    entry->key = key;
+    shard.index[key] = entry;
+  }
+  entry->expire_time = Clock::now() + ttl_;
+  entry->label_id = label_id;
+  entry->prob_dist = prob_dist;
+}
+
+size_t PredictionCache::Size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    size += shards_[i].lru.size();
+  }
+  return size;
+}
+
+void PredictionCache::Clear() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].lru.clear();
+    shards_[i].index.clear();
+  }
+  num_hits_.store(0);
+  num_misses_.store(0);
+}
+
+void PredictionCache::Shard::Validate(uint64_t version) {
+  if (version > model_version) {
+    lru.clear();
+    index.clear();
+    model_version = version;
+  }
+}
+
+}  // namespace maxent
+}  // namespace mltk
@@ -0,0 +1,109 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A concurrent LRU cache of predictions, for traffic in which the same
+// feature vectors are predicted again and again.
+
+#ifndef MLTK_MAXENT_PREDICTION_CACHE_H_
+#define MLTK_MAXENT_PREDICTION_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mltk {
+
+namespace common {
+class MemInstance;
+}  // namespace common
+
+namespace maxent {
+
+// PredictionCache maps the key of a feature vector to p(y|x) and the most
+// probable label. It is split into shards of their own locks and LRU lists,
+// so many threads rarely contend.
+//
+// An entry is tagged with the model version it is predicted by, and a lookup
+// with a newer version drops the stale shard, so the cache is invalidated
+// automatically when the model is reloaded. An entry also expires after ttl,
+// unless ttl is zero.
+class PredictionCache {
+ public:
+  PredictionCache(size_t capacity,
+                  std::chrono::milliseconds ttl,
+                  int32_t num_shards = 16);
+  ~PredictionCache() {}
+
+  // The key of a feature vector, a CityHash64 of its (feature name id, value)
+  // list in the sorted order, so the same features in a different order share
+  // one entry. buffer is scratch memory reused across calls.
+  static uint64_t Key(const common::MemInstance& mem_instance,
+                      std::vector<std::pair<uint64_t, uint64_t> >* buffer);
+
+  // Returns true and fills prob_dist and label_id on a hit. prob_dist must
+  // have the classes of the model of model_version, and an entry of another
+  // size is a miss, as it cannot be of that model.
+  bool Lookup(uint64_t key, uint64_t model_version,
+              std::vector<double>* prob_dist, int32_t* label_id);
+
+  void Insert(uint64_t key, uint64_t model_version,
+              const std::vector<double>& prob_dist, int32_t label_id);
+
+  uint64_t NumHits() const { return num_hits_.load(); }
+  uint64_t NumMisses() const { return num_misses_.load(); }
+  double HitRate() const {
+    const uint64_t num_lookups = NumHits() + NumMisses();
+    return num_lookups > 0 ? static_cast<double>(NumHits()) / num_lookups
+                           : 0.0;
+  }
+
+  // the number of cached entries
+  size_t Size() const;
+
+  void Clear();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Entry {
+    uint64_t key;
+    Clock::time_point expire_time;
+    int32_t label_id;
+    std::vector<double> prob_dist;
+  };
+
+  struct Shard {
+    Shard() : model_version(0) {}
+
+    // Drops all entries if model_version is newer.
+    void Validate(uint64_t model_version);
+
+    mutable std::mutex mutex;
+    uint64_t model_version;  // the version of all entries
+    std::list<Entry> lru;  // the most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  };
+
+  Shard& ShardOf(uint64_t key) {
+    return shards_[(key >> 32) % shards_.size()];
+  }
+
+  size_t shard_capacity_;
+  std::chrono::milliseconds ttl_;
+  std::vector<Shard> shards_;
+
+  std::atomic<uint64_t> num_hits_;
+  std::atomic<uint64_t> num_misses_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_PREDICTION_CACHE_H_
@@ -0,0 +1,411 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/prediction_server.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mltk/common/instance.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+#include "mltk/common/model_handle.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::Instance;
+using mltk::common::MemInstance;
+using mltk::common::ModelData;
+using mltk::common::ModelHandle;
+
+namespace {
+
+// Writes all of data to fd, and returns false if the peer is gone.
+bool WriteAll(int fd, bool is_socket, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    // MSG_NOSIGNAL: a closed connection must not raise SIGPIPE.
+    const ssize_t n = is_socket
+        ? send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL)
+        : write(fd, data.data() + written, data.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct PredictionServer::Connection {
+  Connection(int fd, bool socket)
+      : out_fd(fd), is_socket(socket), num_requests(0), num_answered(0),
+        num_collected(0), writing(false) {}
+  ~Connection() {
+    if (is_socket) { close(out_fd); }
+  }
+
+  const int out_fd;
+  const bool is_socket;  // a socket is owned, and is also the input
+  uint64_t num_requests;  // accessed by the reader only
+
+  std::mutex mutex;  // guards the following
+  std::condition_variable answered_cond;
+  uint64_t num_answered;  // written out
+  std::map<uint64_t, std::string> answers;  // not collected yet, by sequence
+  uint64_t num_collected;  // taken from answers by the writer
+  bool writing;  // whether a worker is writing, outside of mutex
+};
+
+struct PredictionServer::Request {
+  std::shared_ptr<Connection> connection;
+  uint64_t sequence;  // the order on the connection
+  std::string line;
+  Clock::time_point arrival;
+};
+
+// the buffers of a worker, reused by every request to save allocations.
+struct PredictionServer::Scratch {
+  std::vector<Request> batch;
+  std::string answer;
+  Instance instance;
+  MemInstance mem_instance;
+  std::vector<double> prob_dist;
+  std::vector<std::pair<uint64_t, uint64_t> > key_buffer;
+};
+
+PredictionServer::PredictionServer(MaxEnt* maxent, const Options& options)
+    : maxent_(maxent),
+      options_(options),
+      stopping_(false),
+      start_time_(Clock::now()),
+      num_batches_(0) {
+  assert(maxent_ != NULL);
+  assert(options_.num_threads > 0 && options_.max_batch_size > 0);
+  for (int32_t i = 0; i < options_.num_threads; ++i) {
+    workers_.push_back(std::thread(&PredictionServer::Work, this));
+  }
+}
+
+PredictionServer::~PredictionServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queue_cond_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) { workers_[i].join(); }
+}
+
+bool PredictionServer::Serve(int in_fd, int out_fd) {
+  std::shared_ptr<Connection> connection(new Connection(out_fd, false));
+  ReadRequests(in_fd, connection);
+
+  std::unique_lock<std::mutex> lock(connection->mutex);
+  while (connection->num_answered < connection->num_requests) {
+    connection->answered_cond.wait(lock);
+  }
+  return true;
+}
+
+bool PredictionServer::ServeUnixSocket(const std::string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "error: socket path is too long: " << path << std::endl;
+    return false;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    std::cerr << "error: cannot create socket: " << strerror(errno)
+        << std::endl;
+    return false;
+  }
+  unlink(path.c_str());
+  if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+    std::cerr << "error: cannot listen on " << path << ": " << strerror(errno)
+        << std::endl;
+    close(listen_fd);
+    return false;
+  }
+
+  while (true) {
+    const int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) { continue; }
+      std::cerr << "error: accept failed: " << strerror(errno) << std::endl;
+      close(listen_fd);
+      return false;
+    }
+
+    std::shared_ptr<Connection> connection(new Connection(fd, true));
+    std::thread(&PredictionServer::ReadRequests, this, fd, connection)
+        .detach();
+  }
+}
+
+std::string PredictionServer::Stats() const {
+  const double uptime = std::chrono::duration<double>(
+      Clock::now() - start_time_).count();
+  const uint64_t num_requests = latency_.Count();
+  const uint64_t num_batches = num_batches_.load();
+
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "requests=%llu uptime_s=%.1f qps=%.1f batches=%llu "
+           "avg_batch_size=%.2f p50_us=%llu p99_us=%llu max_us=%llu "
+           "model_version=%llu",
+           static_cast<unsigned long long>(num_requests),
+           uptime,
+           uptime > 0 ? num_requests / uptime : 0.0,
+           static_cast<unsigned long long>(num_batches),
+           num_batches > 0 ? static_cast<double>(num_requests) / num_batches
+                           : 0.0,
+           static_cast<unsigned long long>(latency_.Percentile(0.5)),
+           static_cast<unsigned long long>(latency_.Percentile(0.99)),
+           static_cast<unsigned long long>(latency_.Max()),
+           static_cast<unsigned long long>(maxent_->ModelVersion()));
+
+  std::string stats(buf);
+  const PredictionCache* cache = maxent_->GetPredictionCache();
+  if (cache != NULL) {
+    snprintf(buf, sizeof(buf), " cache_size=%llu cache_hit_rate=%.4f",
+             static_cast<unsigned long long>(cache->Size()),
+             cache->HitRate());
+    stats += buf;
+  }
+  return stats;
+}
+
+void PredictionServer::ReadRequests(
+    int in_fd, const std::shared_ptr<Connection>& connection) {
+  char buf[64 * 1024];
+  std::string line;
+  while (true) {
+    const ssize_t n = read(in_fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { break; }
+
+    const char* begin = buf;
+    const char* end = buf + n;
+    const char* eol;
+    while ((eol = std::find(begin, end, '\n')) != end) {
+      line.append(begin, eol);
+      Enqueue(connection, &line);
+      begin = eol + 1;
+    }
+    line.append(begin, end);
+  }
+  Enqueue(connection, &line);  // the last line without '\n'
+}
+
+void PredictionServer::Enqueue(const std::shared_ptr<Connection>& connection,
+                               std::string* line) {
+  if (!line->empty() && (*line)[line->size() - 1] == '\r') {
+    line->resize(line->size() - 1);
+  }
+  if (line->empty()) { return; }
+
+  Request request;
+  request.connection = connection;
+  request.sequence = connection->num_requests++;
+  request.line.swap(*line);
+  request.arrival = Clock::now();
+
+  size_t queue_size = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(request));
+    queue_size = queue_.size();
+  }
+  // a worker waits for the first request of a batch, and for a full batch.
+  if (queue_size == 1 ||
+      queue_size >= static_cast<size_t>(options_.max_batch_size)) {
+    queue_cond_.notify_one();
+  }
+}
+
+void PredictionServer::Work() {
+  const Clock::duration max_delay
+      = std::chrono::microseconds(options_.max_batch_delay_us);
+  const size_t max_batch_size = options_.max_batch_size;
+  Scratch scratch;
+  std::vector<Connection*> connections;
+
+  while (true) {
+    scratch.batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queue_.size() < max_batch_size) {
+        if (stopping_) {
+          if (queue_.empty()) { return; }
+          break;
+        }
+        if (queue_.empty()) {
+          queue_cond_.wait(lock);
+          continue;
+        }
+        const Clock::time_point deadline = queue_.front().arrival + max_delay;
+        if (Clock::now() >= deadline) { break; }
+        queue_cond_.wait_until(lock, deadline);
+      }
+
+      const size_t batch_size = std::min(queue_.size(), max_batch_size);
+      for (size_t i = 0; i < batch_size; ++i) {
+        scratch.batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      if (!queue_.empty()) { queue_cond_.notify_one(); }
+    }
+    ++num_batches_;
+
+    // score the whole batch on one version of the model, whose results are
+    // cached under its own version.
+    const ModelHandle::Snapshot snapshot = maxent_->GetModelSnapshot();
+    const ModelData& model_data = *snapshot.model;
+    const uint64_t model_version = snapshot.version;
+    connections.clear();
+    for (size_t i = 0; i < scratch.batch.size(); ++i) {
+      const Request& request = scratch.batch[i];
+      Answer(model_data, model_version, request.line, &scratch,
+             &scratch.answer);
+
+      Connection* connection = request.connection.get();
+      {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->answers[request.sequence].swap(scratch.answer);
+      }
+      if (std::find(connections.begin(), connections.end(), connection)
+          == connections.end()) {
+        connections.push_back(connection);
+      }
+    }
+
+    // count the batch before its answers are out, so Stats() of a finished
+    // Serve() covers every request.
+    const Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < scratch.batch.size(); ++i) {
+      latency_.Add(std::chrono::duration_cast<std::chrono::microseconds>(
+          now - scratch.batch[i].arrival).count());
+    }
+    for (size_t i = 0; i < connections.size(); ++i) { Flush(connections[i]); }
+  }
+}
+
+void PredictionServer::Answer(const ModelData& model_data,
+                              uint64_t model_version,
+                              const std::string& line,
+                              Scratch* scratch,
+                              std::string* answer) {
+  answer->clear();
+
+  // a line without any tab is a command.
+  if (line.find('\t') == std::string::npos) {
+    if (line == "STATS") {
+      *answer = Stats();
+    } else if (line.compare(0, 7, "RELOAD ") == 0) {
+      const std::string filename = line.substr(7);
+      if (maxent_->LoadModel(filename)) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "OK model_version=%llu",
+                 static_cast<unsigned long long>(maxent_->ModelVersion()));
+        *answer = buf;
+      } else {
+        *answer = "ERROR cannot load model " + filename;
+      }
+    } else {
+      *answer = "ERROR unknown command";
+    }
+    return;
+  }
+
+  if (!scratch->instance.ParseFromText(line)) {
+    *answer = "ERROR invalid instance";
+    return;
+  }
+  if (model_data.NumClasses() == 0) {
+    *answer = "ERROR no model";
+    return;
+  }
+
+  model_data.FormatInstance(scratch->instance, &scratch->mem_instance);
+  scratch->prob_dist.resize(model_data.NumClasses());
+  int32_t label_id = 0;
+  PredictionCache* cache = maxent_->GetPredictionCache();
+  uint64_t key = 0;
+  if (cache != NULL) {
+    key = PredictionCache::Key(scratch->mem_instance, &scratch->key_buffer);
+  }
+  if (cache == NULL ||
+      !cache->Lookup(key, model_version, &scratch->prob_dist, &label_id)) {
+    label_id = model_data.CalcConditionalProbability(scratch->mem_instance,
+                                                     &scratch->prob_dist);
+    if (cache != NULL) {
+      cache->Insert(key, model_version, scratch->prob_dist, label_id);
+    }
+  }
+
+  char buf[32];
+  answer->append(model_data.Label(label_id));
+  for (int32_t i = 0; i < model_data.NumClasses(); ++i) {
+    answer->push_back('\t');
+    answer->append(model_data.Label(i));
+    snprintf(buf, sizeof(buf), ":%.6g", scratch->prob_dist[i]);
+    answer->append(buf);
+  }
+}
+
+void PredictionServer::Flush(Connection* connection) {
+  std::unique_lock<std::mutex> lock(connection->mutex);
+  // one worker writes at a time, without the lock, so a peer which stops
+  // reading blocks that worker only. The others leave their answers to it.
+  if (connection->writing) { return; }
+  connection->writing = true;
+
+  std::string out;
+  while (true) {
+    // answers are written in the order of requests, and some of them may be
+    // still in the batches of other workers.
+    out.clear();
+    uint64_t num_out = 0;
+    std::map<uint64_t, std::string>::iterator iter
+        = connection->answers.begin();
+    while (iter != connection->answers.end() &&
+           iter->first == connection->num_collected) {
+      out.append(iter->second);
+      out.push_back('\n');
+      ++connection->num_collected;
+      ++num_out;
+      connection->answers.erase(iter++);
+    }
+    if (num_out == 0) { break; }
+
+    // a failed write means the peer is gone, and its answers are dropped.
+    lock.unlock();
+    WriteAll(connection->out_fd, connection->is_socket, out);
+    lock.lock();
+    connection->num_answered += num_out;
+    connection->answered_cond.notify_all();
+  }
+  connection->writing = false;
+}
+
+}  // namespace maxent
+}  // namespace mltk
@@ -0,0 +1,110 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// A multi-threaded prediction server of MaxEnt over a line protocol, on
+// stdin/stdout or on a unix domain socket.
+//
+// Every request is one line, and is answered by one line in the order of the
+// requests on the same connection. A line without any tab is a command.
+//
+//    <instance>            an instance in the data format, whose class label
+//                          is required but ignored. The answer is
+//                          <label>\t<label1>:<prob1>\t...\t<labelK>:<probK>,
+//                          where label is the most probable one.
+//    STATS                 the counters of the server, e.g. qps, p50 and p99
+//                          latencies in microseconds, and the hit rate of the
+//                          prediction cache of MaxEnt if any.
+//    RELOAD <model-file>   loads a new model and swaps it in, while the other
+//                          requests are still served by the old one.
+//
+// An invalid request is answered by a line starting with "ERROR".
+//
+// The requests from all connections are queued, and the workers take them in
+// batches of up to max_batch_size requests, waiting for a batch to fill no
+// longer than max_batch_delay_us after its first request arrives. A batch is
+// scored on one snapshot of the model with the scratch buffers of the worker,
+// and the answers of a batch to a connection are written in one system call.
+
+#ifndef MLTK_MAXENT_PREDICTION_SERVER_H_
+#define MLTK_MAXENT_PREDICTION_SERVER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mltk/common/latency_histogram.h"
+#include "mltk/maxent/maxent.h"
+
+namespace mltk {
+namespace maxent {
+
+class PredictionServer {
+ public:
+  struct Options {
+    Options() : num_threads(4), max_batch_size(32), max_batch_delay_us(200) {}
+
+    int32_t num_threads;  // the number of workers
+    int32_t max_batch_size;  // the most requests in a batch
+    int32_t max_batch_delay_us;  // the longest wait for a batch to fill
+  };
+
+  // The server does not own maxent, which must outlive it.
+  PredictionServer(MaxEnt* maxent, const Options& options);
+  ~PredictionServer();
+
+  // Serves the requests read from in_fd until the end of file, e.g. stdin,
+  // and returns after all of them are answered to out_fd.
+  bool Serve(int in_fd, int out_fd);
+
+  // Listens on the unix domain socket path, and serves every connection in a
+  // thread of its own. It never returns unless on error.
+  bool ServeUnixSocket(const std::string& path);
+
+  // The counters in one line, "requests=... qps=... p50_us=... p99_us=...".
+  std::string Stats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Connection;
+  struct Request;
+  struct Scratch;
+
+  void ReadRequests(int in_fd, const std::shared_ptr<Connection>& connection);
+  void Enqueue(const std::shared_ptr<Connection>& connection,
+               std::string* line);
+
+  void Work();
+  void Answer(const common::ModelData& model_data,
+              uint64_t model_version,
+              const std::string& line,
+              Scratch* scratch,
+              std::string* answer);
+  void Flush(Connection* connection);
+
+  MaxEnt* maxent_;
+  Options options_;
+
+  std::mutex mutex_;  // guards queue_ and stopping_
+  std::condition_variable queue_cond_;
+  std::deque<Request> queue_;
+  bool stopping_;
+  std::vector<std::thread> workers_;
+
+  const Clock::time_point start_time_;
+  common::LatencyHistogram latency_;  // from reading a request to its answer
+  std::atomic<uint64_t> num_batches_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_PREDICTION_SERVER_H_
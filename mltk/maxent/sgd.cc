@@ -8,13 +8,19 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "mltk/common/feature.h"
 #include "mltk/common/instance.h"
 #include "mltk/common/mem_instance.h"
 #include "mltk/common/model_data.h"
+#include "mltk/common/spsc_queue.h"
 
 namespace mltk {
 namespace maxent {
@@ -22,112 +28,246 @@ namespace maxent {
 using mltk::common::Feature;
 using mltk::common::Instance;
 using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
 using mltk::common::ModelData;
+using mltk::common::Scalar;
+using mltk::common::SpscQueue;
 
 const static double ALPHA = 0.85;  // the constant for learning rate
                                    // exponential delay.
                                    // eta_k = eta_0 * alpha^(-k / N)
+// the instances the reader hands over at a time, and the batches it may read
+// ahead of the training.
+const static size_t kBatchSize = 1024;
+const static size_t kQueueCapacity = 16;
 
-void SGD::EstimateParamater(const std::vector<Instance>& instances,
-                            int32_t num_heldout,
-                            int32_t feature_cutoff,
-                            ModelData* model_data) {
+void SGD::AddStateMemoryUsage(int32_t num_features,
+                              MemoryBreakdown* breakdown) const {
+  Optimizer::AddStateMemoryUsage(num_features, breakdown);
+  // the cumulative L1 penalties q.
+  breakdown->Add("penalties",
+                 MemoryBreakdown::HeapBytes(num_features * sizeof(Scalar)));
+}
+
+void SGD::CheckSettings() {
   std::cerr << "performing SGD" << std::endl;
   if (l2reg_ > 0) {
     std::cerr << "error: L2 regularization is currently not supported in SGD."
         << std::endl;
     exit(1);
   }
+  std::cerr << "learning_rate = " << learning_rate_
+      << ", alpha = " << ALPHA << std::endl;
+}
 
-  InitFromInstances(instances, num_heldout, feature_cutoff, model_data);
-  PerformSGD();
+bool SGD::ReestimateWithL1Reg(double l1reg, ModelData* model_data) {
+  CheckSettings();
+  return WarmRestart(l1reg, model_data);
 }
 
-void SGD::PerformSGD() {
-  assert(ALPHA < 1.0 && ALPHA > 0.0);
-  std::cerr << "learning_rate = " << learning_rate_
-      << ", alpha = " << ALPHA << std::endl;
+bool SGD::EstimateParamaterFromText(std::istream* in,
+                                    int32_t num_heldout,
+                                    int32_t feature_cutoff,
+                                    ModelData* model_data) {
+  assert(in != NULL);
+  assert(model_data != NULL);
+  CheckSettings();
+  model_data_ = model_data;
+  instances_.clear();
+  train_data_.clear();
+  heldout_data_.clear();
+
+  // The reader interns the instances into the vocabularies of the model,
+  // which the training never reads until the reader is joined, and hands
+  // them over in batches.
+  SpscQueue<std::vector<MemInstance> > queue(kQueueCapacity);
+  std::thread reader([in, model_data, &queue] {
+    std::vector<MemInstance> batch;
+    std::string line;
+    while (std::getline(*in, line)) {
+      batch.push_back(MemInstance());
+      if (!model_data->InternText(line, &batch.back())) {
+        batch.pop_back();
+      } else if (batch.size() == kBatchSize) {
+        queue.Push(&batch);
+        batch.clear();  // the batch consumed before, if any
+      }
+    }
+    if (!batch.empty()) { queue.Push(&batch); }
+    queue.Close();
+  });
+
+  // An instance is trained on once num_heldout more are read, so the last
+  // num_heldout never are. No L1 penalty is applied yet, i.e. u_ stays 0.
+  std::cerr << "training while loading instances ..." << std::endl;
+  u_ = 0.0;
+  q_.clear();
+  std::map<uint32_t, double> feature_counter;
+  std::vector<double> prob_dist;  // of the labels trained on so far
+  std::vector<MemInstance> batch;
+  size_t num_train = 0;
+  int32_t ncorrect = 0;
+  double logl = 0.0;
+  while (queue.Pop(&batch)) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+      instances_.push_back(MemInstance());
+      instances_.back().Swap(&batch[i]);
+      if (instances_.size() <= static_cast<size_t>(num_heldout)) { continue; }
+
+      const MemInstance& mem_instance = instances_[num_train++];
+      model_data_->PutFeatures(mem_instance, feature_cutoff, &feature_counter);
+      q_.resize(model_data_->NumFeatures(), 0);
+      const size_t label_id = mem_instance.label_id();
+      if (label_id >= prob_dist.size()) { prob_dist.resize(label_id + 1); }
+
+      bool correct = false;
+      logl += Update(mem_instance, learning_rate_, &prob_dist, &correct);
+      if (correct) { ++ncorrect; }
+    }
+  }
+  reader.join();
+
+  if (num_train == 0) {
+    std::cerr << (instances_.empty() ? "error: no training data."
+                  : "error: too much heldout data. no training data is "
+                    "available.") << std::endl;
+    return false;
+  }
+  model_data_->SyncFeatureNames();
+  for (size_t n = 0; n < instances_.size(); ++n) {
+    if (n < num_train) {
+      train_data_.push_back(&instances_[n]);
+    } else {
+      heldout_data_.push_back(&instances_[n]);
+    }
+  }
+  if (!InitEstimation()) { return false; }
+
+  // the cumulative L1 penalty of the first iteration, which every feature
+  // pays off once it is met again.
+  u_ = l1reg_ * learning_rate_ * num_train;
+  num_iterations_ = 1;
+  ReportProgress(0, logl, ncorrect);
+  PerformSGD(1);
+  return true;
+}
 
+void SGD::Optimize() {
+  u_ = 0.0;
+  q_.assign(model_data_->NumFeatures(), 0);
+  PerformSGD(0);
+}
+
+void SGD::PerformSGD(int32_t first_iter) {
+  assert(ALPHA < 1.0 && ALPHA > 0.0);
 
   std::vector<int32_t> instance_ids(train_data_.size());
   for (size_t i = 0; i < instance_ids.size(); ++i) { instance_ids[i] = i; }
 
+  // A weighted instance, e.g. of collapsed duplicates, would take a step of
+  // its weight times the gradient, which overshoots. Instead, every iteration
+  // draws the instances by weight, whose unit steps follow the gradient of
+  // the weighted objective on average.
+  std::vector<double> cumulative_weights;
+  if (train_weight_ != train_data_.size()) {
+    double weight = 0.0;
+    for (size_t n = 0; n < train_data_.size(); ++n) {
+      weight += train_data_[n]->weight();
+      cumulative_weights.push_back(weight);
+    }
+  }
+
   const double l1param = l1reg_;
-  double u = 0;  // u_k = C/N * sum_{t=1}^k {eta_t}
-  std::vector<double> q(model_data_->NumFeatures(), 0);  // q_i^k = sum_{t=1}^k {w_i^(t+1) - w_i^(t+1/2)}
-  int32_t iter_sample = 0;  // the number of iter sample
-  std::vector<double>* lambdas = model_data_->MutableLambdas();
+  // the number of iter sample
+  int32_t iter_sample = first_iter * train_data_.size();
+  std::vector<double> prob_dist(model_data_->NumClasses());
 
-  for (int32_t iter = 0; iter < num_iter_; ++iter) {
+  for (int32_t iter = first_iter; iter < num_iter_; ++iter) {
+    num_iterations_ = iter + 1;
     int32_t ncorrect = 0;
     double logl = 0.0;
 
-    random_shuffle(instance_ids.begin(), instance_ids.end());
+    if (cumulative_weights.empty()) {
+      random_shuffle(instance_ids.begin(), instance_ids.end());
+    } else {
+      DrawByWeight(cumulative_weights, &instance_ids);
+    }
 
     // batch size is 1, which is the extreme case.
     for (size_t i = 0; i < train_data_.size(); ++i, ++iter_sample) {
-      const MemInstance& mem_instance = train_data_[instance_ids[i]];
-
-      std::vector<double> prob_dist(model_data_->NumClasses());
-      const int32_t max_label =
-          model_data_->CalcConditionalProbability(mem_instance, &prob_dist);
-      logl += log(prob_dist[mem_instance.label_id()]);
-      if (max_label == mem_instance.label_id()) { ++ncorrect; }
-
       // learning rate : exponential decay
       const double eta = learning_rate_ *
           pow(ALPHA, static_cast<double>(iter_sample) / train_data_.size());
-      u += eta * l1param;
-
-      // update weight/lambdas according to current sampled instance
-      for (MemInstance::ConstIterator citer(mem_instance);
-           !citer.Done(); citer.Next()) {
-        const std::vector<int32_t>& feature_ids
-            = model_data_->FeatureIds(citer.FeatureNameId());
-        for (size_t i = 0; i < feature_ids.size(); ++i) {
-          const int32_t feature_id = feature_ids[i];
-          const Feature& feature = model_data_->FeatureAt(feature_id);
-          const double me = prob_dist[feature.LabelId()];
-          const double ee = (feature.LabelId() == citer.LabelId() ? 1.0 : 0);
-          const double grad = (me - ee) * citer.FeatureValue();
-          (*lambdas)[feature_id] -= eta * grad;  // GD
-
-          ApplyL1Penalty(feature_id, u, lambdas, q);
-        }
-      }
-    }
+      u_ += eta * l1param;
 
-    logl /= train_data_.size();
-    double f = - logl;
-    if (l1param > 0) {
-      const double l1 = model_data_->L1NormLambdas();
-      f += l1param * l1;
+      bool correct = false;
+      logl += Update(*train_data_[instance_ids[i]], eta, &prob_dist,
+                     &correct);
+      if (correct) { ++ncorrect; }
     }
 
-    std::cerr << "iter = " << iter + 1 << ", obj(err) = " << f
-        << ", accuracy = "
-        << static_cast<double>(ncorrect) / train_data_.size() << std::endl;
+    ReportProgress(iter, logl, ncorrect);
+  }
+}
+
+double SGD::Update(const MemInstance& mem_instance,
+                   double eta,
+                   std::vector<double>* prob_dist,
+                   bool* correct) {
+  const int32_t max_label =
+      model_data_->CalcConditionalProbability(mem_instance, prob_dist);
+  *correct = (max_label == mem_instance.label_id());
 
-    if (heldout_data_.size() > 0) {
-      double heldout_logl = CalcHeldoutLikelihood();
-      std::cerr << "\t heldout_logl(err) = " << -1 * heldout_logl
-          << ", accuracy = " << heldout_accuracy_ << std::endl;
+  // update weight/lambdas according to current sampled instance
+  std::vector<Scalar>* lambdas = model_data_->MutableLambdas();
+  for (MemInstance::ConstIterator citer(mem_instance);
+       !citer.Done(); citer.Next()) {
+    const std::vector<int32_t>& feature_ids
+        = model_data_->FeatureIds(citer.FeatureNameId());
+    const double value = citer.FeatureValue();  // 1 if binary
+    for (size_t i = 0; i < feature_ids.size(); ++i) {
+      const int32_t feature_id = feature_ids[i];
+      const Feature& feature = model_data_->FeatureAt(feature_id);
+      const double me = (*prob_dist)[feature.LabelId()];
+      const double ee = (feature.LabelId() == citer.LabelId() ? 1.0 : 0);
+      const double grad = (me - ee) * value;
+      (*lambdas)[feature_id] -= eta * grad;  // GD
+
+      ApplyL1Penalty(feature_id, lambdas);
     }
   }
+
+  return log((*prob_dist)[mem_instance.label_id()]);
+}
+
+void SGD::ReportProgress(int32_t iter, double logl, int32_t ncorrect) {
+  logl /= train_data_.size();
+  double f = - logl;
+  if (l1reg_ > 0) {
+    const double l1 = model_data_->L1NormLambdas();
+    f += l1reg_ * l1;
+  }
+
+  std::cerr << "iter = " << iter + 1 << ", obj(err) = " << f
+      << ", accuracy = "
+      << static_cast<double>(ncorrect) / train_data_.size() << std::endl;
+
+  if (heldout_data_.size() > 0) {
+    double heldout_logl = CalcHeldoutLikelihood();
+    std::cerr << "\t heldout_logl(err) = " << -1 * heldout_logl
+        << ", accuracy = " << heldout_accuracy_ << std::endl;
+  }
 }
 
-void SGD::ApplyL1Penalty(const size_t id,
-                         const double u,
-                         std::vector<double>* lambdas,
-                         std::vector<double>& q) {
-  double& w = (*lambdas)[id];
+void SGD::ApplyL1Penalty(const size_t id, std::vector<Scalar>* lambdas) {
+  Scalar& w = (*lambdas)[id];
   const double z = w;
   if (w > 0) {
-    w = std::max(0.0, w - (u + q[id]));
+    w = std::max(0.0, z - (u_ + q_[id]));
   } else if (w < 0) {
-    w = std::min(0.0, w + (u - q[id]));
+    w = std::min(0.0, z + (u_ - q_[id]));
   }
-  q[id] += w - z;
+  q_[id] += w - z;
 }
 
 }  // namespace maxent
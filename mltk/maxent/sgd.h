@@ -12,12 +12,16 @@
 
 #include "mltk/maxent/optimizer.h"
 
+#include <istream>
 #include <vector>
 
+#include "mltk/common/scalar.h"
+
 namespace mltk {
 
 namespace common {
 class Instance;
+class MemInstance;
 class ModelData;
 }  // namespace common
 
@@ -26,24 +30,53 @@ namespace maxent {
 class SGD : public Optimizer {
  public:
   SGD(int32_t num_iter = 50, double learning_rate = 1)
-      : num_iter_(num_iter), learning_rate_(learning_rate) {}
+      : num_iter_(num_iter), learning_rate_(learning_rate), u_(0.0) {}
   virtual ~SGD() {}
 
-  virtual void EstimateParamater(const std::vector<common::Instance>& instances,
-                                 int32_t num_heldout,
-                                 int32_t feature_cutoff,
-                                 common::ModelData* model_data);
+  virtual bool ReestimateWithL1Reg(double l1reg,
+                                   common::ModelData* model_data);
+
+  // The first iteration trains on the instances in the order of reading, at
+  // the initial learning rate, while a reader thread is still interning the
+  // rest, so loading and training overlap. The features are added as they
+  // reach feature_cutoff, and the L1 penalties of the iteration are applied
+  // once it is over, as the number of instances is unknown until then.
+  virtual bool EstimateParamaterFromText(std::istream* in,
+                                         int32_t num_heldout,
+                                         int32_t feature_cutoff,
+                                         common::ModelData* model_data);
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
 
  private:
-  void PerformSGD();
+  // Runs the iterations from first_iter on, going on with the learning rate
+  // and the cumulative L1 penalties of the ones before.
+  void PerformSGD(int32_t first_iter);
 
-  void ApplyL1Penalty(const size_t id,
-                      const double u,
-                      std::vector<double>* lambdas,
-                      std::vector<double>& q);
+  // Takes a step of learning rate eta on mem_instance, and returns log p(y|x)
+  // before it, which is in prob_dist.
+  double Update(const common::MemInstance& mem_instance,
+                double eta,
+                std::vector<double>* prob_dist,
+                bool* correct);
+
+  void ApplyL1Penalty(const size_t id, std::vector<common::Scalar>* lambdas);
+
+  // Prints the objective and the accuracy of iteration iter, by the sum of
+  // log p(y|x) and the correct predictions over the training data.
+  void ReportProgress(int32_t iter, double logl, int32_t ncorrect);
 
   int32_t num_iter_;  // the total iterations
   double learning_rate_;  // learning rate
+
+  double u_;  // u_k = C/N * sum_{t=1}^k {eta_t}
+  // q_i^k = sum_{t=1}^k {w_i^(t+1) - w_i^(t+1/2)}
+  std::vector<common::Scalar> q_;
 };
 
 }  // namespace maxent
@@ -0,0 +1,189 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/svrg.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+// stopping criteria
+const static double MIN_GRAD_NORM = 0.0001;
+
+void SVRG::AddStateMemoryUsage(int32_t num_features,
+                               MemoryBreakdown* breakdown) const {
+  Optimizer::AddStateMemoryUsage(num_features, breakdown);
+  // the full gradient and the step each feature is updated to, and p(y|x)
+  // of the training instances at the snapshot, once they are known.
+  breakdown->Add("working_vectors", MemoryBreakdown::HeapBytes(
+      num_features * (sizeof(Scalar) + sizeof(int32_t))));
+  if (model_data_ != NULL) {
+    breakdown->Add("probabilities", MemoryBreakdown::HeapBytes(
+        train_data_.size() * model_data_->NumClasses() * sizeof(double)));
+  }
+}
+
+void SVRG::CheckSettings() {
+  std::cerr << "performing SVRG" << std::endl;
+  if (l1reg_ > 0) {
+    std::cerr << "error: L1 regularization is not supported in SVRG,"
+        << "you can use OWLQN method instead." << std::endl;
+    exit(1);
+  }
+}
+
+void SVRG::Optimize() { PerformSVRG(); }
+
+void SVRG::PerformSVRG() {
+  const int32_t num_features = model_data_->NumFeatures();
+  const int32_t num_classes = model_data_->NumClasses();
+  const size_t num_steps = train_data_.size();  // of an iteration
+
+  // the step size, by the mean curvature of the loss of an instance. The
+  // largest one would be safe, but a few long instances make it tiny.
+  double mean_norm = 0.0;
+  for (size_t n = 0; n < train_data_.size(); ++n) {
+    double norm = 0.0;
+    for (MemInstance::ConstIterator citer(*train_data_[n]);
+         !citer.Done(); citer.Next()) {
+      norm += citer.FeatureValue() * citer.FeatureValue();
+    }
+    mean_norm += train_data_[n]->weight() * norm / train_weight_;
+  }
+  const double eta = learning_rate_ / std::max(mean_norm, 1.0);
+  std::cerr << "learning_rate = " << learning_rate_
+      << ", step size = " << eta << std::endl;
+
+  // Between the instances having it, a feature only moves by the full
+  // gradient mu and the L2 regularization, w <- decay * w - eta * mu, so k
+  // steps of it are w <- decay^k * w - eta * mu * sum_{t<k} decay^t.
+  const double decay = 1.0 - 2 * eta * l2reg_;
+  assert(decay > 0);
+  std::vector<double> decays(num_steps + 1);  // decay^k
+  std::vector<double> drifts(num_steps + 1);  // sum_{t<k} decay^t
+  decays[0] = 1.0;
+  drifts[0] = 0.0;
+  for (size_t k = 1; k <= num_steps; ++k) {
+    decays[k] = decays[k - 1] * decay;
+    drifts[k] = drifts[k - 1] * decay + 1.0;
+  }
+
+  std::vector<int32_t> instance_ids(num_steps);
+  for (size_t i = 0; i < instance_ids.size(); ++i) { instance_ids[i] = i; }
+
+  // weighted instances are drawn by weight, as in SGD.
+  std::vector<double> cumulative_weights;
+  if (train_weight_ != train_data_.size()) {
+    double weight = 0.0;
+    for (size_t n = 0; n < train_data_.size(); ++n) {
+      weight += train_data_[n]->weight();
+      cumulative_weights.push_back(weight);
+    }
+  }
+
+  std::vector<Scalar>* lambdas = model_data_->MutableLambdas();
+  std::vector<Scalar> mu(num_features);  // the full gradient of the loss
+  std::vector<int32_t> updated(num_features);  // the step of every feature
+  std::vector<double> snapshot_probs;
+  std::vector<double> prob_dist(num_classes);
+
+  // brings feature_id up to step, applying the steps it missed.
+  auto catch_up = [&](int32_t feature_id, int32_t step) {
+    const int32_t k = step - updated[feature_id];
+    if (k > 0) {
+      (*lambdas)[feature_id] = decays[k] * (*lambdas)[feature_id]
+                               - eta * mu[feature_id] * drifts[k];
+      updated[feature_id] = step;
+    }
+  };
+
+  num_passes_ = 0;
+  for (int32_t iter = 0; iter < num_iter_; ++iter) {  // stopping criteria 1
+    // the snapshot, its full gradient and p(y|x) of the instances.
+    const double f = FunctionGradient(*lambdas, &mu, &snapshot_probs);
+    ++num_passes_;
+    double grad_norm = 0.0;
+    for (int32_t i = 0; i < num_features; ++i) {
+      grad_norm += static_cast<double>(mu[i]) * mu[i];
+      mu[i] -= 2 * l2reg_ * (*lambdas)[i];  // applied by decay instead
+    }
+
+    std::cerr << "iter = " << iter + 1
+        << ", obj(err) = " << f
+        << ", accuracy = " << train_accuracy_ << std::endl;
+
+    if (heldout_data_.size() > 0) {
+      const double heldout_logl = CalcHeldoutLikelihood();
+      std::cerr << "\theldout_logl(err) = " << -1 * heldout_logl
+          << ", accuracy = " << heldout_accuracy_ << std::endl;
+    }
+
+    num_iterations_ = iter + 1;
+    // stopping criteria 2
+    if (sqrt(grad_norm) < MIN_GRAD_NORM) { break; }
+    // stopping criteria 3
+    if (Converged(iter, f)) { break; }
+
+    if (cumulative_weights.empty()) {
+      random_shuffle(instance_ids.begin(), instance_ids.end());
+    } else {
+      DrawByWeight(cumulative_weights, &instance_ids);
+    }
+    std::fill(updated.begin(), updated.end(), 0);
+
+    for (size_t t = 0; t < num_steps; ++t) {
+      const MemInstance& mem_instance = *train_data_[instance_ids[t]];
+      const double* snapshot_prob_dist
+          = &snapshot_probs[instance_ids[t] * num_classes];
+
+      for (MemInstance::ConstIterator citer(mem_instance);
+           !citer.Done(); citer.Next()) {
+        const std::vector<int32_t>& feature_ids
+            = model_data_->FeatureIds(citer.FeatureNameId());
+        for (size_t i = 0; i < feature_ids.size(); ++i) {
+          catch_up(feature_ids[i], t);
+        }
+      }
+      model_data_->CalcConditionalProbability(mem_instance, &prob_dist);
+
+      // the step of t, whose dense part applies once to a feature, and the
+      // gradient of the instance less the one at the snapshot, in which the
+      // empirical parts cancel out.
+      for (MemInstance::ConstIterator citer(mem_instance);
+           !citer.Done(); citer.Next()) {
+        const std::vector<int32_t>& feature_ids
+            = model_data_->FeatureIds(citer.FeatureNameId());
+        const double value = citer.FeatureValue();  // 1 if binary
+        for (size_t i = 0; i < feature_ids.size(); ++i) {
+          const int32_t feature_id = feature_ids[i];
+          const int32_t label_id
+              = model_data_->FeatureAt(feature_id).LabelId();
+          catch_up(feature_id, t + 1);
+          (*lambdas)[feature_id] -= eta * value
+              * (prob_dist[label_id] - snapshot_prob_dist[label_id]);
+        }
+      }
+    }
+    for (int32_t i = 0; i < num_features; ++i) { catch_up(i, num_steps); }
+    ++num_passes_;
+  }
+  std::cerr << "number of data passes = " << num_passes_ << std::endl;
+}
+
+}  // namespace maxent
+}  // namespace mltk
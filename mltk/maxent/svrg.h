@@ -0,0 +1,68 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Implementation of Stochastic Variance Reduced Gradient (SVRG) algorithm.
+//
+// Pls refer to 'Rie Johnson and Tong Zhang. 2013. Accelerating Stochastic
+// Gradient Descent using Predictive Variance Reduction. NIPS.'
+
+#ifndef MLTK_MAXENT_SVRG_H_
+#define MLTK_MAXENT_SVRG_H_
+
+#include "mltk/maxent/optimizer.h"
+
+#include <vector>
+
+#include "mltk/common/scalar.h"
+
+namespace mltk {
+
+namespace common {
+class ModelData;
+}  // namespace common
+
+namespace maxent {
+
+// SVRG takes the full gradient at a snapshot of the lambdas every iteration,
+// and then a pass of stochastic steps, each of the gradient of one instance
+// corrected by its gradient at the snapshot and the full one. The variance of
+// the steps vanishes near the optimum, so a constant learning rate converges
+// linearly, unlike the decaying one of SGD.
+//
+// The gradient of an instance at the snapshot is the one of p(y|x) kept by the
+// full gradient, so a step computes p(y|x) once. The full gradient and the L2
+// regularization move every feature at every step, which is applied to a
+// feature just in time, in closed form, once an instance has it, so a step
+// costs in proportion to the features of the instance. Only L2 regularization
+// is supported.
+class SVRG : public Optimizer {
+ public:
+  // learning_rate is relative to 1 / the mean ||x||^2 of the instances, the
+  // mean curvature of the loss of an instance.
+  SVRG(int32_t num_iter = 30, double learning_rate = 2)
+      : num_iter_(num_iter), learning_rate_(learning_rate), num_passes_(0) {}
+  virtual ~SVRG() {}
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+  // the data passes taken by the last estimation, i.e. two per iteration,
+  // the full gradient and the stochastic steps.
+  int32_t NumDataPasses() const { return num_passes_; }
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
+
+ private:
+  void PerformSVRG();
+
+  int32_t num_iter_;  // the total iterations
+  double learning_rate_;
+  int32_t num_passes_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_SVRG_H_
@@ -0,0 +1,246 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+
+#include "mltk/maxent/tron.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "mltk/common/double_vector.h"
+#include "mltk/common/mem_instance.h"
+#include "mltk/common/model_data.h"
+
+namespace mltk {
+namespace maxent {
+
+using mltk::common::DoubleVector;
+using mltk::common::MemInstance;
+using mltk::common::MemoryBreakdown;
+using mltk::common::ModelData;
+using mltk::common::Scalar;
+
+// the ratios of the actual to the predicted reduction, which decide whether
+// to accept the step, and how to update the trust region.
+const static double ETA0 = 1e-4;
+const static double ETA1 = 0.25;
+const static double ETA2 = 0.75;
+// the factors of the trust region updates.
+const static double SIGMA1 = 0.25;
+const static double SIGMA2 = 0.5;
+const static double SIGMA3 = 4.0;
+// CG stops once the residual is within CG_TOLERANCE * ||grad||.
+const static double CG_TOLERANCE = 0.1;
+// stopping criteria
+const static double MIN_GRAD_NORM = 0.0001;
+
+void TRON::AddStateMemoryUsage(int32_t num_features,
+                               MemoryBreakdown* breakdown) const {
+  Optimizer::AddStateMemoryUsage(num_features, breakdown);
+  // the working vectors of an iteration, i.e. x, grad, s, r, d, Hd, x1 and
+  // grad1, and p(y|x) of the training instances twice, once they are known.
+  breakdown->Add("working_vectors", 8 * MemoryBreakdown::HeapBytes(
+      num_features * sizeof(Scalar)));
+  if (model_data_ != NULL) {
+    breakdown->Add("probabilities", 2 * MemoryBreakdown::HeapBytes(
+        train_data_.size() * model_data_->NumClasses() * sizeof(double)));
+  }
+}
+
+void TRON::CheckSettings() {
+  std::cerr << "performing TRON" << std::endl;
+  if (l1reg_ > 0) {
+    std::cerr << "error: L1 regularization is not supported in TRON,"
+        << "you can use OWLQN method instead." << std::endl;
+    exit(1);
+  }
+}
+
+void TRON::Optimize() {
+  std::vector<Scalar> x = PerformTRON();
+  model_data_->UpdateLambdas(x);
+}
+
+std::vector<Scalar> TRON::PerformTRON() {
+  const std::vector<Scalar>& lambdas = model_data_->Lambdas();
+  assert(static_cast<int32_t>(lambdas.size()) == model_data_->NumFeatures());
+
+  DoubleVector x(lambdas);
+  DoubleVector grad(x.Size());
+  double f = FunctionGradient(x.STLVector(), &(grad.STLVector()), &probs_);
+  double accuracy = train_accuracy_;
+  num_passes_ = 1;
+  num_iterations_ = 0;
+
+  double delta = sqrt(DotProduct(grad, grad));  // the trust region
+  bool stalled = false;  // no reduction is possible any more
+  for (int32_t iter = 0; iter < num_iter_; ++iter) {  // stopping criteria 1
+    std::cerr << "iter = " << iter + 1
+        << ", obj(err) = " << f
+        << ", accuracy = " << accuracy << std::endl;
+
+    if (heldout_data_.size() > 0) {
+      const double heldout_logl = CalcHeldoutLikelihood();
+      std::cerr << "\theldout_logl(err) = " << -1 * heldout_logl
+          << ", accuracy = " << heldout_accuracy_ << std::endl;
+    }
+
+    num_iterations_ = iter + 1;
+    // stopping criteria 2
+    if (sqrt(DotProduct(grad, grad)) < MIN_GRAD_NORM) { break; }
+    // stopping criteria 3
+    if (Converged(iter, f)) { break; }
+
+    // tries Newton steps until one reduces f enough, shrinking the region.
+    while (true) {
+      DoubleVector s(x.Size()), r(x.Size());
+      num_passes_ += TrustRegionCG(delta, grad, &s, &r);
+
+      DoubleVector x1 = x + s;
+      DoubleVector grad1(x.Size());
+      const double f1 = FunctionGradient(x1.STLVector(),
+                                         &(grad1.STLVector()), &trial_probs_);
+      ++num_passes_;
+
+      // the actual and the predicted reduction, by the quadratic model
+      // grad * s + s * H * s / 2, where H * s = -grad - r.
+      const double gs = DotProduct(grad, s);
+      const double predicted = -0.5 * (gs - DotProduct(s, r));
+      const double actual = f - f1;
+      const double snorm = sqrt(DotProduct(s, s));
+      if (iter == 0) { delta = std::min(delta, snorm); }
+
+      // the step length minimizing the quadratic interpolation of f along s.
+      double alpha = SIGMA3;
+      if (f1 - f - gs > 0) {
+        alpha = std::max(SIGMA1, -0.5 * (gs / (f1 - f - gs)));
+      }
+      if (actual < ETA0 * predicted) {
+        delta = std::min(std::max(alpha, SIGMA1) * snorm, SIGMA2 * delta);
+      } else if (actual < ETA1 * predicted) {
+        delta = std::max(SIGMA1 * delta,
+                         std::min(alpha * snorm, SIGMA2 * delta));
+      } else if (actual < ETA2 * predicted) {
+        delta = std::max(SIGMA1 * delta,
+                         std::min(alpha * snorm, SIGMA3 * delta));
+      } else {
+        delta = std::max(delta, std::min(alpha * snorm, SIGMA3 * delta));
+      }
+
+      if (actual > ETA0 * predicted) {
+        x = x1;
+        grad = grad1;
+        f = f1;
+        accuracy = train_accuracy_;
+        probs_.swap(trial_probs_);
+        break;
+      }
+      // the model stays at x, e.g. for the heldout likelihood.
+      model_data_->UpdateLambdas(x.STLVector());
+      if (predicted <= 0 || fabs(actual) <= 1e-12 * fabs(f)) {
+        stalled = true;
+        break;
+      }
+    }
+    if (stalled) { break; }
+  }
+  std::cerr << "number of data passes = " << num_passes_ << std::endl;
+
+  return x.STLVector();
+}
+
+int32_t TRON::TrustRegionCG(double delta,
+                            const DoubleVector& grad,
+                            DoubleVector* s,
+                            DoubleVector* r) {
+  const double tolerance = CG_TOLERANCE * sqrt(DotProduct(grad, grad));
+  *s = DoubleVector(grad.Size());
+  *r = -1 * grad;
+  DoubleVector d = *r;
+  double rr = DotProduct(*r, *r);
+
+  int32_t num_cg_iter = 0;
+  while (sqrt(rr) > tolerance) {
+    ++num_cg_iter;
+    const DoubleVector hd = HessianVectorProduct(d);
+    const double dhd = DotProduct(d, hd);
+    double alpha = dhd > 0 ? rr / dhd : HUGE_VAL;
+
+    // stops on the boundary of the trust region, ||s + alpha * d|| = delta.
+    const double sd = DotProduct(*s, d);
+    const double ss = DotProduct(*s, *s);
+    const double dd = DotProduct(d, d);
+    if (dhd <= 0 || ss + 2 * alpha * sd + alpha * alpha * dd > delta * delta) {
+      const double rad
+          = sqrt(sd * sd + dd * std::max(0.0, delta * delta - ss));
+      alpha = sd >= 0 ? (delta * delta - ss) / (sd + rad) : (rad - sd) / dd;
+      *s += alpha * d;
+      *r += -alpha * hd;
+      break;
+    }
+
+    *s += alpha * d;
+    *r += -alpha * hd;
+    const double rr1 = DotProduct(*r, *r);
+    d = *r + (rr1 / rr) * d;
+    rr = rr1;
+  }
+  return num_cg_iter;
+}
+
+DoubleVector TRON::HessianVectorProduct(const DoubleVector& v) {
+  // H * v = sum_x P1(x) sum_y P(y|x) f(x, y) (f(x, y) * v - E_p(y|x)[f * v]),
+  // plus 2 * l2reg * v.
+  const int32_t num_classes = model_data_->NumClasses();
+  DoubleVector hv(v.Size());
+  std::vector<double> dots(num_classes);  // f(x, y) * v of every label
+
+  for (size_t n = 0; n < train_data_.size(); ++n) {
+    const MemInstance& mem_instance = *train_data_[n];
+    const double* prob_dist = &probs_[n * num_classes];
+
+    std::fill(dots.begin(), dots.end(), 0.0);
+    for (MemInstance::ConstIterator citer(mem_instance);
+         !citer.Done(); citer.Next()) {
+      const std::vector<int32_t>& feature_ids
+          = model_data_->FeatureIds(citer.FeatureNameId());
+      const double value = citer.FeatureValue();
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        const int32_t feature_id = feature_ids[i];
+        dots[model_data_->FeatureAt(feature_id).LabelId()]
+            += v[feature_id] * value;
+      }
+    }
+
+    double mean = 0.0;
+    for (int32_t y = 0; y < num_classes; ++y) {
+      mean += prob_dist[y] * dots[y];
+    }
+    const double weight = mem_instance.weight();
+    for (int32_t y = 0; y < num_classes; ++y) {
+      dots[y] = weight * prob_dist[y] * (dots[y] - mean);
+    }
+
+    for (MemInstance::ConstIterator citer(mem_instance);
+         !citer.Done(); citer.Next()) {
+      const std::vector<int32_t>& feature_ids
+          = model_data_->FeatureIds(citer.FeatureNameId());
+      const double value = citer.FeatureValue();
+      for (size_t i = 0; i < feature_ids.size(); ++i) {
+        const int32_t feature_id = feature_ids[i];
+        hv[feature_id]
+            += dots[model_data_->FeatureAt(feature_id).LabelId()] * value;
+      }
+    }
+  }
+
+  hv *= 1.0 / train_weight_;
+  if (l2reg_ > 0) { hv += (2 * l2reg_) * v; }
+  return hv;
+}
+
+}  // namespace maxent
+}  // namespace mltk
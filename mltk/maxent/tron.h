@@ -0,0 +1,77 @@
+// Copyright (c) 2013 MLTK Project.
+// Author: Lifeng Wang (ofandywang@gmail.com)
+//
+// Implementation of the trust region Newton method (TRON).
+//
+// Pls refer to 'Chih-Jen Lin, Ruby C. Weng and S. Sathiya Keerthi, "Trust
+// Region Newton Method for Large-Scale Logistic Regression", JMLR, 2008.'
+
+#ifndef MLTK_MAXENT_TRON_H_
+#define MLTK_MAXENT_TRON_H_
+
+#include "mltk/maxent/optimizer.h"
+
+#include <vector>
+
+#include "mltk/common/scalar.h"
+
+namespace mltk {
+
+namespace common {
+class DoubleVector;
+class ModelData;
+}  // namespace common
+
+namespace maxent {
+
+// TRON minimizes the objective of LBFGS by Newton steps within a trust
+// region, each approximately solved by conjugate gradient (CG) on the
+// Hessian. The Hessian is never formed: every CG iteration takes a product of
+// it and a vector in a pass over the data, which reuses p(y|x) of the
+// instances kept by the last function evaluation. On ill-conditioned
+// problems, it takes far fewer data passes than LBFGS, at the memory of
+// NumClasses() probabilities per instance, twice. Only L2 regularization is
+// supported.
+class TRON : public Optimizer {
+ public:
+  explicit TRON(int32_t num_iter = 100)
+      : num_iter_(num_iter), num_passes_(0) {}
+  virtual ~TRON() {}
+
+  virtual void AddStateMemoryUsage(int32_t num_features,
+                                   common::MemoryBreakdown* breakdown) const;
+
+  // the data passes taken by the last estimation, i.e. the function
+  // evaluations and the Hessian-vector products.
+  int32_t NumDataPasses() const { return num_passes_; }
+
+ protected:
+  virtual void CheckSettings();
+  virtual void Optimize();
+
+ private:
+  std::vector<common::Scalar> PerformTRON();
+
+  // Approximately solves H * s = -grad within ||s|| <= delta by CG, and
+  // returns its iterations. r gets the residual -grad - H * s.
+  int32_t TrustRegionCG(double delta,
+                        const common::DoubleVector& grad,
+                        common::DoubleVector* s,
+                        common::DoubleVector* r);
+
+  // H * v, by p(y|x) of probs_.
+  common::DoubleVector HessianVectorProduct(const common::DoubleVector& v);
+
+  int32_t num_iter_;  // the total iterations
+  int32_t num_passes_;
+
+  // p(y|x) of every training instance at the current x, and at the trial
+  // step, which replaces it once accepted.
+  std::vector<double> probs_;
+  std::vector<double> trial_probs_;
+};
+
+}  // namespace maxent
+}  // namespace mltk
+
+#endif  // MLTK_MAXENT_TRON_H_